@@ -25,6 +25,7 @@
 #include "MeasurementTool.hh"
 #include "../../core/include/SceneGraph.hh"
 #include "../../core/include/CommandStack.hh"
+#include "../../core/include/HistoryJournal.hh"
 
 namespace geantcad {
 
@@ -42,6 +43,7 @@ private slots:
     void onSaveAs();
     void onGenerate();
     void onBuildRun();
+    void onCheckOverlaps();
     
     // View actions
     void onViewFront();
@@ -80,6 +82,12 @@ private:
     void loadPreferences();
     void savePreferences();
     void updateViewCubePosition();
+    // Crash-recovery journal: "<project>.journal" next to the project file,
+    // or in the application data directory while the project is untitled
+    QString journalDirectory() const;
+    // Journal the current scene from now on; 'offerRecovery' first offers to
+    // replay a journal left there by a session that didn't close cleanly
+    void restartJournal(bool offerRecovery);
     bool eventFilter(QObject* obj, QEvent* event) override;
 
     // UI Components
@@ -114,6 +122,7 @@ private:
     // Core
     SceneGraph* sceneGraph_;
     CommandStack* commandStack_;
+    HistoryJournal journal_;
     
     QString currentFilePath_;
 };
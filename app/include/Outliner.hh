@@ -3,6 +3,7 @@
 #include <QTreeWidget>
 #include <QContextMenuEvent>
 #include "../../core/include/SceneGraph.hh"
+#include "../../core/include/CommandStack.hh"
 
 namespace geantcad {
 
@@ -13,6 +14,7 @@ public:
     explicit Outliner(QWidget* parent = nullptr);
     
     void setSceneGraph(SceneGraph* sceneGraph);
+    void setCommandStack(CommandStack* commandStack) { commandStack_ = commandStack; }
     void refresh();
 
 signals:
@@ -38,6 +40,7 @@ private:
     QIcon getShapeIcon(ShapeType type, const QColor& materialColor = QColor()) const;
     
     SceneGraph* sceneGraph_;
+    CommandStack* commandStack_ = nullptr;
     QTreeWidgetItem* rootItem_;
     
     std::map<VolumeNode*, QTreeWidgetItem*> nodeToItem_;
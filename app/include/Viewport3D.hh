@@ -11,18 +11,25 @@
 #include <vtkRenderWindowInteractor.h>
 #include <vtkInteractorStyleTrackballCamera.h>
 #include <vtkOrientationMarkerWidget.h>
+#include <vtkPolyData.h>
 #endif
 
 #include "../../core/include/SceneGraph.hh"
 #include "../../core/include/Shape.hh"
 #include "../../core/include/CommandStack.hh"
 #include <map>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 
 // Forward declarations
 class vtkActor;
+class vtkGlyph3DMapper;
 class vtkPolyDataMapper;
+class vtkProp;
 class vtkPolyDataAlgorithm;
 class vtkTextActor;
+class QTimer;
 
 namespace geantcad {
 
@@ -79,6 +86,26 @@ public:
     void setWireframeMode(bool enabled);
     bool isWireframeMode() const { return wireframeMode_; }
     
+    // Instanced rendering: volumes with the same tessellation and appearance
+    // share one glyph mapper (per-instance matrix and color)
+    void setInstancingEnabled(bool enabled);
+    bool isInstancingEnabled() const { return instancingEnabled_; }
+    
+    // Level of detail: tubes, spheres and cones are tessellated from their
+    // projected size (and drawn as their bounding box below a few pixels);
+    // levels are re-evaluated once the camera stops moving
+    void setLevelOfDetailEnabled(bool enabled);
+    bool isLevelOfDetailEnabled() const { return lodEnabled_; }
+    
+    // Picking: ID buffer (hardware selector, also resolves the instance of a
+    // group) or prop picker + z-buffer position
+    enum class PickingMode {
+        IdBuffer,
+        PropPicker
+    };
+    void setPickingMode(PickingMode mode) { pickingMode_ = mode; }
+    PickingMode getPickingMode() const { return pickingMode_; }
+    
     // Camera controls
     void resetView();
     void frameSelection();
@@ -152,7 +179,10 @@ protected:
 private:
     void setupRenderer();
     void setupInteractor();
-    void updateScene();
+    void updateScene();          // full rebuild of every actor
+    void applyPendingChanges();  // only what changed since the last refresh
+    void connectSceneGraph();
+    void disconnectSceneGraph();
     void setupViewCube();
     void createGrid();
     void updateGrid();
@@ -160,6 +190,25 @@ private:
 #ifndef GEANTCAD_NO_VTK
     void updateSelectionHighlight(VolumeNode* selectedNode);
     void showContextMenu(const QPoint& pos);
+    
+    // Per-node actor management
+    void rebuildActor(VolumeNode* node);
+    void removeActor(VolumeNode* node);
+    static void applyActorTransform(const VolumeNode* node, vtkActor* actor);
+    static void applyActorMaterial(const VolumeNode* node, vtkActor* actor);
+    
+    // Instanced groups
+    bool addInstance(VolumeNode* node, const vtkSmartPointer<vtkPolyData>& mesh);
+    void removeInstance(VolumeNode* node);
+    void flushInstanceGroups();
+    
+    // Level of detail
+    void updateLodView();
+    int lodResolution(const VolumeNode* node) const;
+    void updateLevelsOfDetail();
+    
+    // Volume under the cursor (widget coordinates), nullptr on empty space
+    VolumeNode* pickNode(int x, int y);
 #endif
     
     SceneGraph* sceneGraph_;
@@ -169,6 +218,14 @@ private:
     ProjectionMode projectionMode_ = ProjectionMode::Orthographic;  // CAD default
     bool measurementMode_ = false;  // For measurement tool picking
     bool wireframeMode_ = false;  // Toggle solid/wireframe
+    bool instancingEnabled_ = true;
+    bool lodEnabled_ = true;
+    PickingMode pickingMode_ = PickingMode::IdBuffer;
+    
+    // Scene changes recorded by the SceneGraph callbacks, applied on refresh()
+    std::unordered_set<VolumeNode*> pendingAdded_;
+    std::unordered_map<VolumeNode*, uint32_t> pendingChanges_;  // NodeChange bitmask
+    bool fullRebuildPending_ = true;
     
 #ifndef GEANTCAD_NO_VTK
     vtkSmartPointer<vtkRenderer> renderer_;
@@ -178,6 +235,43 @@ private:
     // Actor storage (volume -> actor mapping)
     std::map<VolumeNode*, vtkSmartPointer<vtkActor>> actors_;
     
+    // Instanced volumes: one actor + glyph mapper per (mesh, opacity, wireframe)
+    struct InstanceGroup {
+        vtkSmartPointer<vtkPolyData> mesh;
+        vtkSmartPointer<vtkGlyph3DMapper> mapper;
+        vtkSmartPointer<vtkActor> actor;
+        std::vector<VolumeNode*> nodes;  // instance i = point i of the mapper input
+        bool dirty = true;
+    };
+    struct InstanceSlot {
+        InstanceGroup* group;
+        size_t index;
+    };
+    using InstanceKey = std::tuple<const vtkPolyData*, double, bool>;
+    std::map<InstanceKey, InstanceGroup> instanceGroups_;
+    std::unordered_map<VolumeNode*, InstanceSlot> instanceSlots_;
+    std::unordered_set<VolumeNode*> selectionActors_;  // own actor only while selected
+    std::vector<VolumeNode*> highlightedSelection_;   // selection at the last highlight
+    
+    // Reverse indexes for picking (prop -> volume / instanced group)
+    std::unordered_map<vtkProp*, VolumeNode*> actorNodes_;
+    std::unordered_map<vtkProp*, InstanceGroup*> groupActors_;
+    
+    // Instance of the group hit by the ray under (x, y); instanceId is a hint
+    // from the ID buffer (-1 if none)
+    VolumeNode* pickInstance(const InstanceGroup& group, int x, int y, int instanceId);
+    
+    // Camera as seen by the level of detail (refreshed by updateLodView)
+    struct LodView {
+        bool parallel = true;
+        double eye[3] = {0.0, 0.0, 0.0};
+        double pixelsPerMm = 0.0;  // perspective: at unit distance from the eye; 0 = unknown
+    };
+    LodView lodView_;
+    std::unordered_map<VolumeNode*, int> lodResolutions_;  // resolution drawn per round volume
+    QTimer* lodTimer_ = nullptr;        // restarted on every camera change
+    unsigned long lodObserverTag_ = 0;
+    
     // Grid
     vtkSmartPointer<vtkActor> gridActor_;
     vtkSmartPointer<vtkActor> axisXActor_;
@@ -114,9 +114,8 @@ void HistoryPanel::updateHistoryList() {
     historyList_->addItem(initialItem);
     
     // Add command history
-    const auto& history = commandStack_->getHistory();
-    for (size_t i = 0; i < history.size(); ++i) {
-        QString desc = getCommandDescription(history[i].get());
+    for (size_t i = 0; i < commandStack_->getHistorySize(); ++i) {
+        QString desc = getCommandDescription(commandStack_->getCommand(i));
         QString icon;
         
         // Determine icon based on command type
@@ -181,19 +180,8 @@ void HistoryPanel::redo() {
 void HistoryPanel::jumpToState(int index) {
     if (!commandStack_) return;
     
-    int currentIndex = commandStack_->getCurrentIndex();
-    
-    if (index < currentIndex) {
-        // Undo to reach target state
-        while (commandStack_->getCurrentIndex() > index && commandStack_->canUndo()) {
-            commandStack_->undo();
-        }
-    } else if (index > currentIndex) {
-        // Redo to reach target state
-        while (commandStack_->getCurrentIndex() < index && commandStack_->canRedo()) {
-            commandStack_->redo();
-        }
-    }
+    // Restores the nearest checkpoint when it beats stepping one command at a time
+    commandStack_->jumpTo(index);
     
     refresh();
     emit stateRestored();
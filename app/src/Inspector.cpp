@@ -450,7 +450,7 @@ void Inspector::updateUI() {
     if (currentNode_) {
         nameEdit_->setText(QString::fromStdString(currentNode_->getName()));
         
-        auto& t = currentNode_->getTransform();
+        const auto& t = currentNode_->getTransform();
         auto pos = t.getTranslation();
         posX_->setValue(pos.x());
         posY_->setValue(pos.y());
@@ -567,7 +567,7 @@ void Inspector::onTransformChanged() {
         auto cmd = std::make_unique<TransformVolumeCommand>(currentNode_, newTransform);
         commandStack_->execute(std::move(cmd));
     } else {
-        currentNode_->getTransform() = newTransform;
+        currentNode_->setTransform(newTransform);
     }
     
     emit nodeChanged(currentNode_);
@@ -644,14 +644,23 @@ void Inspector::onMaterialColorClicked() {
                                               QColorDialog::ShowAlphaChannel);
     
     if (newColor.isValid()) {
-        // Update material visual properties
-        material->getVisual().r = newColor.redF();
-        material->getVisual().g = newColor.greenF();
-        material->getVisual().b = newColor.blueF();
-        material->getVisual().a = newColor.alphaF();
+        // The material may be shared by other volumes (and the scene's material
+        // table): recolour a copy and give it to this volume only
+        auto recolored = std::make_shared<Material>(*material);
+        recolored->getVisual().r = newColor.redF();
+        recolored->getVisual().g = newColor.greenF();
+        recolored->getVisual().b = newColor.blueF();
+        recolored->getVisual().a = newColor.alphaF();
+        
+        if (commandStack_) {
+            auto cmd = std::make_unique<ModifyMaterialCommand>(currentNode_, recolored);
+            commandStack_->execute(std::move(cmd));
+        } else {
+            currentNode_->setMaterial(recolored);
+        }
         
         // Update UI
-        updateMaterialColorPreview(material);
+        updateMaterialColorPreview(recolored);
         
         // Refresh viewport
         emit nodeChanged(currentNode_);
@@ -736,7 +745,7 @@ void Inspector::onOpticalPresetChanged() {
     if (updating_ || !currentNode_) return;
     
     QString preset = opticalPresetCombo_->currentData().toString();
-    auto& opticalConfig = currentNode_->getOpticalConfig();
+    OpticalSurfaceConfig opticalConfig = currentNode_->getOpticalConfig();
     opticalConfig.preset = preset.toStdString();
     
     if (!preset.isEmpty()) {
@@ -757,7 +766,16 @@ void Inspector::onOpticalPresetChanged() {
             opticalConfig.finish = "ground";
             opticalConfig.model = "unified";
         }
-        
+    }
+    
+    if (commandStack_) {
+        auto cmd = std::make_unique<ModifyOpticalConfigCommand>(currentNode_, opticalConfig);
+        commandStack_->execute(std::move(cmd));
+    } else {
+        currentNode_->getOpticalConfig() = opticalConfig;
+    }
+    
+    if (!preset.isEmpty()) {
         // Update UI to reflect preset values
         updating_ = true;
         int finishIndex = opticalFinishCombo_->findData(QString::fromStdString(opticalConfig.finish));
@@ -788,7 +806,7 @@ void Inspector::updateShapeUI() {
     updatingShape_ = true;
     hideAllShapeWidgets();
     
-    Shape* shape = currentNode_->getShape();
+    const Shape* shape = currentNode_->getShape();
     ShapeType type = shape->getType();
     
     switch (type) {
@@ -854,7 +872,7 @@ void Inspector::updateShapeUI() {
 void Inspector::onShapeParamsChanged() {
     if (updatingShape_ || !currentNode_ || !currentNode_->getShape()) return;
     
-    Shape* shape = currentNode_->getShape();
+    const Shape* shape = currentNode_->getShape();
     ShapeType type = shape->getType();
     ShapeParams oldParams = shape->getParams();
     ShapeParams newParams = oldParams;
@@ -947,7 +965,8 @@ void Inspector::onShapeParamsChanged() {
         commandStack_->execute(std::move(cmd));
     } else {
         // Apply directly if no command stack
-        shape->getParams() = newParams;
+        currentNode_->editShape()->getParams() = newParams;
+        currentNode_->notifyChanged(NodeChange::Shape);
     }
     
     emit nodeChanged(currentNode_);
@@ -16,6 +16,7 @@
 #include <QByteArray>
 #include <QResizeEvent>
 #include <QColorDialog>
+#include <QStandardPaths>
 
 #ifndef GEANTCAD_NO_VTK
 #include <vtkSmartPointer.h>
@@ -28,7 +29,9 @@
 #include "../../core/include/Material.hh"
 #include "../../core/include/Serialization.hh"
 #include "../../core/include/Command.hh"
+#include "../../core/include/OverlapChecker.hh"
 #include "../../generator/include/GDMLExporter.hh"
+#include "../../generator/include/GDMLImporter.hh"
 #include "../../generator/include/Geant4ProjectGenerator.hh"
 #include "../../generator/include/MeshExporter.hh"
 #include "BuildRunDialog.hh"
@@ -47,6 +50,9 @@
 #include <QLineEdit>
 #include <QLabel>
 #include <QCheckBox>
+#include <QProgressDialog>
+#include <QTableWidget>
+#include <QHeaderView>
 using namespace geantcad;
 
 namespace {
@@ -100,6 +106,7 @@ MainWindow::MainWindow(QWidget *parent)
     , measureDock_(nullptr)
 {
     setWindowTitle("GeantCAD");
+    commandStack_->setSceneGraph(sceneGraph_);
     applyStylesheet();
     setupUI(); // Must be called before loadPreferences() so viewport_ exists
     setupMenus();
@@ -108,10 +115,13 @@ MainWindow::MainWindow(QWidget *parent)
     setupStatusBar();
     connectSignals();
     loadPreferences(); // Load preferences after UI is set up (but after menus to avoid fullscreen issues)
+    restartJournal(true);
 }
 
 MainWindow::~MainWindow() {
     savePreferences();
+    // Clean exit: nothing to recover
+    journal_.close(true);
 }
 
 void MainWindow::setupUI() {
@@ -129,6 +139,7 @@ void MainWindow::setupUI() {
     // Left: Scene Hierarchy (Outliner only)
     outliner_ = new Outliner(this);
     outliner_->setSceneGraph(sceneGraph_);
+    outliner_->setCommandStack(commandStack_);
     outliner_->setMinimumWidth(180);
     outliner_->setMaximumWidth(280);
     mainSplitter_->addWidget(outliner_);
@@ -240,6 +251,43 @@ void MainWindow::setupMenus() {
     
     fileMenu->addSeparator();
     
+    // Import submenu
+    QMenu* importMenu = fileMenu->addMenu("&Import");
+    
+    QAction* importGDMLAction = importMenu->addAction("Import &GDML...", this, [this]() {
+        QString fileName = QFileDialog::getOpenFileName(this, "Import GDML", "", "GDML Files (*.gdml);;All Files (*)");
+        if (!fileName.isEmpty()) {
+            QApplication::setOverrideCursor(Qt::WaitCursor);
+            GDMLImporter importer;
+            bool imported = importer.importFromFile(sceneGraph_, fileName.toStdString());
+            QApplication::restoreOverrideCursor();
+            if (imported) {
+                // The geometry is replaced: earlier edits can't be undone on it
+                commandStack_->clear();
+                currentFilePath_.clear();
+                restartJournal(false);
+                
+                viewport_->setSceneGraph(sceneGraph_);
+                outliner_->setSceneGraph(sceneGraph_);
+                inspector_->clear();
+                
+                viewport_->refresh();
+                outliner_->refresh();
+                
+                const auto& stats = importer.getLastStats();
+                QString message = QString("Imported GDML: %1 (%2 volumes, %3 logical volumes, %4 solids)")
+                    .arg(fileName).arg(stats.volumes).arg(stats.logicalVolumes).arg(stats.solids);
+                if (stats.skipped > 0) {
+                    message += QString(", %1 unsupported elements skipped").arg(stats.skipped);
+                }
+                statusBar_->showMessage(message, 5000);
+            } else {
+                QMessageBox::warning(this, "Import Failed",
+                    QString("Failed to import GDML file: %1").arg(QString::fromStdString(importer.getLastError())));
+            }
+        }
+    });
+    
     // Export submenu
     QMenu* exportMenu = fileMenu->addMenu("&Export");
     
@@ -248,7 +296,9 @@ void MainWindow::setupMenus() {
         if (!fileName.isEmpty()) {
             GDMLExporter exporter;
             if (exporter.exportToFile(sceneGraph_, fileName.toStdString())) {
-                statusBar_->showMessage("Exported to GDML: " + fileName, 3000);
+                const auto& stats = exporter.getLastStats();
+                statusBar_->showMessage(QString("Exported to GDML: %1 (%2 volumes as %3 logical volumes, %4 solids)")
+                    .arg(fileName).arg(stats.volumes).arg(stats.logicalVolumes).arg(stats.solids), 5000);
             } else {
                 QMessageBox::warning(this, "Export Failed", "Failed to export GDML file.");
             }
@@ -260,7 +310,9 @@ void MainWindow::setupMenus() {
         if (!fileName.isEmpty()) {
             MeshExporter exporter;
             if (exporter.exportToSTL(sceneGraph_, fileName.toStdString())) {
-                statusBar_->showMessage("Exported to STL: " + fileName, 3000);
+                const auto& stats = exporter.getLastStats();
+                statusBar_->showMessage(QString("Exported to STL: %1 (%2 volumes, %3 triangles)")
+                    .arg(fileName).arg(stats.volumes).arg(stats.triangles), 5000);
             } else {
                 QMessageBox::warning(this, "Export Failed", 
                     QString("Failed to export STL file: %1").arg(QString::fromStdString(exporter.getLastError())));
@@ -273,7 +325,9 @@ void MainWindow::setupMenus() {
         if (!fileName.isEmpty()) {
             MeshExporter exporter;
             if (exporter.exportToOBJ(sceneGraph_, fileName.toStdString())) {
-                statusBar_->showMessage("Exported to OBJ: " + fileName, 3000);
+                const auto& stats = exporter.getLastStats();
+                statusBar_->showMessage(QString("Exported to OBJ: %1 (%2 volumes, %3 triangles)")
+                    .arg(fileName).arg(stats.volumes).arg(stats.triangles), 5000);
             } else {
                 QMessageBox::warning(this, "Export Failed", 
                     QString("Failed to export OBJ file: %1").arg(QString::fromStdString(exporter.getLastError())));
@@ -507,6 +561,8 @@ void MainWindow::setupMenus() {
     
     // Generate menu
     QMenu* generateMenu = menuBar->addMenu("&Generate");
+    QAction* overlapAction = generateMenu->addAction("Check &Overlaps...", this, [this]() { onCheckOverlaps(); });
+    generateMenu->addSeparator();
     QAction* genAction = generateMenu->addAction(style()->standardIcon(QStyle::SP_FileDialogNewFolder), "&Generate Geant4 Project...", this, [this]() { onGenerate(); });
     QAction* buildAction = generateMenu->addAction(style()->standardIcon(QStyle::SP_MediaPlay), "&Build & Run", this, [this]() { onBuildRun(); });
     
@@ -809,9 +865,10 @@ void MainWindow::connectSignals() {
             VolumeNode* duplicated = cmdPtr->getDuplicatedNode();
             if (duplicated) {
                 // Move duplicated node slightly for visibility
-                auto& t = duplicated->getTransform();
+                Transform t = duplicated->getTransform();
                 auto pos = t.getTranslation();
                 t.setTranslation(QVector3D(pos.x() + 20, pos.y() + 20, pos.z()));
+                duplicated->setTransform(t);
             }
             
             outliner_->refresh();
@@ -955,6 +1012,7 @@ void MainWindow::onNew() {
     // Reset scene - create new SceneGraph
     sceneGraph_ = new SceneGraph();
     commandStack_->clear();
+    commandStack_->setSceneGraph(sceneGraph_);
     
     viewport_->setSceneGraph(sceneGraph_);
     outliner_->setSceneGraph(sceneGraph_);
@@ -963,16 +1021,32 @@ void MainWindow::onNew() {
     outputPanel_->setConfig(sceneGraph_->getOutputConfig());
     
     currentFilePath_.clear();
+    restartJournal(false);
     viewport_->refresh();
     outliner_->refresh();
     statusBar_->showMessage("New project", 2000);
 }
 
 void MainWindow::onOpen() {
-    QString fileName = QFileDialog::getOpenFileName(this, "Open GeantCAD Project", "", "GeantCAD Files (*.geantcad);;All Files (*)");
+    QString fileName = QFileDialog::getOpenFileName(this, "Open GeantCAD Project", "", "GeantCAD Files (*.geantcad);;GeantCAD Binary (*.gcadb);;All Files (*)");
     if (!fileName.isEmpty()) {
-        if (loadSceneFromFile(sceneGraph_, fileName.toStdString())) {
+        QProgressDialog progressDialog("Loading project...", "Cancel", 0, 100, this);
+        progressDialog.setWindowTitle("Open Project");
+        progressDialog.setWindowModality(Qt::WindowModal);
+        progressDialog.setMinimumDuration(300);
+        
+        bool loaded = loadSceneFromFile(sceneGraph_, fileName.toStdString(), [&](size_t bytesRead, size_t totalBytes) {
+            progressDialog.setValue(totalBytes ? int(bytesRead * 100 / totalBytes) : 100);
+            QApplication::processEvents();
+            return !progressDialog.wasCanceled();
+        });
+        bool cancelled = progressDialog.wasCanceled();
+        progressDialog.reset();
+        
+        if (loaded) {
             currentFilePath_ = fileName;
+            // The history (and its checkpoints) belongs to the previous scene
+            commandStack_->clear();
             
             viewport_->setSceneGraph(sceneGraph_);
             outliner_->setSceneGraph(sceneGraph_);
@@ -984,6 +1058,9 @@ void MainWindow::onOpen() {
             outliner_->refresh();
             
             statusBar_->showMessage("Opened: " + fileName, 2000);
+            restartJournal(true);
+        } else if (cancelled) {
+            statusBar_->showMessage("Open cancelled", 3000);
         } else {
             QMessageBox::critical(this, "Error", "Failed to open file: " + fileName);
             statusBar_->showMessage("Failed to open file", 3000);
@@ -996,6 +1073,8 @@ void MainWindow::onSave() {
         onSaveAs();
     } else {
         if (saveSceneToFile(sceneGraph_, currentFilePath_.toStdString())) {
+            // The journal restarts from the saved state
+            journal_.compact();
             statusBar_->showMessage("Saved: " + currentFilePath_, 2000);
         } else {
             QMessageBox::critical(this, "Error", "Failed to save file: " + currentFilePath_);
@@ -1005,15 +1084,16 @@ void MainWindow::onSave() {
 }
 
 void MainWindow::onSaveAs() {
-    QString fileName = QFileDialog::getSaveFileName(this, "Save GeantCAD Project", "", "GeantCAD Files (*.geantcad);;All Files (*)");
+    QString fileName = QFileDialog::getSaveFileName(this, "Save GeantCAD Project", "", "GeantCAD Files (*.geantcad);;GeantCAD Binary (*.gcadb);;All Files (*)");
     if (!fileName.isEmpty()) {
-        // Ensure .geantcad extension
-        if (!fileName.endsWith(".geantcad", Qt::CaseInsensitive)) {
+        // Ensure .geantcad extension (binary projects keep .gcadb)
+        if (!fileName.endsWith(".geantcad", Qt::CaseInsensitive) && !fileName.endsWith(".gcadb", Qt::CaseInsensitive)) {
             fileName += ".geantcad";
         }
         
         if (saveSceneToFile(sceneGraph_, fileName.toStdString())) {
             currentFilePath_ = fileName;
+            restartJournal(false);
             statusBar_->showMessage("Saved: " + fileName, 2000);
         } else {
             QMessageBox::critical(this, "Error", "Failed to save file: " + fileName);
@@ -1022,6 +1102,43 @@ void MainWindow::onSaveAs() {
     }
 }
 
+QString MainWindow::journalDirectory() const {
+    if (currentFilePath_.isEmpty()) {
+        return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/recovery/untitled.journal";
+    }
+    return currentFilePath_ + ".journal";
+}
+
+void MainWindow::restartJournal(bool offerRecovery) {
+    // The previous journal is done with: its scene was saved or replaced
+    journal_.close(true);
+    
+    const std::string directory = journalDirectory().toStdString();
+    const bool found = offerRecovery && HistoryJournal::hasJournal(directory);
+    if (!journal_.open(directory, sceneGraph_, commandStack_)) {
+        statusBar_->showMessage("Recovery journal unavailable: " + QString::fromStdString(journal_.getLastError()), 5000);
+        return;
+    }
+    
+    if (found && QMessageBox::question(this, "Recover Session",
+            "GeantCAD did not close cleanly. Recover the unsaved changes of the last session?") == QMessageBox::Yes) {
+        if (journal_.recover()) {
+            viewport_->setSceneGraph(sceneGraph_);
+            outliner_->setSceneGraph(sceneGraph_);
+            inspector_->clear();
+            physicsPanel_->setConfig(sceneGraph_->getPhysicsConfig());
+            outputPanel_->setConfig(sceneGraph_->getOutputConfig());
+            viewport_->refresh();
+            outliner_->refresh();
+            statusBar_->showMessage("Session recovered", 3000);
+            return;
+        }
+        QMessageBox::warning(this, "Recover Session",
+            "Could not recover the session: " + QString::fromStdString(journal_.getLastError()));
+    }
+    journal_.start();
+}
+
 void MainWindow::onGenerate() {
     QString dirPath = QFileDialog::getExistingDirectory(this, "Select Output Directory for Geant4 Project", "");
     if (!dirPath.isEmpty()) {
@@ -1082,6 +1199,83 @@ void MainWindow::onBuildRun() {
     }
 }
 
+void MainWindow::onCheckOverlaps() {
+    QProgressDialog progressDialog("Checking geometry overlaps...", "Cancel", 0, 100, this);
+    progressDialog.setWindowTitle("Overlap Check");
+    progressDialog.setWindowModality(Qt::WindowModal);
+    progressDialog.setMinimumDuration(300);
+    
+    // The check runs on all cores; this callback is invoked on the GUI thread
+    OverlapChecker checker;
+    std::vector<OverlapReport> reports = checker.check(*sceneGraph_, [&](size_t done, size_t total) {
+        progressDialog.setValue(total ? int(done * 100 / total) : 100);
+        QApplication::processEvents();
+        return !progressDialog.wasCanceled();
+    });
+    progressDialog.reset();
+    
+    if (checker.wasCancelled()) {
+        statusBar_->showMessage("Overlap check cancelled", 3000);
+        return;
+    }
+    
+    const OverlapChecker::Stats& stats = checker.getStats();
+    QString summary = QString("%1 overlap(s) in %2 volumes (%3 s)")
+        .arg(reports.size()).arg(stats.volumes).arg(stats.seconds, 0, 'f', 2);
+    if (stats.skipped > 0) {
+        summary += QString(", %1 volume(s) skipped").arg(stats.skipped);
+    }
+    statusBar_->showMessage(summary, 5000);
+    
+    if (reports.empty()) {
+        QMessageBox::information(this, "Overlap Check", "No overlaps found.\n" + summary);
+        return;
+    }
+    
+    // Result list: double-click selects and frames the volume
+    QDialog dialog(this);
+    dialog.setWindowTitle("Overlap Check");
+    dialog.resize(640, 400);
+    QVBoxLayout* layout = new QVBoxLayout(&dialog);
+    layout->addWidget(new QLabel(summary, &dialog));
+    
+    QTableWidget* table = new QTableWidget(int(reports.size()), 4, &dialog);
+    table->setHorizontalHeaderLabels({"Volume", "Overlaps", "Depth (mm)", "Method"});
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->verticalHeader()->setVisible(false);
+    table->horizontalHeader()->setStretchLastSection(true);
+    for (int row = 0; row < int(reports.size()); ++row) {
+        const OverlapReport& report = reports[row];
+        // Array copies are named by their copy number
+        auto placementName = [](const VolumeNode* node, int copy) {
+            QString name = QString::fromStdString(node->getName());
+            if (node->getArrayPattern().isArray()) name += QString(" [copy %1]").arg(copy);
+            return name;
+        };
+        QString other = report.kind == OverlapReport::Kind::Extrusion
+            ? "mother " + QString::fromStdString(report.other->getName())
+            : placementName(report.other, report.otherCopy);
+        table->setItem(row, 0, new QTableWidgetItem(placementName(report.volume, report.copy)));
+        table->setItem(row, 1, new QTableWidgetItem(other));
+        table->setItem(row, 2, new QTableWidgetItem(QString::number(report.depth, 'g', 4)));
+        table->setItem(row, 3, new QTableWidgetItem(report.exact ? "analytic" : "sampled"));
+    }
+    table->resizeColumnsToContents();
+    layout->addWidget(table);
+    
+    connect(table, &QTableWidget::cellDoubleClicked, &dialog, [this, &reports](int row, int) {
+        sceneGraph_->setSelected(reports[row].volume);
+        viewport_->frameSelection();
+    });
+    
+    QDialogButtonBox* buttons = new QDialogButtonBox(QDialogButtonBox::Close, &dialog);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+    
+    dialog.exec();
+}
+
 // === View action slots ===
 
 void MainWindow::onViewFront() {
@@ -1355,6 +1549,31 @@ void MainWindow::performBooleanOperation(BooleanOperation operation) {
         mixB /= colorCount;
     }
     
+    // Result appearance: selected material with the mixed color, placed at
+    // the first solid
+    std::shared_ptr<Material> mixedMaterial;
+    if (resultMaterial) {
+        mixedMaterial = std::make_shared<Material>(*resultMaterial);
+        mixedMaterial->getVisual().r = mixR;
+        mixedMaterial->getVisual().g = mixG;
+        mixedMaterial->getVisual().b = mixB;
+    }
+    Transform resultTransform;
+    resultTransform.setTranslation(solids[0]->getTransform().getTranslation());
+    
+    // Every volume created or hidden below is one undo step, and the scene
+    // reports the changes once at commit
+    commandStack_->beginTransaction(QString("Boolean %1").arg(opNames[static_cast<int>(operation)]).toStdString(),
+                                    sceneGraph_);
+    auto createResult = [&](const std::string& name, std::unique_ptr<Shape> shape, bool last) {
+        auto cmd = std::make_unique<CreateVolumeCommand>(sceneGraph_, name, std::move(shape),
+                                                         last ? mixedMaterial : nullptr);
+        if (last) cmd->setTransform(resultTransform);
+        CreateVolumeCommand* cmdPtr = cmd.get();
+        commandStack_->execute(std::move(cmd));
+        return cmdPtr->getCreatedNode();
+    };
+    
     // For Union: chain multiple solids
     // For Intersection/Subtraction: just 2 solids
     VolumeNode* resultNode = nullptr;
@@ -1365,7 +1584,8 @@ void MainWindow::performBooleanOperation(BooleanOperation operation) {
         
         for (size_t i = 1; i < solids.size(); ++i) {
             std::string nextName = solids[i]->getName();
-            std::string unionName = (i == solids.size() - 1) 
+            const bool last = i == solids.size() - 1;
+            std::string unionName = last
                 ? resultName->text().toStdString()
                 : currentName + "_" + nextName;
             
@@ -1382,8 +1602,7 @@ void MainWindow::performBooleanOperation(BooleanOperation operation) {
                 0.0, 0.0, 0.0
             );
             
-            resultNode = sceneGraph_->createVolume(unionName);
-            resultNode->setShape(std::move(boolShape));
+            resultNode = createResult(unionName, std::move(boolShape), last);
             currentName = unionName;
         }
     } else {
@@ -1404,31 +1623,16 @@ void MainWindow::performBooleanOperation(BooleanOperation operation) {
             0.0, 0.0, 0.0
         );
         
-        resultNode = sceneGraph_->createVolume(resultName->text().toStdString());
-        resultNode->setShape(std::move(boolShape));
+        resultNode = createResult(resultName->text().toStdString(), std::move(boolShape), true);
     }
     
-    if (resultNode) {
-        // Set material and color
-        if (resultMaterial) {
-            // Create a copy with mixed color
-            auto mixedMaterial = std::make_shared<Material>(*resultMaterial);
-            mixedMaterial->getVisual().r = mixR;
-            mixedMaterial->getVisual().g = mixG;
-            mixedMaterial->getVisual().b = mixB;
-            resultNode->setMaterial(mixedMaterial);
-        }
-        
-        // Position at first solid's position
-        resultNode->getTransform().setTranslation(solids[0]->getTransform().getTranslation());
-        
-        // Hide original solids if requested
-        if (hideOriginals->isChecked()) {
-            for (auto* s : solids) {
-                s->setVisible(false);
-            }
+    // Hide original solids if requested
+    if (resultNode && hideOriginals->isChecked()) {
+        for (auto* s : solids) {
+            commandStack_->execute(std::make_unique<ModifyVisibilityCommand>(s, false));
         }
     }
+    commandStack_->commit();
     
     // Clear selection and select result
     sceneGraph_->clearSelection();
@@ -1437,7 +1641,9 @@ void MainWindow::performBooleanOperation(BooleanOperation operation) {
     }
     
     // Update viewport
+    outliner_->refresh();
     viewport_->refresh();
+    if (historyPanel_) historyPanel_->refresh();
     
     statusBar_->showMessage(QString("Created boolean %1: %2")
         .arg(opNames[static_cast<int>(operation)])
@@ -1465,18 +1671,27 @@ void MainWindow::onPatternAlongLine() {
         return;
     }
     
-    // Simple dialog for pattern parameters
+    // Create pattern dialog
     QDialog dialog(this);
-    dialog.setWindowTitle("Pattern Along Line");
+    dialog.setWindowTitle("Pattern");
     dialog.setModal(true);
     
     QFormLayout* layout = new QFormLayout(&dialog);
     
+    QComboBox* typeCmb = new QComboBox(&dialog);
+    typeCmb->addItems({"Line", "Grid (XY)", "Ring (about Z)"});
+    layout->addRow("Pattern:", typeCmb);
+    
     QSpinBox* countSpin = new QSpinBox(&dialog);
-    countSpin->setRange(2, 100);
+    countSpin->setRange(2, 10000);
     countSpin->setValue(5);
     layout->addRow("Number of copies:", countSpin);
     
+    QSpinBox* rowsSpin = new QSpinBox(&dialog);
+    rowsSpin->setRange(1, 10000);
+    rowsSpin->setValue(5);
+    layout->addRow("Rows (grid):", rowsSpin);
+    
     QDoubleSpinBox* distanceSpin = new QDoubleSpinBox(&dialog);
     distanceSpin->setRange(1.0, 1000.0);
     distanceSpin->setValue(60.0);
@@ -1499,45 +1714,37 @@ void MainWindow::onPatternAlongLine() {
     double distance = distanceSpin->value();
     int axis = axisCmb->currentIndex();  // 0=X, 1=Y, 2=Z
     
-    // Get current position of selected object
-    const Transform& baseTransform = selected->getTransform();
-    QVector3D basePos = baseTransform.getTranslation();
-    
-    // Create copies along the selected axis
-    for (int i = 1; i < count; ++i) {
-        // Calculate offset
-        QVector3D offset(0, 0, 0);
-        if (axis == 0) offset.setX(i * distance);
-        else if (axis == 1) offset.setY(i * distance);
-        else offset.setZ(i * distance);
-        
-        // Create new node
-        VolumeNode* newNode = sceneGraph_->createVolume(
-            selected->getName() + "_" + std::to_string(i));
-        
-        // Copy shape (clone by recreating from params)
-        if (selected->getShape()) {
-            Shape* srcShape = selected->getShape();
-            auto newShape = std::make_unique<Shape>(
-                srcShape->getType(), 
-                srcShape->getName(), 
-                srcShape->getParams());
-            newNode->setShape(std::move(newShape));
-        }
-        newNode->setMaterial(selected->getMaterial());
-        
-        // Set position with offset
-        QVector3D newPos = basePos + offset;
-        newNode->getTransform().setTranslation(newPos);
-        newNode->getTransform().setRotation(baseTransform.getRotation());
-        newNode->getTransform().setScale(baseTransform.getScale());
+    // The copies are not separate volumes: the selected volume becomes an
+    // array, exported as a replica/parameterised placement
+    ArrayPattern pattern;
+    pattern.count[0] = count;
+    QString description;
+    switch (typeCmb->currentIndex()) {
+        case 0:
+            pattern.type = ArrayPattern::Type::Linear;
+            pattern.step[axis] = distance;
+            description = QString("%1 copies with %2 mm spacing along %3 axis")
+                .arg(count).arg(distance).arg(axis == 0 ? "X" : (axis == 1 ? "Y" : "Z"));
+            break;
+        case 1:
+            pattern.type = ArrayPattern::Type::Grid;
+            pattern.count[1] = rowsSpin->value();
+            pattern.step[0] = distance;
+            pattern.step[1] = distance;
+            description = QString("%1 x %2 grid with %3 mm pitch").arg(count).arg(rowsSpin->value()).arg(distance);
+            break;
+        default:
+            pattern.type = ArrayPattern::Type::Ring;
+            description = QString("ring of %1 copies").arg(count);
+            break;
     }
     
+    commandStack_->execute(std::make_unique<ModifyArrayPatternCommand>(selected, pattern));
+    
     // Update viewport
     viewport_->refresh();
     
-    statusBar_->showMessage(QString("Created %1 copies with %2 mm spacing along %3 axis")
-        .arg(count - 1).arg(distance).arg(axis == 0 ? "X" : (axis == 1 ? "Y" : "Z")), 3000);
+    statusBar_->showMessage("Created " + description, 3000);
 }
 
 } // namespace geantcad
@@ -11,6 +11,7 @@
 #include "../../core/include/VolumeNode.hh"
 #include "../../core/include/Shape.hh"
 #include "../../core/include/Material.hh"
+#include "../../core/include/Command.hh"
 
 Q_DECLARE_METATYPE(geantcad::VolumeNode*)
 
@@ -66,7 +67,18 @@ void Outliner::refresh() {
 void Outliner::buildTree() {
     if (!sceneGraph_ || !sceneGraph_->getRoot()) return;
     
-    rootItem_ = createTreeItem(sceneGraph_->getRoot());
+    // Pre-order walk: ancestors[d] is the last item created at depth d,
+    // i.e. the parent of the next node at depth d + 1
+    std::vector<QTreeWidgetItem*> ancestors;
+    sceneGraph_->forEach([&](VolumeNode* node, size_t depth) {
+        QTreeWidgetItem* item = createTreeItem(node);
+        ancestors.resize(depth);
+        if (depth > 0) {
+            ancestors.back()->addChild(item);
+        }
+        ancestors.push_back(item);
+    });
+    rootItem_ = ancestors.front();
     addTopLevelItem(rootItem_);
     rootItem_->setExpanded(true);
     
@@ -224,12 +236,6 @@ QTreeWidgetItem* Outliner::createTreeItem(VolumeNode* node) {
     
     nodeToItem_[node] = item;
     
-    // Add children recursively
-    for (auto* child : node->getChildren()) {
-        QTreeWidgetItem* childItem = createTreeItem(child);
-        item->addChild(childItem);
-    }
-    
     return item;
 }
 
@@ -268,14 +274,26 @@ void Outliner::onItemChanged(QTreeWidgetItem* item, int column) {
         }
         
         // Update node name
-        node->setName(newName.toStdString());
+        if (node->getName() != newName.toStdString()) {
+            if (commandStack_) {
+                commandStack_->execute(std::make_unique<ModifyNameCommand>(node, newName.toStdString()));
+            } else {
+                node->setName(newName.toStdString());
+            }
+        }
         
         // Emit signal to notify other components
         emit nodeSelected(node);
     } else if (column == COL_VISIBLE) {
         // Handle visibility changes
         bool visible = (item->checkState(COL_VISIBLE) == Qt::Checked);
-        node->setVisible(visible);
+        if (node->isVisible() != visible) {
+            if (commandStack_) {
+                commandStack_->execute(std::make_unique<ModifyVisibilityCommand>(node, visible));
+            } else {
+                node->setVisible(visible);
+            }
+        }
         
         // Update item appearance
         if (visible) {
@@ -5,7 +5,9 @@
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QVector3D>
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 #ifndef GEANTCAD_NO_VTK
 #include <QVTKOpenGLNativeWidget.h>
@@ -26,6 +28,11 @@
 #include <vtkSampleFunction.h>
 #include <vtkContourFilter.h>
 #include <vtkPolyDataMapper.h>
+#include <vtkGlyph3DMapper.h>
+#include <vtkDoubleArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
 #include <vtkActor.h>
 #include <vtkProperty.h>
 #include <vtkCamera.h>
@@ -36,6 +43,11 @@
 // vtkTrd.h not available in VTK 9.1 - using vtkCubeSource for Trd shapes
 #include <vtkCellPicker.h>
 #include <vtkPropPicker.h>
+#include <vtkHardwareSelector.h>
+#include <vtkSelection.h>
+#include <vtkSelectionNode.h>
+#include <vtkInformation.h>
+#include <vtkIdTypeArray.h>
 #include <vtkPlaneSource.h>
 #include <vtkLineSource.h>
 #include <vtkAppendPolyData.h>
@@ -44,6 +56,7 @@
 #include <vtkCellArray.h>
 #include <vtkLine.h>
 #include <vtkCommand.h>
+#include <vtkCallbackCommand.h>
 #include <vtkArrowSource.h>
 #include <vtkDiskSource.h>
 #include <vtkTubeFilter.h>
@@ -51,6 +64,7 @@
 #include <vtkInteractorStyleTrackballCamera.h>
 // vtkVectorText requires FreeType - using cone markers instead
 #include <QMenu>
+#include <QTimer>
 
 // Custom interactor style - Shapr3D/Fusion360 style:
 // - Left button: NEVER camera (handled by Qt for selection/manipulation)
@@ -110,6 +124,7 @@ public:
 #include <QCoreApplication>
 #include "../../core/include/Command.hh"
 #include "../../core/include/Transform.hh"
+#include "../../generator/include/MeshCache.hh"
 #endif
 
 namespace geantcad {
@@ -126,6 +141,7 @@ Viewport3D::Viewport3D(QWidget* parent)
 }
 
 Viewport3D::~Viewport3D() {
+    disconnectSceneGraph();
 }
 #else
 Viewport3D::Viewport3D(QWidget* parent)
@@ -142,9 +158,25 @@ Viewport3D::Viewport3D(QWidget* parent)
     
     // Setup view cube (only after interactor is set)
     setupViewCube();
+    
+    // Level of detail is re-evaluated when the camera has been still for a moment
+    lodTimer_ = new QTimer(this);
+    lodTimer_->setSingleShot(true);
+    lodTimer_->setInterval(150);
+    connect(lodTimer_, &QTimer::timeout, this, [this]() { updateLevelsOfDetail(); });
+    vtkSmartPointer<vtkCallbackCommand> cameraObserver = vtkSmartPointer<vtkCallbackCommand>::New();
+    cameraObserver->SetClientData(lodTimer_);
+    cameraObserver->SetCallback([](vtkObject*, unsigned long, void* timer, void*) {
+        static_cast<QTimer*>(timer)->start();
+    });
+    lodObserverTag_ = renderer_->GetActiveCamera()->AddObserver(vtkCommand::ModifiedEvent, cameraObserver);
 }
 
 Viewport3D::~Viewport3D() {
+    if (renderer_ && lodObserverTag_) {
+        renderer_->GetActiveCamera()->RemoveObserver(lodObserverTag_);
+    }
+    disconnectSceneGraph();
 }
 
 void Viewport3D::setupRenderer() {
@@ -527,6 +559,14 @@ void Viewport3D::setWireframeMode(bool enabled) {
             }
         }
     }
+    for (auto& [key, group] : instanceGroups_) {
+        if (wireframeMode_) {
+            group.actor->GetProperty()->SetRepresentationToWireframe();
+            group.actor->GetProperty()->SetLineWidth(1.5);
+        } else {
+            group.actor->GetProperty()->SetRepresentationToSurface();
+        }
+    }
     
     if (renderWindow_) {
         renderWindow_->Render();
@@ -534,11 +574,63 @@ void Viewport3D::setWireframeMode(bool enabled) {
 }
 #endif
 
+void Viewport3D::setInstancingEnabled(bool enabled) {
+    if (instancingEnabled_ == enabled) return;
+    instancingEnabled_ = enabled;
+    fullRebuildPending_ = true;
+    refresh();
+}
+
+void Viewport3D::setLevelOfDetailEnabled(bool enabled) {
+    if (lodEnabled_ == enabled) return;
+    lodEnabled_ = enabled;
+    fullRebuildPending_ = true;
+    refresh();
+}
+
 void Viewport3D::setSceneGraph(SceneGraph* sceneGraph) {
+    disconnectSceneGraph();
     sceneGraph_ = sceneGraph;
+    connectSceneGraph();
+    fullRebuildPending_ = true;
     updateScene();
 }
 
+void Viewport3D::connectSceneGraph() {
+    if (!sceneGraph_) return;
+    
+    // Record what changed; actors are touched on the next refresh(). Removals are
+    // applied right away because the node is about to be destroyed.
+    sceneGraph_->onNodeAdded = [this](VolumeNode* node) {
+        if (!fullRebuildPending_) {
+            pendingAdded_.insert(node);
+        }
+    };
+    sceneGraph_->onNodeRemoved = [this](VolumeNode* node) {
+        pendingAdded_.erase(node);
+        pendingChanges_.erase(node);
+#ifndef GEANTCAD_NO_VTK
+        if (draggedNode_ == node) {
+            draggedNode_ = nullptr;
+            isDragging_ = false;
+        }
+        removeActor(node);
+#endif
+    };
+    sceneGraph_->onNodeChanged = [this](VolumeNode* node, NodeChange change) {
+        if (!fullRebuildPending_) {
+            pendingChanges_[node] |= static_cast<uint32_t>(change);
+        }
+    };
+}
+
+void Viewport3D::disconnectSceneGraph() {
+    if (!sceneGraph_) return;
+    sceneGraph_->onNodeAdded = nullptr;
+    sceneGraph_->onNodeRemoved = nullptr;
+    sceneGraph_->onNodeChanged = nullptr;
+}
+
 void Viewport3D::resetView() {
 #ifdef GEANTCAD_NO_VTK
     (void)0; // No-op without VTK
@@ -714,7 +806,7 @@ void Viewport3D::frameSelection() {
 }
 
 void Viewport3D::refresh() {
-    updateScene();
+    applyPendingChanges();
 #ifndef GEANTCAD_NO_VTK
     if (renderWindow_) {
         renderWindow_->Render();
@@ -723,69 +815,140 @@ void Viewport3D::refresh() {
 }
 
 #ifndef GEANTCAD_NO_VTK
-// Helper function to create VTK source from Shape
-static vtkSmartPointer<vtkPolyDataAlgorithm> createVTKSourceFromShape(const Shape* shape) {
-    if (!shape) return nullptr;
-    
-    switch (shape->getType()) {
-        case ShapeType::Box: {
-            if (auto* params = shape->getParamsAs<BoxParams>()) {
-                // Use vtkCubeSource for better performance
-                vtkSmartPointer<vtkCubeSource> cube = vtkSmartPointer<vtkCubeSource>::New();
-                cube->SetXLength(params->x * 2.0);
-                cube->SetYLength(params->y * 2.0);
-                cube->SetZLength(params->z * 2.0);
-                cube->SetCenter(0, 0, 0);
-                return cube;
-            }
-            break;
+namespace {
+    // Angular resolution of round shapes in the viewport without level of
+    // detail, and the resolutions chosen from with it (coarsest first)
+    constexpr int ViewportResolution = 32;
+    constexpr int LodResolutions[] = {8, 16, 32, 64};
+    constexpr int LodLevels = sizeof(LodResolutions) / sizeof(LodResolutions[0]);
+    
+    // Largest gap (pixels) allowed between a tessellated outline and the true one
+    constexpr double LodPixelError = 0.5;
+    
+    // Volumes whose bounding sphere projects to a smaller radius (pixels)
+    // are drawn as their bounding box
+    constexpr double ImpostorRadius = 1.5;
+    
+    // Shapes whose tessellation depends on the resolution
+    bool isRound(const Shape& shape) {
+        switch (shape.getType()) {
+            case ShapeType::Tube:
+            case ShapeType::Sphere:
+            case ShapeType::Cone:
+                return true;
+            default:
+                return false;
         }
-        case ShapeType::Tube: {
-            if (auto* params = shape->getParamsAs<TubeParams>()) {
-                vtkSmartPointer<vtkCylinderSource> cylinder = vtkSmartPointer<vtkCylinderSource>::New();
-                cylinder->SetRadius(params->rmax);
-                cylinder->SetHeight(params->dz * 2.0);
-                cylinder->SetResolution(32);
-                cylinder->SetCenter(0, 0, 0);
-                return cylinder;
+    }
+    
+    // One mesh with every copy of a volume inside array patterns; offsets are
+    // in the volume's own frame (arrayCopyOffsets)
+    vtkSmartPointer<vtkPolyData> arrayMesh(vtkPolyData* mesh, const std::vector<QMatrix4x4>& offsets) {
+        vtkSmartPointer<vtkAppendPolyData> append = vtkSmartPointer<vtkAppendPolyData>::New();
+        const vtkIdType pointCount = mesh->GetNumberOfPoints();
+        vtkDataArray* normals = mesh->GetPointData()->GetNormals();
+        for (const QMatrix4x4& offset : offsets) {
+            vtkSmartPointer<vtkPolyData> copy = vtkSmartPointer<vtkPolyData>::New();
+            copy->ShallowCopy(mesh);
+            vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+            points->SetNumberOfPoints(pointCount);
+            vtkSmartPointer<vtkDoubleArray> copyNormals;
+            if (normals) {
+                copyNormals = vtkSmartPointer<vtkDoubleArray>::New();
+                copyNormals->SetNumberOfComponents(3);
+                copyNormals->SetNumberOfTuples(pointCount);
             }
-            break;
+            for (vtkIdType i = 0; i < pointCount; ++i) {
+                double p[3];
+                mesh->GetPoint(i, p);
+                QVector3D q = offset.map(QVector3D(float(p[0]), float(p[1]), float(p[2])));
+                points->SetPoint(i, q.x(), q.y(), q.z());
+                if (normals) {
+                    double* n = normals->GetTuple3(i);
+                    QVector3D r = offset.mapVector(QVector3D(float(n[0]), float(n[1]), float(n[2]))).normalized();
+                    copyNormals->SetTuple3(i, r.x(), r.y(), r.z());
+                }
+            }
+            copy->SetPoints(points);
+            if (normals) copy->GetPointData()->SetNormals(copyNormals);
+            append->AddInputData(copy);
         }
-        case ShapeType::Sphere: {
-            if (auto* params = shape->getParamsAs<SphereParams>()) {
-                vtkSmartPointer<vtkSphereSource> sphere = vtkSmartPointer<vtkSphereSource>::New();
-                sphere->SetRadius(params->rmax);
-                sphere->SetThetaResolution(32);
-                sphere->SetPhiResolution(32);
-                sphere->SetCenter(0, 0, 0);
-                return sphere;
+        append->Update();
+        return append->GetOutput();
+    }
+    
+    // Split a world matrix into translation, rotation quaternion (w,x,y,z) and
+    // per-axis scale, the instance attributes of vtkGlyph3DMapper. Fails for
+    // shear (non-uniform scale under a rotated parent) and mirroring.
+    bool decomposeInstanceMatrix(const QMatrix4x4& m, double pos[3], double quat[4], double scale[3]) {
+        double r[3][3];
+        for (int j = 0; j < 3; ++j) {
+            scale[j] = std::sqrt(m(0, j) * m(0, j) + m(1, j) * m(1, j) + m(2, j) * m(2, j));
+            if (scale[j] <= 0.0) return false;
+            for (int i = 0; i < 3; ++i) {
+                r[i][j] = m(i, j) / scale[j];
             }
-            break;
         }
-        case ShapeType::Cone: {
-            if (auto* params = shape->getParamsAs<ConeParams>()) {
-                vtkSmartPointer<vtkConeSource> cone = vtkSmartPointer<vtkConeSource>::New();
-                cone->SetRadius(params->rmax2); // Use larger radius
-                cone->SetHeight(params->dz * 2.0);
-                cone->SetResolution(32);
-                cone->SetCenter(0, 0, 0);
-                return cone;
+        
+        // Columns must be orthonormal with positive determinant
+        constexpr double tolerance = 1e-4;
+        for (int a = 0; a < 3; ++a) {
+            for (int b = a + 1; b < 3; ++b) {
+                double dot = r[0][a] * r[0][b] + r[1][a] * r[1][b] + r[2][a] * r[2][b];
+                if (std::abs(dot) > tolerance) return false;
             }
-            break;
         }
-        default:
-            break;
+        double det = r[0][0] * (r[1][1] * r[2][2] - r[1][2] * r[2][1])
+                   - r[0][1] * (r[1][0] * r[2][2] - r[1][2] * r[2][0])
+                   + r[0][2] * (r[1][0] * r[2][1] - r[1][1] * r[2][0]);
+        if (det <= 0.0) return false;
+        
+        for (int i = 0; i < 3; ++i) {
+            pos[i] = m(i, 3);
+        }
+        
+        double trace = r[0][0] + r[1][1] + r[2][2];
+        if (trace > 0.0) {
+            double s = 2.0 * std::sqrt(trace + 1.0);
+            quat[0] = 0.25 * s;
+            quat[1] = (r[2][1] - r[1][2]) / s;
+            quat[2] = (r[0][2] - r[2][0]) / s;
+            quat[3] = (r[1][0] - r[0][1]) / s;
+        } else if (r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+            double s = 2.0 * std::sqrt(1.0 + r[0][0] - r[1][1] - r[2][2]);
+            quat[0] = (r[2][1] - r[1][2]) / s;
+            quat[1] = 0.25 * s;
+            quat[2] = (r[0][1] + r[1][0]) / s;
+            quat[3] = (r[0][2] + r[2][0]) / s;
+        } else if (r[1][1] > r[2][2]) {
+            double s = 2.0 * std::sqrt(1.0 + r[1][1] - r[0][0] - r[2][2]);
+            quat[0] = (r[0][2] - r[2][0]) / s;
+            quat[1] = (r[0][1] + r[1][0]) / s;
+            quat[2] = 0.25 * s;
+            quat[3] = (r[1][2] + r[2][1]) / s;
+        } else {
+            double s = 2.0 * std::sqrt(1.0 + r[2][2] - r[0][0] - r[1][1]);
+            quat[0] = (r[1][0] - r[0][1]) / s;
+            quat[1] = (r[0][2] + r[2][0]) / s;
+            quat[2] = (r[1][2] + r[2][1]) / s;
+            quat[3] = 0.25 * s;
+        }
+        return true;
     }
-    
-    return nullptr;
 }
 #endif
 
 void Viewport3D::updateScene() {
+    pendingAdded_.clear();
+    pendingChanges_.clear();
+    fullRebuildPending_ = false;
 #ifdef GEANTCAD_NO_VTK
     (void)0; // No-op without VTK
 #else
-    if (!renderer_ || !sceneGraph_) return;
+    if (!renderer_ || !sceneGraph_) {
+        fullRebuildPending_ = true;
+        return;
+    }
     
     // Clear existing actors safely
     for (auto& pair : actors_) {
@@ -794,68 +957,23 @@ void Viewport3D::updateScene() {
         }
     }
     actors_.clear();
+    actorNodes_.clear();
+    for (auto& [key, group] : instanceGroups_) {
+        renderer_->RemoveActor(group.actor);
+    }
+    instanceGroups_.clear();
+    instanceSlots_.clear();
+    groupActors_.clear();
+    selectionActors_.clear();
+    lodResolutions_.clear();
     
     // Traverse scene graph and create actors
-    sceneGraph_->traverse([this](VolumeNode* node) {
-        if (!node || !node->getShape()) return;
-        
-        // Skip hidden nodes
-        if (!node->isVisible()) return;
-        
-        // Skip root/world node for now (or render it differently)
-        if (node->getName() == "World") return;
-        
-        // Create VTK source from shape
-        auto source = createVTKSourceFromShape(node->getShape());
-        if (!source) return;
-        
-        // Create mapper
-        vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-        mapper->SetInputConnection(source->GetOutputPort());
-        
-        // Create actor
-        vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
-        actor->SetMapper(mapper);
-        
-        // Apply transform
-        auto transform = node->getWorldTransform();
-        auto matrix = transform.getMatrix();
-        vtkSmartPointer<vtkTransform> vtkXForm = vtkSmartPointer<vtkTransform>::New();
-        
-        // Convert QMatrix4x4 to vtkMatrix4x4
-        // QMatrix4x4 uses column-major storage, VTK uses row-major
-        // QMatrix4x4::constData() returns data in column-major order
-        // So we need to transpose when setting VTK matrix
-        vtkSmartPointer<vtkMatrix4x4> vtkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-        const float* data = matrix.constData();
-        for (int i = 0; i < 4; ++i) {
-            for (int j = 0; j < 4; ++j) {
-                // Transpose: swap i and j when reading from Qt data
-                vtkMatrix->SetElement(i, j, data[j * 4 + i]);
-            }
-        }
-        vtkXForm->SetMatrix(vtkMatrix);
-        actor->SetUserTransform(vtkXForm);
-        
-        // Apply material visual properties
-        if (auto material = node->getMaterial()) {
-            auto& visual = material->getVisual();
-            actor->GetProperty()->SetColor(visual.r, visual.g, visual.b);
-            actor->GetProperty()->SetOpacity(visual.a);
-            if (visual.wireframe) {
-                actor->GetProperty()->SetRepresentationToWireframe();
-            } else {
-                actor->GetProperty()->SetRepresentationToSurface();
-            }
-        } else {
-            // Default appearance
-            actor->GetProperty()->SetColor(0.8, 0.8, 0.8);
-        }
-        
-        // Add to renderer
-        renderer_->AddActor(actor);
-        actors_[node] = actor;
+    sceneGraph_->updateWorldTransforms();
+    updateLodView();
+    sceneGraph_->forEach([this](VolumeNode* node) {
+        rebuildActor(node);
     });
+    flushInstanceGroups();
     
     // Don't reset camera during drag operations
     // Don't auto-reset camera - user controls the view
@@ -875,6 +993,537 @@ void Viewport3D::updateScene() {
 #endif
 }
 
+void Viewport3D::applyPendingChanges() {
+    if (fullRebuildPending_) {
+        updateScene();
+        return;
+    }
+#ifdef GEANTCAD_NO_VTK
+    pendingAdded_.clear();
+    pendingChanges_.clear();
+#else
+    if (!renderer_ || !sceneGraph_) return;
+    if (pendingAdded_.empty() && pendingChanges_.empty()) {
+        // Selection changed elsewhere (outliner, commands)
+        if (sceneGraph_->getMultiSelection() != highlightedSelection_) {
+            updateSelectionHighlight(sceneGraph_->getSelected());
+        }
+        return;
+    }
+    
+    sceneGraph_->updateWorldTransforms();
+    
+    constexpr uint32_t rebuildMask = static_cast<uint32_t>(NodeChange::Shape)
+                                   | static_cast<uint32_t>(NodeChange::Visibility)
+                                   | static_cast<uint32_t>(NodeChange::Name); // "World" is skipped by name
+    std::unordered_set<const Material*> changedMaterials;
+    
+    for (const auto& [node, changes] : pendingChanges_) {
+        // New nodes get a fresh actor below anyway
+        if (pendingAdded_.count(node)) continue;
+        
+        if (changes & rebuildMask) {
+            rebuildActor(node);
+        }
+        if (changes & static_cast<uint32_t>(NodeChange::Transform)) {
+            // World transforms of the whole subtree moved
+            traversal::preOrder(node, [this](VolumeNode* n) {
+                // Offsets of array copies depend on the local transforms
+                if (arrayCopyOffsets(n).size() > 1) {
+                    rebuildActor(n);
+                    return;
+                }
+                auto it = actors_.find(n);
+                if (it != actors_.end() && it->second) {
+                    applyActorTransform(n, it->second);
+                    return;
+                }
+                auto slot = instanceSlots_.find(n);
+                if (slot != instanceSlots_.end()) {
+                    slot->second.group->dirty = true;
+                }
+            });
+        }
+        if (changes & static_cast<uint32_t>(NodeChange::Array)) {
+            traversal::preOrder(node, [this](VolumeNode* n) { rebuildActor(n); });
+        }
+        if (changes & static_cast<uint32_t>(NodeChange::Material)) {
+            if (auto material = node->getMaterial()) {
+                changedMaterials.insert(material.get());
+            }
+            auto it = actors_.find(node);
+            if (it != actors_.end() && it->second) {
+                applyActorMaterial(node, it->second);
+            } else if (instanceSlots_.count(node)) {
+                rebuildActor(node); // opacity/wireframe select the group
+            }
+        }
+    }
+    
+    for (VolumeNode* node : pendingAdded_) {
+        rebuildActor(node);
+    }
+    
+    // Materials are shared: in-place edits show on every volume using them
+    if (!changedMaterials.empty()) {
+        for (auto& [node, actor] : actors_) {
+            if (actor && node->getMaterial() && changedMaterials.count(node->getMaterial().get())) {
+                applyActorMaterial(node, actor);
+            }
+        }
+        std::vector<VolumeNode*> instanced;
+        for (const auto& [node, slot] : instanceSlots_) {
+            if (node->getMaterial() && changedMaterials.count(node->getMaterial().get())) {
+                instanced.push_back(node);
+            }
+        }
+        for (VolumeNode* node : instanced) {
+            rebuildActor(node);
+        }
+    }
+    
+    pendingAdded_.clear();
+    pendingChanges_.clear();
+    flushInstanceGroups();
+    
+    // Preserve selection highlight (material colors were reapplied)
+    updateSelectionHighlight(sceneGraph_->getSelected());
+#endif
+}
+
+#ifndef GEANTCAD_NO_VTK
+void Viewport3D::removeActor(VolumeNode* node) {
+    removeInstance(node);
+    selectionActors_.erase(node);
+    lodResolutions_.erase(node);
+    auto it = actors_.find(node);
+    if (it == actors_.end()) return;
+    if (it->second && renderer_) {
+        renderer_->RemoveActor(it->second);
+    }
+    actorNodes_.erase(it->second.GetPointer());
+    actors_.erase(it);
+}
+
+void Viewport3D::rebuildActor(VolumeNode* node) {
+    removeActor(node);
+    
+    if (!node || !node->getShape()) return;
+    
+    // Skip hidden nodes
+    if (!node->isVisible()) return;
+    
+    // Skip root/world node for now (or render it differently)
+    if (node->getName() == "World") return;
+    
+    // Tessellation shared by every volume with the same geometry (and level)
+    const int resolution = lodResolution(node);
+    vtkSmartPointer<vtkPolyData> mesh = MeshCache::instance().get(*node->getShape(), resolution);
+    if (!mesh) return;
+    if (isRound(*node->getShape())) {
+        lodResolutions_[node] = resolution;
+    }
+    
+    // Volumes inside array patterns draw all their copies with one actor
+    std::vector<QMatrix4x4> copies = arrayCopyOffsets(node);
+    if (copies.size() > 1) {
+        mesh = arrayMesh(mesh, copies);
+    }
+    
+    // Selected volumes keep their own actor (outline, framing, dragging)
+    if (instancingEnabled_ && copies.size() == 1) {
+        if (sceneGraph_ && sceneGraph_->isSelected(node)) {
+            selectionActors_.insert(node);
+        } else if (addInstance(node, mesh)) {
+            return;
+        }
+    }
+    
+    // Create mapper
+    vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+    mapper->SetInputData(mesh);
+    
+    // Create actor
+    vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
+    actor->SetMapper(mapper);
+    applyActorTransform(node, actor);
+    applyActorMaterial(node, actor);
+    
+    // Add to renderer
+    renderer_->AddActor(actor);
+    actors_[node] = actor;
+    actorNodes_[actor.GetPointer()] = node;
+}
+
+void Viewport3D::updateLodView() {
+    vtkCamera* camera = renderer_->GetActiveCamera();
+    const int* size = renderer_->GetSize();
+    lodView_.parallel = camera->GetParallelProjection() != 0;
+    camera->GetPosition(lodView_.eye);
+    if (!size || size[1] <= 0) {
+        lodView_.pixelsPerMm = 0.0;  // not laid out yet: no level of detail
+    } else if (lodView_.parallel) {
+        lodView_.pixelsPerMm = size[1] / (2.0 * std::max(camera->GetParallelScale(), 1e-9));
+    } else {
+        const double halfAngle = camera->GetViewAngle() * 3.14159265358979 / 360.0;
+        lodView_.pixelsPerMm = size[1] / (2.0 * std::tan(halfAngle));
+    }
+}
+
+int Viewport3D::lodResolution(const VolumeNode* node) const {
+    const Shape& shape = *node->getShape();
+    if (!isRound(shape) || !lodEnabled_ || lodView_.pixelsPerMm <= 0.0) {
+        return ViewportResolution;
+    }
+    double lo[3], hi[3];
+    if (!shape.localBounds(lo, hi)) return ViewportResolution;
+    
+    // Bounding sphere of the local bounds, in world space
+    const QMatrix4x4& world = node->getWorldMatrix();
+    const QVector3D center = world.map(QVector3D(float((lo[0] + hi[0]) * 0.5),
+                                                 float((lo[1] + hi[1]) * 0.5),
+                                                 float((lo[2] + hi[2]) * 0.5)));
+    const double radius = world.mapVector(QVector3D(float((hi[0] - lo[0]) * 0.5),
+                                                    float((hi[1] - lo[1]) * 0.5),
+                                                    float((hi[2] - lo[2]) * 0.5))).length();
+    
+    double pixels = radius * lodView_.pixelsPerMm;
+    if (!lodView_.parallel) {
+        const double dx = center.x() - lodView_.eye[0];
+        const double dy = center.y() - lodView_.eye[1];
+        const double dz = center.z() - lodView_.eye[2];
+        const double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        if (distance <= radius) return LodResolutions[LodLevels - 1];
+        pixels /= distance;
+    }
+    if (pixels < ImpostorRadius) return MeshCache::BoundsResolution;
+    
+    // N segments miss the circle by r * (1 - cos(pi / N)) at mid-chord
+    for (int resolution : LodResolutions) {
+        if (pixels * (1.0 - std::cos(3.14159265358979 / resolution)) <= LodPixelError) {
+            return resolution;
+        }
+    }
+    return LodResolutions[LodLevels - 1];
+}
+
+void Viewport3D::updateLevelsOfDetail() {
+    if (!lodEnabled_ || !renderer_ || !sceneGraph_ || fullRebuildPending_ || isDragging_) return;
+    
+    sceneGraph_->updateWorldTransforms();
+    updateLodView();
+    std::vector<VolumeNode*> changed;
+    bool selectionChanged = false;
+    for (const auto& [node, resolution] : lodResolutions_) {
+        if (lodResolution(node) != resolution) {
+            changed.push_back(node);
+            selectionChanged = selectionChanged || sceneGraph_->isSelected(node);
+        }
+    }
+    if (changed.empty()) return;
+    
+    // Only the volumes that crossed a level get a new mesh
+    for (VolumeNode* node : changed) {
+        rebuildActor(node);
+    }
+    flushInstanceGroups();
+    if (selectionChanged) {
+        updateSelectionHighlight(sceneGraph_->getSelected());
+    }
+    renderWindow_->Render();
+}
+
+void Viewport3D::applyActorTransform(const VolumeNode* node, vtkActor* actor) {
+    // Cached world matrix (refreshed by updateWorldTransforms before the walk)
+    const QMatrix4x4& matrix = node->getWorldMatrix();
+    vtkSmartPointer<vtkTransform> vtkXForm = vtkSmartPointer<vtkTransform>::New();
+    
+    // Convert QMatrix4x4 to vtkMatrix4x4
+    // QMatrix4x4 uses column-major storage, VTK uses row-major
+    // QMatrix4x4::constData() returns data in column-major order
+    // So we need to transpose when setting VTK matrix
+    vtkSmartPointer<vtkMatrix4x4> vtkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    const float* data = matrix.constData();
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            // Transpose: swap i and j when reading from Qt data
+            vtkMatrix->SetElement(i, j, data[j * 4 + i]);
+        }
+    }
+    vtkXForm->SetMatrix(vtkMatrix);
+    actor->SetUserTransform(vtkXForm);
+}
+
+void Viewport3D::applyActorMaterial(const VolumeNode* node, vtkActor* actor) {
+    // Apply material visual properties
+    if (auto material = node->getMaterial()) {
+        auto& visual = material->getVisual();
+        actor->GetProperty()->SetColor(visual.r, visual.g, visual.b);
+        actor->GetProperty()->SetOpacity(visual.a);
+        if (visual.wireframe) {
+            actor->GetProperty()->SetRepresentationToWireframe();
+        } else {
+            actor->GetProperty()->SetRepresentationToSurface();
+        }
+    } else {
+        // Default appearance
+        actor->GetProperty()->SetColor(0.8, 0.8, 0.8);
+    }
+}
+
+bool Viewport3D::addInstance(VolumeNode* node, const vtkSmartPointer<vtkPolyData>& mesh) {
+    double pos[3], quat[4], scale[3];
+    if (!decomposeInstanceMatrix(node->getWorldMatrix(), pos, quat, scale)) return false;
+    
+    // Color is per instance; what the actor property controls selects the group
+    double opacity = 1.0;
+    bool wireframe = false;
+    if (auto material = node->getMaterial()) {
+        opacity = material->getVisual().a;
+        wireframe = material->getVisual().wireframe;
+    }
+    
+    auto [it, inserted] = instanceGroups_.try_emplace(InstanceKey(mesh.GetPointer(), opacity, wireframe));
+    InstanceGroup& group = it->second;
+    if (inserted) {
+        group.mesh = mesh;
+        group.mapper = vtkSmartPointer<vtkGlyph3DMapper>::New();
+        group.mapper->SetSourceData(mesh);
+        group.mapper->SetScaling(true);
+        group.mapper->SetScaleModeToScaleByVectorComponents();
+        group.mapper->SetScaleArray("scale");
+        group.mapper->SetOrientationModeToQuaternion();
+        group.mapper->SetOrientationArray("orientation");
+        group.mapper->SetScalarModeToUsePointFieldData();
+        group.mapper->SelectColorArray("colors");
+        group.mapper->SetColorModeToDirectScalars();
+        group.mapper->ScalarVisibilityOn();
+        group.mapper->SetSelectionIdArray("instanceIds");
+        group.mapper->UseSelectionIdsOn();
+        
+        group.actor = vtkSmartPointer<vtkActor>::New();
+        group.actor->SetMapper(group.mapper);
+        group.actor->GetProperty()->SetOpacity(opacity);
+        if (wireframe || wireframeMode_) {
+            group.actor->GetProperty()->SetRepresentationToWireframe();
+        }
+        renderer_->AddActor(group.actor);
+        groupActors_[group.actor.GetPointer()] = &group;
+    }
+    
+    instanceSlots_[node] = InstanceSlot{&group, group.nodes.size()};
+    group.nodes.push_back(node);
+    group.dirty = true;
+    return true;
+}
+
+void Viewport3D::removeInstance(VolumeNode* node) {
+    auto it = instanceSlots_.find(node);
+    if (it == instanceSlots_.end()) return;
+    
+    // Swap with the last instance so removal stays O(1)
+    InstanceGroup* group = it->second.group;
+    size_t index = it->second.index;
+    instanceSlots_.erase(it);
+    VolumeNode* last = group->nodes.back();
+    group->nodes[index] = last;
+    group->nodes.pop_back();
+    if (last != node) {
+        instanceSlots_[last].index = index;
+    }
+    group->dirty = true;
+}
+
+void Viewport3D::flushInstanceGroups() {
+    std::vector<VolumeNode*> sheared;
+    
+    for (auto it = instanceGroups_.begin(); it != instanceGroups_.end();) {
+        InstanceGroup& group = it->second;
+        if (group.nodes.empty()) {
+            renderer_->RemoveActor(group.actor);
+            groupActors_.erase(group.actor.GetPointer());
+            it = instanceGroups_.erase(it);
+            continue;
+        }
+        if (group.dirty) {
+            const vtkIdType count = static_cast<vtkIdType>(group.nodes.size());
+            
+            vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+            points->SetDataTypeToDouble();
+            points->SetNumberOfPoints(count);
+            vtkSmartPointer<vtkDoubleArray> orientation = vtkSmartPointer<vtkDoubleArray>::New();
+            orientation->SetName("orientation");
+            orientation->SetNumberOfComponents(4);
+            orientation->SetNumberOfTuples(count);
+            vtkSmartPointer<vtkDoubleArray> scale = vtkSmartPointer<vtkDoubleArray>::New();
+            scale->SetName("scale");
+            scale->SetNumberOfComponents(3);
+            scale->SetNumberOfTuples(count);
+            vtkSmartPointer<vtkUnsignedCharArray> colors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+            colors->SetName("colors");
+            colors->SetNumberOfComponents(4);
+            colors->SetNumberOfTuples(count);
+            vtkSmartPointer<vtkIdTypeArray> instanceIds = vtkSmartPointer<vtkIdTypeArray>::New();
+            instanceIds->SetName("instanceIds");
+            instanceIds->SetNumberOfTuples(count);
+            
+            for (vtkIdType i = 0; i < count; ++i) {
+                VolumeNode* node = group.nodes[i];
+                double pos[3] = {0.0, 0.0, 0.0};
+                double quat[4] = {1.0, 0.0, 0.0, 0.0};
+                double s[3] = {0.0, 0.0, 0.0};  // collapsed until moved out below
+                if (!decomposeInstanceMatrix(node->getWorldMatrix(), pos, quat, s)) {
+                    sheared.push_back(node);
+                }
+                points->SetPoint(i, pos);
+                orientation->SetTypedTuple(i, quat);
+                scale->SetTypedTuple(i, s);
+                
+                double rgb[3] = {0.8, 0.8, 0.8};
+                if (auto material = node->getMaterial()) {
+                    const auto& visual = material->getVisual();
+                    rgb[0] = visual.r;
+                    rgb[1] = visual.g;
+                    rgb[2] = visual.b;
+                }
+                unsigned char rgba[4] = {
+                    static_cast<unsigned char>(std::clamp(rgb[0], 0.0, 1.0) * 255.0 + 0.5),
+                    static_cast<unsigned char>(std::clamp(rgb[1], 0.0, 1.0) * 255.0 + 0.5),
+                    static_cast<unsigned char>(std::clamp(rgb[2], 0.0, 1.0) * 255.0 + 0.5),
+                    255
+                };
+                colors->SetTypedTuple(i, rgba);
+                instanceIds->SetValue(i, i + 1);  // 0 would read as "no composite index"
+            }
+            
+            vtkSmartPointer<vtkPolyData> instances = vtkSmartPointer<vtkPolyData>::New();
+            instances->SetPoints(points);
+            instances->GetPointData()->AddArray(orientation);
+            instances->GetPointData()->AddArray(scale);
+            instances->GetPointData()->AddArray(colors);
+            instances->GetPointData()->AddArray(instanceIds);
+            group.mapper->SetInputData(instances);
+            group.dirty = false;
+        }
+        ++it;
+    }
+    
+    // A transform that can't be expressed per instance: give the volume its own actor
+    if (!sheared.empty()) {
+        bool enabled = instancingEnabled_;
+        instancingEnabled_ = false;
+        for (VolumeNode* node : sheared) {
+            rebuildActor(node);
+        }
+        instancingEnabled_ = enabled;
+        flushInstanceGroups();
+    }
+}
+
+VolumeNode* Viewport3D::pickNode(int x, int y) {
+    if (!renderer_ || !renderWindow_) return nullptr;
+    
+    const int displayY = renderWindow_->GetSize()[1] - y - 1;
+    if (x < 0 || displayY < 0) return nullptr;
+    vtkProp* prop = nullptr;
+    int instanceId = -1;
+    
+    if (pickingMode_ == PickingMode::IdBuffer) {
+        // One-pixel hardware selection: cost independent of the cell count
+        vtkSmartPointer<vtkHardwareSelector> selector = vtkSmartPointer<vtkHardwareSelector>::New();
+        selector->SetRenderer(renderer_);
+        selector->SetFieldAssociation(vtkDataObject::FIELD_ASSOCIATION_CELLS);
+        selector->SetArea(x, displayY, x, displayY);
+        vtkSmartPointer<vtkSelection> selection;
+        selection.TakeReference(selector->Select());
+        if (selection && selection->GetNumberOfNodes() > 0) {
+            vtkInformation* properties = selection->GetNode(0)->GetProperties();
+            prop = vtkProp::SafeDownCast(properties->Get(vtkSelectionNode::PROP()));
+            if (properties->Has(vtkSelectionNode::COMPOSITE_INDEX())) {
+                instanceId = properties->Get(vtkSelectionNode::COMPOSITE_INDEX()) - 1;
+            }
+        }
+    } else {
+        vtkSmartPointer<vtkPropPicker> picker = vtkSmartPointer<vtkPropPicker>::New();
+        picker->Pick(x, displayY, 0, renderer_);
+        prop = picker->GetViewProp();
+    }
+    if (!prop) return nullptr;
+    
+    auto nodeIt = actorNodes_.find(prop);
+    if (nodeIt != actorNodes_.end()) {
+        return nodeIt->second;
+    }
+    auto groupIt = groupActors_.find(prop);
+    if (groupIt != groupActors_.end()) {
+        return pickInstance(*groupIt->second, x, y, instanceId);
+    }
+    return nullptr;
+}
+
+VolumeNode* Viewport3D::pickInstance(const InstanceGroup& group, int x, int y, int instanceId) {
+    // Pick ray in world coordinates, tested against each instance's local mesh bounds
+    double bounds[6];
+    group.mesh->GetBounds(bounds);
+    const QVector3D rayStart = screenToWorld(x, y, 0.0);
+    const QVector3D rayEnd = screenToWorld(x, y, 1.0);
+    
+    auto hitDistance = [&](const VolumeNode* node) {
+        bool invertible = false;
+        QMatrix4x4 toLocal = node->getWorldMatrix().inverted(&invertible);
+        if (!invertible) return -1.0;
+        const QVector3D a = toLocal.map(rayStart);
+        const QVector3D d = toLocal.map(rayEnd) - a;
+        double tNear = 0.0, tFar = 1.0;
+        for (int axis = 0; axis < 3; ++axis) {
+            const double lo = bounds[2 * axis], hi = bounds[2 * axis + 1];
+            if (std::abs(d[axis]) < 1e-12) {
+                if (a[axis] < lo || a[axis] > hi) return -1.0;
+                continue;
+            }
+            double t0 = (lo - a[axis]) / d[axis];
+            double t1 = (hi - a[axis]) / d[axis];
+            if (t0 > t1) std::swap(t0, t1);
+            tNear = std::max(tNear, t0);
+            tFar = std::min(tFar, t1);
+            if (tNear > tFar) return -1.0;
+        }
+        return tNear;
+    };
+    
+    // The ID buffer names the instance directly; the ray only confirms it
+    // (ids are stale if the group changed since the last render)
+    if (instanceId >= 0 && static_cast<size_t>(instanceId) < group.nodes.size()) {
+        VolumeNode* candidate = group.nodes[instanceId];
+        if (hitDistance(candidate) >= 0.0) {
+            return candidate;
+        }
+    }
+    
+    // Nearest instance along the ray. Candidates come from the scene BVH sorted
+    // by box entry, so the walk ends once no closer hit is possible.
+    if (!sceneGraph_) return nullptr;
+    const QVector3D ray = rayEnd - rayStart;
+    const double rayLength = ray.length();
+    std::vector<SpatialIndex::RayHit> hits;
+    sceneGraph_->getSpatialIndex().queryRay(rayStart, ray, static_cast<float>(rayLength), hits);
+    
+    VolumeNode* best = nullptr;
+    double bestDistance = std::numeric_limits<double>::max();
+    for (const auto& hit : hits) {
+        if (hit.distance > bestDistance) break;
+        auto slot = instanceSlots_.find(hit.node);
+        if (slot == instanceSlots_.end() || slot->second.group != &group) continue;
+        double t = hitDistance(hit.node);
+        if (t >= 0.0 && t * rayLength < bestDistance) {
+            bestDistance = t * rayLength;
+            best = hit.node;
+        }
+    }
+    return best;
+}
+#endif
+
 void Viewport3D::setCommandStack(CommandStack* commandStack) {
     commandStack_ = commandStack;
 }
@@ -1098,20 +1747,7 @@ void Viewport3D::mousePressEvent(QMouseEvent* event) {
             }
             
             // Check what we clicked on
-            vtkSmartPointer<vtkPropPicker> picker = vtkSmartPointer<vtkPropPicker>::New();
-            picker->Pick(x, renderWindow_->GetSize()[1] - y - 1, 0, renderer_);
-            
-            vtkActor* pickedActor = picker->GetActor();
-            VolumeNode* pickedNode = nullptr;
-            
-            if (pickedActor) {
-                for (const auto& pair : actors_) {
-                    if (pair.second && pair.second.GetPointer() == pickedActor) {
-                        pickedNode = pair.first;
-                        break;
-                    }
-                }
-            }
+            VolumeNode* pickedNode = pickNode(x, y);
             
             // Click on selected object = start dragging
             if (pickedNode == selected) {
@@ -1146,20 +1782,7 @@ void Viewport3D::mousePressEvent(QMouseEvent* event) {
         
         // In Select mode, pick objects or start panning on empty click
         if (interactionMode_ == InteractionMode::Select && sceneGraph_) {
-            vtkSmartPointer<vtkPropPicker> picker = vtkSmartPointer<vtkPropPicker>::New();
-            picker->Pick(x, renderWindow_->GetSize()[1] - y - 1, 0, renderer_);
-            
-            vtkActor* pickedActor = picker->GetActor();
-            VolumeNode* pickedNode = nullptr;
-            
-            if (pickedActor) {
-                for (const auto& pair : actors_) {
-                    if (pair.second && pair.second.GetPointer() == pickedActor) {
-                        pickedNode = pair.first;
-                        break;
-                    }
-                }
-            }
+            VolumeNode* pickedNode = pickNode(x, y);
             
             if (pickedNode && pickedNode != sceneGraph_->getRoot()) {
                 // Check for Ctrl modifier for multi-selection
@@ -1307,7 +1930,7 @@ void Viewport3D::mouseMoveEvent(QMouseEvent* event) {
             // Update transform
             Transform newTransform = draggedNode_->getTransform();
             newTransform.setTranslation(newPos);
-            draggedNode_->getTransform() = newTransform;
+            draggedNode_->setTransform(newTransform);
             
             // Display position with axis indicator
             QString axisHint;
@@ -1368,7 +1991,9 @@ void Viewport3D::mouseMoveEvent(QMouseEvent* event) {
                     break;
             }
             
-            draggedNode_->getTransform().setRotation(currentRotation);
+            Transform newTransform = draggedNode_->getTransform();
+            newTransform.setRotation(currentRotation);
+            draggedNode_->setTransform(newTransform);
             
             // Display rotation with axis indicator
             QVector3D currentEuler = currentRotation.toEulerAngles();
@@ -1405,7 +2030,7 @@ void Viewport3D::mouseMoveEvent(QMouseEvent* event) {
             // For shapes, we modify the shape parameters based on type
             // This is more Geant4-like (shape dimensions matter, not transform scale)
             if (draggedNode_->getShape()) {
-                Shape* shape = draggedNode_->getShape();
+                Shape* shape = draggedNode_->editShape();
                 ShapeType type = shape->getType();
                 
                 // Scale based on shape type and constraint
@@ -1468,6 +2093,7 @@ void Viewport3D::mouseMoveEvent(QMouseEvent* event) {
                     default:
                         break;
                 }
+                draggedNode_->notifyChanged(NodeChange::Shape);
                 
                 // Display actual scale text with shape dimensions
                 QString scaleText;
@@ -1559,7 +2185,7 @@ void Viewport3D::mouseReleaseEvent(QMouseEvent* event) {
         if (commandStack_) {
             Transform finalTransform = draggedNode_->getTransform();
             // Restore original transform first
-            draggedNode_->getTransform() = dragStartTransform_;
+            draggedNode_->setTransform(dragStartTransform_);
             // Then execute command (which will apply the new transform)
             auto cmd = std::make_unique<TransformVolumeCommand>(draggedNode_, finalTransform);
             commandStack_->execute(std::move(cmd));
@@ -1616,22 +2242,8 @@ void Viewport3D::mouseReleaseEvent(QMouseEvent* event) {
                 return;
             }
             
-            vtkSmartPointer<vtkPropPicker> picker = vtkSmartPointer<vtkPropPicker>::New();
-            picker->Pick(x, renderWindow_->GetSize()[1] - y - 1, 0, renderer_);
+            VolumeNode* pickedNode = pickNode(x, y);
             
-            vtkActor* pickedActor = picker->GetActor();
-                VolumeNode* pickedNode = nullptr;
-            
-            if (pickedActor) {
-                // Find VolumeNode from actor
-                for (const auto& pair : actors_) {
-                    if (pair.second && pair.second.GetPointer() == pickedActor) {
-                        pickedNode = pair.first;
-                        break;
-                    }
-                    }
-                }
-                
             // Update selection
                         updateSelectionHighlight(pickedNode);
                         emit selectionChanged(pickedNode);
@@ -1687,6 +2299,26 @@ void Viewport3D::updateSelectionHighlight(VolumeNode* selectedNode) {
     // Get multi-selection from scene graph
     const auto& multiSelection = sceneGraph_ ? sceneGraph_->getMultiSelection() : std::vector<VolumeNode*>();
     
+    // Selected volumes leave their instanced group for an own actor, and go back when deselected
+    if (instancingEnabled_ && renderer_) {
+        std::vector<VolumeNode*> moved;
+        for (VolumeNode* node : multiSelection) {
+            if (instanceSlots_.count(node)) moved.push_back(node);
+        }
+        for (VolumeNode* node : selectionActors_) {
+            if (std::find(multiSelection.begin(), multiSelection.end(), node) == multiSelection.end()) {
+                moved.push_back(node);
+            }
+        }
+        for (VolumeNode* node : moved) {
+            rebuildActor(node);
+        }
+        if (!moved.empty()) {
+            flushInstanceGroups();
+        }
+    }
+    highlightedSelection_ = multiSelection;
+    
     // Reset all actors to normal appearance
     for (auto& pair : actors_) {
         if (!pair.second) continue;
@@ -1745,20 +2377,7 @@ void Viewport3D::showContextMenu(const QPoint& pos) {
     // Check if we right-clicked on an object
     int x = pos.x();
     int y = pos.y();
-    vtkSmartPointer<vtkPropPicker> picker = vtkSmartPointer<vtkPropPicker>::New();
-    picker->Pick(x, renderWindow_->GetSize()[1] - y - 1, 0, renderer_);
-    
-    vtkActor* pickedActor = picker->GetActor();
-    VolumeNode* clickedNode = nullptr;
-    
-    if (pickedActor) {
-        for (const auto& pair : actors_) {
-            if (pair.second && pair.second.GetPointer() == pickedActor) {
-                clickedNode = pair.first;
-                break;
-            }
-        }
-    }
+    VolumeNode* clickedNode = pickNode(x, y);
     
     VolumeNode* selected = sceneGraph_->getSelected();
     
@@ -2203,7 +2822,7 @@ void Viewport3D::updateGizmoPosition() {
     // Calculate object bounding box size to offset gizmos outside object
     double objectRadius = 30.0; // Default minimum offset
     if (selected->getShape()) {
-        Shape* shape = selected->getShape();
+        const Shape* shape = selected->getShape();
         switch (shape->getType()) {
             case ShapeType::Box:
                 if (auto* p = shape->getParamsAs<BoxParams>()) {
@@ -2468,7 +3087,7 @@ std::vector<Viewport3D::AlignmentGuide> Viewport3D::findAlignments(VolumeNode* m
     
     // Collect all other nodes' positions
     std::vector<QVector3D> otherPositions;
-    sceneGraph_->traverse([&](VolumeNode* node) {
+    sceneGraph_->forEach([&](const VolumeNode* node) {
         if (node != movingNode && node != sceneGraph_->getRoot() && node->getShape()) {
             otherPositions.push_back(node->getTransform().getTranslation());
         }
@@ -2572,7 +3191,7 @@ QVector3D Viewport3D::applySmartSnap(const QVector3D& pos, VolumeNode* movingNod
     QVector3D result = pos;
     
     // Collect all other nodes' positions
-    sceneGraph_->traverse([&](VolumeNode* node) {
+    sceneGraph_->forEach([&](const VolumeNode* node) {
         if (node != movingNode && node != sceneGraph_->getRoot() && node->getShape()) {
             QVector3D otherPos = node->getTransform().getTranslation();
             
@@ -1,7 +1,10 @@
 #include <QApplication>
 #include "MainWindow.hh"
 #include "../../core/include/VolumeNode.hh"
+#include "../../core/include/Serialization.hh"
 #include <QMetaType>
+#include <cstring>
+#include <iostream>
 
 Q_DECLARE_METATYPE(geantcad::VolumeNode*)
 
@@ -9,6 +12,15 @@ using namespace geantcad;
 
 int main(int argc, char *argv[])
 {
+    // Headless conversion: geantcad --convert <input> <output>
+    if (argc >= 2 && std::strcmp(argv[1], "--convert") == 0) {
+        if (argc != 4) {
+            std::cerr << "Usage: " << argv[0] << " --convert <input> <output>" << std::endl;
+            return 2;
+        }
+        return convertSceneFile(argv[2], argv[3]) ? 0 : 1;
+    }
+
     QApplication app(argc, argv);
     
     // Register VolumeNode* type for Qt6 QVariant support
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Transform.hh"
+#include <nlohmann/json.hpp>
+#include <vector>
+
+namespace geantcad {
+
+class VolumeNode;
+
+/**
+ * ArrayPattern: un volume (con i suoi figli) piazzato piu' volte nel genitore.
+ * La copia 0 e' il volume stesso, le altre sono traslate (Linear, Grid) o
+ * ruotate attorno all'asse Z del genitore (Ring). Le copie non sono nodi della
+ * scena: l'export le scrive come replica/paramvol invece di N physvol.
+ */
+struct ArrayPattern {
+    enum class Type { None, Linear, Grid, Ring };
+
+    Type type = Type::None;
+    // Linear: count[0] copies, each one shifted by step (mm, parent frame)
+    // Grid: count[0] x count[1] x count[2] copies, pitch step[i] along parent axis i
+    // Ring: count[0] copies rotated about the parent Z axis by dphi degrees
+    //       (0 = evenly over 360)
+    int count[3] = {1, 1, 1};
+    double step[3] = {0.0, 0.0, 0.0};
+    double dphi = 0.0;
+
+    bool isArray() const { return type != Type::None && copies() > 1; }
+    int copies() const;
+
+    double ringStep() const { return dphi != 0.0 ? dphi : 360.0 / count[0]; }
+
+    // Local transform (parent frame) of a copy, given the volume's own
+    Transform copyTransform(const Transform& local, int copy) const;
+
+    bool operator==(const ArrayPattern& other) const;
+    bool operator!=(const ArrayPattern& other) const { return !(*this == other); }
+
+    nlohmann::json toJson() const;
+    static ArrayPattern fromJson(const nlohmann::json& j);
+};
+
+// World placements of every copy of a node produced by its own pattern and by
+// those of its ancestors, as offsets m with copy = node->getWorldMatrix() * m.
+// The first offset is the identity (the node itself).
+std::vector<QMatrix4x4> arrayCopyOffsets(const VolumeNode* node);
+
+} // namespace geantcad
@@ -5,6 +5,7 @@
 #include "VolumeNode.hh"
 #include "Shape.hh"
 #include "Material.hh"
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -14,25 +15,86 @@ namespace geantcad {
 class CommandStack;
 
 /**
- * Concrete commands for undo/redo
+ * Riferimento a un volume tramite ID: resta valido quando il volume viene
+ * ricreato (undo di una cancellazione, ripristino di un checkpoint).
  */
+class NodeRef {
+public:
+    NodeRef() = default;
+    NodeRef(VolumeNode* node);
+    NodeRef(SceneGraph* sceneGraph, uint64_t id) : sceneGraph_(sceneGraph), id_(id) {}
+    
+    // Current node with this ID, nullptr while it is not in the scene
+    VolumeNode* get() const;
+    VolumeNode* operator->() const { return get(); }
+    explicit operator bool() const { return get() != nullptr; }
+    uint64_t getId() const { return id_; }
+    // Current name, for descriptions ("volume" while the node is gone)
+    std::string getName() const;
+
+private:
+    SceneGraph* sceneGraph_ = nullptr;
+    VolumeNode* detached_ = nullptr;  // node outside any scene graph
+    uint64_t id_ = 0;
+};
+
+/**
+ * Concrete commands for undo/redo. Volumes are referenced by ID (NodeRef), so
+ * a command still applies after the scene was restored from a checkpoint.
+ */
+
+/**
+ * Voce unica della cronologia per i comandi di una transazione
+ * (CommandStack::beginTransaction): undo in ordine inverso, redo in ordine.
+ * Le notifiche della scena sono raggruppate (SceneGraph::beginBatch).
+ */
+class MacroCommand : public Command {
+public:
+    MacroCommand(const std::string& description, SceneGraph* sceneGraph);
+    void execute() override;
+    void undo() override;
+    std::string getDescription() const override { return description_; }
+    size_t getMemoryUsage() const override;
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
+    
+    // Append a command that has already been executed
+    void add(std::unique_ptr<Command> cmd) { commands_.push_back(std::move(cmd)); }
+    bool isEmpty() const { return commands_.empty(); }
+    size_t size() const { return commands_.size(); }
+    SceneGraph* getSceneGraph() const { return sceneGraph_; }
+
+private:
+    std::string description_;
+    SceneGraph* sceneGraph_;
+    std::vector<std::unique_ptr<Command>> commands_;
+};
 
 class CreateVolumeCommand : public Command {
 public:
     CreateVolumeCommand(SceneGraph* sceneGraph, const std::string& name, 
-                       std::unique_ptr<Shape> shape, std::shared_ptr<Material> material);
+                       std::shared_ptr<const Shape> shape, std::shared_ptr<Material> material);
     void execute() override;
     void undo() override;
     std::string getDescription() const override { return "Create " + volumeName_; }
+    size_t getMemoryUsage() const override;
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
     
-    VolumeNode* getCreatedNode() const { return createdNode_; }
+    // Placement of the new volume (set before execute)
+    void setTransform(const Transform& transform) { transform_ = transform; }
+    
+    VolumeNode* getCreatedNode() const;
 
 private:
     SceneGraph* sceneGraph_;
     std::string volumeName_;
-    std::unique_ptr<Shape> shape_;
+    std::shared_ptr<const Shape> shape_;  // released once the volume is created
     std::shared_ptr<Material> material_;
-    VolumeNode* createdNode_ = nullptr;
+    Transform transform_;
+    uint64_t createdId_ = 0;
+    // The created volume (serializeSubtree): redo recreates it with its ID
+    std::vector<char> snapshot_;
 };
 
 class DeleteVolumeCommand : public Command {
@@ -41,18 +103,20 @@ public:
     void execute() override;
     void undo() override;
     std::string getDescription() const override { return "Delete " + volumeName_; }
+    size_t getMemoryUsage() const override;
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
 
 private:
     SceneGraph* sceneGraph_;
-    VolumeNode* node_;
+    uint64_t nodeId_ = 0;
+    uint64_t parentId_ = 0;
+    size_t childIndex_ = 0;
     std::string volumeName_;
-    VolumeNode* parent_;
-    size_t childIndex_;
-    std::unique_ptr<Shape> shape_;
-    std::shared_ptr<Material> material_;
-    Transform transform_;
-    std::vector<VolumeNode*> children_; // Store children for undo
-    nlohmann::json nodeJson_; // Full node state for undo
+    // Removed subtree in the compact binary format (serializeSubtree), taken
+    // on the first execute. Kept afterwards: undo may follow a checkpoint
+    // restore that skipped execute().
+    std::vector<char> snapshot_;
 };
 
 class TransformVolumeCommand : public Command {
@@ -60,10 +124,15 @@ public:
     TransformVolumeCommand(VolumeNode* node, const Transform& newTransform);
     void execute() override;
     void undo() override;
-    std::string getDescription() const override { return "Transform " + node_->getName(); }
+    std::string getDescription() const override { return "Transform " + node_.getName(); }
+    size_t getMemoryUsage() const override { return sizeof(*this); }
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
+    // Successive transforms of the same volume become one step
+    bool mergeWith(const Command& next) override;
 
 private:
-    VolumeNode* node_;
+    NodeRef node_;
     Transform oldTransform_;
     Transform newTransform_;
 };
@@ -73,14 +142,20 @@ public:
     DuplicateVolumeCommand(SceneGraph* sceneGraph, VolumeNode* sourceNode);
     void execute() override;
     void undo() override;
-    std::string getDescription() const override { return "Duplicate " + sourceNode_->getName(); }
+    std::string getDescription() const override { return "Duplicate " + source_.getName(); }
+    size_t getMemoryUsage() const override { return sizeof(*this) + snapshot_.capacity(); }
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
     
-    VolumeNode* getDuplicatedNode() const { return duplicatedNode_; }
+    VolumeNode* getDuplicatedNode() const;
 
 private:
     SceneGraph* sceneGraph_;
-    VolumeNode* sourceNode_;
-    VolumeNode* duplicatedNode_ = nullptr;
+    NodeRef source_;
+    uint64_t duplicatedId_ = 0;
+    uint64_t parentId_ = 0;
+    // The copy as first created (serializeSubtree): redo restores it with its IDs
+    std::vector<char> snapshot_;
     
     VolumeNode* duplicateNodeRecursive(VolumeNode* source);
 };
@@ -90,12 +165,17 @@ public:
     ModifyShapeCommand(VolumeNode* node, const ShapeParams& newParams);
     void execute() override;
     void undo() override;
-    std::string getDescription() const override { return "Modify Shape " + node_->getName(); }
+    std::string getDescription() const override { return "Modify Shape " + node_.getName(); }
+    size_t getMemoryUsage() const override;
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
 
 private:
-    VolumeNode* node_;
-    ShapeParams oldParams_;
-    ShapeParams newParams_;
+    NodeRef node_;
+    // Edits never touch a shape in place: the node is switched to a modified
+    // copy, so linked instances keep the original (copy-on-write)
+    std::shared_ptr<const Shape> oldShape_;
+    std::shared_ptr<const Shape> newShape_;
 };
 
 class ModifyNameCommand : public Command {
@@ -103,10 +183,13 @@ public:
     ModifyNameCommand(VolumeNode* node, const std::string& newName);
     void execute() override;
     void undo() override;
-    std::string getDescription() const override { return "Rename " + (node_ ? node_->getName() : "volume"); }
+    std::string getDescription() const override { return "Rename " + node_.getName(); }
+    size_t getMemoryUsage() const override;
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
 
 private:
-    VolumeNode* node_;
+    NodeRef node_;
     std::string oldName_;
     std::string newName_;
 };
@@ -116,10 +199,13 @@ public:
     ModifyMaterialCommand(VolumeNode* node, std::shared_ptr<Material> newMaterial);
     void execute() override;
     void undo() override;
-    std::string getDescription() const override { return "Modify Material " + (node_ ? node_->getName() : "volume"); }
+    std::string getDescription() const override { return "Modify Material " + node_.getName(); }
+    size_t getMemoryUsage() const override { return sizeof(*this); }
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
 
 private:
-    VolumeNode* node_;
+    NodeRef node_;
     std::shared_ptr<Material> oldMaterial_;
     std::shared_ptr<Material> newMaterial_;
 };
@@ -129,10 +215,13 @@ public:
     ModifySDConfigCommand(VolumeNode* node, const SensitiveDetectorConfig& newConfig);
     void execute() override;
     void undo() override;
-    std::string getDescription() const override { return "Modify SD Config " + (node_ ? node_->getName() : "volume"); }
+    std::string getDescription() const override { return "Modify SD Config " + node_.getName(); }
+    size_t getMemoryUsage() const override;
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
 
 private:
-    VolumeNode* node_;
+    NodeRef node_;
     SensitiveDetectorConfig oldConfig_;
     SensitiveDetectorConfig newConfig_;
 };
@@ -142,14 +231,53 @@ public:
     ModifyOpticalConfigCommand(VolumeNode* node, const OpticalSurfaceConfig& newConfig);
     void execute() override;
     void undo() override;
-    std::string getDescription() const override { return "Modify Optical Config " + (node_ ? node_->getName() : "volume"); }
+    std::string getDescription() const override { return "Modify Optical Config " + node_.getName(); }
+    size_t getMemoryUsage() const override { return sizeof(*this); }
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
 
 private:
-    VolumeNode* node_;
+    NodeRef node_;
     OpticalSurfaceConfig oldConfig_;
     OpticalSurfaceConfig newConfig_;
 };
 
+class ModifyVisibilityCommand : public Command {
+public:
+    ModifyVisibilityCommand(VolumeNode* node, bool visible);
+    void execute() override;
+    void undo() override;
+    std::string getDescription() const override { return (newVisible_ ? "Show " : "Hide ") + node_.getName(); }
+    size_t getMemoryUsage() const override { return sizeof(*this); }
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
+
+private:
+    NodeRef node_;
+    bool oldVisible_ = true;
+    bool newVisible_;
+};
+
+class ModifyArrayPatternCommand : public Command {
+public:
+    ModifyArrayPatternCommand(VolumeNode* node, const ArrayPattern& newPattern);
+    void execute() override;
+    void undo() override;
+    std::string getDescription() const override { return "Modify Array " + node_.getName(); }
+    size_t getMemoryUsage() const override { return sizeof(*this); }
+    nlohmann::json toJson() const override;
+    static std::unique_ptr<Command> fromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
+
+private:
+    NodeRef node_;
+    ArrayPattern oldPattern_;
+    ArrayPattern newPattern_;
+};
+
+// Command from its journal record (Command::toJson), nullptr if not valid.
+// Volumes are looked up in 'sceneGraph' by ID when the command runs.
+std::unique_ptr<Command> commandFromJson(const nlohmann::json& j, SceneGraph* sceneGraph);
+
 // Convenience command aliases (used by Inspector)
 using SetNameCommand = ModifyNameCommand;
 using SetMaterialCommand = ModifyMaterialCommand;
@@ -1,11 +1,19 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
 #include <memory>
+#include <string>
 #include <vector>
 #include <functional>
+#include <nlohmann/json.hpp>
 
 namespace geantcad {
 
+class SceneGraph;
+class MacroCommand;
+class HistoryJournal;
+
 /**
  * Command pattern per undo/redo.
  */
@@ -15,41 +23,161 @@ public:
     virtual void execute() = 0;
     virtual void undo() = 0;
     virtual std::string getDescription() const = 0;
+    
+    // Bytes held by the command for undo/redo (object and owned payloads;
+    // shapes and materials shared with the scene are not counted). May change
+    // after execute()/undo().
+    virtual size_t getMemoryUsage() const { return sizeof(Command); }
+    
+    // Coalescing: absorb 'next' (already executed) into this command, so that
+    // undo reverts both at once. Only asked for the newest entry.
+    virtual bool mergeWith(const Command& next) { (void)next; return false; }
+    
+    // Journal record (HistoryJournal, read back by commandFromJson): what redo
+    // and undo need once the command has been executed; null if unsupported
+    virtual nlohmann::json toJson() const { return nullptr; }
 };
 
 /**
- * CommandStack gestisce undo/redo.
+ * CommandStack gestisce undo/redo. La cronologia e' un ring buffer limitato
+ * dalla memoria dichiarata dai comandi: i piu' vecchi escono per primi.
+ * Con una scena associata la cronologia salva dei checkpoint (snapshot
+ * binari dei volumi), distanziati in base al costo dei comandi, per saltare
+ * a uno stato lontano senza ripetere tutti i comandi intermedi.
  */
 class CommandStack {
 public:
-    CommandStack(size_t maxHistory = 100);
+    static constexpr size_t DefaultMemoryBudget = size_t(64) << 20;
+    
+    // Consecutive mergeable commands coalesce only when issued this close together
+    static constexpr std::chrono::milliseconds MergeWindow{2000};
+    
+    // Minimum number of commands between two scene checkpoints. Beyond it a
+    // checkpoint is taken once replaying the commands since the previous one
+    // would cost more than restoring it.
+    static constexpr size_t DefaultCheckpointInterval = 32;
+    
+    // Cost model of jumps, in bytes of snapshot data: replaying a command
+    // costs its payload (getMemoryUsage) plus ReplayCommandCost, restoring a
+    // checkpoint RestoreCostFactor times its size (decode and reconciliation)
+    static constexpr size_t ReplayCommandCost = 64;
+    static constexpr size_t RestoreCostFactor = 2;
+    
+    explicit CommandStack(size_t memoryBudget = DefaultMemoryBudget);
+    ~CommandStack();
     
     void execute(std::unique_ptr<Command> cmd);
     void undo();
     void redo();
     void clear();
     
-    bool canUndo() const { return currentIndex_ > 0; }
-    bool canRedo() const { return currentIndex_ < history_.size(); }
+    // Move to the state after command 'index' (-1 = before the oldest kept),
+    // undoing/redoing as needed. When it is cheaper, the volumes are restored
+    // from the checkpoint nearest to the target (SceneGraph::restoreHierarchy)
+    // and only the commands after it replay.
+    // Notifications are batched; onHistoryChanged fires once.
+    void jumpTo(int index);
+    
+    // Scene for checkpoints and batched jumps. Checkpoints hold only what the
+    // commands did: once the scene reports a change made outside the stack
+    // (SceneGraph::getRevision), the existing ones are dropped.
+    void setSceneGraph(SceneGraph* sceneGraph);
+    // 0 disables checkpoints
+    void setCheckpointInterval(size_t commands);
+    size_t getCheckpointInterval() const { return checkpointInterval_; }
+    
+    // On-disk journal (HistoryJournal::open installs itself): executed
+    // entries, undo/redo/jumps and clear are recorded as they happen
+    void setJournal(HistoryJournal* journal) { journal_ = journal; }
+    HistoryJournal* getJournal() const { return journal_; }
+    
+    // Transactions: commands executed until commit() become one history entry
+    // (a MacroCommand, undone/redone as a whole). Nested begin/commit pairs
+    // join the outermost transaction. With a scene graph, its notifications
+    // are batched (SceneGraph::beginBatch) until the transaction ends, and
+    // again on every undo/redo of the entry.
+    void beginTransaction(const std::string& description, SceneGraph* sceneGraph = nullptr);
+    void commit();
+    // Undo what the open transaction executed and drop it (all nesting levels)
+    void rollback();
+    bool inTransaction() const { return transactionDepth_ > 0; }
     
-    const std::string& getUndoDescription() const;
-    const std::string& getRedoDescription() const;
+    bool canUndo() const { return currentIndex_ > 0 && !inTransaction(); }
+    bool canRedo() const { return currentIndex_ < count_ && !inTransaction(); }
     
-    // History access for HistoryPanel
-    const std::vector<std::unique_ptr<Command>>& getHistory() const { return history_; }
-    size_t getHistorySize() const { return history_.size(); }
+    std::string getUndoDescription() const;
+    std::string getRedoDescription() const;
+    
+    // History access for HistoryPanel (index 0 = oldest command kept)
+    const Command* getCommand(size_t index) const { return slot(index).command.get(); }
+    size_t getHistorySize() const { return count_; }
     int getCurrentIndex() const { return static_cast<int>(currentIndex_) - 1; }
     
+    // Memory budget in bytes. The most recent command is always kept, even
+    // when it alone exceeds the budget.
+    void setMemoryBudget(size_t bytes);
+    size_t getMemoryBudget() const { return memoryBudget_; }
+    size_t getMemoryUsage() const { return memoryUsage_; }  // checkpoints included
+    
     // Signals
     std::function<void()> onHistoryChanged;
 
 private:
-    std::vector<std::unique_ptr<Command>> history_;
-    size_t currentIndex_;
-    size_t maxHistory_;
+    friend class HistoryJournal;
+    
+    struct Slot {
+        std::unique_ptr<Command> command;
+        size_t bytes = 0;  // getMemoryUsage() at the last execute/undo, plus the checkpoint
+        // Volumes after this command (serializeSubtree of the root), or empty
+        std::vector<char> checkpoint;
+    };
+    
+    // Ring of power-of-two size: command i lives at (head_ + i) & mask
+    std::vector<Slot> ring_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    size_t currentIndex_ = 0;
+    size_t memoryBudget_;
+    size_t memoryUsage_ = 0;
+    
+    SceneGraph* sceneGraph_ = nullptr;
+    size_t checkpointInterval_ = DefaultCheckpointInterval;
+    uint64_t sceneRevision_ = 0;  // scene revision after the last command run by the stack
+    HistoryJournal* journal_ = nullptr;
     
+    // Open transaction
+    std::unique_ptr<MacroCommand> transaction_;
+    int transactionDepth_ = 0;
+    
+    // Time of the last execute, for MergeWindow; moved back by undo, redo
+    // and jumpTo so that they close the window
+    std::chrono::steady_clock::time_point lastExecute_;
+    
+    void append(std::unique_ptr<Command> cmd);
+    void push(std::unique_ptr<Command> cmd);
+    bool mergeIntoNewest(const Command& cmd);
+    
+    // Journal replay: an executed entry as recorded (merged or pushed), and a
+    // whole history whose first 'currentIndex' entries the scene already shows
+    void replayExecute(std::unique_ptr<Command> cmd, bool merged);
+    void adoptHistory(std::vector<std::unique_ptr<Command>> commands, size_t currentIndex);
+    void dropRedo();
+    
+    Slot& slot(size_t index) { return ring_[(head_ + index) & (ring_.size() - 1)]; }
+    const Slot& slot(size_t index) const { return ring_[(head_ + index) & (ring_.size() - 1)]; }
+    void remeasure(Slot& s);
+    static size_t replayCost(const Slot& s);
+    static size_t restoreCost(const Slot& s) { return RestoreCostFactor * s.checkpoint.size(); }
+    void updateCheckpoint();
+    void dropCheckpoints();
+    // Drop the checkpoints if the scene was edited since recordSceneRevision
+    void checkSceneRevision();
+    void recordSceneRevision();
+    void closeMergeWindow();
+    void step(size_t state);
+    void dropOldest();
+    void trimToBudget();
     void notifyHistoryChanged();
 };
 
 } // namespace geantcad
-
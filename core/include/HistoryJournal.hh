@@ -0,0 +1,148 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace geantcad {
+
+class Command;
+class CommandStack;
+class SceneGraph;
+
+/**
+ * Statistiche del journal (contate dal thread di scrittura).
+ */
+struct JournalStats {
+    size_t records = 0;       // records appended to the log
+    size_t bytes = 0;         // bytes written, compactions included
+    size_t syncs = 0;         // fsync calls, one per batch of records
+    size_t compactions = 0;
+    size_t failures = 0;      // failed writes, syncs and compactions
+    size_t dropped = 0;       // records not written because the log was unusable
+};
+
+/**
+ * HistoryJournal registra la sessione su disco per il recupero dopo un crash.
+ * Il log è append-only: una base (snapshot binario della scena con la
+ * cronologia dei comandi) seguita dai comandi eseguiti e dagli spostamenti
+ * di undo/redo. Il thread della UI si limita a preparare i record e ad
+ * accodarli; un thread di scrittura li codifica e li scrive con un solo
+ * fsync per gruppo.
+ * Quando il log cresce viene compattato in una nuova base, scritta a parte
+ * e sostituita atomicamente.
+ *
+ * Le modifiche fatte fuori dalla CommandStack (es. configurazioni di fisica
+ * e output) entrano nel journal solo alla compattazione successiva.
+ *
+ * Dopo un errore di scrittura il log non riceve piu' record: il record
+ * successivo chiede una nuova base, che riprende da capo lo stato corrente.
+ */
+class HistoryJournal {
+public:
+    static constexpr size_t DefaultCompactThreshold = size_t(4) << 20;
+
+    HistoryJournal();
+    ~HistoryJournal();
+
+    // Journal kept in 'directory' (created if missing) for 'sceneGraph' edited
+    // through 'commandStack', which records into it from now on. Nothing is
+    // written before start() or recover().
+    bool open(const std::string& directory, SceneGraph* sceneGraph, CommandStack* commandStack);
+    // Waits for the writer; 'discard' removes the log (clean exit, nothing to recover)
+    void close(bool discard);
+    bool isOpen() const { return sceneGraph_ != nullptr; }
+    const std::string& getDirectory() const { return directory_; }
+
+    // True when 'directory' holds a log left by a session that didn't close
+    static bool hasJournal(const std::string& directory);
+
+    // Begin the log with the current scene and history
+    void start() { compact(); }
+    // Rebuild the scene and the history from the log found in the directory,
+    // then keep journaling into it. A torn or corrupt tail is dropped.
+    bool recover();
+
+    // Called by CommandStack as the history changes
+    void recordExecute(const Command& cmd, bool merged);
+    void recordMove(int delta);
+    void recordClear();
+
+    // Replace the log with a new base (current scene and history). The scene
+    // is serialized here, the rest is encoded and swapped in by the writer.
+    void compact();
+    // Compact once the records appended since the last base exceed this
+    // (or the base itself, whichever is larger)
+    void setCompactThreshold(size_t bytes) { compactThreshold_ = bytes; }
+    size_t getCompactThreshold() const { return compactThreshold_; }
+
+    // Block until everything queued so far is handled. False while the log
+    // can't be written: the session is then only in memory until a new base
+    // is written.
+    bool flush();
+
+    JournalStats getStats() const;
+    // Errors of open/recover, or of the writer when it failed more recently
+    std::string getLastError() const;
+
+private:
+    enum RecordType : uint8_t {
+        BaseRecord = 1,     // serializeScene bytes
+        HistoryRecord = 2,  // CBOR {commands, current}
+        ExecuteRecord = 3,  // CBOR {command, merged}
+        MoveRecord = 4,     // CBOR {delta}: undo/redo/jump, relative to the current state
+        ClearRecord = 5
+    };
+
+    // The UI thread only builds the JSON; CBOR, framing and CRCs are the writer's
+    struct Job {
+        bool compact = false;    // 'data' starts a whole new log replacing the current one
+        std::vector<char> data;  // records already framed (compaction: header + base)
+        RecordType type = ClearRecord;
+        nlohmann::json record;   // payload of the record appended to 'data'
+    };
+
+    std::string logPath() const;
+    void appendRecord(RecordType type, nlohmann::json record);
+    // Returns true when the log has grown enough to be compacted
+    bool enqueue(Job job);
+    void startWriter();
+    void stopWriter();
+
+    // Writer thread
+    void writerLoop();
+    bool writeJob(Job& job, std::string& error);
+    bool replaceLog(const std::vector<char>& data, std::string& error);
+
+    SceneGraph* sceneGraph_ = nullptr;
+    CommandStack* commandStack_ = nullptr;
+    std::string directory_;
+    bool started_ = false;
+    size_t compactThreshold_ = DefaultCompactThreshold;
+    std::string lastError_;
+
+    std::thread writer_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;    // jobs queued or stop requested
+    std::condition_variable synced_;  // syncedSeq_ moved
+    std::deque<Job> queue_;
+    uint64_t queuedSeq_ = 0;
+    uint64_t syncedSeq_ = 0;
+    bool stop_ = false;
+    bool writerIdle_ = false;     // waiting on wake_, so a new job must notify
+    bool compactQueued_ = false;
+    bool rebase_ = false;         // the log can't be appended to: the next record asks for a base
+    std::string writerError_;
+    size_t baseBytes_ = 0;        // size of the current base
+    size_t appendedBytes_ = 0;    // records written after it
+    int fd_ = -1;  // log being appended to, owned by the writer
+    JournalStats stats_;
+};
+
+} // namespace geantcad
@@ -129,6 +129,11 @@ public:
     const Visual& getVisual() const { return visual_; }
     Visual& getVisual() { return visual_; }
     
+    // Content identity: every property, visual included. Materials with
+    // sameContent() are interchangeable (MaterialRegistry shares them).
+    size_t contentHash() const;
+    bool sameContent(const Material& other) const;
+    
     // Serialization
     nlohmann::json toJson() const;
     static std::shared_ptr<Material> fromJson(const nlohmann::json& j);
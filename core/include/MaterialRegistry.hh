@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Material.hh"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace geantcad {
+
+/**
+ * MaterialRegistry: tabella dei materiali deduplicati per contenuto.
+ *
+ * intern() restituisce l'istanza canonica di un materiale (registrandolo se
+ * nuovo): materiali con lo stesso contenuto diventano un unico shared_ptr.
+ * Ogni materiale ha un id stabile (posizione nella tabella), usato dai volumi
+ * serializzati per riferirsi alla tabella scritta una sola volta.
+ *
+ * Un materiale registrato puo' essere condiviso da piu' volumi: non va
+ * modificato in place. Una modifica (es. colore) si applica a una copia,
+ * assegnata al solo volume interessato (ModifyMaterialCommand).
+ */
+class MaterialRegistry {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Canonical instance with the same content (the material itself if new)
+    std::shared_ptr<Material> intern(const std::shared_ptr<Material>& material);
+
+    // Table id of a material with the same content, npos if none
+    size_t indexOf(const Material* material) const;
+    std::shared_ptr<Material> at(size_t index) const;
+
+    const std::vector<std::shared_ptr<Material>>& getMaterials() const { return materials_; }
+    size_t size() const { return materials_.size(); }
+    bool empty() const { return materials_.empty(); }
+    void clear();
+
+    // Table serialization: one entry per material, components that reference
+    // another material by name are resolved within the table
+    nlohmann::json toJson() const;
+    static MaterialRegistry fromJson(const nlohmann::json& j);
+
+private:
+    std::vector<std::shared_ptr<Material>> materials_;
+    std::unordered_map<size_t, std::vector<size_t>> byHash_;     // contentHash at insertion -> ids
+    std::unordered_map<const Material*, size_t> byPointer_;      // canonical instances -> ids
+
+    size_t find(const Material& material) const;
+};
+
+} // namespace geantcad
@@ -1,12 +1,18 @@
 #pragma once
 
 #include "VolumeNode.hh"
+#include "MaterialRegistry.hh"
+#include "SpatialIndex.hh"
+#include "SceneTraversal.hh"
 #include "PhysicsConfig.hh"
 #include "OutputConfig.hh"
 #include "ParticleGunConfig.hh"
 #include <memory>
 #include <vector>
 #include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <nlohmann/json.hpp>
 
 namespace geantcad {
@@ -26,8 +32,18 @@ public:
     // Node operations
     VolumeNode* createVolume(const std::string& name);
     void removeVolume(VolumeNode* node);
+    // Make the volumes match 'target', a detached copy of the hierarchy (e.g.
+    // deserializeSubtree of the root), pairing volumes by ID: missing ones are
+    // created, extra ones removed, the others moved/updated in place. Batched.
+    void restoreHierarchy(const VolumeNode& target);
+    // O(1) lookups backed by indexes maintained on attach/detach/rename.
+    // findVolumeByName returns the first volume with the name in pre-order
+    // (volumes sharing it are compared along their ancestor paths);
+    // findVolumesByName returns all of them in no particular order.
     VolumeNode* findVolumeById(uint64_t id);
     VolumeNode* findVolumeByName(const std::string& name);
+    const std::vector<VolumeNode*>& findVolumesByName(const std::string& name) const;
+    size_t getVolumeCount() const { return idIndex_.size(); }
     
     // Selection (single and multi)
     VolumeNode* getSelected() const { return selected_; }
@@ -42,7 +58,36 @@ public:
     bool isSelected(VolumeNode* node) const;
     void clearMultiSelection();
 
-    // Traversal
+    // World-space BVH over the volumes (ray/box/nearest queries). Rebuilt when
+    // the structure changes, refitted for the transform and shape changes
+    // reported since the previous call.
+    const SpatialIndex& getSpatialIndex();
+
+    // Traversal (iterative, see SceneTraversal.hh). A visitor returning true stops
+    // the walk; the node where it stopped is returned, nullptr otherwise.
+    template<class F> VolumeNode* forEach(F&& visitor) {
+        return traversal::preOrder(root_.get(), std::forward<F>(visitor));
+    }
+    template<class F> const VolumeNode* forEach(F&& visitor) const {
+        return traversal::preOrder(static_cast<const VolumeNode*>(root_.get()), std::forward<F>(visitor));
+    }
+    template<class F> VolumeNode* forEachPostOrder(F&& visitor) {
+        return traversal::postOrder(root_.get(), std::forward<F>(visitor));
+    }
+    template<class F> const VolumeNode* forEachPostOrder(F&& visitor) const {
+        return traversal::postOrder(static_cast<const VolumeNode*>(root_.get()), std::forward<F>(visitor));
+    }
+    template<class Pred> VolumeNode* findIf(Pred&& pred) {
+        return traversal::findFirst(root_.get(), std::forward<Pred>(pred));
+    }
+    template<class Pred> const VolumeNode* findIf(Pred&& pred) const {
+        return traversal::findFirst(static_cast<const VolumeNode*>(root_.get()), std::forward<Pred>(pred));
+    }
+
+    // Refresh every dirty cached world transform in one top-down pass
+    void updateWorldTransforms() const { if (root_) root_->updateWorldTransforms(); }
+
+    // Type-erased variants, kept for callers that store the visitor (e.g. bindings)
     void traverse(std::function<void(VolumeNode*)> visitor);
     void traverseConst(std::function<void(const VolumeNode*)> visitor) const;
 
@@ -58,27 +103,106 @@ public:
     ParticleGunConfig& getParticleGunConfig() { return particleGunConfig_; }
     const ParticleGunConfig& getParticleGunConfig() const { return particleGunConfig_; }
 
-    // Serialization
+    // Materials used by the scene, shared by content. Filled on load; volumes
+    // edited afterwards keep their own instances until internMaterials().
+    MaterialRegistry& getMaterialRegistry() { return materials_; }
+    const MaterialRegistry& getMaterialRegistry() const { return materials_; }
+    
+    // Rebuild the registry from the volumes, making volumes with equal material
+    // content share one instance. Returns the number of distinct materials.
+    size_t internMaterials();
+
+    // Linked instances: volumes sharing one shape object (duplicates and
+    // patterns share the source shape, an edit gives the edited volume its
+    // own copy). The result includes the node itself.
+    std::vector<VolumeNode*> getLinkedInstances(const VolumeNode* node);
+
+    // Make volumes with identical shapes (geometry and name) share one shape
+    // object. Returns the number of distinct shapes.
+    size_t internShapes();
+
+    // Serialization: materials are written once in a "materials" table and
+    // referenced by id from the volumes
     nlohmann::json toJson() const;
     void fromJson(const nlohmann::json& j);
 
     // Signals (per integrazione con GUI - usando std::function per MVP)
+    // onNodeAdded/onNodeRemoved fire for every node entering/leaving the scene
+    // (subtrees included, parents first); onNodeRemoved fires while the node is
+    // still alive. onNodeChanged fires once the new value is written.
     std::function<void(VolumeNode*)> onSelectionChanged;
     std::function<void(VolumeNode*)> onNodeAdded;
     std::function<void(VolumeNode*)> onNodeRemoved;
+    std::function<void(VolumeNode*, NodeChange)> onNodeChanged;
     std::function<void()> onGraphChanged;
 
+    // Notification batching (nestable): between beginBatch() and the outermost
+    // endBatch() added/changed notifications are merged and delivered at the
+    // end (parents first, one onNodeChanged per node and change kind) and
+    // onGraphChanged fires at most once. onNodeRemoved stays immediate; nodes
+    // added and removed inside the batch are not reported at all.
+    void beginBatch() { ++batchDepth_; }
+    void endBatch();
+    bool isBatching() const { return batchDepth_ > 0; }
+    
+    // Incremented by every reported volume change (added, removed, changed;
+    // batched or not), so observers can tell whether the scene was edited
+    uint64_t getRevision() const { return revision_; }
+
 private:
+    friend class VolumeNode;
+    friend class BinarySceneLoader;
+    friend class JsonSceneLoader;
+    friend class GDMLImporter;
+
     std::unique_ptr<VolumeNode> root_;
     VolumeNode* selected_ = nullptr;
     std::vector<VolumeNode*> multiSelection_;  // Multiple selected nodes
     PhysicsConfig physicsConfig_;
     OutputConfig outputConfig_;
     ParticleGunConfig particleGunConfig_;
+    MaterialRegistry materials_;
+    
+    // Lookup indexes (id -> node, name -> nodes; VolumeNode::nameSlot_ is the
+    // position of a node in its list, for O(1) removal)
+    std::unordered_map<uint64_t, VolumeNode*> idIndex_;
+    std::unordered_map<std::string, std::vector<VolumeNode*>> nameIndex_;
+    
+    // Bumped when volumes are attached/detached or shapes replaced
+    uint64_t structureVersion_ = 0;
+    
+    // Spatial index, rebuilt when structureVersion_ moves past spatialVersion_,
+    // plus the nodes to refit
+    SpatialIndex spatialIndex_;
+    uint64_t spatialVersion_ = 0;
+    bool spatialBuilt_ = false;
+    std::unordered_map<VolumeNode*, uint32_t> spatialDirty_;  // NodeChange bitmask
+    
+    uint64_t revision_ = 0;
+    
+    // Notifications held back by beginBatch
+    int batchDepth_ = 0;
+    std::vector<VolumeNode*> batchAdded_;                   // in notification order
+    std::unordered_set<VolumeNode*> batchAddedSet_;         // not yet removed again
+    std::vector<VolumeNode*> batchChangedOrder_;
+    std::unordered_map<VolumeNode*, uint32_t> batchChanges_;  // NodeChange bitmask
+    bool batchGraphChanged_ = false;
+    
+    void setRoot(std::unique_ptr<VolumeNode> root);
+    // Replace the scene with a loaded hierarchy; 'j' supplies selectedId and the
+    // simulation configs as written by toJson (missing keys are left untouched)
+    void adoptLoadedScene(std::unique_ptr<VolumeNode> root, const nlohmann::json& j);
+    void markStructureChanged() { ++structureVersion_; }
+    void indexNode(VolumeNode* node);
+    void unindexNode(VolumeNode* node);
+    void reindexName(VolumeNode* node, const std::string& oldName);
+    void addName(VolumeNode* node);
+    void removeName(VolumeNode* node, const std::string& name);
     
     void notifySelectionChanged();
     void notifyNodeAdded(VolumeNode* node);
     void notifyNodeRemoved(VolumeNode* node);
+    void notifyNodeChanged(VolumeNode* node, NodeChange change);
     void notifyGraphChanged();
 };
 
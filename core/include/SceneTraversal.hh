@@ -0,0 +1,167 @@
+#pragma once
+
+#include "VolumeNode.hh"
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace geantcad {
+
+/**
+ * Traversal iterativa della gerarchia, templata sul visitor (nessun std::function,
+ * nessuna ricorsione: profondita' arbitraria senza rischio di stack overflow).
+ *
+ * Il visitor puo' essere:
+ *   void(Node*)                 - visita semplice
+ *   void(Node*, size_t depth)   - riceve anche la profondita' (root = 0)
+ *   bool(Node*[, size_t])       - early exit: restituire true interrompe la visita
+ *
+ * Il visitor non deve aggiungere/rimuovere figli durante la visita.
+ */
+namespace traversal {
+
+namespace detail {
+
+    template<class Node>
+    struct Frame {
+        Node* node;
+        VolumeNode* const* next;  // next child to visit
+        VolumeNode* const* end;
+    };
+
+    constexpr size_t InlineDepth = 64;
+
+    // Move the frames to a buffer twice as large; returns the new base
+    template<class Node>
+    Frame<Node>* grow(std::vector<Frame<Node>>& heap, Frame<Node>* base, size_t size) {
+        std::vector<Frame<Node>> bigger(size * 2);
+        std::copy(base, base + size, bigger.begin());
+        heap.swap(bigger);
+        return heap.data();
+    }
+
+    template<class Node>
+    Frame<Node> makeFrame(Node* node) {
+        const auto& children = node->getChildren();
+        return {node, children.data(), children.data() + children.size()};
+    }
+
+    // Invoke a visitor with or without depth; true means "stop"
+    template<class Node, class F>
+    bool invoke(F& visitor, Node* node, size_t depth) {
+        if constexpr (std::is_invocable_v<F&, Node*, size_t>) {
+            using R = std::invoke_result_t<F&, Node*, size_t>;
+            if constexpr (std::is_convertible_v<R, bool>) {
+                return static_cast<bool>(visitor(node, depth));
+            } else {
+                visitor(node, depth);
+                return false;
+            }
+        } else {
+            using R = std::invoke_result_t<F&, Node*>;
+            if constexpr (std::is_convertible_v<R, bool>) {
+                return static_cast<bool>(visitor(node));
+            } else {
+                visitor(node);
+                return false;
+            }
+        }
+    }
+
+} // namespace detail
+
+// The frame stack lives in locals (inline storage for typical depths, heap beyond):
+// keeping the pointers out of memory lets them stay in registers across visitor calls.
+
+/**
+ * Pre-order (parent before children). Returns the node at which the visitor
+ * requested a stop, or nullptr if the whole subtree was visited.
+ */
+template<class Node, class F>
+Node* preOrder(Node* root, F&& visitor) {
+    using detail::Frame;
+    if (!root) return nullptr;
+    if (detail::invoke(visitor, root, 0)) return root;
+    if (root->getChildren().empty()) return nullptr;
+
+    // Only nodes with children get a frame, so leaves cost a single visit.
+    // The cursor of the top frame is kept in next/end and saved on push.
+    Frame<Node> inlineFrames[detail::InlineDepth];
+    std::vector<Frame<Node>> heap;
+    Frame<Node>* base = inlineFrames;
+    size_t capacity = detail::InlineDepth;
+    size_t size = 1;
+    base[0] = detail::makeFrame(root);
+    VolumeNode* const* next = base[0].next;
+    VolumeNode* const* end = base[0].end;
+
+    for (;;) {
+        if (next == end) {
+            if (--size == 0) break;
+            next = base[size - 1].next;
+            end = base[size - 1].end;
+            continue;
+        }
+        Node* child = *next++;
+        if (detail::invoke(visitor, child, size)) return child;
+        const auto& children = child->getChildren();
+        if (!children.empty()) {
+            base[size - 1].next = next;
+            if (size == capacity) {
+                base = detail::grow(heap, base, size);
+                capacity *= 2;
+            }
+            base[size++] = detail::makeFrame(child);
+            next = children.data();
+            end = next + children.size();
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Post-order (children before parent), same early-exit contract as preOrder.
+ */
+template<class Node, class F>
+Node* postOrder(Node* root, F&& visitor) {
+    using detail::Frame;
+    if (!root) return nullptr;
+
+    Frame<Node> inlineFrames[detail::InlineDepth];
+    std::vector<Frame<Node>> heap;
+    Frame<Node>* base = inlineFrames;
+    size_t capacity = detail::InlineDepth;
+    size_t size = 0;
+    base[size++] = detail::makeFrame(root);
+
+    while (size > 0) {
+        Frame<Node>& frame = base[size - 1];
+        if (frame.next != frame.end) {
+            Node* child = *frame.next++;
+            if (size == capacity) {
+                base = detail::grow(heap, base, size);
+                capacity *= 2;
+            }
+            base[size++] = detail::makeFrame(child);
+        } else {
+            Node* node = frame.node;
+            --size;
+            if (detail::invoke(visitor, node, size)) return node;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * First node (pre-order) for which the predicate returns true.
+ */
+template<class Node, class Pred>
+Node* findFirst(Node* root, Pred&& pred) {
+    return preOrder(root, [&](Node* node) -> bool { return pred(node); });
+}
+
+} // namespace traversal
+
+} // namespace geantcad
@@ -1,19 +1,69 @@
 #pragma once
 
 #include "SceneGraph.hh"
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace geantcad {
 
 /**
- * Save scene graph to JSON file
+ * Save scene graph to file: a project directory (JSON), a legacy .json file,
+ * or a binary .gcadb file, chosen by the extension
  */
 bool saveSceneToFile(SceneGraph* sceneGraph, const std::string& filePath);
 
 /**
- * Load scene graph from JSON file
+ * Load scene graph from a project directory, a JSON file or a binary file
+ * (detected by its header)
  */
 bool loadSceneFromFile(SceneGraph* sceneGraph, const std::string& filePath);
 
+/**
+ * Progress of a load in bytes of the scene file; return false to cancel
+ * (the scene is left untouched)
+ */
+using LoadProgressCallback = std::function<bool(size_t bytesRead, size_t totalBytes)>;
+
+bool loadSceneFromFile(SceneGraph* sceneGraph, const std::string& filePath, const LoadProgressCallback& progress);
+
+/**
+ * Load a scene JSON file (scene.json or a legacy single file) through a SAX
+ * parser: volumes are built as the file is read, without the whole document DOM
+ */
+bool loadSceneFromJson(SceneGraph* sceneGraph, const std::string& filePath,
+                       const LoadProgressCallback& progress = nullptr);
+
+/**
+ * Formato binario (.gcadb): tabelle a record fissi caricate da un file mappato
+ * in memoria, senza parsing per nodo. Il JSON resta il formato di interscambio.
+ */
+bool saveSceneToBinary(SceneGraph* sceneGraph, const std::string& filePath);
+bool loadSceneFromBinary(SceneGraph* sceneGraph, const std::string& filePath);
+bool isBinarySceneFile(const std::string& filePath);
+
+/**
+ * Sottoalbero di volumi nello stesso formato binario (senza impostazioni di
+ * simulazione), per gli snapshot in memoria dell'undo. deserializeSubtree
+ * restituisce la gerarchia staccata, con gli ID originali; nullptr se i
+ * dati non sono validi.
+ */
+std::vector<char> serializeSubtree(const VolumeNode& node);
+std::unique_ptr<VolumeNode> deserializeSubtree(const std::vector<char>& bytes);
+
+/**
+ * Scena completa (volumi e impostazioni) nel formato binario, in memoria: la
+ * base del journal della cronologia. deserializeScene sostituisce la scena.
+ */
+std::vector<char> serializeScene(const SceneGraph& sceneGraph);
+bool deserializeScene(SceneGraph* sceneGraph, const std::vector<char>& bytes);
+
+/**
+ * Convert between formats (JSON project or file <-> binary), by output extension
+ */
+bool convertSceneFile(const std::string& inputPath, const std::string& outputPath);
+
 } // namespace geantcad
 
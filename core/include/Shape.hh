@@ -161,6 +161,16 @@ public:
     ShapeParams& getParams() { return params_; }
     const ShapeParams& getParams() const { return params_; }
 
+    // Geometry identity: type + parameters (the name is not part of it).
+    // Shapes with sameGeometry() can share tessellations, solids, etc.
+    size_t geometryHash() const;
+    bool sameGeometry(const Shape& other) const;
+
+    // Axis-aligned bounds in the shape's local frame (mm), conservative for
+    // phi/theta segments. False when unknown (boolean solids reference their
+    // operands by name).
+    bool localBounds(double min[3], double max[3]) const;
+
     // Serialization
     virtual nlohmann::json toJson() const;
     static std::unique_ptr<Shape> fromJson(const nlohmann::json& j);
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace geantcad {
+
+class VolumeNode;
+
+/**
+ * Axis-aligned bounding box in world coordinates (mm).
+ */
+struct Aabb {
+    QVector3D min{std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    QVector3D max{-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+
+    Aabb() = default;
+    Aabb(const QVector3D& lo, const QVector3D& hi) : min(lo), max(hi) {}
+
+    bool isValid() const { return min.x() <= max.x() && min.y() <= max.y() && min.z() <= max.z(); }
+    QVector3D center() const { return (min + max) * 0.5f; }
+
+    void expand(const QVector3D& p);
+    void expand(const Aabb& other);
+    bool intersects(const Aabb& other) const;
+    bool contains(const QVector3D& p) const;
+    float distanceSquared(const QVector3D& p) const;  // 0 inside
+
+    // Entry distance of the ray origin + t*dir (t in [0, maxT]), or -1 on a miss
+    float rayEntry(const QVector3D& origin, const QVector3D& invDir, float maxT) const;
+
+    // Box of a local-frame box mapped through an affine matrix
+    static Aabb transformed(const double localMin[3], const double localMax[3], const QMatrix4x4& matrix);
+
+    friend bool operator==(const Aabb& a, const Aabb& b) { return a.min == b.min && a.max == b.max; }
+    friend bool operator!=(const Aabb& a, const Aabb& b) { return !(a == b); }
+};
+
+/**
+ * SpatialIndex: bounding-volume hierarchy sui box world-space dei VolumeNode.
+ *
+ * Costruita con split mediano sull'asse piu' lungo (albero bilanciato, profondita'
+ * log2(n)); le modifiche di trasformazione/shape vengono assorbite con un refit
+ * incrementale (solo le foglie toccate e i loro antenati). La topologia resta
+ * quella del build: dopo molti spostamenti grandi conviene ricostruire.
+ *
+ * SceneGraph::getSpatialIndex() la mantiene aggiornata; il nodo root (world) e i
+ * volumi senza bounds noti (boolean solid) non sono indicizzati. Ogni copia di
+ * un array (arrayCopyOffsets) ha il suo box; le query riportano un volume una
+ * sola volta, con la copia piu' vicina.
+ */
+class SpatialIndex {
+public:
+    struct RayHit {
+        VolumeNode* node;
+        float distance;  // along the normalized ray direction, 0 if the origin is inside
+    };
+    struct Neighbor {
+        VolumeNode* node;
+        float distance;  // from the query point to the box, 0 inside
+    };
+    using Filter = std::function<bool(const VolumeNode*)>;
+
+    // Index every node of the subtree except the root itself
+    void build(VolumeNode* root);
+    void clear();
+
+    size_t size() const { return items_.size(); }  // boxes, array copies included
+    bool empty() const { return items_.empty(); }
+    bool contains(const VolumeNode* node) const { return itemIndex_.count(node) != 0; }
+
+    // World box of an indexed node, copy 0 for arrays (invalid box if not indexed)
+    Aabb bounds(const VolumeNode* node) const;
+    Aabb sceneBounds() const { return nodes_.empty() ? Aabb() : nodes_[0].bounds; }
+
+    // Incremental update: re-read the node's world box, then refit() once
+    // for the whole batch. World transforms must be up to date. Returns false
+    // if the node is not indexed but now has bounds, or if its number of array
+    // copies changed (a rebuild is needed).
+    bool updateNode(const VolumeNode* node);
+    void refit();
+
+    // Queries. Box tests are conservative (world boxes, not exact solids).
+    void queryBox(const Aabb& box, std::vector<VolumeNode*>& out) const;
+    void queryRay(const QVector3D& origin, const QVector3D& direction, float maxDistance,
+                  std::vector<RayHit>& hits) const;  // sorted by distance
+    bool raycast(const QVector3D& origin, const QVector3D& direction, float maxDistance,
+                 RayHit& hit, const Filter& accept = nullptr) const;
+    VolumeNode* nearest(const QVector3D& point, float* distance = nullptr,
+                        const Filter& accept = nullptr) const;
+    void kNearest(const QVector3D& point, size_t k, std::vector<Neighbor>& out,
+                  const Filter& accept = nullptr) const;
+
+    // Depth of the tree (0 when empty); bounded by log2(size) + 1
+    size_t depth() const;
+
+private:
+    using Index = uint32_t;
+    static constexpr Index InvalidIndex = std::numeric_limits<Index>::max();
+    static constexpr size_t MaxLeafSize = 4;
+    static constexpr size_t MaxDepth = 64;
+
+    struct Item {
+        VolumeNode* node;
+        Aabb bounds;
+        Index leaf;
+        Index copy;  // array copy of the node
+    };
+    // Internal: children at index + 1 and right. Leaf: items [first, first + count).
+    struct Node {
+        Aabb bounds;
+        Index parent;
+        Index right;
+        Index first;
+        Index count;  // 0 for internal nodes
+        bool isLeaf() const { return count != 0; }
+    };
+
+    Index buildRange(Index first, Index last, Index parent);
+    // World boxes of every array copy of the node (none without known bounds)
+    static void worldBounds(const VolumeNode* node, bool inArray, std::vector<Aabb>& boxes);
+    static bool inArray(const VolumeNode* node);
+
+    std::vector<Item> items_;
+    std::vector<Node> nodes_;
+    std::unordered_map<const VolumeNode*, Index> itemIndex_;                // copy 0
+    std::unordered_map<const VolumeNode*, std::vector<Index>> copyItems_;   // copies 1..n-1
+    std::vector<Aabb> boxScratch_;
+    std::vector<Index> dirtyLeaves_;
+};
+
+} // namespace geantcad
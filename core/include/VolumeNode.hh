@@ -3,6 +3,7 @@
 #include "Transform.hh"
 #include "Shape.hh"
 #include "Material.hh"
+#include "ArrayPattern.hh"
 #include <string>
 #include <memory>
 #include <vector>
@@ -10,6 +11,9 @@
 
 namespace geantcad {
 
+class SceneGraph;
+class MaterialRegistry;
+
 /**
  * Scorer configuration for MultiFunctionalDetector
  */
@@ -41,6 +45,9 @@ struct SensitiveDetectorConfig {
     int nBinsX = 10;
     int nBinsY = 10;
     int nBinsZ = 10;
+    
+    nlohmann::json toJson() const;
+    static SensitiveDetectorConfig fromJson(const nlohmann::json& j);
 };
 
 /**
@@ -53,6 +60,22 @@ struct OpticalSurfaceConfig {
     double reflectivity = 0.95;
     double sigmaAlpha = 0.0; // surface roughness (degrees)
     std::string preset = ""; // "tyvek", "esr", "black"
+    
+    nlohmann::json toJson() const;
+    static OpticalSurfaceConfig fromJson(const nlohmann::json& j);
+};
+
+/**
+ * Tipi di modifica di un nodo, notificati tramite SceneGraph::onNodeChanged
+ * (usabili come bitmask).
+ */
+enum class NodeChange : uint32_t {
+    Transform  = 1u << 0,  // local transform (world transforms of the subtree change too)
+    Shape      = 1u << 1,
+    Material   = 1u << 2,
+    Visibility = 1u << 3,
+    Name       = 1u << 4,
+    Array      = 1u << 5   // array pattern (placements of the copies)
 };
 
 /**
@@ -66,33 +89,42 @@ public:
 
     // Identity
     const std::string& getName() const { return name_; }
-    void setName(const std::string& name) { name_ = name; }
+    void setName(const std::string& name);
     
     uint64_t getId() const { return id_; }
 
+    // Owning scene graph (nullptr while the node is detached)
+    SceneGraph* getSceneGraph() const { return sceneGraph_; }
+
     // Hierarchy
     VolumeNode* getParent() const { return parent_; }
     const std::vector<VolumeNode*>& getChildren() const { return children_; }
     void setParent(VolumeNode* parent);
     void addChild(VolumeNode* child);
+    // addChild, placed at 'index' among the children (clamped)
+    void insertChild(size_t index, VolumeNode* child);
     void removeChild(VolumeNode* child);
     bool isDescendantOf(const VolumeNode* ancestor) const;
 
-    // Geometry
-    std::unique_ptr<Shape> shape_;
-    Transform transform_;
+    // Geometry. A shape is immutable once attached and can be shared by several
+    // volumes (linked instances, see SceneGraph::getLinkedInstances).
+    // editShape() gives this volume its own copy first if the shape is shared.
+    std::shared_ptr<const Shape> shape_;
     
-    Shape* getShape() { return shape_.get(); }
     const Shape* getShape() const { return shape_.get(); }
-    void setShape(std::unique_ptr<Shape> shape);
+    const std::shared_ptr<const Shape>& getSharedShape() const { return shape_; }
+    Shape* editShape();
+    void setShape(std::shared_ptr<const Shape> shape);
     
-    Transform& getTransform() { return transform_; }
+    // Local transform. Writes go through setTransform, which marks the cached
+    // world transforms of the subtree dirty and notifies the scene.
     const Transform& getTransform() const { return transform_; }
+    void setTransform(const Transform& transform);
 
     // Material
     std::shared_ptr<Material> material_;
     std::shared_ptr<Material> getMaterial() const { return material_; }
-    void setMaterial(std::shared_ptr<Material> material) { material_ = material; }
+    void setMaterial(std::shared_ptr<Material> material);
 
     // Sensitive Detector
     SensitiveDetectorConfig sdConfig_;
@@ -104,23 +136,65 @@ public:
     const OpticalSurfaceConfig& getOpticalConfig() const { return opticalConfig_; }
     OpticalSurfaceConfig& getOpticalConfig() { return opticalConfig_; }
 
+    // Array pattern: the volume is placed several times in its parent
+    ArrayPattern arrayPattern_;
+    const ArrayPattern& getArrayPattern() const { return arrayPattern_; }
+    void setArrayPattern(const ArrayPattern& pattern);
+
     // Visibility (for viewport display, not affecting export)
     bool isVisible() const { return visible_; }
-    void setVisible(bool visible) { visible_ = visible; }
-
-    // World transform (combines all parent transforms)
-    Transform getWorldTransform() const;
+    void setVisible(bool visible);
+    
+    // Report an in-place edit (shape parameters, material properties) that
+    // bypassed the setters, so scene listeners can update
+    void notifyChanged(NodeChange change);
+
+    // World transform (combines all parent transforms). Cached per node and
+    // recomputed lazily after a local transform change or a reparent.
+    // Not thread-safe while dirty: call updateWorldTransforms() before sharing
+    // the hierarchy between threads.
+    const Transform& getWorldTransform() const;
+    const QMatrix4x4& getWorldMatrix() const;
+    bool isWorldTransformDirty() const { return worldDirty_; }
+    
+    // Recompute every dirty world transform of this subtree in one top-down pass
+    void updateWorldTransforms() const;
 
-    // Serialization
-    nlohmann::json toJson() const;
-    static std::unique_ptr<VolumeNode> fromJson(const nlohmann::json& j);
+    // Serialization. With a material table the material is written/read as
+    // "materialId" into it, otherwise it is embedded in each volume.
+    nlohmann::json toJson(const MaterialRegistry* materials = nullptr) const;
+    static std::unique_ptr<VolumeNode> fromJson(const nlohmann::json& j, const MaterialRegistry* materials = nullptr);
 
 private:
+    friend class SceneGraph;
+    friend class BinarySceneLoader;  // build hierarchies directly while loading
+    friend class JsonSceneLoader;
+    friend class GDMLImporter;
+
     uint64_t id_; // unique ID
     std::string name_;
     VolumeNode* parent_ = nullptr;
     std::vector<VolumeNode*> children_;
     bool visible_ = true; // visibility in viewport
+    SceneGraph* sceneGraph_ = nullptr;
+    uint32_t nameSlot_ = 0;  // position in the scene graph's list of volumes with this name
+    Transform transform_;
+    
+    // World transform cache. Invariant: a dirty node has only dirty descendants.
+    mutable Transform worldTransform_;
+    mutable QMatrix4x4 worldMatrix_;
+    mutable bool worldDirty_ = true;
+    
+    void markWorldDirty();
+    void transformChanged();
+    void computeWorldTransform() const; // parent must be clean
+    
+    // Register/unregister this subtree in the scene graph lookup indexes
+    void attachToScene(SceneGraph* sceneGraph);
+    void detachFromScene();
+    
+    // Everything fromJson reads except the children (shared with the streaming loader)
+    void readJsonFields(const nlohmann::json& j, const MaterialRegistry* materials);
     
     static uint64_t nextId_;
 };
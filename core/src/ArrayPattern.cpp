@@ -0,0 +1,124 @@
+#include "ArrayPattern.hh"
+#include "VolumeNode.hh"
+#include <algorithm>
+
+namespace geantcad {
+
+namespace {
+
+const char* typeName(ArrayPattern::Type type) {
+    switch (type) {
+        case ArrayPattern::Type::Linear: return "linear";
+        case ArrayPattern::Type::Grid: return "grid";
+        case ArrayPattern::Type::Ring: return "ring";
+        case ArrayPattern::Type::None: break;
+    }
+    return "none";
+}
+
+} // namespace
+
+int ArrayPattern::copies() const {
+    switch (type) {
+        case Type::None: return 1;
+        case Type::Grid: return std::max(1, count[0]) * std::max(1, count[1]) * std::max(1, count[2]);
+        case Type::Linear:
+        case Type::Ring: return std::max(1, count[0]);
+    }
+    return 1;
+}
+
+Transform ArrayPattern::copyTransform(const Transform& local, int copy) const {
+    Transform result = local;
+    if (copy <= 0) return result;
+
+    const QVector3D& t = local.getTranslation();
+    switch (type) {
+        case Type::None:
+            break;
+        case Type::Linear:
+            result.setTranslation(t + QVector3D(float(step[0] * copy), float(step[1] * copy), float(step[2] * copy)));
+            break;
+        case Type::Grid: {
+            // X index runs fastest
+            int nx = std::max(1, count[0]);
+            int ny = std::max(1, count[1]);
+            int i = copy % nx;
+            int j = (copy / nx) % ny;
+            int k = copy / (nx * ny);
+            result.setTranslation(t + QVector3D(float(step[0] * i), float(step[1] * j), float(step[2] * k)));
+            break;
+        }
+        case Type::Ring: {
+            QQuaternion rotation = QQuaternion::fromAxisAndAngle(0.0f, 0.0f, 1.0f, float(ringStep() * copy));
+            result.setTranslation(rotation.rotatedVector(t));
+            result.setRotation(rotation * local.getRotation());
+            break;
+        }
+    }
+    return result;
+}
+
+bool ArrayPattern::operator==(const ArrayPattern& other) const {
+    if (type != other.type) return false;
+    if (type == Type::None) return true;
+    return std::equal(count, count + 3, other.count) && std::equal(step, step + 3, other.step)
+        && dphi == other.dphi;
+}
+
+nlohmann::json ArrayPattern::toJson() const {
+    return {
+        {"type", typeName(type)},
+        {"count", {count[0], count[1], count[2]}},
+        {"step", {step[0], step[1], step[2]}},
+        {"dphi", dphi}
+    };
+}
+
+ArrayPattern ArrayPattern::fromJson(const nlohmann::json& j) {
+    ArrayPattern pattern;
+    std::string type = j.value("type", "none");
+    if (type == "linear") pattern.type = Type::Linear;
+    else if (type == "grid") pattern.type = Type::Grid;
+    else if (type == "ring") pattern.type = Type::Ring;
+
+    if (j.contains("count") && j["count"].is_array()) {
+        for (size_t i = 0; i < 3 && i < j["count"].size(); ++i) pattern.count[i] = j["count"][i].get<int>();
+    }
+    if (j.contains("step") && j["step"].is_array()) {
+        for (size_t i = 0; i < 3 && i < j["step"].size(); ++i) pattern.step[i] = j["step"][i].get<double>();
+    }
+    pattern.dphi = j.value("dphi", 0.0);
+    return pattern;
+}
+
+std::vector<QMatrix4x4> arrayCopyOffsets(const VolumeNode* node) {
+    std::vector<QMatrix4x4> offsets(1);
+    if (!node) return offsets;
+
+    // below / belowInverse: the node relative to the frame of the current ancestor
+    QMatrix4x4 below;
+    QMatrix4x4 belowInverse;
+    for (const VolumeNode* a = node; a && a->getParent(); a = a->getParent()) {
+        const Transform& local = a->getTransform();
+        const ArrayPattern& pattern = a->getArrayPattern();
+        if (pattern.isArray()) {
+            // Copy i of a moves the node by below^-1 * local^-1 * copy_i * below
+            QMatrix4x4 toCopyFrame = belowInverse * local.getInverseMatrix();
+            std::vector<QMatrix4x4> combined;
+            combined.reserve(offsets.size() * size_t(pattern.copies()));
+            for (int i = 0; i < pattern.copies(); ++i) {
+                QMatrix4x4 offset = i == 0 ? QMatrix4x4() : toCopyFrame * pattern.copyTransform(local, i).getMatrix() * below;
+                for (const QMatrix4x4& inner : offsets) {
+                    combined.push_back(offset * inner);
+                }
+            }
+            offsets.swap(combined);
+        }
+        below = local.getMatrix() * below;
+        belowInverse = belowInverse * local.getInverseMatrix();
+    }
+    return offsets;
+}
+
+} // namespace geantcad
@@ -0,0 +1,880 @@
+#include "Serialization.hh"
+#include "SceneGraph.hh"
+#include "SceneTraversal.hh"
+#include <QFile>
+#include <QString>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+namespace geantcad {
+
+/**
+ * Layout del formato binario (.gcadb), versione 1. Little-endian, record a
+ * dimensione fissa allineati a 8 byte, cosi' il file mappato in memoria si
+ * legge direttamente senza parsing:
+ *
+ *   FileHeader | Nodes | Shapes | Params | Materials | Components |
+ *   SensitiveDetectors | Scorers | OpticalSurfaces | Strings | StringData
+ *
+ * I nodi sono in pre-order (il parent precede i figli, ordine dei figli
+ * preservato). Shape identiche (geometria + nome) e stringhe uguali sono
+ * salvate una volta sola; i materiali condivisi restano condivisi. Le
+ * configurazioni di simulazione e gli array pattern, piccoli, sono JSON
+ * compatto nella string table.
+ */
+namespace {
+
+constexpr char BinaryMagic[8] = {'G', 'C', 'A', 'D', 'B', 'I', 'N', '\0'};
+constexpr uint32_t BinaryFormatVersion = 1;
+constexpr uint32_t ByteOrderMark = 0x01020304u;
+constexpr uint32_t None = std::numeric_limits<uint32_t>::max();
+
+enum Section : uint32_t {
+    Nodes, Shapes, Params, Materials, Components,
+    SensitiveDetectors, Scorers, OpticalSurfaces, Strings, StringData,
+    SectionCount
+};
+
+struct SectionEntry {
+    uint64_t offset;  // from the start of the file, multiple of 8
+    uint64_t count;   // records (bytes for StringData)
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    uint64_t selectedId;  // 0 = no selection
+    uint32_t physics;     // strings: compact JSON of the simulation settings
+    uint32_t output;
+    uint32_t particleGun;
+    uint32_t sectionCount;
+    SectionEntry sections[SectionCount];
+};
+
+constexpr uint32_t NodeVisible = 1u << 0;
+constexpr uint32_t NodeArray = 1u << 1;  // arrayPattern is set
+
+struct NodeRecord {
+    uint64_t id;
+    uint32_t parent;             // record index, None for the root (record 0)
+    uint32_t name;
+    uint32_t shape;              // None if the node has no shape
+    uint32_t material;
+    uint32_t sensitiveDetector;  // None for the default configuration
+    uint32_t opticalSurface;     // None for the default configuration
+    uint32_t flags;
+    float translation[3];
+    float rotation[4];           // w x y z
+    float scale[3];
+    uint32_t arrayPattern;       // strings: compact JSON, valid with NodeArray
+};
+
+// Params layout by type: Box x y z | Tube rmin rmax dz sphi dphi |
+// Sphere rmin rmax sphi dphi stheta dtheta | Cone rmin1 rmax1 rmin2 rmax2 dz sphi dphi |
+// Trd dx1 dx2 dy1 dy2 dz | Polycone/Polyhedra sphi dphi nz nrmin nrmax z.. rmin.. rmax.. |
+// Boolean relPos xyz relRot xyz
+struct ShapeRecord {
+    uint32_t type;
+    uint32_t name;
+    uint32_t firstParam;
+    uint32_t paramCount;
+    int32_t extra;    // Polyhedra: numSides, Boolean: operation
+    uint32_t solidA;  // Boolean operand names
+    uint32_t solidB;
+    uint32_t reserved;
+};
+
+struct MaterialRecord {
+    uint32_t name;
+    uint32_t nistName;
+    uint32_t type;
+    uint32_t state;
+    double density;
+    double atomicMass;
+    double temperature;
+    double pressure;
+    int32_t atomicNumber;
+    uint32_t firstComponent;
+    uint32_t componentCount;
+    uint32_t wireframe;
+    float color[4];
+};
+
+struct ComponentRecord {
+    uint32_t type;
+    uint32_t material;  // index of an earlier material (Material components)
+    uint32_t symbol;
+    uint32_t elementName;
+    int32_t atomicNumber;
+    int32_t nAtoms;
+    double atomicMass;
+    double fraction;
+};
+
+constexpr uint32_t DetectorEnabled = 1u << 0;
+constexpr uint32_t DetectorScoringMesh = 1u << 1;
+
+struct SensitiveDetectorRecord {
+    uint32_t type;
+    uint32_t collectionName;
+    int32_t copyNumber;
+    uint32_t flags;
+    double meshSize[3];
+    int32_t nBins[3];
+    uint32_t firstScorer;
+    uint32_t scorerCount;
+    uint32_t reserved;
+};
+
+struct ScorerRecord {
+    uint32_t name;
+    uint32_t type;
+    uint32_t particleFilter;
+    uint32_t reserved;
+    double minEnergy;
+    double maxEnergy;
+};
+
+struct OpticalSurfaceRecord {
+    uint32_t model;
+    uint32_t finish;
+    uint32_t preset;
+    uint32_t enabled;
+    double reflectivity;
+    double sigmaAlpha;
+};
+
+struct StringRecord {
+    uint64_t offset;  // into StringData
+    uint64_t length;
+};
+
+static_assert(sizeof(NodeRecord) == 80, "NodeRecord layout");
+static_assert(sizeof(ShapeRecord) == 32, "ShapeRecord layout");
+static_assert(sizeof(MaterialRecord) == 80, "MaterialRecord layout");
+static_assert(sizeof(ComponentRecord) == 40, "ComponentRecord layout");
+static_assert(sizeof(SensitiveDetectorRecord) == 64, "SensitiveDetectorRecord layout");
+static_assert(sizeof(ScorerRecord) == 32, "ScorerRecord layout");
+static_assert(sizeof(OpticalSurfaceRecord) == 32, "OpticalSurfaceRecord layout");
+static_assert(sizeof(StringRecord) == 16, "StringRecord layout");
+
+const size_t RecordSize[SectionCount] = {
+    sizeof(NodeRecord), sizeof(ShapeRecord), sizeof(double), sizeof(MaterialRecord),
+    sizeof(ComponentRecord), sizeof(SensitiveDetectorRecord), sizeof(ScorerRecord),
+    sizeof(OpticalSurfaceRecord), sizeof(StringRecord), 1
+};
+
+bool isDefault(const SensitiveDetectorConfig& sd) {
+    const SensitiveDetectorConfig d;
+    return sd.enabled == d.enabled && sd.type == d.type && sd.collectionName == d.collectionName
+        && sd.copyNumber == d.copyNumber && sd.scorers.empty() && sd.usesScoringMesh == d.usesScoringMesh
+        && sd.meshSizeX == d.meshSizeX && sd.meshSizeY == d.meshSizeY && sd.meshSizeZ == d.meshSizeZ
+        && sd.nBinsX == d.nBinsX && sd.nBinsY == d.nBinsY && sd.nBinsZ == d.nBinsZ;
+}
+
+bool isDefault(const OpticalSurfaceConfig& op) {
+    const OpticalSurfaceConfig d;
+    return op.enabled == d.enabled && op.model == d.model && op.finish == d.finish
+        && op.reflectivity == d.reflectivity && op.sigmaAlpha == d.sigmaAlpha && op.preset == d.preset;
+}
+
+// ===== Writer =====
+
+class BinarySceneWriter {
+public:
+    void write(const SceneGraph& sceneGraph) {
+        writeSubtree(*sceneGraph.getRoot());
+        header_.physics = addString(sceneGraph.getPhysicsConfig().toJson().dump());
+        header_.output = addString(sceneGraph.getOutputConfig().toJson().dump());
+        header_.particleGun = addString(sceneGraph.getParticleGunConfig().toJson().dump());
+        header_.selectedId = sceneGraph.getSelected() ? sceneGraph.getSelected()->getId() : 0;
+    }
+
+    // Volumes only: the settings strings stay None
+    void writeSubtree(const VolumeNode& root) {
+        header_.physics = header_.output = header_.particleGun = None;
+        std::vector<uint32_t> stack;
+        traversal::preOrder(&root, [&](const VolumeNode* node, size_t depth) {
+            if (stack.size() <= depth) stack.resize(depth + 1);
+            stack[depth] = uint32_t(nodes_.size());
+            addNode(*node, depth > 0 ? stack[depth - 1] : None);
+        });
+    }
+
+    std::vector<char> finish() {
+        std::memcpy(header_.magic, BinaryMagic, sizeof(BinaryMagic));
+        header_.version = BinaryFormatVersion;
+        header_.byteOrder = ByteOrderMark;
+        header_.sectionCount = SectionCount;
+
+        std::vector<char> out(sizeof(FileHeader));
+        append(out, Nodes, nodes_);
+        append(out, Shapes, shapes_);
+        append(out, Params, params_);
+        append(out, Materials, materials_);
+        append(out, Components, components_);
+        append(out, SensitiveDetectors, detectors_);
+        append(out, Scorers, scorers_);
+        append(out, OpticalSurfaces, opticals_);
+        append(out, Strings, strings_);
+        align(out);
+        header_.sections[StringData] = {out.size(), stringData_.size()};
+        out.insert(out.end(), stringData_.begin(), stringData_.end());
+        align(out);
+
+        header_.fileSize = out.size();
+        std::memcpy(out.data(), &header_, sizeof(FileHeader));
+        return out;
+    }
+
+private:
+    static void align(std::vector<char>& out) { out.resize((out.size() + 7) & ~size_t(7), '\0'); }
+
+    template<class T>
+    void append(std::vector<char>& out, Section section, const std::vector<T>& records) {
+        align(out);
+        header_.sections[section] = {out.size(), records.size()};
+        const char* bytes = reinterpret_cast<const char*>(records.data());
+        out.insert(out.end(), bytes, bytes + records.size() * sizeof(T));
+    }
+
+    uint32_t addString(const std::string& s) {
+        auto it = stringIndex_.find(s);
+        if (it != stringIndex_.end()) return it->second;
+        uint32_t index = uint32_t(strings_.size());
+        strings_.push_back({stringData_.size(), s.size()});
+        stringData_.append(s);
+        stringIndex_.emplace(s, index);
+        return index;
+    }
+
+    void addNode(const VolumeNode& node, uint32_t parent) {
+        NodeRecord r{};
+        r.id = node.getId();
+        r.parent = parent;
+        r.name = addString(node.getName());
+        r.shape = node.getShape() ? addShape(*node.getShape()) : None;
+        r.material = node.getMaterial() ? addMaterial(node.getMaterial()) : None;
+        r.sensitiveDetector = isDefault(node.getSDConfig()) ? None : addDetector(node.getSDConfig());
+        r.opticalSurface = isDefault(node.getOpticalConfig()) ? None : addOptical(node.getOpticalConfig());
+        r.flags = node.isVisible() ? NodeVisible : 0;
+        if (node.getArrayPattern().type != ArrayPattern::Type::None) {
+            r.flags |= NodeArray;
+            r.arrayPattern = addString(node.getArrayPattern().toJson().dump());
+        }
+        const Transform& t = node.getTransform();
+        const QVector3D& pos = t.getTranslation();
+        const QQuaternion& rot = t.getRotation();
+        const QVector3D& scale = t.getScale();
+        float values[10] = {pos.x(), pos.y(), pos.z(), rot.scalar(), rot.x(), rot.y(), rot.z(), scale.x(), scale.y(), scale.z()};
+        std::memcpy(r.translation, values, 3 * sizeof(float));
+        std::memcpy(r.rotation, values + 3, 4 * sizeof(float));
+        std::memcpy(r.scale, values + 7, 3 * sizeof(float));
+        nodes_.push_back(r);
+    }
+
+    uint32_t addShape(const Shape& shape) {
+        // Identical shapes (geometry and name) share one record
+        auto& candidates = shapeIndex_[shape.geometryHash()];
+        for (uint32_t index : candidates) {
+            const Shape& other = *shapeRefs_[index];
+            if (other.getName() == shape.getName() && other.sameGeometry(shape)) return index;
+        }
+
+        ShapeRecord r{};
+        r.type = static_cast<uint32_t>(shape.getType());
+        r.name = addString(shape.getName());
+        r.firstParam = uint32_t(params_.size());
+        r.solidA = r.solidB = None;
+        auto push = [this](std::initializer_list<double> values) { params_.insert(params_.end(), values); };
+        auto pushPlanes = [&](double sphi, double dphi, const std::vector<double>& z,
+                              const std::vector<double>& rmin, const std::vector<double>& rmax) {
+            push({sphi, dphi, double(z.size()), double(rmin.size()), double(rmax.size())});
+            params_.insert(params_.end(), z.begin(), z.end());
+            params_.insert(params_.end(), rmin.begin(), rmin.end());
+            params_.insert(params_.end(), rmax.begin(), rmax.end());
+        };
+        if (auto* p = shape.getParamsAs<BoxParams>()) {
+            push({p->x, p->y, p->z});
+        } else if (auto* p = shape.getParamsAs<TubeParams>()) {
+            push({p->rmin, p->rmax, p->dz, p->sphi, p->dphi});
+        } else if (auto* p = shape.getParamsAs<SphereParams>()) {
+            push({p->rmin, p->rmax, p->sphi, p->dphi, p->stheta, p->dtheta});
+        } else if (auto* p = shape.getParamsAs<ConeParams>()) {
+            push({p->rmin1, p->rmax1, p->rmin2, p->rmax2, p->dz, p->sphi, p->dphi});
+        } else if (auto* p = shape.getParamsAs<TrdParams>()) {
+            push({p->dx1, p->dx2, p->dy1, p->dy2, p->dz});
+        } else if (auto* p = shape.getParamsAs<PolyconeParams>()) {
+            pushPlanes(p->sphi, p->dphi, p->zPlanes, p->rmin, p->rmax);
+        } else if (auto* p = shape.getParamsAs<PolyhedraParams>()) {
+            r.extra = p->numSides;
+            pushPlanes(p->sphi, p->dphi, p->zPlanes, p->rmin, p->rmax);
+        } else if (auto* p = shape.getParamsAs<BooleanParams>()) {
+            r.extra = static_cast<int32_t>(p->operation);
+            r.solidA = addString(p->solidA_name);
+            r.solidB = addString(p->solidB_name);
+            push({p->relPosX, p->relPosY, p->relPosZ, p->relRotX, p->relRotY, p->relRotZ});
+        }
+        r.paramCount = uint32_t(params_.size()) - r.firstParam;
+
+        uint32_t index = uint32_t(shapes_.size());
+        shapes_.push_back(r);
+        shapeRefs_.push_back(&shape);
+        candidates.push_back(index);
+        return index;
+    }
+
+    uint32_t addMaterial(const std::shared_ptr<Material>& used) {
+        // Equal materials are written once, even when volumes hold separate copies
+        std::shared_ptr<Material> material = materialTable_.intern(used);
+        auto it = materialIndex_.find(material.get());
+        if (it != materialIndex_.end()) return it->second;
+        // Reserve the slot first: a (malformed) cycle through components ends here
+        materialIndex_.emplace(material.get(), None);
+
+        // Referenced materials are written first, so indexes always point backwards
+        std::vector<ComponentRecord> components;
+        for (const auto& comp : material->getComponents()) {
+            ComponentRecord c{};
+            c.type = static_cast<uint32_t>(comp.type);
+            c.material = None;
+            if (comp.type == MaterialComponent::Type::Material && comp.material) {
+                c.material = addMaterial(comp.material);
+            }
+            c.symbol = addString(comp.element.symbol);
+            c.elementName = addString(comp.element.name);
+            c.atomicNumber = comp.element.atomicNumber;
+            c.atomicMass = comp.element.atomicMass;
+            c.nAtoms = comp.nAtoms;
+            c.fraction = comp.fraction;
+            components.push_back(c);
+        }
+
+        MaterialRecord r{};
+        r.name = addString(material->getName());
+        r.nistName = addString(material->getNistName());
+        r.type = static_cast<uint32_t>(material->getMaterialType());
+        r.state = static_cast<uint32_t>(material->getState());
+        r.density = material->getDensity();
+        r.atomicMass = material->getAtomicMass();
+        r.temperature = material->getTemperature();
+        r.pressure = material->getPressure();
+        r.atomicNumber = material->getAtomicNumber();
+        r.firstComponent = uint32_t(components_.size());
+        r.componentCount = uint32_t(components.size());
+        const Material::Visual& visual = material->getVisual();
+        r.wireframe = visual.wireframe ? 1 : 0;
+        r.color[0] = visual.r; r.color[1] = visual.g; r.color[2] = visual.b; r.color[3] = visual.a;
+        components_.insert(components_.end(), components.begin(), components.end());
+
+        uint32_t index = uint32_t(materials_.size());
+        materials_.push_back(r);
+        materialIndex_[material.get()] = index;
+        return index;
+    }
+
+    uint32_t addDetector(const SensitiveDetectorConfig& sd) {
+        SensitiveDetectorRecord r{};
+        r.type = addString(sd.type);
+        r.collectionName = addString(sd.collectionName);
+        r.copyNumber = sd.copyNumber;
+        r.flags = (sd.enabled ? DetectorEnabled : 0) | (sd.usesScoringMesh ? DetectorScoringMesh : 0);
+        r.meshSize[0] = sd.meshSizeX; r.meshSize[1] = sd.meshSizeY; r.meshSize[2] = sd.meshSizeZ;
+        r.nBins[0] = sd.nBinsX; r.nBins[1] = sd.nBinsY; r.nBins[2] = sd.nBinsZ;
+        r.firstScorer = uint32_t(scorers_.size());
+        r.scorerCount = uint32_t(sd.scorers.size());
+        for (const auto& scorer : sd.scorers) {
+            ScorerRecord s{};
+            s.name = addString(scorer.name);
+            s.type = addString(scorer.type);
+            s.particleFilter = addString(scorer.particle_filter);
+            s.minEnergy = scorer.min_energy;
+            s.maxEnergy = scorer.max_energy;
+            scorers_.push_back(s);
+        }
+        detectors_.push_back(r);
+        return uint32_t(detectors_.size() - 1);
+    }
+
+    uint32_t addOptical(const OpticalSurfaceConfig& op) {
+        OpticalSurfaceRecord r{};
+        r.model = addString(op.model);
+        r.finish = addString(op.finish);
+        r.preset = addString(op.preset);
+        r.enabled = op.enabled ? 1 : 0;
+        r.reflectivity = op.reflectivity;
+        r.sigmaAlpha = op.sigmaAlpha;
+        opticals_.push_back(r);
+        return uint32_t(opticals_.size() - 1);
+    }
+
+    FileHeader header_{};
+    std::vector<NodeRecord> nodes_;
+    std::vector<ShapeRecord> shapes_;
+    std::vector<const Shape*> shapeRefs_;
+    std::unordered_map<size_t, std::vector<uint32_t>> shapeIndex_;
+    std::vector<double> params_;
+    std::vector<MaterialRecord> materials_;
+    MaterialRegistry materialTable_;
+    std::unordered_map<const Material*, uint32_t> materialIndex_;
+    std::vector<ComponentRecord> components_;
+    std::vector<SensitiveDetectorRecord> detectors_;
+    std::vector<ScorerRecord> scorers_;
+    std::vector<OpticalSurfaceRecord> opticals_;
+    std::vector<StringRecord> strings_;
+    std::string stringData_;
+    std::unordered_map<std::string, uint32_t> stringIndex_;
+};
+
+} // namespace
+
+// ===== Loader =====
+
+/**
+ * Legge un file .gcadb mappato: validate() controlla ogni offset e indice
+ * (un file corrotto non puo' far leggere fuori dal mapping), load() costruisce
+ * la gerarchia staccata e la installa nella scena solo a costruzione completata.
+ */
+class BinarySceneLoader {
+public:
+    BinarySceneLoader(const unsigned char* data, size_t size) : data_(data), size_(size) {}
+
+    bool validate(std::string& error);
+    void load(SceneGraph* sceneGraph);
+    // Detached hierarchy of the file (volume IDs preserved)
+    std::unique_ptr<VolumeNode> buildHierarchy();
+
+private:
+    template<class T>
+    const T* records(Section section) const {
+        return reinterpret_cast<const T*>(data_ + header_->sections[section].offset);
+    }
+    size_t count(Section section) const { return size_t(header_->sections[section].count); }
+
+    std::string string(uint32_t index) const {
+        const StringRecord& s = strings_[index];
+        return std::string(stringData_ + s.offset, size_t(s.length));
+    }
+    bool validString(uint32_t index, bool allowNone = false) const {
+        return index < count(Strings) || (allowNone && index == None);
+    }
+
+    std::unique_ptr<Shape> makeShape(const ShapeRecord& r) const;
+    std::shared_ptr<Material> makeMaterial(const MaterialRecord& r, const std::vector<std::shared_ptr<Material>>& earlier) const;
+
+    const unsigned char* data_;
+    size_t size_;
+    const FileHeader* header_ = nullptr;
+    const StringRecord* strings_ = nullptr;
+    const char* stringData_ = nullptr;
+    std::vector<uint32_t> childCounts_;
+};
+
+bool BinarySceneLoader::validate(std::string& error) {
+    if (size_ < sizeof(FileHeader)) { error = "file too small"; return false; }
+    header_ = reinterpret_cast<const FileHeader*>(data_);
+    if (std::memcmp(header_->magic, BinaryMagic, sizeof(BinaryMagic)) != 0) { error = "not a GeantCAD binary scene"; return false; }
+    if (header_->byteOrder != ByteOrderMark) { error = "byte order mismatch"; return false; }
+    if (header_->version > BinaryFormatVersion) {
+        error = "format version " + std::to_string(header_->version) + " is newer than supported version "
+            + std::to_string(BinaryFormatVersion);
+        return false;
+    }
+    if (header_->fileSize != size_ || header_->sectionCount != SectionCount) { error = "truncated or corrupt header"; return false; }
+
+    for (uint32_t s = 0; s < SectionCount; ++s) {
+        const SectionEntry& e = header_->sections[s];
+        if (e.offset % 8 != 0 || e.offset > size_ || e.count > (size_ - e.offset) / RecordSize[s]) {
+            error = "section " + std::to_string(s) + " out of bounds";
+            return false;
+        }
+    }
+    strings_ = records<StringRecord>(Strings);
+    stringData_ = records<char>(StringData);
+    const uint64_t dataSize = count(StringData);
+    for (size_t i = 0; i < count(Strings); ++i) {
+        if (strings_[i].offset > dataSize || strings_[i].length > dataSize - strings_[i].offset) {
+            error = "string table corrupt";
+            return false;
+        }
+    }
+    if (!validString(header_->physics, true) || !validString(header_->output, true) || !validString(header_->particleGun, true)) {
+        error = "settings reference missing strings";
+        return false;
+    }
+
+    const size_t paramCount = count(Params);
+    const ShapeRecord* shapes = records<ShapeRecord>(Shapes);
+    const double* params = records<double>(Params);
+    for (size_t i = 0; i < count(Shapes); ++i) {
+        const ShapeRecord& r = shapes[i];
+        bool ok = r.type <= static_cast<uint32_t>(ShapeType::BooleanSolid) && validString(r.name)
+            && r.firstParam <= paramCount && r.paramCount <= paramCount - r.firstParam;
+        if (ok) {
+            const double* p = params + r.firstParam;
+            switch (static_cast<ShapeType>(r.type)) {
+                case ShapeType::Box: ok = r.paramCount == 3; break;
+                case ShapeType::Tube: ok = r.paramCount == 5; break;
+                case ShapeType::Sphere: ok = r.paramCount == 6; break;
+                case ShapeType::Cone: ok = r.paramCount == 7; break;
+                case ShapeType::Trd: ok = r.paramCount == 5; break;
+                case ShapeType::Polycone:
+                case ShapeType::Polyhedra:
+                    ok = r.paramCount >= 5 && p[2] >= 0 && p[3] >= 0 && p[4] >= 0
+                        && p[2] + p[3] + p[4] == double(r.paramCount - 5);
+                    break;
+                case ShapeType::BooleanSolid:
+                    ok = r.paramCount == 6 && validString(r.solidA) && validString(r.solidB)
+                        && r.extra >= 0 && r.extra <= static_cast<int32_t>(BooleanOperation::Intersection);
+                    break;
+            }
+        }
+        if (!ok) { error = "shape " + std::to_string(i) + " corrupt"; return false; }
+    }
+
+    const MaterialRecord* materials = records<MaterialRecord>(Materials);
+    const ComponentRecord* components = records<ComponentRecord>(Components);
+    for (size_t i = 0; i < count(Materials); ++i) {
+        const MaterialRecord& r = materials[i];
+        bool ok = validString(r.name) && validString(r.nistName)
+            && r.type <= static_cast<uint32_t>(Material::Type::Mixture)
+            && r.state <= static_cast<uint32_t>(Material::State::Gas)
+            && r.firstComponent <= count(Components) && r.componentCount <= count(Components) - r.firstComponent;
+        for (uint32_t c = 0; ok && c < r.componentCount; ++c) {
+            const ComponentRecord& comp = components[r.firstComponent + c];
+            ok = comp.type <= static_cast<uint32_t>(MaterialComponent::Type::Material)
+                && (comp.material == None || comp.material < i)
+                && validString(comp.symbol) && validString(comp.elementName);
+        }
+        if (!ok) { error = "material " + std::to_string(i) + " corrupt"; return false; }
+    }
+
+    const SensitiveDetectorRecord* detectors = records<SensitiveDetectorRecord>(SensitiveDetectors);
+    const ScorerRecord* scorers = records<ScorerRecord>(Scorers);
+    for (size_t i = 0; i < count(SensitiveDetectors); ++i) {
+        const SensitiveDetectorRecord& r = detectors[i];
+        bool ok = validString(r.type) && validString(r.collectionName)
+            && r.firstScorer <= count(Scorers) && r.scorerCount <= count(Scorers) - r.firstScorer;
+        for (uint32_t s = 0; ok && s < r.scorerCount; ++s) {
+            const ScorerRecord& scorer = scorers[r.firstScorer + s];
+            ok = validString(scorer.name) && validString(scorer.type) && validString(scorer.particleFilter);
+        }
+        if (!ok) { error = "sensitive detector " + std::to_string(i) + " corrupt"; return false; }
+    }
+    const OpticalSurfaceRecord* opticals = records<OpticalSurfaceRecord>(OpticalSurfaces);
+    for (size_t i = 0; i < count(OpticalSurfaces); ++i) {
+        if (!validString(opticals[i].model) || !validString(opticals[i].finish) || !validString(opticals[i].preset)) {
+            error = "optical surface " + std::to_string(i) + " corrupt";
+            return false;
+        }
+    }
+
+    const NodeRecord* nodes = records<NodeRecord>(Nodes);
+    const size_t nodeCount = count(Nodes);
+    if (nodeCount == 0 || nodes[0].parent != None) { error = "missing root volume"; return false; }
+    childCounts_.assign(nodeCount, 0);
+    for (size_t i = 0; i < nodeCount; ++i) {
+        const NodeRecord& r = nodes[i];
+        bool ok = validString(r.name)
+            && (i == 0 || r.parent < i)
+            && (r.shape == None || r.shape < count(Shapes))
+            && (r.material == None || r.material < count(Materials))
+            && (r.sensitiveDetector == None || r.sensitiveDetector < count(SensitiveDetectors))
+            && (r.opticalSurface == None || r.opticalSurface < count(OpticalSurfaces))
+            && (!(r.flags & NodeArray) || validString(r.arrayPattern));
+        if (!ok) { error = "volume " + std::to_string(i) + " corrupt"; return false; }
+        if (i > 0) ++childCounts_[r.parent];
+    }
+    return true;
+}
+
+std::unique_ptr<Shape> BinarySceneLoader::makeShape(const ShapeRecord& r) const {
+    const double* p = records<double>(Params) + r.firstParam;
+    auto planes = [p](auto& params) {
+        params.sphi = p[0];
+        params.dphi = p[1];
+        size_t nz = size_t(p[2]), nrmin = size_t(p[3]), nrmax = size_t(p[4]);
+        const double* values = p + 5;
+        params.zPlanes.assign(values, values + nz);
+        params.rmin.assign(values + nz, values + nz + nrmin);
+        params.rmax.assign(values + nz + nrmin, values + nz + nrmin + nrmax);
+    };
+
+    ShapeParams params;
+    ShapeType type = static_cast<ShapeType>(r.type);
+    switch (type) {
+        case ShapeType::Box: params = BoxParams{p[0], p[1], p[2]}; break;
+        case ShapeType::Tube: params = TubeParams{p[0], p[1], p[2], p[3], p[4]}; break;
+        case ShapeType::Sphere: params = SphereParams{p[0], p[1], p[2], p[3], p[4], p[5]}; break;
+        case ShapeType::Cone: params = ConeParams{p[0], p[1], p[2], p[3], p[4], p[5], p[6]}; break;
+        case ShapeType::Trd: params = TrdParams{p[0], p[1], p[2], p[3], p[4]}; break;
+        case ShapeType::Polycone: {
+            PolyconeParams poly;
+            planes(poly);
+            params = std::move(poly);
+            break;
+        }
+        case ShapeType::Polyhedra: {
+            PolyhedraParams poly;
+            poly.numSides = r.extra;
+            planes(poly);
+            params = std::move(poly);
+            break;
+        }
+        case ShapeType::BooleanSolid: {
+            BooleanParams b;
+            b.operation = static_cast<BooleanOperation>(r.extra);
+            b.solidA_name = string(r.solidA);
+            b.solidB_name = string(r.solidB);
+            b.relPosX = p[0]; b.relPosY = p[1]; b.relPosZ = p[2];
+            b.relRotX = p[3]; b.relRotY = p[4]; b.relRotZ = p[5];
+            params = std::move(b);
+            break;
+        }
+    }
+    return std::make_unique<Shape>(type, string(r.name), std::move(params));
+}
+
+std::shared_ptr<Material> BinarySceneLoader::makeMaterial(const MaterialRecord& r,
+                                                          const std::vector<std::shared_ptr<Material>>& earlier) const {
+    auto material = std::make_shared<Material>(string(r.name), string(r.nistName));
+    material->setMaterialType(static_cast<Material::Type>(r.type));
+    material->setState(static_cast<Material::State>(r.state));
+    material->setDensity(r.density);
+    material->setAtomicMass(r.atomicMass);
+    material->setAtomicNumber(r.atomicNumber);
+    material->setTemperature(r.temperature);
+    material->setPressure(r.pressure);
+    Material::Visual& visual = material->getVisual();
+    visual.r = r.color[0]; visual.g = r.color[1]; visual.b = r.color[2]; visual.a = r.color[3];
+    visual.wireframe = r.wireframe != 0;
+
+    const ComponentRecord* components = records<ComponentRecord>(Components) + r.firstComponent;
+    for (uint32_t i = 0; i < r.componentCount; ++i) {
+        const ComponentRecord& c = components[i];
+        MaterialComponent comp;
+        comp.type = static_cast<MaterialComponent::Type>(c.type);
+        comp.element = Element(string(c.symbol), string(c.elementName), c.atomicNumber, c.atomicMass);
+        if (c.material != None) comp.material = earlier[c.material];
+        comp.nAtoms = c.nAtoms;
+        comp.fraction = c.fraction;
+        material->addComponent(comp);
+    }
+    return material;
+}
+
+void BinarySceneLoader::load(SceneGraph* sceneGraph) {
+    // Settings first: a malformed blob throws before the scene is touched
+    nlohmann::json settings = nlohmann::json::object();
+    if (header_->physics != None) settings["physics"] = nlohmann::json::parse(string(header_->physics));
+    if (header_->output != None) settings["output"] = nlohmann::json::parse(string(header_->output));
+    if (header_->particleGun != None) settings["particleGun"] = nlohmann::json::parse(string(header_->particleGun));
+    if (header_->selectedId != 0) settings["selectedId"] = header_->selectedId;
+
+    sceneGraph->adoptLoadedScene(buildHierarchy(), settings);
+}
+
+std::unique_ptr<VolumeNode> BinarySceneLoader::buildHierarchy() {
+    const MaterialRecord* materialRecords = records<MaterialRecord>(Materials);
+    std::vector<std::shared_ptr<Material>> materials;
+    materials.reserve(count(Materials));
+    for (size_t i = 0; i < count(Materials); ++i) {
+        materials.push_back(makeMaterial(materialRecords[i], materials));
+    }
+
+    // One shape per record, shared by every volume that uses it
+    const ShapeRecord* shapeRecords = records<ShapeRecord>(Shapes);
+    std::vector<std::shared_ptr<const Shape>> shapes;
+    shapes.reserve(count(Shapes));
+    for (size_t i = 0; i < count(Shapes); ++i) shapes.push_back(makeShape(shapeRecords[i]));
+
+    const NodeRecord* records = this->records<NodeRecord>(Nodes);
+    const SensitiveDetectorRecord* detectors = this->records<SensitiveDetectorRecord>(SensitiveDetectors);
+    const ScorerRecord* scorers = this->records<ScorerRecord>(Scorers);
+    const OpticalSurfaceRecord* opticals = this->records<OpticalSurfaceRecord>(OpticalSurfaces);
+    const size_t nodeCount = count(Nodes);
+
+    std::vector<VolumeNode*> nodes(nodeCount);
+    std::unique_ptr<VolumeNode> root;
+    uint64_t maxId = 0;
+    for (size_t i = 0; i < nodeCount; ++i) {
+        const NodeRecord& r = records[i];
+        auto* node = new VolumeNode(string(r.name));
+        nodes[i] = node;
+        if (i == 0) {
+            root.reset(node);
+        } else {
+            // Validated: unique parents that precede their children, so the
+            // linear duplicate check of addChild is not needed
+            node->parent_ = nodes[r.parent];
+            node->parent_->children_.push_back(node);
+        }
+        node->children_.reserve(childCounts_[i]);
+        node->id_ = r.id;
+        maxId = std::max(maxId, r.id);
+        node->transform_ = Transform(QVector3D(r.translation[0], r.translation[1], r.translation[2]),
+                                     QQuaternion(r.rotation[0], r.rotation[1], r.rotation[2], r.rotation[3]),
+                                     QVector3D(r.scale[0], r.scale[1], r.scale[2]));
+        if (r.shape != None) node->shape_ = shapes[r.shape];
+        if (r.material != None) node->material_ = materials[r.material];
+        if (r.sensitiveDetector != None) {
+            const SensitiveDetectorRecord& d = detectors[r.sensitiveDetector];
+            SensitiveDetectorConfig& sd = node->sdConfig_;
+            sd.enabled = (d.flags & DetectorEnabled) != 0;
+            sd.usesScoringMesh = (d.flags & DetectorScoringMesh) != 0;
+            sd.type = string(d.type);
+            sd.collectionName = string(d.collectionName);
+            sd.copyNumber = d.copyNumber;
+            sd.meshSizeX = d.meshSize[0]; sd.meshSizeY = d.meshSize[1]; sd.meshSizeZ = d.meshSize[2];
+            sd.nBinsX = d.nBins[0]; sd.nBinsY = d.nBins[1]; sd.nBinsZ = d.nBins[2];
+            for (uint32_t s = 0; s < d.scorerCount; ++s) {
+                const ScorerRecord& rec = scorers[d.firstScorer + s];
+                sd.scorers.push_back({string(rec.name), string(rec.type), string(rec.particleFilter), rec.minEnergy, rec.maxEnergy});
+            }
+        }
+        if (r.opticalSurface != None) {
+            const OpticalSurfaceRecord& o = opticals[r.opticalSurface];
+            OpticalSurfaceConfig& op = node->opticalConfig_;
+            op.enabled = o.enabled != 0;
+            op.model = string(o.model);
+            op.finish = string(o.finish);
+            op.preset = string(o.preset);
+            op.reflectivity = o.reflectivity;
+            op.sigmaAlpha = o.sigmaAlpha;
+        }
+        node->visible_ = (r.flags & NodeVisible) != 0;
+        if (r.flags & NodeArray) {
+            node->arrayPattern_ = ArrayPattern::fromJson(nlohmann::json::parse(string(r.arrayPattern)));
+        }
+    }
+    // Keep freshly created nodes from reusing a loaded ID
+    if (maxId >= VolumeNode::nextId_) VolumeNode::nextId_ = maxId + 1;
+    return root;
+}
+
+// ===== Public API =====
+
+bool saveSceneToBinary(SceneGraph* sceneGraph, const std::string& filePath) {
+    if (!sceneGraph || !sceneGraph->getRoot()) return false;
+
+    try {
+        std::vector<char> bytes = serializeScene(*sceneGraph);
+
+        std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open file for writing: " << filePath << std::endl;
+            return false;
+        }
+        file.write(bytes.data(), std::streamsize(bytes.size()));
+        if (!file) {
+            std::cerr << "Failed to write binary scene: " << filePath << std::endl;
+            return false;
+        }
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error saving binary scene: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool loadSceneFromBinary(SceneGraph* sceneGraph, const std::string& filePath) {
+    if (!sceneGraph) return false;
+
+    QFile file(QString::fromStdString(filePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "Failed to open file for reading: " << filePath << std::endl;
+        return false;
+    }
+    const qint64 size = file.size();
+    uchar* data = size > 0 ? file.map(0, size) : nullptr;
+    if (!data) {
+        std::cerr << "Failed to map binary scene: " << filePath << std::endl;
+        return false;
+    }
+
+    bool ok = false;
+    try {
+        BinarySceneLoader loader(data, size_t(size));
+        std::string error;
+        if (loader.validate(error)) {
+            loader.load(sceneGraph);
+            ok = true;
+        } else {
+            std::cerr << "Invalid binary scene " << filePath << ": " << error << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error loading binary scene: " << e.what() << std::endl;
+    }
+    file.unmap(data);
+    return ok;
+}
+
+std::vector<char> serializeSubtree(const VolumeNode& node) {
+    BinarySceneWriter writer;
+    writer.writeSubtree(node);
+    return writer.finish();
+}
+
+std::unique_ptr<VolumeNode> deserializeSubtree(const std::vector<char>& bytes) {
+    try {
+        BinarySceneLoader loader(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size());
+        std::string error;
+        if (!loader.validate(error)) {
+            std::cerr << "Invalid volume snapshot: " << error << std::endl;
+            return nullptr;
+        }
+        return loader.buildHierarchy();
+    } catch (const std::exception& e) {
+        std::cerr << "Error restoring volume snapshot: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+std::vector<char> serializeScene(const SceneGraph& sceneGraph) {
+    BinarySceneWriter writer;
+    writer.write(sceneGraph);
+    return writer.finish();
+}
+
+bool deserializeScene(SceneGraph* sceneGraph, const std::vector<char>& bytes) {
+    if (!sceneGraph) return false;
+    try {
+        BinarySceneLoader loader(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size());
+        std::string error;
+        if (!loader.validate(error)) {
+            std::cerr << "Invalid scene snapshot: " << error << std::endl;
+            return false;
+        }
+        loader.load(sceneGraph);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error restoring scene snapshot: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool isBinarySceneFile(const std::string& filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    char magic[sizeof(BinaryMagic)] = {};
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, BinaryMagic, sizeof(BinaryMagic)) == 0;
+}
+
+bool convertSceneFile(const std::string& inputPath, const std::string& outputPath) {
+    SceneGraph sceneGraph;
+    if (!loadSceneFromFile(&sceneGraph, inputPath)) {
+        std::cerr << "Conversion failed: cannot load " << inputPath << std::endl;
+        return false;
+    }
+    if (!saveSceneToFile(&sceneGraph, outputPath)) {
+        std::cerr << "Conversion failed: cannot save " << outputPath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace geantcad
@@ -1,13 +1,124 @@
 #include "Command.hh"
 #include "SceneGraph.hh"
+#include "Serialization.hh"
 #include <algorithm>
 #include <iostream>
 
 namespace geantcad {
 
+namespace {
+    size_t shapeBytes(const Shape& shape) {
+        size_t bytes = sizeof(Shape) + shape.getName().capacity();
+        auto planes = [](const auto& p) {
+            return (p.zPlanes.capacity() + p.rmin.capacity() + p.rmax.capacity()) * sizeof(double);
+        };
+        if (auto* p = shape.getParamsAs<PolyconeParams>()) {
+            bytes += planes(*p);
+        } else if (auto* p = shape.getParamsAs<PolyhedraParams>()) {
+            bytes += planes(*p);
+        } else if (auto* p = shape.getParamsAs<BooleanParams>()) {
+            bytes += p->solidA_name.capacity() + p->solidB_name.capacity();
+        }
+        return bytes;
+    }
+    
+    // Shapes are counted only while the history is their last owner
+    size_t ownedShapeBytes(const std::shared_ptr<const Shape>& shape) {
+        return shape && shape.use_count() == 1 ? shapeBytes(*shape) : 0;
+    }
+    
+    size_t detectorBytes(const SensitiveDetectorConfig& config) {
+        size_t bytes = config.type.capacity() + config.collectionName.capacity()
+            + config.scorers.capacity() * sizeof(ScorerConfig);
+        for (const auto& scorer : config.scorers) {
+            bytes += scorer.name.capacity() + scorer.type.capacity() + scorer.particle_filter.capacity();
+        }
+        return bytes;
+    }
+    
+    // Snapshots go into the journal records as binary values (CBOR byte strings)
+    nlohmann::json binaryJson(const std::vector<char>& bytes) {
+        return nlohmann::json::binary(std::vector<std::uint8_t>(bytes.begin(), bytes.end()));
+    }
+    
+    std::vector<char> binaryFromJson(const nlohmann::json& j) {
+        if (!j.is_binary()) return {};
+        const auto& bytes = j.get_binary();
+        return std::vector<char>(bytes.begin(), bytes.end());
+    }
+    
+    nlohmann::json shapeJson(const std::shared_ptr<const Shape>& shape) {
+        return shape ? shape->toJson() : nlohmann::json();
+    }
+    
+    std::shared_ptr<const Shape> shapeFromJson(const nlohmann::json& j) {
+        if (j.is_null()) return nullptr;
+        return std::shared_ptr<const Shape>(Shape::fromJson(j));
+    }
+    
+    nlohmann::json materialJson(const std::shared_ptr<Material>& material) {
+        return material ? material->toJson() : nlohmann::json();
+    }
+    
+    std::shared_ptr<Material> materialFromJson(const nlohmann::json& j) {
+        return j.is_null() ? nullptr : Material::fromJson(j);
+    }
+}
+
+// MacroCommand
+MacroCommand::MacroCommand(const std::string& description, SceneGraph* sceneGraph)
+    : description_(description)
+    , sceneGraph_(sceneGraph)
+{
+}
+
+void MacroCommand::execute() {
+    if (sceneGraph_) sceneGraph_->beginBatch();
+    for (auto& cmd : commands_) {
+        cmd->execute();
+    }
+    if (sceneGraph_) sceneGraph_->endBatch();
+}
+
+void MacroCommand::undo() {
+    if (sceneGraph_) sceneGraph_->beginBatch();
+    for (auto it = commands_.rbegin(); it != commands_.rend(); ++it) {
+        (*it)->undo();
+    }
+    if (sceneGraph_) sceneGraph_->endBatch();
+}
+
+size_t MacroCommand::getMemoryUsage() const {
+    size_t bytes = sizeof(*this) + description_.capacity() + commands_.capacity() * sizeof(commands_[0]);
+    for (const auto& cmd : commands_) {
+        bytes += cmd->getMemoryUsage();
+    }
+    return bytes;
+}
+
+// NodeRef
+NodeRef::NodeRef(VolumeNode* node)
+    : sceneGraph_(node ? node->getSceneGraph() : nullptr)
+    , detached_(sceneGraph_ ? nullptr : node)
+    , id_(node ? node->getId() : 0)
+{
+}
+
+VolumeNode* NodeRef::get() const {
+    if (sceneGraph_) {
+        return sceneGraph_->findVolumeById(id_);
+    }
+    return detached_;
+}
+
+std::string NodeRef::getName() const {
+    VolumeNode* node = get();
+    return node ? node->getName() : "volume";
+}
+
 // CreateVolumeCommand
 CreateVolumeCommand::CreateVolumeCommand(SceneGraph* sceneGraph, const std::string& name,
-                                       std::unique_ptr<Shape> shape, std::shared_ptr<Material> material)
+                                       std::shared_ptr<const Shape> shape, std::shared_ptr<Material> material)
     : sceneGraph_(sceneGraph)
     , volumeName_(name)
     , shape_(std::move(shape))
@@ -18,95 +129,103 @@ CreateVolumeCommand::CreateVolumeCommand(SceneGraph* sceneGraph, const std::stri
 void CreateVolumeCommand::execute() {
     if (!sceneGraph_) return;
     
-    createdNode_ = sceneGraph_->createVolume(volumeName_);
-    if (createdNode_) {
+    if (!snapshot_.empty()) {
+        // Redo: the same volume, same ID, so later commands still find it
+        std::unique_ptr<VolumeNode> node = deserializeSubtree(snapshot_);
+        if (!node) {
+            std::cerr << "Error recreating volume: " << volumeName_ << std::endl;
+            return;
+        }
+        sceneGraph_->getRoot()->addChild(node.release());
+        return;
+    }
+    
+    VolumeNode* createdNode = sceneGraph_->createVolume(volumeName_);
+    if (createdNode) {
         if (shape_) {
-            // Set the shape (we can move it since execute() is only called once)
-            createdNode_->setShape(std::move(shape_));
+            // Shapes are immutable: the volume shares the command's copy
+            createdNode->setShape(shape_);
         }
         if (material_) {
-            createdNode_->setMaterial(material_);
+            createdNode->setMaterial(material_);
         }
+        createdNode->setTransform(transform_);
+        createdId_ = createdNode->getId();
+        snapshot_ = serializeSubtree(*createdNode);
+        shape_.reset();
+        material_.reset();
     }
 }
 
 void CreateVolumeCommand::undo() {
-    if (createdNode_ && sceneGraph_) {
-        sceneGraph_->removeVolume(createdNode_);
-        createdNode_ = nullptr;
+    if (VolumeNode* createdNode = getCreatedNode()) {
+        sceneGraph_->removeVolume(createdNode);
     }
 }
 
+VolumeNode* CreateVolumeCommand::getCreatedNode() const {
+    return sceneGraph_ && createdId_ ? sceneGraph_->findVolumeById(createdId_) : nullptr;
+}
+
+size_t CreateVolumeCommand::getMemoryUsage() const {
+    return sizeof(*this) + volumeName_.capacity() + ownedShapeBytes(shape_) + snapshot_.capacity();
+}
+
 // DeleteVolumeCommand
 DeleteVolumeCommand::DeleteVolumeCommand(SceneGraph* sceneGraph, VolumeNode* node)
     : sceneGraph_(sceneGraph)
-    , node_(node)
 {
-    if (node_) {
-        volumeName_ = node_->getName();
-        parent_ = node_->getParent();
+    if (node) {
+        nodeId_ = node->getId();
+        volumeName_ = node->getName();
         
-        // Find child index
-        if (parent_) {
-            const auto& siblings = parent_->getChildren();
-            auto it = std::find(siblings.begin(), siblings.end(), node_);
+        if (VolumeNode* parent = node->getParent()) {
+            parentId_ = parent->getId();
+            const auto& siblings = parent->getChildren();
+            auto it = std::find(siblings.begin(), siblings.end(), node);
             childIndex_ = (it != siblings.end()) ? std::distance(siblings.begin(), it) : 0;
         }
-        
-        // Save state using JSON serialization for complete state preservation
-        if (node_->getShape()) {
-            nlohmann::json shapeJson = node_->getShape()->toJson();
-            shape_ = Shape::fromJson(shapeJson);
-        }
-        material_ = node_->getMaterial();
-        transform_ = node_->getTransform();
-        
-        // Save children references (they will be deleted by execute, so we need to recreate them)
-        for (auto* child : node_->getChildren()) {
-            children_.push_back(child);
-        }
     }
 }
 
 void DeleteVolumeCommand::execute() {
-    if (node_ && sceneGraph_) {
-        // Store reference before deletion
-        VolumeNode* nodeToDelete = node_;
-        node_ = nullptr; // Clear reference to avoid use-after-delete
-        
-        // Save full state using JSON before deletion
-        nlohmann::json nodeJson = nodeToDelete->toJson();
-        
-        // Delete the node (this will also delete children)
-        sceneGraph_->removeVolume(nodeToDelete);
-        
-        // Store JSON for undo
-        nodeJson_ = nodeJson;
+    if (!sceneGraph_) return;
+    
+    VolumeNode* nodeToDelete = sceneGraph_->findVolumeById(nodeId_);
+    if (!nodeToDelete) return;
+    
+    // Save full state of the subtree before deletion
+    if (snapshot_.empty()) {
+        snapshot_ = serializeSubtree(*nodeToDelete);
     }
+    
+    // Delete the node (this will also delete children)
+    sceneGraph_->removeVolume(nodeToDelete);
 }
 
 void DeleteVolumeCommand::undo() {
-    if (!sceneGraph_ || nodeJson_.is_null()) return;
+    if (!sceneGraph_ || snapshot_.empty()) return;
+    if (sceneGraph_->findVolumeById(nodeId_)) return;
     
-    // Recreate node from JSON
-    try {
-        auto restoredNode = VolumeNode::fromJson(nodeJson_);
-        node_ = restoredNode.release();
-        
-        // Reattach to parent
-        if (parent_) {
-            parent_->addChild(node_);
-        } else {
-            // If no parent, add to root
-            if (sceneGraph_->getRoot()) {
-                sceneGraph_->getRoot()->addChild(node_);
-            }
-        }
-        
-        // Note: SceneGraph notifications will be handled by addChild internally
-    } catch (const std::exception& e) {
-        std::cerr << "Error restoring deleted node: " << e.what() << std::endl;
+    // Recreate the subtree (same volume IDs)
+    std::unique_ptr<VolumeNode> restoredNode = deserializeSubtree(snapshot_);
+    if (!restoredNode) {
+        std::cerr << "Error restoring deleted node: " << volumeName_ << std::endl;
+        return;
+    }
+    
+    // Reattach at its place (or to the root when the parent is gone)
+    VolumeNode* parent = parentId_ ? sceneGraph_->findVolumeById(parentId_) : nullptr;
+    if (!parent) {
+        parent = sceneGraph_->getRoot();
     }
+    if (parent) {
+        parent->insertChild(childIndex_, restoredNode.release());
+    }
+}
+
+size_t DeleteVolumeCommand::getMemoryUsage() const {
+    return sizeof(*this) + volumeName_.capacity() + snapshot_.capacity();
 }
 
 // TransformVolumeCommand
@@ -114,46 +233,72 @@ TransformVolumeCommand::TransformVolumeCommand(VolumeNode* node, const Transform
     : node_(node)
     , newTransform_(newTransform)
 {
-    if (node_) {
-        oldTransform_ = node_->getTransform();
+    if (node) {
+        oldTransform_ = node->getTransform();
     }
 }
 
 void TransformVolumeCommand::execute() {
-    if (node_) {
-        node_->getTransform() = newTransform_;
+    if (VolumeNode* node = node_.get()) {
+        node->setTransform(newTransform_);
     }
 }
 
 void TransformVolumeCommand::undo() {
-    if (node_) {
-        node_->getTransform() = oldTransform_;
+    if (VolumeNode* node = node_.get()) {
+        node->setTransform(oldTransform_);
     }
 }
 
+bool TransformVolumeCommand::mergeWith(const Command& next) {
+    auto* other = dynamic_cast<const TransformVolumeCommand*>(&next);
+    if (!other || other->node_.getId() != node_.getId()) return false;
+    newTransform_ = other->newTransform_;
+    return true;
+}
+
 // DuplicateVolumeCommand
 DuplicateVolumeCommand::DuplicateVolumeCommand(SceneGraph* sceneGraph, VolumeNode* sourceNode)
     : sceneGraph_(sceneGraph)
-    , sourceNode_(sourceNode)
+    , source_(sourceNode)
 {
 }
 
 void DuplicateVolumeCommand::execute() {
-    if (!sceneGraph_ || !sourceNode_) return;
+    if (!sceneGraph_) return;
     
-    duplicatedNode_ = duplicateNodeRecursive(sourceNode_);
-    if (duplicatedNode_ && sourceNode_->getParent()) {
-        sourceNode_->getParent()->addChild(duplicatedNode_);
+    if (!snapshot_.empty()) {
+        // Redo: the same copy, same IDs
+        VolumeNode* parent = sceneGraph_->findVolumeById(parentId_);
+        std::unique_ptr<VolumeNode> duplicate = parent ? deserializeSubtree(snapshot_) : nullptr;
+        if (duplicate) {
+            parent->addChild(duplicate.release());
+        }
+        return;
+    }
+    
+    VolumeNode* sourceNode = source_.get();
+    if (!sourceNode || !sourceNode->getParent()) return;
+    
+    VolumeNode* duplicatedNode = duplicateNodeRecursive(sourceNode);
+    if (duplicatedNode) {
+        sourceNode->getParent()->addChild(duplicatedNode);
+        duplicatedId_ = duplicatedNode->getId();
+        parentId_ = sourceNode->getParent()->getId();
+        snapshot_ = serializeSubtree(*duplicatedNode);
     }
 }
 
 void DuplicateVolumeCommand::undo() {
-    if (duplicatedNode_ && sceneGraph_) {
-        sceneGraph_->removeVolume(duplicatedNode_);
-        duplicatedNode_ = nullptr;
+    if (VolumeNode* duplicatedNode = getDuplicatedNode()) {
+        sceneGraph_->removeVolume(duplicatedNode);
     }
 }
 
+VolumeNode* DuplicateVolumeCommand::getDuplicatedNode() const {
+    return sceneGraph_ && duplicatedId_ ? sceneGraph_->findVolumeById(duplicatedId_) : nullptr;
+}
+
 VolumeNode* DuplicateVolumeCommand::duplicateNodeRecursive(VolumeNode* source) {
     if (!source) return nullptr;
     
@@ -162,16 +307,13 @@ VolumeNode* DuplicateVolumeCommand::duplicateNodeRecursive(VolumeNode* source) {
     VolumeNode* duplicate = new VolumeNode(newName);
     
     // Copy transform
-    duplicate->getTransform() = source->getTransform();
+    duplicate->setTransform(source->getTransform());
     
     // Copy material
     duplicate->setMaterial(source->getMaterial());
     
-    // Clone shape using JSON serialization
-    if (source->getShape()) {
-        nlohmann::json shapeJson = source->getShape()->toJson();
-        duplicate->setShape(Shape::fromJson(shapeJson));
-    }
+    // Share the shape: the duplicate is a linked instance until one of them is edited
+    duplicate->setShape(source->getSharedShape());
     
     // Copy SD config
     duplicate->getSDConfig() = source->getSDConfig();
@@ -179,6 +321,9 @@ VolumeNode* DuplicateVolumeCommand::duplicateNodeRecursive(VolumeNode* source) {
     // Copy optical config
     duplicate->getOpticalConfig() = source->getOpticalConfig();
     
+    // Copy array pattern
+    duplicate->setArrayPattern(source->getArrayPattern());
+    
     // Recursively duplicate children
     for (auto* child : source->getChildren()) {
         VolumeNode* childDup = duplicateNodeRecursive(child);
@@ -193,66 +338,78 @@ VolumeNode* DuplicateVolumeCommand::duplicateNodeRecursive(VolumeNode* source) {
 // ModifyShapeCommand
 ModifyShapeCommand::ModifyShapeCommand(VolumeNode* node, const ShapeParams& newParams)
     : node_(node)
-    , newParams_(newParams)
 {
-    if (node_ && node_->getShape()) {
-        oldParams_ = node_->getShape()->getParams();
+    if (node && node->getShape()) {
+        oldShape_ = node->getSharedShape();
+        auto shape = std::make_shared<Shape>(*oldShape_);
+        shape->getParams() = newParams;
+        newShape_ = std::move(shape);
     }
 }
 
 void ModifyShapeCommand::execute() {
-    if (node_ && node_->getShape()) {
-        node_->getShape()->getParams() = newParams_;
+    VolumeNode* node = node_.get();
+    if (node && newShape_) {
+        node->setShape(newShape_);
     }
 }
 
 void ModifyShapeCommand::undo() {
-    if (node_ && node_->getShape()) {
-        node_->getShape()->getParams() = oldParams_;
+    VolumeNode* node = node_.get();
+    if (node && oldShape_) {
+        node->setShape(oldShape_);
     }
 }
 
+size_t ModifyShapeCommand::getMemoryUsage() const {
+    return sizeof(*this) + ownedShapeBytes(oldShape_) + ownedShapeBytes(newShape_);
+}
+
 // ModifyNameCommand
 ModifyNameCommand::ModifyNameCommand(VolumeNode* node, const std::string& newName)
     : node_(node)
     , newName_(newName)
 {
-    if (node_) {
-        oldName_ = node_->getName();
+    if (node) {
+        oldName_ = node->getName();
     }
 }
 
 void ModifyNameCommand::execute() {
-    if (node_) {
-        node_->setName(newName_);
+    if (VolumeNode* node = node_.get()) {
+        node->setName(newName_);
     }
 }
 
 void ModifyNameCommand::undo() {
-    if (node_) {
-        node_->setName(oldName_);
+    if (VolumeNode* node = node_.get()) {
+        node->setName(oldName_);
     }
 }
 
+size_t ModifyNameCommand::getMemoryUsage() const {
+    return sizeof(*this) + oldName_.capacity() + newName_.capacity();
+}
+
 // ModifyMaterialCommand
 ModifyMaterialCommand::ModifyMaterialCommand(VolumeNode* node, std::shared_ptr<Material> newMaterial)
     : node_(node)
     , newMaterial_(newMaterial)
 {
-    if (node_) {
-        oldMaterial_ = node_->getMaterial();
+    if (node) {
+        oldMaterial_ = node->getMaterial();
     }
 }
 
 void ModifyMaterialCommand::execute() {
-    if (node_) {
-        node_->setMaterial(newMaterial_);
+    if (VolumeNode* node = node_.get()) {
+        node->setMaterial(newMaterial_);
     }
 }
 
 void ModifyMaterialCommand::undo() {
-    if (node_) {
-        node_->setMaterial(oldMaterial_);
+    if (VolumeNode* node = node_.get()) {
+        node->setMaterial(oldMaterial_);
     }
 }
 
@@ -261,44 +418,287 @@ ModifySDConfigCommand::ModifySDConfigCommand(VolumeNode* node, const SensitiveDe
     : node_(node)
     , newConfig_(newConfig)
 {
-    if (node_) {
-        oldConfig_ = node_->getSDConfig();
+    if (node) {
+        oldConfig_ = node->getSDConfig();
     }
 }
 
 void ModifySDConfigCommand::execute() {
-    if (node_) {
-        node_->getSDConfig() = newConfig_;
+    if (VolumeNode* node = node_.get()) {
+        node->getSDConfig() = newConfig_;
     }
 }
 
 void ModifySDConfigCommand::undo() {
-    if (node_) {
-        node_->getSDConfig() = oldConfig_;
+    if (VolumeNode* node = node_.get()) {
+        node->getSDConfig() = oldConfig_;
     }
 }
 
+size_t ModifySDConfigCommand::getMemoryUsage() const {
+    return sizeof(*this) + detectorBytes(oldConfig_) + detectorBytes(newConfig_);
+}
+
 // ModifyOpticalConfigCommand
 ModifyOpticalConfigCommand::ModifyOpticalConfigCommand(VolumeNode* node, const OpticalSurfaceConfig& newConfig)
     : node_(node)
     , newConfig_(newConfig)
 {
-    if (node_) {
-        oldConfig_ = node_->getOpticalConfig();
+    if (node) {
+        oldConfig_ = node->getOpticalConfig();
     }
 }
 
 void ModifyOpticalConfigCommand::execute() {
-    if (node_) {
-        node_->getOpticalConfig() = newConfig_;
+    if (VolumeNode* node = node_.get()) {
+        node->getOpticalConfig() = newConfig_;
     }
 }
 
 void ModifyOpticalConfigCommand::undo() {
-    if (node_) {
-        node_->getOpticalConfig() = oldConfig_;
+    if (VolumeNode* node = node_.get()) {
+        node->getOpticalConfig() = oldConfig_;
     }
 }
 
-} // namespace geantcad
+// ModifyVisibilityCommand
+ModifyVisibilityCommand::ModifyVisibilityCommand(VolumeNode* node, bool visible)
+    : node_(node)
+    , newVisible_(visible)
+{
+    if (node) {
+        oldVisible_ = node->isVisible();
+    }
+}
+
+void ModifyVisibilityCommand::execute() {
+    if (VolumeNode* node = node_.get()) {
+        node->setVisible(newVisible_);
+    }
+}
+
+void ModifyVisibilityCommand::undo() {
+    if (VolumeNode* node = node_.get()) {
+        node->setVisible(oldVisible_);
+    }
+}
+
+// ModifyArrayPatternCommand
+ModifyArrayPatternCommand::ModifyArrayPatternCommand(VolumeNode* node, const ArrayPattern& newPattern)
+    : node_(node)
+    , newPattern_(newPattern)
+{
+    if (node) {
+        oldPattern_ = node->getArrayPattern();
+    }
+}
+
+void ModifyArrayPatternCommand::execute() {
+    if (VolumeNode* node = node_.get()) {
+        node->setArrayPattern(newPattern_);
+    }
+}
+
+void ModifyArrayPatternCommand::undo() {
+    if (VolumeNode* node = node_.get()) {
+        node->setArrayPattern(oldPattern_);
+    }
+}
+
+// Journal records
+std::unique_ptr<Command> commandFromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    using Factory = std::unique_ptr<Command> (*)(const nlohmann::json&, SceneGraph*);
+    static const std::pair<const char*, Factory> factories[] = {
+        {"macro", &MacroCommand::fromJson},
+        {"create", &CreateVolumeCommand::fromJson},
+        {"delete", &DeleteVolumeCommand::fromJson},
+        {"transform", &TransformVolumeCommand::fromJson},
+        {"duplicate", &DuplicateVolumeCommand::fromJson},
+        {"shape", &ModifyShapeCommand::fromJson},
+        {"name", &ModifyNameCommand::fromJson},
+        {"material", &ModifyMaterialCommand::fromJson},
+        {"sensitiveDetector", &ModifySDConfigCommand::fromJson},
+        {"opticalSurface", &ModifyOpticalConfigCommand::fromJson},
+        {"visibility", &ModifyVisibilityCommand::fromJson},
+        {"array", &ModifyArrayPatternCommand::fromJson},
+    };
+    try {
+        const std::string type = j.value("type", "");
+        for (const auto& [name, factory] : factories) {
+            if (type == name) {
+                return factory(j, sceneGraph);
+            }
+        }
+        std::cerr << "Unknown command type in journal: " << type << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid command in journal: " << e.what() << std::endl;
+    }
+    return nullptr;
+}
+
+nlohmann::json MacroCommand::toJson() const {
+    nlohmann::json commands = nlohmann::json::array();
+    for (const auto& cmd : commands_) {
+        nlohmann::json record = cmd->toJson();
+        if (record.is_null()) return nullptr;
+        commands.push_back(std::move(record));
+    }
+    return {{"type", "macro"}, {"description", description_}, {"commands", std::move(commands)}};
+}
+
+std::unique_ptr<Command> MacroCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto macro = std::make_unique<MacroCommand>(j.at("description").get<std::string>(), sceneGraph);
+    for (const auto& record : j.at("commands")) {
+        std::unique_ptr<Command> cmd = commandFromJson(record, sceneGraph);
+        if (!cmd) return nullptr;
+        macro->add(std::move(cmd));
+    }
+    return macro;
+}
+
+nlohmann::json CreateVolumeCommand::toJson() const {
+    if (snapshot_.empty()) return nullptr;
+    return {{"type", "create"}, {"name", volumeName_}, {"id", createdId_}, {"snapshot", binaryJson(snapshot_)}};
+}
+
+std::unique_ptr<Command> CreateVolumeCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<CreateVolumeCommand>(sceneGraph, j.at("name").get<std::string>(), nullptr, nullptr);
+    cmd->createdId_ = j.at("id").get<uint64_t>();
+    cmd->snapshot_ = binaryFromJson(j.at("snapshot"));
+    if (cmd->snapshot_.empty()) return nullptr;
+    return cmd;
+}
+
+nlohmann::json DeleteVolumeCommand::toJson() const {
+    nlohmann::json j = {{"type", "delete"}, {"id", nodeId_}, {"parentId", parentId_},
+                        {"index", childIndex_}, {"name", volumeName_}};
+    if (!snapshot_.empty()) {
+        j["snapshot"] = binaryJson(snapshot_);
+    }
+    return j;
+}
+
+std::unique_ptr<Command> DeleteVolumeCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<DeleteVolumeCommand>(sceneGraph, nullptr);
+    cmd->nodeId_ = j.at("id").get<uint64_t>();
+    cmd->parentId_ = j.at("parentId").get<uint64_t>();
+    cmd->childIndex_ = j.at("index").get<size_t>();
+    cmd->volumeName_ = j.at("name").get<std::string>();
+    if (j.contains("snapshot")) {
+        cmd->snapshot_ = binaryFromJson(j["snapshot"]);
+    }
+    return cmd;
+}
+
+nlohmann::json TransformVolumeCommand::toJson() const {
+    return {{"type", "transform"}, {"id", node_.getId()},
+            {"old", oldTransform_.toJson()}, {"new", newTransform_.toJson()}};
+}
+
+std::unique_ptr<Command> TransformVolumeCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<TransformVolumeCommand>(nullptr, Transform::fromJson(j.at("new")));
+    cmd->node_ = NodeRef(sceneGraph, j.at("id").get<uint64_t>());
+    cmd->oldTransform_ = Transform::fromJson(j.at("old"));
+    return cmd;
+}
+
+nlohmann::json DuplicateVolumeCommand::toJson() const {
+    if (snapshot_.empty()) return nullptr;
+    return {{"type", "duplicate"}, {"sourceId", source_.getId()}, {"id", duplicatedId_},
+            {"parentId", parentId_}, {"snapshot", binaryJson(snapshot_)}};
+}
+
+std::unique_ptr<Command> DuplicateVolumeCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<DuplicateVolumeCommand>(sceneGraph, nullptr);
+    cmd->source_ = NodeRef(sceneGraph, j.at("sourceId").get<uint64_t>());
+    cmd->duplicatedId_ = j.at("id").get<uint64_t>();
+    cmd->parentId_ = j.at("parentId").get<uint64_t>();
+    cmd->snapshot_ = binaryFromJson(j.at("snapshot"));
+    if (cmd->snapshot_.empty()) return nullptr;
+    return cmd;
+}
+
+nlohmann::json ModifyShapeCommand::toJson() const {
+    return {{"type", "shape"}, {"id", node_.getId()},
+            {"old", shapeJson(oldShape_)}, {"new", shapeJson(newShape_)}};
+}
+
+std::unique_ptr<Command> ModifyShapeCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<ModifyShapeCommand>(nullptr, ShapeParams());
+    cmd->node_ = NodeRef(sceneGraph, j.at("id").get<uint64_t>());
+    cmd->oldShape_ = shapeFromJson(j.at("old"));
+    cmd->newShape_ = shapeFromJson(j.at("new"));
+    return cmd;
+}
+
+nlohmann::json ModifyNameCommand::toJson() const {
+    return {{"type", "name"}, {"id", node_.getId()}, {"old", oldName_}, {"new", newName_}};
+}
+
+std::unique_ptr<Command> ModifyNameCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<ModifyNameCommand>(nullptr, j.at("new").get<std::string>());
+    cmd->node_ = NodeRef(sceneGraph, j.at("id").get<uint64_t>());
+    cmd->oldName_ = j.at("old").get<std::string>();
+    return cmd;
+}
 
+nlohmann::json ModifyMaterialCommand::toJson() const {
+    return {{"type", "material"}, {"id", node_.getId()},
+            {"old", materialJson(oldMaterial_)}, {"new", materialJson(newMaterial_)}};
+}
+
+std::unique_ptr<Command> ModifyMaterialCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<ModifyMaterialCommand>(nullptr, materialFromJson(j.at("new")));
+    cmd->node_ = NodeRef(sceneGraph, j.at("id").get<uint64_t>());
+    cmd->oldMaterial_ = materialFromJson(j.at("old"));
+    return cmd;
+}
+
+nlohmann::json ModifySDConfigCommand::toJson() const {
+    return {{"type", "sensitiveDetector"}, {"id", node_.getId()},
+            {"old", oldConfig_.toJson()}, {"new", newConfig_.toJson()}};
+}
+
+std::unique_ptr<Command> ModifySDConfigCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<ModifySDConfigCommand>(nullptr, SensitiveDetectorConfig::fromJson(j.at("new")));
+    cmd->node_ = NodeRef(sceneGraph, j.at("id").get<uint64_t>());
+    cmd->oldConfig_ = SensitiveDetectorConfig::fromJson(j.at("old"));
+    return cmd;
+}
+
+nlohmann::json ModifyOpticalConfigCommand::toJson() const {
+    return {{"type", "opticalSurface"}, {"id", node_.getId()},
+            {"old", oldConfig_.toJson()}, {"new", newConfig_.toJson()}};
+}
+
+std::unique_ptr<Command> ModifyOpticalConfigCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<ModifyOpticalConfigCommand>(nullptr, OpticalSurfaceConfig::fromJson(j.at("new")));
+    cmd->node_ = NodeRef(sceneGraph, j.at("id").get<uint64_t>());
+    cmd->oldConfig_ = OpticalSurfaceConfig::fromJson(j.at("old"));
+    return cmd;
+}
+
+nlohmann::json ModifyVisibilityCommand::toJson() const {
+    return {{"type", "visibility"}, {"id", node_.getId()}, {"old", oldVisible_}, {"new", newVisible_}};
+}
+
+std::unique_ptr<Command> ModifyVisibilityCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<ModifyVisibilityCommand>(nullptr, j.at("new").get<bool>());
+    cmd->node_ = NodeRef(sceneGraph, j.at("id").get<uint64_t>());
+    cmd->oldVisible_ = j.at("old").get<bool>();
+    return cmd;
+}
+
+nlohmann::json ModifyArrayPatternCommand::toJson() const {
+    return {{"type", "array"}, {"id", node_.getId()},
+            {"old", oldPattern_.toJson()}, {"new", newPattern_.toJson()}};
+}
+
+std::unique_ptr<Command> ModifyArrayPatternCommand::fromJson(const nlohmann::json& j, SceneGraph* sceneGraph) {
+    auto cmd = std::make_unique<ModifyArrayPatternCommand>(nullptr, ArrayPattern::fromJson(j.at("new")));
+    cmd->node_ = NodeRef(sceneGraph, j.at("id").get<uint64_t>());
+    cmd->oldPattern_ = ArrayPattern::fromJson(j.at("old"));
+    return cmd;
+}
+
+} // namespace geantcad
@@ -1,70 +1,395 @@
 #include "CommandStack.hh"
+#include "Command.hh"
+#include "SceneGraph.hh"
+#include "HistoryJournal.hh"
+#include "Serialization.hh"
+#include <algorithm>
 #include <string>
 
 namespace geantcad {
 
-CommandStack::CommandStack(size_t maxHistory)
-    : currentIndex_(0)
-    , maxHistory_(maxHistory)
+CommandStack::CommandStack(size_t memoryBudget)
+    : memoryBudget_(memoryBudget)
 {
 }
 
+CommandStack::~CommandStack() = default;
+
 void CommandStack::execute(std::unique_ptr<Command> cmd) {
+    // Inside a transaction the command joins the open macro
+    checkSceneRevision();
+    if (transaction_) {
+        cmd->execute();
+        transaction_->add(std::move(cmd));
+        recordSceneRevision();
+        return;
+    }
+    
     // Remove any redo history
-    history_.erase(history_.begin() + currentIndex_, history_.end());
+    const bool wasNewest = currentIndex_ == count_;
+    dropRedo();
     
-    // Execute command
+    // Execute command (payloads such as deleted subtrees are captured here)
+    cmd->execute();
+    
+    // Coalesce with the newest entry (e.g. successive moves of one volume)
+    const auto now = std::chrono::steady_clock::now();
+    const bool recent = now - lastExecute_ < MergeWindow;
+    lastExecute_ = now;
+    const bool merged = wasNewest && recent && count_ > 0 && mergeIntoNewest(*cmd);
+    if (!merged) {
+        const Command& added = *cmd;
+        push(std::move(cmd));
+        if (journal_) {
+            journal_->recordExecute(added, false);
+        }
+        trimToBudget();
+    } else if (journal_) {
+        journal_->recordExecute(*cmd, true);
+    }
+    recordSceneRevision();
+    notifyHistoryChanged();
+}
+
+bool CommandStack::mergeIntoNewest(const Command& cmd) {
+    Slot& newest = slot(count_ - 1);
+    if (!newest.command->mergeWith(cmd)) return false;
+    // The checkpoint shows the state before the merge; the next push takes a new one
+    std::vector<char>().swap(newest.checkpoint);
+    remeasure(newest);
+    return true;
+}
+
+void CommandStack::replayExecute(std::unique_ptr<Command> cmd, bool merged) {
+    const bool wasNewest = currentIndex_ == count_;
+    dropRedo();
     cmd->execute();
+    recordSceneRevision();
+    if (merged && wasNewest && count_ > 0 && mergeIntoNewest(*cmd)) return;
+    push(std::move(cmd));
+    trimToBudget();
+}
+
+void CommandStack::adoptHistory(std::vector<std::unique_ptr<Command>> commands, size_t currentIndex) {
+    ring_.clear();
+    head_ = 0;
+    count_ = 0;
+    memoryUsage_ = 0;
+    for (auto& cmd : commands) {
+        append(std::move(cmd));
+    }
+    currentIndex_ = std::min(currentIndex, count_);
+    recordSceneRevision();
+    trimToBudget();
+}
+
+void CommandStack::append(std::unique_ptr<Command> cmd) {
+    // Add to history, growing the ring when full
+    if (count_ == ring_.size()) {
+        std::vector<Slot> grown(ring_.empty() ? 16 : ring_.size() * 2);
+        for (size_t i = 0; i < count_; ++i) {
+            grown[i] = std::move(slot(i));
+        }
+        ring_ = std::move(grown);
+        head_ = 0;
+    }
+    Slot& added = slot(count_);
+    added.command = std::move(cmd);
+    added.bytes = 0;
+    remeasure(added);
+    ++count_;
+}
+
+void CommandStack::push(std::unique_ptr<Command> cmd) {
+    append(std::move(cmd));
+    currentIndex_ = count_;
+    updateCheckpoint();
+}
+
+size_t CommandStack::replayCost(const Slot& s) {
+    return ReplayCommandCost + (s.bytes - s.checkpoint.capacity());
+}
+
+void CommandStack::updateCheckpoint() {
+    if (!sceneGraph_ || !sceneGraph_->getRoot() || checkpointInterval_ == 0) return;
     
-    // Add to history
-    history_.push_back(std::move(cmd));
-    currentIndex_ = history_.size();
+    // A new checkpoint once replaying from the previous one would cost more
+    // than restoring it: jumps never replay much more than one restore, and
+    // the checkpoints take about as much memory as the commands themselves
+    size_t cost = 0;
+    size_t commands = 0;
+    for (size_t i = count_ - 1; i-- > 0;) {
+        const Slot& s = slot(i);
+        if (!s.checkpoint.empty()) {
+            if (commands < checkpointInterval_ || cost < restoreCost(s)) return;
+            break;
+        }
+        cost += replayCost(s);
+        ++commands;
+    }
+    if (commands + 1 < checkpointInterval_) return;
     
-    // Limit history size
-    if (history_.size() > maxHistory_) {
-        history_.erase(history_.begin());
-        currentIndex_--;
+    Slot& newest = slot(count_ - 1);
+    newest.checkpoint = serializeSubtree(*sceneGraph_->getRoot());
+    remeasure(newest);
+}
+
+void CommandStack::dropRedo() {
+    while (count_ > currentIndex_) {
+        Slot& last = slot(count_ - 1);
+        memoryUsage_ -= last.bytes;
+        last = Slot();
+        --count_;
+    }
+}
+
+void CommandStack::beginTransaction(const std::string& description, SceneGraph* sceneGraph) {
+    if (transactionDepth_++ > 0) return;
+    
+    checkSceneRevision();
+    // The scene diverges from the redo entries from here on
+    dropRedo();
+    transaction_ = std::make_unique<MacroCommand>(description, sceneGraph);
+    if (sceneGraph) {
+        sceneGraph->beginBatch();
+    }
+}
+
+void CommandStack::commit() {
+    if (transactionDepth_ == 0 || --transactionDepth_ > 0) return;
+    
+    std::unique_ptr<MacroCommand> macro = std::move(transaction_);
+    if (macro->getSceneGraph()) {
+        macro->getSceneGraph()->endBatch();
     }
+    if (macro->isEmpty()) return;
     
+    recordSceneRevision();
+    lastExecute_ = std::chrono::steady_clock::now();
+    const Command& added = *macro;
+    push(std::move(macro));
+    if (journal_) {
+        journal_->recordExecute(added, false);
+    }
+    trimToBudget();
     notifyHistoryChanged();
 }
 
+void CommandStack::rollback() {
+    if (!transaction_) return;
+    
+    transactionDepth_ = 0;
+    std::unique_ptr<MacroCommand> macro = std::move(transaction_);
+    macro->undo();
+    if (macro->getSceneGraph()) {
+        macro->getSceneGraph()->endBatch();
+    }
+    recordSceneRevision();
+}
+
 void CommandStack::undo() {
     if (!canUndo()) return;
     
+    checkSceneRevision();
     currentIndex_--;
-    history_[currentIndex_]->undo();
+    Slot& s = slot(currentIndex_);
+    s.command->undo();
+    remeasure(s);
+    recordSceneRevision();
+    closeMergeWindow();
+    if (journal_) {
+        journal_->recordMove(-1);
+    }
     notifyHistoryChanged();
 }
 
 void CommandStack::redo() {
     if (!canRedo()) return;
     
-    history_[currentIndex_]->execute();
+    checkSceneRevision();
+    Slot& s = slot(currentIndex_);
+    s.command->execute();
+    remeasure(s);
     currentIndex_++;
+    recordSceneRevision();
+    closeMergeWindow();
+    if (journal_) {
+        journal_->recordMove(1);
+    }
+    notifyHistoryChanged();
+}
+
+void CommandStack::jumpTo(int index) {
+    if (inTransaction()) return;
+    
+    const size_t target = static_cast<size_t>(std::clamp(index + 1, 0, static_cast<int>(count_)));
+    if (target == currentIndex_) return;
+    const size_t start = currentIndex_;
+    checkSceneRevision();
+    
+    // Replay cost from state 0 to each state; the cheapest plan wins: direct
+    // replay or restoring a checkpoint and replaying from there
+    std::vector<size_t> cost(count_ + 1, 0);
+    for (size_t i = 0; i < count_; ++i) {
+        cost[i + 1] = cost[i] + replayCost(slot(i));
+    }
+    auto replay = [&cost](size_t from, size_t to) {
+        return from > to ? cost[from] - cost[to] : cost[to] - cost[from];
+    };
+    
+    size_t checkpoint = 0;
+    if (sceneGraph_) {
+        size_t best = replay(currentIndex_, target);
+        for (size_t i = 0; i < count_; ++i) {
+            const Slot& s = slot(i);
+            if (s.checkpoint.empty()) continue;
+            const size_t restore = restoreCost(s) + replay(i + 1, target);
+            if (restore < best) {
+                best = restore;
+                checkpoint = i + 1;
+            }
+        }
+        sceneGraph_->beginBatch();
+    }
+    
+    if (checkpoint > 0) {
+        std::unique_ptr<VolumeNode> volumes = deserializeSubtree(slot(checkpoint - 1).checkpoint);
+        if (volumes) {
+            sceneGraph_->restoreHierarchy(*volumes);
+            currentIndex_ = checkpoint;
+        }
+    }
+    step(target);
+    
+    if (sceneGraph_) {
+        sceneGraph_->endBatch();
+    }
+    recordSceneRevision();
+    closeMergeWindow();
+    if (journal_) {
+        journal_->recordMove(static_cast<int>(target) - static_cast<int>(start));
+    }
     notifyHistoryChanged();
 }
 
+void CommandStack::step(size_t state) {
+    while (currentIndex_ > state) {
+        currentIndex_--;
+        Slot& s = slot(currentIndex_);
+        s.command->undo();
+        remeasure(s);
+    }
+    while (currentIndex_ < state) {
+        Slot& s = slot(currentIndex_);
+        s.command->execute();
+        remeasure(s);
+        currentIndex_++;
+    }
+}
+
+void CommandStack::closeMergeWindow() {
+    // After undo/redo the newest entry is not what the user just did: the
+    // next command must not coalesce with it
+    lastExecute_ = std::chrono::steady_clock::now() - MergeWindow;
+}
+
+void CommandStack::setSceneGraph(SceneGraph* sceneGraph) {
+    if (sceneGraph_ == sceneGraph) return;
+    sceneGraph_ = sceneGraph;
+    // Checkpoints of another scene are meaningless
+    dropCheckpoints();
+    recordSceneRevision();
+}
+
+void CommandStack::setCheckpointInterval(size_t commands) {
+    checkpointInterval_ = commands;
+    if (checkpointInterval_ == 0) {
+        dropCheckpoints();
+    }
+}
+
+void CommandStack::dropCheckpoints() {
+    for (size_t i = 0; i < count_; ++i) {
+        std::vector<char>().swap(slot(i).checkpoint);
+        remeasure(slot(i));
+    }
+}
+
+void CommandStack::checkSceneRevision() {
+    // Restoring a checkpoint would revert edits that bypassed the commands
+    if (sceneGraph_ && sceneGraph_->getRevision() != sceneRevision_) {
+        dropCheckpoints();
+        sceneRevision_ = sceneGraph_->getRevision();
+    }
+}
+
+void CommandStack::recordSceneRevision() {
+    sceneRevision_ = sceneGraph_ ? sceneGraph_->getRevision() : 0;
+}
+
 void CommandStack::clear() {
-    history_.clear();
+    if (transaction_) {
+        // The executed commands stay applied, without history
+        if (transaction_->getSceneGraph()) {
+            transaction_->getSceneGraph()->endBatch();
+        }
+        transaction_.reset();
+        transactionDepth_ = 0;
+    }
+    ring_.clear();
+    head_ = 0;
+    count_ = 0;
     currentIndex_ = 0;
+    memoryUsage_ = 0;
+    recordSceneRevision();
+    if (journal_) {
+        journal_->recordClear();
+    }
     notifyHistoryChanged();
 }
 
-const std::string& CommandStack::getUndoDescription() const {
-    static const std::string empty;
+void CommandStack::setMemoryBudget(size_t bytes) {
+    memoryBudget_ = bytes;
+    if (memoryUsage_ > memoryBudget_) {
+        trimToBudget();
+        notifyHistoryChanged();
+    }
+}
+
+std::string CommandStack::getUndoDescription() const {
     if (canUndo()) {
-        return history_[currentIndex_ - 1]->getDescription();
+        return slot(currentIndex_ - 1).command->getDescription();
     }
-    return empty;
+    return std::string();
 }
 
-const std::string& CommandStack::getRedoDescription() const {
-    static const std::string empty;
+std::string CommandStack::getRedoDescription() const {
     if (canRedo()) {
-        return history_[currentIndex_]->getDescription();
+        return slot(currentIndex_).command->getDescription();
+    }
+    return std::string();
+}
+
+void CommandStack::remeasure(Slot& s) {
+    memoryUsage_ -= s.bytes;
+    s.bytes = s.command->getMemoryUsage() + s.checkpoint.capacity();
+    memoryUsage_ += s.bytes;
+}
+
+void CommandStack::dropOldest() {
+    Slot& oldest = slot(0);
+    memoryUsage_ -= oldest.bytes;
+    oldest = Slot();
+    head_ = (head_ + 1) & (ring_.size() - 1);
+    --count_;
+    --currentIndex_;
+}
+
+void CommandStack::trimToBudget() {
+    // Oldest first; redo entries and the last undoable command are kept
+    while (memoryUsage_ > memoryBudget_ && count_ > 1 && currentIndex_ > 1) {
+        dropOldest();
     }
-    return empty;
 }
 
 void CommandStack::notifyHistoryChanged() {
@@ -74,4 +399,3 @@ void CommandStack::notifyHistoryChanged() {
 }
 
 } // namespace geantcad
-
@@ -0,0 +1,596 @@
+#include "HistoryJournal.hh"
+#include "Command.hh"
+#include "CommandStack.hh"
+#include "SceneGraph.hh"
+#include "Serialization.hh"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace geantcad {
+
+namespace fs = std::filesystem;
+
+/**
+ * Layout del log (journal.log), byte order dell'host:
+ *
+ *   "GCADJRNL" | u32 versione | Record*
+ *   Record = u32 size | u32 crc32 | u8 type | payload   (size e crc su type + payload)
+ *
+ * Il log inizia sempre con BaseRecord + HistoryRecord. La lettura si ferma
+ * al primo record incompleto o con CRC errato (scrittura interrotta).
+ */
+namespace {
+
+constexpr char JournalMagic[8] = {'G', 'C', 'A', 'D', 'J', 'R', 'N', 'L'};
+constexpr uint32_t JournalVersion = 1;
+constexpr size_t FileHeaderSize = sizeof(JournalMagic) + sizeof(uint32_t);
+constexpr size_t RecordHeaderSize = 2 * sizeof(uint32_t);
+constexpr const char* LogName = "journal.log";
+constexpr const char* CompactName = "journal.log.tmp";
+
+uint32_t crc32(const char* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        c = table[(c ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+// Frame 'payload' as a record at the end of 'out'; the CRC is left to sealRecords
+void appendFrame(std::vector<char>& out, uint8_t type, const void* payload, size_t size) {
+    const uint32_t length = static_cast<uint32_t>(size + 1);
+    const size_t at = out.size();
+    out.resize(at + RecordHeaderSize + length);
+    std::memcpy(out.data() + at, &length, sizeof(length));
+    out[at + RecordHeaderSize] = static_cast<char>(type);
+    if (size > 0) {
+        std::memcpy(out.data() + at + RecordHeaderSize + 1, payload, size);
+    }
+}
+
+// Fill in the CRC of every record from 'offset' on
+void sealRecords(std::vector<char>& data, size_t offset) {
+    while (offset + RecordHeaderSize <= data.size()) {
+        uint32_t length = 0;
+        std::memcpy(&length, data.data() + offset, sizeof(length));
+        const uint32_t crc = crc32(data.data() + offset + RecordHeaderSize, length);
+        std::memcpy(data.data() + offset + sizeof(uint32_t), &crc, sizeof(crc));
+        offset += RecordHeaderSize + length;
+    }
+}
+
+std::vector<uint8_t> encode(const nlohmann::json& j) {
+    return nlohmann::json::to_cbor(j);
+}
+
+nlohmann::json decode(const char* data, size_t size) {
+    return nlohmann::json::from_cbor(reinterpret_cast<const uint8_t*>(data),
+                                     reinterpret_cast<const uint8_t*>(data) + size);
+}
+
+// Plain descriptors: the writer needs fsync, which streams don't offer
+int openFile(const std::string& path, bool truncate) {
+#ifdef _WIN32
+    const int flags = _O_WRONLY | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : _O_APPEND);
+    return _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+    const int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : O_APPEND);
+    return ::open(path.c_str(), flags, 0644);
+#endif
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        const int n = _write(fd, data, static_cast<unsigned>(std::min<size_t>(size, size_t(1) << 30)));
+#else
+        const ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+#endif
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool syncFile(int fd) {
+#if defined(_WIN32)
+    return _commit(fd) == 0;
+#elif defined(__APPLE__)
+    return ::fsync(fd) == 0;
+#else
+    return ::fdatasync(fd) == 0;
+#endif
+}
+
+void closeFile(int fd) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+// Make a rename durable (POSIX wants the directory entry synced too)
+void syncDirectory(const std::string& directory) {
+#ifndef _WIN32
+    const int fd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#else
+    (void)directory;
+#endif
+}
+
+} // namespace
+
+HistoryJournal::HistoryJournal() = default;
+
+HistoryJournal::~HistoryJournal() {
+    close(false);
+}
+
+bool HistoryJournal::open(const std::string& directory, SceneGraph* sceneGraph, CommandStack* commandStack) {
+    close(false);
+    if (!sceneGraph || !commandStack) return false;
+
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec) {
+        lastError_ = "Cannot create journal directory " + directory + ": " + ec.message();
+        std::cerr << lastError_ << std::endl;
+        return false;
+    }
+
+    directory_ = directory;
+    sceneGraph_ = sceneGraph;
+    commandStack_ = commandStack;
+    started_ = false;
+    lastError_.clear();
+    startWriter();
+    commandStack_->setJournal(this);
+    return true;
+}
+
+void HistoryJournal::close(bool discard) {
+    if (!isOpen()) return;
+    if (commandStack_->getJournal() == this) {
+        commandStack_->setJournal(nullptr);
+    }
+    stopWriter();
+    if (discard) {
+        std::error_code ec;
+        fs::remove(logPath(), ec);
+        fs::remove(fs::path(directory_) / CompactName, ec);
+        fs::remove(directory_, ec);  // only if nothing else lives there
+    }
+    sceneGraph_ = nullptr;
+    commandStack_ = nullptr;
+    started_ = false;
+}
+
+bool HistoryJournal::hasJournal(const std::string& directory) {
+    std::error_code ec;
+    const auto size = fs::file_size(fs::path(directory) / LogName, ec);
+    return !ec && size > FileHeaderSize;
+}
+
+std::string HistoryJournal::logPath() const {
+    return (fs::path(directory_) / LogName).string();
+}
+
+bool HistoryJournal::recover() {
+    if (!isOpen()) return false;
+
+    std::ifstream file(logPath(), std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        lastError_ = "No journal in " + directory_;
+        return false;
+    }
+    std::vector<char> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(data.data(), std::streamsize(data.size()));
+    file.close();
+
+    uint32_t version = 0;
+    if (data.size() >= FileHeaderSize) {
+        std::memcpy(&version, data.data() + sizeof(JournalMagic), sizeof(version));
+    }
+    if (data.size() < FileHeaderSize || std::memcmp(data.data(), JournalMagic, sizeof(JournalMagic)) != 0 ||
+        version != JournalVersion) {
+        lastError_ = "Not a GeantCAD journal: " + logPath();
+        std::cerr << lastError_ << std::endl;
+        return false;
+    }
+
+    // Records up to the first torn or corrupt one
+    struct Record {
+        uint8_t type;
+        const char* payload;
+        size_t size;
+    };
+    std::vector<Record> records;
+    size_t pos = FileHeaderSize;
+    while (data.size() - pos > RecordHeaderSize) {
+        uint32_t length = 0;
+        uint32_t crc = 0;
+        std::memcpy(&length, data.data() + pos, sizeof(length));
+        std::memcpy(&crc, data.data() + pos + sizeof(length), sizeof(crc));
+        const char* body = data.data() + pos + RecordHeaderSize;
+        if (length == 0 || length > data.size() - pos - RecordHeaderSize || crc32(body, length) != crc) break;
+        records.push_back({static_cast<uint8_t>(body[0]), body + 1, length - 1});
+        pos += RecordHeaderSize + length;
+    }
+    if (pos != data.size()) {
+        std::cerr << "Journal: dropped " << (data.size() - pos) << " damaged bytes at the end of " << logPath() << std::endl;
+    }
+    if (records.size() < 2 || records[0].type != BaseRecord || records[1].type != HistoryRecord) {
+        lastError_ = "Journal has no base snapshot: " + logPath();
+        std::cerr << lastError_ << std::endl;
+        return false;
+    }
+
+    // Replay with the journal detached, so nothing is recorded twice
+    CommandStack& stack = *commandStack_;
+    stack.setJournal(nullptr);
+    stack.adoptHistory({}, 0);
+    if (!deserializeScene(sceneGraph_, std::vector<char>(records[0].payload, records[0].payload + records[0].size))) {
+        lastError_ = "Cannot restore the journal snapshot: " + logPath();
+        stack.setJournal(this);
+        return false;
+    }
+
+    sceneGraph_->beginBatch();
+    try {
+        const nlohmann::json history = decode(records[1].payload, records[1].size);
+        std::vector<std::unique_ptr<Command>> commands;
+        for (const auto& record : history.at("commands")) {
+            std::unique_ptr<Command> cmd = commandFromJson(record, sceneGraph_);
+            if (!cmd) throw std::runtime_error("unreadable history entry");
+            commands.push_back(std::move(cmd));
+        }
+        stack.adoptHistory(std::move(commands), history.at("current").get<size_t>());
+
+        for (size_t i = 2; i < records.size(); ++i) {
+            const Record& r = records[i];
+            switch (r.type) {
+                case ExecuteRecord: {
+                    const nlohmann::json j = decode(r.payload, r.size);
+                    std::unique_ptr<Command> cmd = commandFromJson(j.at("command"), sceneGraph_);
+                    if (!cmd) throw std::runtime_error("unreadable command");
+                    stack.replayExecute(std::move(cmd), j.value("merged", false));
+                    break;
+                }
+                case MoveRecord: {
+                    const int delta = decode(r.payload, r.size).at("delta").get<int>();
+                    stack.jumpTo(stack.getCurrentIndex() + delta);
+                    break;
+                }
+                case ClearRecord:
+                    stack.adoptHistory({}, 0);
+                    break;
+                default:
+                    throw std::runtime_error("unknown record type " + std::to_string(r.type));
+            }
+        }
+    } catch (const std::exception& e) {
+        // Keep what was replayed: the scene is consistent up to the bad record
+        lastError_ = std::string("Journal replay stopped early: ") + e.what();
+        std::cerr << lastError_ << std::endl;
+    }
+    sceneGraph_->endBatch();
+    stack.setJournal(this);
+    stack.notifyHistoryChanged();
+
+    // Fold the replayed records (and drop a damaged tail) into a new base
+    compact();
+    return true;
+}
+
+void HistoryJournal::recordExecute(const Command& cmd, bool merged) {
+    if (!started_) return;
+    nlohmann::json record = cmd.toJson();
+    if (record.is_null()) {
+        // Not expressible as a record: the change goes into a new base instead
+        compact();
+        return;
+    }
+    appendRecord(ExecuteRecord, {{"command", std::move(record)}, {"merged", merged}});
+}
+
+void HistoryJournal::recordMove(int delta) {
+    if (delta == 0) return;
+    appendRecord(MoveRecord, {{"delta", delta}});
+}
+
+void HistoryJournal::recordClear() {
+    appendRecord(ClearRecord, nullptr);
+}
+
+void HistoryJournal::appendRecord(RecordType type, nlohmann::json record) {
+    if (!started_) return;
+    Job job;
+    job.type = type;
+    job.record = std::move(record);
+    if (enqueue(std::move(job))) {
+        compact();
+    }
+}
+
+void HistoryJournal::compact() {
+    if (!isOpen()) return;
+    const CommandStack& stack = *commandStack_;
+
+    // History from the newest entry that can't be journaled on (entries
+    // before it are lost on recovery, a redo tail is cut there)
+    nlohmann::json commands = nlohmann::json::array();
+    size_t first = 0;
+    for (size_t i = 0; i < stack.count_; ++i) {
+        nlohmann::json record = stack.slot(i).command->toJson();
+        if (record.is_null()) {
+            if (i >= stack.currentIndex_) break;
+            commands = nlohmann::json::array();
+            first = i + 1;
+            continue;
+        }
+        commands.push_back(std::move(record));
+    }
+    const std::vector<char> base = serializeScene(*sceneGraph_);
+
+    Job job;
+    job.compact = true;
+    job.data.reserve(FileHeaderSize + RecordHeaderSize + 1 + base.size());
+    job.data.insert(job.data.end(), JournalMagic, JournalMagic + sizeof(JournalMagic));
+    job.data.resize(FileHeaderSize);
+    std::memcpy(job.data.data() + sizeof(JournalMagic), &JournalVersion, sizeof(JournalVersion));
+    appendFrame(job.data, BaseRecord, base.data(), base.size());
+    job.type = HistoryRecord;
+    job.record = {{"commands", std::move(commands)}, {"current", stack.currentIndex_ - first}};
+
+    started_ = true;
+    enqueue(std::move(job));
+}
+
+bool HistoryJournal::enqueue(Job job) {
+    bool wake = false;
+    bool due = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        compactQueued_ = compactQueued_ || job.compact;
+        queue_.push_back(std::move(job));
+        ++queuedSeq_;
+        // A busy writer picks the job up with its next batch
+        wake = writerIdle_;
+        due = !compactQueued_ && (rebase_ || appendedBytes_ > std::max(compactThreshold_, baseBytes_));
+    }
+    if (wake) {
+        wake_.notify_one();
+    }
+    return due;
+}
+
+bool HistoryJournal::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const uint64_t target = queuedSeq_;
+    synced_.wait(lock, [&] { return syncedSeq_ >= target; });
+    return !rebase_;
+}
+
+JournalStats HistoryJournal::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+std::string HistoryJournal::getLastError() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return writerError_.empty() ? lastError_ : writerError_;
+}
+
+void HistoryJournal::startWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.clear();
+        queuedSeq_ = 0;
+        syncedSeq_ = 0;
+        stop_ = false;
+        writerIdle_ = false;
+        compactQueued_ = false;
+        rebase_ = false;
+        writerError_.clear();
+        baseBytes_ = 0;
+        appendedBytes_ = 0;
+        stats_ = JournalStats();
+    }
+    writer_ = std::thread(&HistoryJournal::writerLoop, this);
+}
+
+void HistoryJournal::stopWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
+
+void HistoryJournal::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        writerIdle_ = true;
+        wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        writerIdle_ = false;
+        if (queue_.empty()) break;  // stopping, everything written
+
+        // Group commit: whatever piled up while the previous batch was syncing
+        std::deque<Job> batch;
+        batch.swap(queue_);
+        const uint64_t seq = queuedSeq_;
+        lock.unlock();
+
+        // A new base supersedes the records queued before it
+        size_t first = 0;
+        for (size_t i = batch.size(); i-- > 0;) {
+            if (batch[i].compact) {
+                first = i;
+                break;
+            }
+        }
+        JournalStats done;
+        std::string error;
+        bool appended = false;
+        bool rebased = false;
+        size_t baseBytes = 0;
+        size_t appendedBytes = 0;
+        for (size_t i = first; i < batch.size(); ++i) {
+            Job& job = batch[i];
+            const size_t offset = job.compact ? FileHeaderSize : 0;
+            const std::vector<uint8_t> payload = job.record.is_null() ? std::vector<uint8_t>() : encode(job.record);
+            appendFrame(job.data, job.type, payload.data(), payload.size());
+            sealRecords(job.data, offset);
+            if (job.compact) {
+                if (replaceLog(job.data, error)) {
+                    ++done.compactions;
+                    ++done.syncs;
+                    done.bytes += job.data.size();
+                    rebased = true;
+                    baseBytes = job.data.size();
+                    appendedBytes = 0;
+                } else {
+                    ++done.failures;
+                }
+            } else if (fd_ < 0) {
+                // Left to the base requested after the failure
+                ++done.dropped;
+            } else if (writeJob(job, error)) {
+                ++done.records;
+                done.bytes += job.data.size();
+                appendedBytes += job.data.size();
+                appended = true;
+            } else {
+                ++done.failures;
+                ++done.dropped;
+            }
+        }
+        if (appended && fd_ >= 0) {
+            if (syncFile(fd_)) {
+                ++done.syncs;
+            } else {
+                // Whether the records reached the disk is unknown: start over from a base
+                error = std::string("Journal: fsync failed: ") + std::strerror(errno);
+                ++done.failures;
+                closeFile(fd_);
+                fd_ = -1;
+            }
+        }
+        if (!error.empty()) {
+            std::cerr << error << std::endl;
+        }
+
+        lock.lock();
+        stats_.records += done.records;
+        stats_.bytes += done.bytes;
+        stats_.syncs += done.syncs;
+        stats_.compactions += done.compactions;
+        stats_.failures += done.failures;
+        stats_.dropped += done.dropped;
+        if (rebased) {
+            baseBytes_ = baseBytes;
+            appendedBytes_ = 0;
+        }
+        if (!error.empty()) {
+            writerError_ = error;
+        }
+        // Until a base is written to a reopened log, records can't be appended
+        rebase_ = fd_ < 0;
+        appendedBytes_ += appendedBytes;
+        compactQueued_ = std::any_of(queue_.begin(), queue_.end(), [](const Job& job) { return job.compact; });
+        syncedSeq_ = seq;
+        synced_.notify_all();
+    }
+    lock.unlock();
+
+    if (fd_ >= 0) {
+        closeFile(fd_);
+        fd_ = -1;
+    }
+}
+
+bool HistoryJournal::writeJob(Job& job, std::string& error) {
+    if (writeAll(fd_, job.data.data(), job.data.size())) return true;
+    // Records can't follow a partial one: stop appending until the next base
+    error = std::string("Journal: write failed: ") + std::strerror(errno);
+    closeFile(fd_);
+    fd_ = -1;
+    return false;
+}
+
+bool HistoryJournal::replaceLog(const std::vector<char>& data, std::string& error) {
+    // Written aside and renamed over the log: a crash leaves the old or the new one
+    const std::string compactPath = (fs::path(directory_) / CompactName).string();
+    const int fd = openFile(compactPath, true);
+    if (fd < 0) {
+        error = "Journal: cannot create " + compactPath + ": " + std::strerror(errno);
+        return false;
+    }
+    const bool written = writeAll(fd, data.data(), data.size()) && syncFile(fd);
+    if (!written) {
+        error = "Journal: cannot write " + compactPath + ": " + std::strerror(errno);
+    }
+    closeFile(fd);
+
+    std::error_code ec;
+    if (written) {
+        fs::rename(compactPath, logPath(), ec);
+        if (ec) {
+            error = "Journal: cannot replace " + logPath() + ": " + ec.message();
+        }
+    }
+    if (!written || ec) {
+        // The old log is untouched and fd_ still appends to it
+        fs::remove(compactPath, ec);
+        return false;
+    }
+    syncDirectory(directory_);
+
+    // fd_ still points at the replaced file
+    if (fd_ >= 0) {
+        closeFile(fd_);
+    }
+    fd_ = openFile(logPath(), false);
+    if (fd_ < 0) {
+        error = "Journal: cannot reopen " + logPath() + ": " + std::strerror(errno);
+    }
+    return true;
+}
+
+} // namespace geantcad
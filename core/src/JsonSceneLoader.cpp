@@ -0,0 +1,274 @@
+#include "Serialization.hh"
+#include "SceneGraph.hh"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace geantcad {
+
+/**
+ * Loader SAX per scene.json: i VolumeNode vengono creati e collegati man mano
+ * che arrivano i token, senza costruire il DOM dell'intero documento.
+ *
+ * Solo i membri di un singolo volume (shape, material, transform, sdConfig...)
+ * vengono raccolti in un piccolo oggetto JSON, letto a fine oggetto con lo stesso
+ * codice di VolumeNode::fromJson. La memoria extra e' quindi limitata a un
+ * oggetto per livello di profondita', non proporzionale al file.
+ *
+ * La tabella "materials" di norma precede "root" (toJson ordina i membri); se
+ * arriva dopo, i "materialId" letti fin li' vengono risolti a fine documento.
+ */
+class JsonSceneLoader {
+public:
+    using json = nlohmann::json;
+
+    JsonSceneLoader(std::istream& in, size_t totalBytes, const LoadProgressCallback& progress)
+        : in_(in), totalBytes_(totalBytes), progress_(progress) {}
+
+    // SAX interface (nlohmann::json::sax_parse)
+    bool null() { return scalar(nullptr); }
+    bool boolean(bool value) { return scalar(value); }
+    bool number_integer(json::number_integer_t value) { return scalar(value); }
+    bool number_unsigned(json::number_unsigned_t value) { return scalar(value); }
+    bool number_float(json::number_float_t value, const json::string_t&) { return scalar(value); }
+    bool string(json::string_t& value) { return scalar(std::move(value)); }
+    bool binary(json::binary_t&) { return fail("unexpected binary value"); }
+    bool start_object(std::size_t);
+    bool key(json::string_t& name);
+    bool end_object() { return endContainer(); }
+    bool start_array(std::size_t);
+    bool end_array() { return endContainer(); }
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e) { return fail(e.what()); }
+
+    bool wasCancelled() const { return cancelled_; }
+    const std::string& getError() const { return error_; }
+    size_t getVolumeCount() const { return volumes_; }
+
+    // After a successful parse: install the hierarchy (if the document had a root)
+    void apply(SceneGraph* sceneGraph);
+
+private:
+    struct Frame {
+        enum class Kind { Document, Volume, Children };
+        Kind kind;
+        VolumeNode* node = nullptr;          // Volume: node being read, Children: their parent
+        json fields = json::object();        // Document/Volume: members read so far
+    };
+
+    bool scalar(json value);
+    json* slot();
+    bool open(json container);
+    bool endContainer();
+    VolumeNode* newVolume(VolumeNode* parent);
+    bool reportProgress();
+    void loadMaterials(json& fields);
+    bool fail(const std::string& message) { error_ = message; return false; }
+
+    std::istream& in_;
+    size_t totalBytes_;
+    const LoadProgressCallback& progress_;
+
+    std::vector<Frame> frames_;
+    std::string key_;               // last member name of the innermost Document/Volume frame
+    std::vector<json*> values_;     // open containers of the member value being collected
+    json* member_ = nullptr;        // next object slot inside a collected value
+    std::unique_ptr<VolumeNode> root_;
+    MaterialRegistry materials_;    // table referenced by "materialId"
+    bool materialsLoaded_ = false;
+    std::vector<std::pair<VolumeNode*, size_t>> pendingMaterials_;  // read before the table
+    json settings_;                 // document members other than the root
+    size_t volumes_ = 0;
+    bool cancelled_ = false;
+    std::string error_;
+};
+
+JsonSceneLoader::json* JsonSceneLoader::slot() {
+    if (values_.empty()) {
+        return &frames_.back().fields[key_];
+    }
+    json& top = *values_.back();
+    if (top.is_array()) {
+        top.push_back(nullptr);
+        return &top.back();
+    }
+    return member_;
+}
+
+bool JsonSceneLoader::scalar(json value) {
+    if (frames_.empty() || (values_.empty() && frames_.back().kind == Frame::Kind::Children)) {
+        return fail("expected a volume object");
+    }
+    *slot() = std::move(value);
+    return true;
+}
+
+bool JsonSceneLoader::open(json container) {
+    json* target = slot();
+    *target = std::move(container);
+    values_.push_back(target);
+    return true;
+}
+
+VolumeNode* JsonSceneLoader::newVolume(VolumeNode* parent) {
+    auto* node = new VolumeNode("");
+    if (parent) {
+        // Owned by the parent from now on; a fresh node cannot be a duplicate child
+        node->parent_ = parent;
+        parent->children_.push_back(node);
+    } else {
+        root_.reset(node);
+    }
+    frames_.push_back({Frame::Kind::Volume, node});
+    return node;
+}
+
+bool JsonSceneLoader::start_object(std::size_t) {
+    if (!values_.empty()) return open(json::object());
+    if (frames_.empty()) {
+        frames_.push_back({Frame::Kind::Document});
+        return true;
+    }
+    switch (frames_.back().kind) {
+        case Frame::Kind::Document:
+            if (key_ == "root") {
+                if (root_) return fail("duplicate root");
+                // toJson writes members sorted, so the material table normally comes first
+                loadMaterials(frames_.back().fields);
+                newVolume(nullptr);
+                return true;
+            }
+            return open(json::object());
+        case Frame::Kind::Volume:
+            return open(json::object());
+        case Frame::Kind::Children:
+            newVolume(frames_.back().node);
+            return true;
+    }
+    return false;
+}
+
+bool JsonSceneLoader::start_array(std::size_t) {
+    if (!values_.empty()) return open(json::array());
+    if (frames_.empty()) return fail("scene JSON must be an object");
+    switch (frames_.back().kind) {
+        case Frame::Kind::Volume:
+            if (key_ == "children") {
+                frames_.push_back({Frame::Kind::Children, frames_.back().node});
+                return true;
+            }
+            return open(json::array());
+        case Frame::Kind::Document:
+            return open(json::array());
+        case Frame::Kind::Children:
+            return fail("expected a volume object");
+    }
+    return false;
+}
+
+bool JsonSceneLoader::key(json::string_t& name) {
+    if (!values_.empty()) {
+        member_ = &(*values_.back())[name];
+    } else {
+        key_ = std::move(name);
+    }
+    return true;
+}
+
+bool JsonSceneLoader::endContainer() {
+    if (!values_.empty()) {
+        values_.pop_back();
+        return true;
+    }
+    Frame& frame = frames_.back();
+    switch (frame.kind) {
+        case Frame::Kind::Volume:
+            if (!materialsLoaded_ && frame.fields.contains("materialId")) {
+                pendingMaterials_.emplace_back(frame.node, frame.fields["materialId"].get<size_t>());
+                frame.fields.erase("materialId");
+            }
+            frame.node->readJsonFields(frame.fields, &materials_);
+            ++volumes_;
+            frames_.pop_back();
+            return (volumes_ % 1024 != 0) || reportProgress();
+        case Frame::Kind::Children:
+            frames_.pop_back();
+            return true;
+        case Frame::Kind::Document:
+            loadMaterials(frame.fields);
+            if (!pendingMaterials_.empty()) {
+                if (!materialsLoaded_) {
+                    return fail("Volume references a material table that is missing");
+                }
+                for (const auto& [node, id] : pendingMaterials_) {
+                    node->material_ = materials_.at(id);
+                }
+                pendingMaterials_.clear();
+            }
+            settings_ = std::move(frame.fields);
+            frames_.pop_back();
+            return true;
+    }
+    return false;
+}
+
+void JsonSceneLoader::loadMaterials(json& fields) {
+    if (materialsLoaded_ || !fields.contains("materials")) return;
+    materials_ = MaterialRegistry::fromJson(fields["materials"]);
+    fields.erase("materials");
+    materialsLoaded_ = true;
+}
+
+bool JsonSceneLoader::reportProgress() {
+    if (!progress_) return true;
+    std::streamoff position = in_.tellg();
+    size_t bytesRead = position > 0 ? std::min(size_t(position), totalBytes_) : 0;
+    if (!progress_(bytesRead, totalBytes_)) {
+        cancelled_ = true;
+        return false;
+    }
+    return true;
+}
+
+void JsonSceneLoader::apply(SceneGraph* sceneGraph) {
+    if (root_) {
+        sceneGraph->adoptLoadedScene(std::move(root_), settings_);
+    }
+}
+
+bool loadSceneFromJson(SceneGraph* sceneGraph, const std::string& filePath, const LoadProgressCallback& progress) {
+    if (!sceneGraph) return false;
+
+    // Larger stream buffer: the parser pulls one character at a time
+    std::vector<char> buffer(1 << 16);
+    std::ifstream file;
+    file.rdbuf()->pubsetbuf(buffer.data(), std::streamsize(buffer.size()));
+    file.open(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file for reading: " << filePath << std::endl;
+        return false;
+    }
+
+    std::error_code ec;
+    size_t totalBytes = size_t(std::filesystem::file_size(filePath, ec));
+    if (ec) totalBytes = 0;
+
+    try {
+        JsonSceneLoader loader(file, totalBytes, progress);
+        if (!nlohmann::json::sax_parse(file, &loader)) {
+            if (!loader.wasCancelled()) {
+                std::cerr << "Error loading scene " << filePath << ": " << loader.getError() << std::endl;
+            }
+            return false;
+        }
+        if (progress && !progress(totalBytes, totalBytes)) {
+            return false;
+        }
+        loader.apply(sceneGraph);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error loading scene: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+} // namespace geantcad
@@ -2,9 +2,26 @@
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <functional>
 
 namespace geantcad {
 
+namespace {
+    void hashCombine(size_t& seed, size_t value) {
+        seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    }
+    
+    template<class T>
+    void hashValue(size_t& seed, const T& value) {
+        hashCombine(seed, std::hash<T>()(value));
+    }
+    
+    bool sameElement(const Element& a, const Element& b) {
+        return a.symbol == b.symbol && a.name == b.name
+            && a.atomicNumber == b.atomicNumber && a.atomicMass == b.atomicMass;
+    }
+}
+
 // ============= Element Implementation =============
 
 nlohmann::json Element::toJson() const {
@@ -121,6 +138,62 @@ nlohmann::json Material::toJson() const {
     return j;
 }
 
+size_t Material::contentHash() const {
+    size_t seed = 0;
+    hashValue(seed, name_);
+    hashValue(seed, nistName_);
+    hashValue(seed, static_cast<int>(type_));
+    hashValue(seed, density_);
+    hashValue(seed, atomicNumber_);
+    hashValue(seed, atomicMass_);
+    hashValue(seed, components_.size());
+    for (const auto& comp : components_) {
+        hashValue(seed, static_cast<int>(comp.type));
+        hashValue(seed, comp.element.symbol);
+        hashValue(seed, comp.element.atomicNumber);
+        hashValue(seed, comp.element.atomicMass);
+        hashValue(seed, comp.material ? comp.material->contentHash() : size_t(0));
+        hashValue(seed, comp.fraction);
+        hashValue(seed, comp.nAtoms);
+    }
+    hashValue(seed, static_cast<int>(state_));
+    hashValue(seed, temperature_);
+    hashValue(seed, pressure_);
+    hashValue(seed, visual_.r);
+    hashValue(seed, visual_.g);
+    hashValue(seed, visual_.b);
+    hashValue(seed, visual_.a);
+    hashValue(seed, visual_.wireframe);
+    return seed;
+}
+
+bool Material::sameContent(const Material& other) const {
+    if (this == &other) return true;
+    if (name_ != other.name_ || nistName_ != other.nistName_ || type_ != other.type_
+        || density_ != other.density_ || atomicNumber_ != other.atomicNumber_
+        || atomicMass_ != other.atomicMass_ || state_ != other.state_
+        || temperature_ != other.temperature_ || pressure_ != other.pressure_
+        || visual_.r != other.visual_.r || visual_.g != other.visual_.g
+        || visual_.b != other.visual_.b || visual_.a != other.visual_.a
+        || visual_.wireframe != other.visual_.wireframe
+        || components_.size() != other.components_.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < components_.size(); ++i) {
+        const auto& a = components_[i];
+        const auto& b = other.components_[i];
+        if (a.type != b.type || a.fraction != b.fraction || a.nAtoms != b.nAtoms
+            || !sameElement(a.element, b.element)) {
+            return false;
+        }
+        if (a.material != b.material
+            && (!a.material || !b.material || !a.material->sameContent(*b.material))) {
+            return false;
+        }
+    }
+    return true;
+}
+
 std::shared_ptr<Material> Material::fromJson(const nlohmann::json& j) {
     auto mat = std::make_shared<Material>(j["name"], j.value("nistName", ""));
     mat->density_ = j.value("density", 0.0);
@@ -0,0 +1,99 @@
+#include "MaterialRegistry.hh"
+#include <stdexcept>
+
+namespace geantcad {
+
+size_t MaterialRegistry::find(const Material& material) const {
+    auto it = byPointer_.find(&material);
+    if (it != byPointer_.end()) return it->second;
+
+    auto bucket = byHash_.find(material.contentHash());
+    if (bucket == byHash_.end()) return npos;
+    for (size_t index : bucket->second) {
+        if (materials_[index]->sameContent(material)) return index;
+    }
+    return npos;
+}
+
+std::shared_ptr<Material> MaterialRegistry::intern(const std::shared_ptr<Material>& material) {
+    if (!material) return nullptr;
+
+    size_t index = find(*material);
+    if (index != npos) return materials_[index];
+
+    // Referenced component materials are shared too
+    for (const auto& comp : material->getComponents()) {
+        intern(comp.material);
+    }
+
+    index = materials_.size();
+    materials_.push_back(material);
+    byHash_[material->contentHash()].push_back(index);
+    byPointer_.emplace(material.get(), index);
+    return material;
+}
+
+size_t MaterialRegistry::indexOf(const Material* material) const {
+    return material ? find(*material) : npos;
+}
+
+std::shared_ptr<Material> MaterialRegistry::at(size_t index) const {
+    if (index >= materials_.size()) {
+        throw std::out_of_range("Unknown material id " + std::to_string(index));
+    }
+    return materials_[index];
+}
+
+void MaterialRegistry::clear() {
+    materials_.clear();
+    byHash_.clear();
+    byPointer_.clear();
+}
+
+nlohmann::json MaterialRegistry::toJson() const {
+    nlohmann::json j = nlohmann::json::array();
+    for (const auto& material : materials_) {
+        j.push_back(material->toJson());
+    }
+    return j;
+}
+
+MaterialRegistry MaterialRegistry::fromJson(const nlohmann::json& j) {
+    MaterialRegistry registry;
+    if (!j.is_array()) return registry;
+
+    // Entries are not interned: ids must match the table positions
+    std::unordered_map<std::string, std::shared_ptr<Material>> byName;
+    for (const auto& entry : j) {
+        auto material = Material::fromJson(entry);
+        byName.emplace(material->getName(), material);
+        size_t index = registry.materials_.size();
+        registry.materials_.push_back(material);
+        registry.byPointer_.emplace(material.get(), index);
+    }
+
+    // MaterialComponent::fromJson leaves material references to the caller
+    for (size_t i = 0; i < registry.materials_.size(); ++i) {
+        const auto& entry = j[i];
+        if (!entry.contains("components")) continue;
+        auto components = registry.materials_[i]->getComponents();
+        bool resolved = false;
+        for (size_t c = 0; c < components.size() && c < entry["components"].size(); ++c) {
+            const auto& compJson = entry["components"][c];
+            auto ref = byName.find(compJson.value("materialName", ""));
+            if (components[c].type == MaterialComponent::Type::Material && ref != byName.end()) {
+                components[c].material = ref->second;
+                resolved = true;
+            }
+        }
+        if (resolved) registry.materials_[i]->setComponents(components);
+    }
+
+    // Hash last: component references are part of the content
+    for (size_t i = 0; i < registry.materials_.size(); ++i) {
+        registry.byHash_[registry.materials_[i]->contentHash()].push_back(i);
+    }
+    return registry;
+}
+
+} // namespace geantcad
@@ -0,0 +1,915 @@
+#include "OverlapChecker.hh"
+#include "SceneGraph.hh"
+#include "SceneTraversal.hh"
+#include "VolumeNode.hh"
+#include "ArrayPattern.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace geantcad {
+
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+constexpr double TwoPi = 2.0 * Pi;
+constexpr double HalfPi = 0.5 * Pi;
+constexpr double DegToRad = Pi / 180.0;
+
+// ===== Small double-precision vector/frame helpers =====
+
+struct V3 {
+    double x, y, z;
+};
+
+inline V3 operator+(const V3& a, const V3& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline V3 operator-(const V3& a, const V3& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline V3 operator*(const V3& a, double s) { return {a.x * s, a.y * s, a.z * s}; }
+inline double dot(const V3& a, const V3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline V3 cross(const V3& a, const V3& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+inline double norm(const V3& a) { return std::sqrt(dot(a, a)); }
+
+// Rigid placement: world = rot * local + pos (no scale, as in the GDML export)
+struct Frame {
+    double r[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    V3 t{0, 0, 0};
+
+    V3 toWorld(const V3& p) const {
+        return {r[0][0] * p.x + r[0][1] * p.y + r[0][2] * p.z + t.x,
+                r[1][0] * p.x + r[1][1] * p.y + r[1][2] * p.z + t.y,
+                r[2][0] * p.x + r[2][1] * p.y + r[2][2] * p.z + t.z};
+    }
+    V3 dirToLocal(const V3& d) const {
+        return {r[0][0] * d.x + r[1][0] * d.y + r[2][0] * d.z,
+                r[0][1] * d.x + r[1][1] * d.y + r[2][1] * d.z,
+                r[0][2] * d.x + r[1][2] * d.y + r[2][2] * d.z};
+    }
+    V3 toLocal(const V3& p) const { return dirToLocal(p - t); }
+    V3 axis(int i) const { return {r[0][i], r[1][i], r[2][i]}; }
+};
+
+Frame localFrame(const Transform& transform) {
+    Frame f;
+    const QQuaternion& q = transform.getRotation();
+    double w = q.scalar(), x = q.x(), y = q.y(), z = q.z();
+    double n = w * w + x * x + y * y + z * z;
+    if (n > 0.0) {
+        double s = 2.0 / n;
+        f.r[0][0] = 1 - s * (y * y + z * z); f.r[0][1] = s * (x * y - w * z);     f.r[0][2] = s * (x * z + w * y);
+        f.r[1][0] = s * (x * y + w * z);     f.r[1][1] = 1 - s * (x * x + z * z); f.r[1][2] = s * (y * z - w * x);
+        f.r[2][0] = s * (x * z - w * y);     f.r[2][1] = s * (y * z + w * x);     f.r[2][2] = 1 - s * (x * x + y * y);
+    }
+    const QVector3D& p = transform.getTranslation();
+    f.t = {p.x(), p.y(), p.z()};
+    return f;
+}
+
+Frame compose(const Frame& parent, const Frame& local) {
+    Frame f;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            f.r[i][j] = parent.r[i][0] * local.r[0][j] + parent.r[i][1] * local.r[1][j] + parent.r[i][2] * local.r[2][j];
+        }
+    }
+    f.t = parent.toWorld(local.t);
+    return f;
+}
+
+// ===== Solids =====
+
+/**
+ * Shape parameters unpacked once (radians, sorted planes). Tubes, cones and
+ * polycones are all "revolved" solids described by z planes; polyhedra are
+ * revolved solids with sides > 0 (radii are distances to the sides).
+ */
+struct Solid {
+    enum class Kind { None, Box, Trd, Sphere, Revolved };
+
+    Kind kind = Kind::None;
+    double a[5] = {};  // Box: dx dy dz | Trd: dx1 dx2 dy1 dy2 dz | Sphere: rmin rmax
+    double sphi = 0.0, dphi = TwoPi;
+    double stheta = 0.0, etheta = Pi;
+    bool fullPhi = true, fullTheta = true;
+    int sides = 0;
+    std::vector<double> z, rmin, rmax;
+    double lo[3] = {}, hi[3] = {};  // local bounds
+
+    bool isCylinder() const {
+        return kind == Kind::Revolved && sides == 0 && fullPhi && z.size() == 2
+            && rmin[0] == rmin[1] && rmax[0] == rmax[1];
+    }
+    bool isSolidSphere() const { return kind == Kind::Sphere && a[0] <= 0.0 && fullPhi && fullTheta; }
+    bool isPolyhedral() const { return kind == Kind::Box || kind == Kind::Trd; }
+    bool isConvex() const {
+        if (isPolyhedral() || isSolidSphere()) return true;
+        return kind == Kind::Revolved && sides == 0 && fullPhi && z.size() == 2
+            && rmin[0] <= 0.0 && rmin[1] <= 0.0;
+    }
+    // Convex hull known in closed form (holes and inner radii do not matter)
+    bool hasHull() const {
+        if (kind == Kind::Sphere) return fullPhi && fullTheta;
+        return kind != Kind::None && fullPhi;
+    }
+};
+
+void setPhi(Solid& s, double sphi, double dphi) {
+    s.fullPhi = dphi >= 360.0 - 1e-9;
+    s.sphi = sphi * DegToRad;  // also orients the sides of a full polyhedra
+    s.dphi = s.fullPhi ? TwoPi : dphi * DegToRad;
+}
+
+bool setPlanes(Solid& s, std::vector<double> z, std::vector<double> rmin, std::vector<double> rmax) {
+    if (z.size() < 2 || rmin.size() != z.size() || rmax.size() != z.size()) return false;
+    if (z.front() > z.back()) {
+        std::reverse(z.begin(), z.end());
+        std::reverse(rmin.begin(), rmin.end());
+        std::reverse(rmax.begin(), rmax.end());
+    }
+    if (!std::is_sorted(z.begin(), z.end()) || z.front() == z.back()) return false;
+    for (size_t i = 0; i < z.size(); ++i) {
+        if (rmin[i] < 0.0 || rmax[i] < rmin[i]) return false;
+    }
+    s.kind = Solid::Kind::Revolved;
+    s.z = std::move(z);
+    s.rmin = std::move(rmin);
+    s.rmax = std::move(rmax);
+    return true;
+}
+
+Solid makeSolid(const Shape* shape) {
+    Solid s;
+    if (!shape || !shape->localBounds(s.lo, s.hi)) return s;
+
+    bool ok = false;
+    if (auto* p = shape->getParamsAs<BoxParams>()) {
+        s.kind = Solid::Kind::Box;
+        s.a[0] = p->x; s.a[1] = p->y; s.a[2] = p->z;
+        ok = p->x > 0 && p->y > 0 && p->z > 0;
+    } else if (auto* p = shape->getParamsAs<TrdParams>()) {
+        s.kind = Solid::Kind::Trd;
+        s.a[0] = p->dx1; s.a[1] = p->dx2; s.a[2] = p->dy1; s.a[3] = p->dy2; s.a[4] = p->dz;
+        ok = p->dz > 0 && p->dx1 >= 0 && p->dx2 >= 0 && p->dy1 >= 0 && p->dy2 >= 0
+            && std::max(p->dx1, p->dx2) > 0 && std::max(p->dy1, p->dy2) > 0;
+    } else if (auto* p = shape->getParamsAs<SphereParams>()) {
+        s.kind = Solid::Kind::Sphere;
+        s.a[0] = p->rmin; s.a[1] = p->rmax;
+        setPhi(s, p->sphi, p->dphi);
+        s.fullTheta = p->stheta <= 0.0 && p->stheta + p->dtheta >= 180.0 - 1e-9;
+        s.stheta = std::max(0.0, p->stheta) * DegToRad;
+        s.etheta = std::min(180.0, p->stheta + p->dtheta) * DegToRad;
+        ok = p->rmax > p->rmin && p->rmin >= 0 && s.etheta > s.stheta && p->dphi > 0;
+    } else if (auto* p = shape->getParamsAs<TubeParams>()) {
+        setPhi(s, p->sphi, p->dphi);
+        ok = p->dz > 0 && p->dphi > 0
+            && setPlanes(s, {-p->dz, p->dz}, {p->rmin, p->rmin}, {p->rmax, p->rmax});
+    } else if (auto* p = shape->getParamsAs<ConeParams>()) {
+        setPhi(s, p->sphi, p->dphi);
+        ok = p->dz > 0 && p->dphi > 0
+            && setPlanes(s, {-p->dz, p->dz}, {p->rmin1, p->rmin2}, {p->rmax1, p->rmax2});
+    } else if (auto* p = shape->getParamsAs<PolyconeParams>()) {
+        setPhi(s, p->sphi, p->dphi);
+        ok = p->dphi > 0 && setPlanes(s, p->zPlanes, p->rmin, p->rmax);
+    } else if (auto* p = shape->getParamsAs<PolyhedraParams>()) {
+        setPhi(s, p->sphi, p->dphi);
+        s.sides = p->numSides;
+        ok = p->numSides >= 1 && p->dphi > 0 && setPlanes(s, p->zPlanes, p->rmin, p->rmax);
+    }
+    if (!ok) s.kind = Solid::Kind::None;
+    return s;
+}
+
+// Angle of (x, y) from the start of the phi segment, in [0, 2pi)
+inline double relativePhi(const Solid& s, double x, double y) {
+    double phi = std::atan2(y, x) - s.sphi;
+    return phi - TwoPi * std::floor(phi / TwoPi);
+}
+
+// Signed distance to the two phi half-planes (positive inside the segment)
+double phiDistance(const Solid& s, double x, double y) {
+    double rho = std::hypot(x, y);
+    double phi = relativePhi(s, x, y);
+    if (phi <= s.dphi) {
+        return rho * std::sin(std::min(std::min(phi, s.dphi - phi), HalfPi));
+    }
+    return -rho * std::sin(std::min(std::min(phi - s.dphi, TwoPi - phi), HalfPi));
+}
+
+// Distance of a point from the z axis, measured to the side planes for polyhedra
+double radialCoordinate(const Solid& s, double x, double y) {
+    double rho = std::hypot(x, y);
+    if (s.sides <= 0 || rho == 0.0) return rho;
+    double width = s.dphi / s.sides;
+    double phi = relativePhi(s, x, y);
+    double side = std::min(std::floor(phi / width), double(s.sides - 1));
+    return rho * std::cos(phi - (side + 0.5) * width);
+}
+
+/**
+ * Approximate signed distance to the surface: positive inside, negative
+ * outside. It is the minimum over the bounding surfaces (planes, cones, phi
+ * and theta cuts), so the sign is exact and the magnitude is close to the
+ * real distance (exact for boxes).
+ */
+double insideDepth(const Solid& s, const V3& p) {
+    switch (s.kind) {
+        case Solid::Kind::Box: {
+            double qx = std::abs(p.x) - s.a[0], qy = std::abs(p.y) - s.a[1], qz = std::abs(p.z) - s.a[2];
+            double ox = std::max(qx, 0.0), oy = std::max(qy, 0.0), oz = std::max(qz, 0.0);
+            double outside = std::sqrt(ox * ox + oy * oy + oz * oz);
+            return -(outside + std::min(std::max(qx, std::max(qy, qz)), 0.0));
+        }
+        case Solid::Kind::Trd: {
+            double dz = s.a[4];
+            double t = (p.z + dz) / (2.0 * dz);
+            double sx = (s.a[1] - s.a[0]) / (2.0 * dz), sy = (s.a[3] - s.a[2]) / (2.0 * dz);
+            double hx = s.a[0] + (s.a[1] - s.a[0]) * t, hy = s.a[2] + (s.a[3] - s.a[2]) * t;
+            double d = dz - std::abs(p.z);
+            d = std::min(d, (hx - std::abs(p.x)) / std::sqrt(1.0 + sx * sx));
+            return std::min(d, (hy - std::abs(p.y)) / std::sqrt(1.0 + sy * sy));
+        }
+        case Solid::Kind::Sphere: {
+            double r = norm(p);
+            double d = s.a[1] - r;
+            if (s.a[0] > 0.0) d = std::min(d, r - s.a[0]);
+            if (!s.fullTheta && r > 0.0) {
+                double theta = std::acos(std::clamp(p.z / r, -1.0, 1.0));
+                if (theta >= s.stheta && theta <= s.etheta) {
+                    d = std::min(d, r * std::sin(std::min(std::min(theta - s.stheta, s.etheta - theta), HalfPi)));
+                } else {
+                    double off = theta < s.stheta ? s.stheta - theta : theta - s.etheta;
+                    d = std::min(d, -r * std::sin(std::min(off, HalfPi)));
+                }
+            }
+            if (!s.fullPhi) d = std::min(d, phiDistance(s, p.x, p.y));
+            return d;
+        }
+        case Solid::Kind::Revolved: {
+            const std::vector<double>& z = s.z;
+            double d = std::min(p.z - z.front(), z.back() - p.z);
+            // Section containing p.z (clamped at the ends; zero-length steps skipped)
+            size_t i = std::upper_bound(z.begin(), z.end(), p.z) - z.begin();
+            i = std::min(std::max<size_t>(i, 1), z.size() - 1) - 1;
+            while (z[i + 1] == z[i] && i + 2 < z.size()) ++i;
+            while (z[i + 1] == z[i] && i > 0) --i;
+            double len = z[i + 1] - z[i];
+            double t = std::clamp((p.z - z[i]) / len, 0.0, 1.0);
+            double rho = radialCoordinate(s, p.x, p.y);
+            double so = (s.rmax[i + 1] - s.rmax[i]) / len;
+            d = std::min(d, (s.rmax[i] + (s.rmax[i + 1] - s.rmax[i]) * t - rho) / std::sqrt(1.0 + so * so));
+            if (s.rmin[i] > 0.0 || s.rmin[i + 1] > 0.0) {
+                double si = (s.rmin[i + 1] - s.rmin[i]) / len;
+                d = std::min(d, (rho - s.rmin[i] - (s.rmin[i + 1] - s.rmin[i]) * t) / std::sqrt(1.0 + si * si));
+            }
+            if (!s.fullPhi) d = std::min(d, phiDistance(s, p.x, p.y));
+            return d;
+        }
+        case Solid::Kind::None:
+            break;
+    }
+    return -1.0;
+}
+
+// Max of dot(p, d) over the convex hull of the solid (Solid::hasHull)
+double support(const Solid& s, const V3& d) {
+    switch (s.kind) {
+        case Solid::Kind::Box:
+            return std::abs(d.x) * s.a[0] + std::abs(d.y) * s.a[1] + std::abs(d.z) * s.a[2];
+        case Solid::Kind::Trd: {
+            double dz = s.a[4];
+            return std::max(-dz * d.z + std::abs(d.x) * s.a[0] + std::abs(d.y) * s.a[2],
+                            dz * d.z + std::abs(d.x) * s.a[1] + std::abs(d.y) * s.a[3]);
+        }
+        case Solid::Kind::Sphere:
+            return s.a[1] * norm(d);
+        case Solid::Kind::Revolved: {
+            // Outer rim of every plane: circles, or the polygon corners
+            double radial = std::hypot(d.x, d.y);
+            if (s.sides > 0) {
+                double width = s.dphi / s.sides, best = 0.0;
+                for (int k = 0; k < s.sides; ++k) {
+                    double phi = s.sphi + k * width;
+                    best = std::max(best, std::cos(phi) * d.x + std::sin(phi) * d.y);
+                }
+                radial = best / std::cos(0.5 * width);
+            }
+            double best = -std::numeric_limits<double>::max();
+            for (size_t i = 0; i < s.z.size(); ++i) best = std::max(best, s.z[i] * d.z + s.rmax[i] * radial);
+            return best;
+        }
+        case Solid::Kind::None:
+            break;
+    }
+    return 0.0;
+}
+
+// Corners of a box or trd
+void vertices(const Solid& s, V3 out[8]) {
+    for (int i = 0; i < 8; ++i) {
+        double sx = (i & 1) ? 1.0 : -1.0, sy = (i & 2) ? 1.0 : -1.0, sz = (i & 4) ? 1.0 : -1.0;
+        if (s.kind == Solid::Kind::Box) {
+            out[i] = {sx * s.a[0], sy * s.a[1], sz * s.a[2]};
+        } else {
+            bool top = sz > 0;
+            out[i] = {sx * s.a[top ? 1 : 0], sy * s.a[top ? 3 : 2], sz * s.a[4]};
+        }
+    }
+}
+
+// ===== Surface sampling =====
+
+class SurfaceSampler {
+public:
+    explicit SurfaceSampler(uint64_t seed) : rng_(seed) {}
+
+    void sample(const Solid& s, int count, std::vector<V3>& out) {
+        out.clear();
+        out.reserve(count);
+        switch (s.kind) {
+            case Solid::Kind::Box: sampleBox(s, count, out); break;
+            case Solid::Kind::Trd: sampleTrd(s, count, out); break;
+            case Solid::Kind::Sphere: sampleSphere(s, count, out); break;
+            case Solid::Kind::Revolved: sampleRevolved(s, count, out); break;
+            case Solid::Kind::None: break;
+        }
+    }
+
+private:
+    double uniform() { return dist_(rng_); }
+    double uniform(double lo, double hi) { return lo + (hi - lo) * uniform(); }
+
+    // Index of a patch, chosen proportionally to its area
+    size_t pick(const std::vector<double>& areas, double total) {
+        double u = uniform() * total;
+        size_t last = 0;
+        for (size_t i = 0; i < areas.size(); ++i) {
+            if (areas[i] <= 0.0) continue;
+            if (u < areas[i]) return i;
+            u -= areas[i];
+            last = i;
+        }
+        return last;  // rounding
+    }
+
+    void sampleBox(const Solid& s, int count, std::vector<V3>& out) {
+        const double* h = s.a;
+        areas_ = {h[1] * h[2], h[1] * h[2], h[0] * h[2], h[0] * h[2], h[0] * h[1], h[0] * h[1]};
+        double total = 2.0 * (h[1] * h[2] + h[0] * h[2] + h[0] * h[1]);
+        for (int n = 0; n < count; ++n) {
+            size_t face = pick(areas_, total);
+            double c[3] = {uniform(-h[0], h[0]), uniform(-h[1], h[1]), uniform(-h[2], h[2])};
+            c[face / 2] = (face & 1) ? h[face / 2] : -h[face / 2];
+            out.push_back({c[0], c[1], c[2]});
+        }
+    }
+
+    void sampleTrd(const Solid& s, int count, std::vector<V3>& out) {
+        double dx1 = s.a[0], dx2 = s.a[1], dy1 = s.a[2], dy2 = s.a[3], dz = s.a[4];
+        areas_ = {dx1 * dy1, dx2 * dy2, dz * (dy1 + dy2), dz * (dy1 + dy2), dz * (dx1 + dx2), dz * (dx1 + dx2)};
+        double total = 0.0;
+        for (double a : areas_) total += a;
+        for (int n = 0; n < count; ++n) {
+            size_t face = pick(areas_, total);
+            if (face < 2) {
+                double hx = face ? dx2 : dx1, hy = face ? dy2 : dy1;
+                out.push_back({uniform(-hx, hx), uniform(-hy, hy), face ? dz : -dz});
+                continue;
+            }
+            double z = uniform(-dz, dz);
+            double t = (z + dz) / (2.0 * dz);
+            double hx = dx1 + (dx2 - dx1) * t, hy = dy1 + (dy2 - dy1) * t;
+            double side = (face & 1) ? 1.0 : -1.0;
+            if (face < 4) out.push_back({side * hx, uniform(-hy, hy), z});
+            else out.push_back({uniform(-hx, hx), side * hy, z});
+        }
+    }
+
+    void sampleSphere(const Solid& s, int count, std::vector<V3>& out) {
+        double rmin = s.a[0], rmax = s.a[1];
+        double c0 = std::cos(s.stheta), c1 = std::cos(s.etheta);
+        double ring = 0.5 * (rmax * rmax - rmin * rmin);
+        areas_ = {
+            s.dphi * (c0 - c1) * rmax * rmax,
+            s.dphi * (c0 - c1) * rmin * rmin,
+            s.stheta > 0.0 ? s.dphi * std::sin(s.stheta) * ring : 0.0,
+            s.etheta < Pi ? s.dphi * std::sin(s.etheta) * ring : 0.0,
+            s.fullPhi ? 0.0 : 2.0 * (s.etheta - s.stheta) * ring
+        };
+        double total = 0.0;
+        for (double a : areas_) total += a;
+        if (total <= 0.0) return;
+        for (int n = 0; n < count; ++n) {
+            size_t patch = pick(areas_, total);
+            double r, theta, phi = s.sphi + uniform() * s.dphi;
+            if (patch < 2) {
+                r = patch == 0 ? rmax : rmin;
+                theta = std::acos(std::clamp(c0 - uniform() * (c0 - c1), -1.0, 1.0));
+            } else {
+                r = std::sqrt(rmin * rmin + uniform() * (rmax * rmax - rmin * rmin));
+                if (patch == 2) theta = s.stheta;
+                else if (patch == 3) theta = s.etheta;
+                else {
+                    theta = uniform(s.stheta, s.etheta);
+                    phi = uniform() < 0.5 ? s.sphi : s.sphi + s.dphi;
+                }
+            }
+            double st = std::sin(theta);
+            out.push_back({r * st * std::cos(phi), r * st * std::sin(phi), r * std::cos(theta)});
+        }
+    }
+
+    struct Patch {
+        enum Type { Outer, Inner, Ring, PhiCut } type;
+        size_t section;  // plane index (Ring) or lower plane of the section
+        double r0, r1;   // Ring: radial interval
+        double z;        // Ring: plane position
+    };
+
+    void sampleRevolved(const Solid& s, int count, std::vector<V3>& out) {
+        const std::vector<double>& z = s.z;
+        patches_.clear();
+        areas_.clear();
+        auto add = [this](const Patch& p, double area) {
+            if (area <= 0.0) return;
+            patches_.push_back(p);
+            areas_.push_back(area);
+        };
+
+        // Lateral surfaces and phi cuts of each section
+        for (size_t i = 0; i + 1 < z.size(); ++i) {
+            double len = z[i + 1] - z[i];
+            if (len <= 0.0) continue;
+            add({Patch::Outer, i, 0, 0, 0}, 0.5 * s.dphi * (s.rmax[i] + s.rmax[i + 1]) * std::hypot(len, s.rmax[i + 1] - s.rmax[i]));
+            add({Patch::Inner, i, 0, 0, 0}, 0.5 * s.dphi * (s.rmin[i] + s.rmin[i + 1]) * std::hypot(len, s.rmin[i + 1] - s.rmin[i]));
+            if (!s.fullPhi) {
+                add({Patch::PhiCut, i, 0, 0, 0}, len * (s.rmax[i] - s.rmin[i] + s.rmax[i + 1] - s.rmin[i + 1]));
+            }
+        }
+        // Flat rings at each z level: the symmetric difference between the
+        // cross-section arriving from below and the one leaving upwards
+        for (size_t j = 0; j < z.size();) {
+            size_t k = j;
+            while (k + 1 < z.size() && z[k + 1] == z[j]) ++k;
+            double below[2] = {0.0, 0.0}, above[2] = {0.0, 0.0};
+            if (j > 0) { below[0] = s.rmin[j]; below[1] = s.rmax[j]; }
+            if (k + 1 < z.size()) { above[0] = s.rmin[k]; above[1] = s.rmax[k]; }
+            double e[4] = {below[0], below[1], above[0], above[1]};
+            std::sort(e, e + 4);
+            for (int half = 0; half < 2; ++half) {
+                double r0 = e[2 * half], r1 = e[2 * half + 1];
+                add({Patch::Ring, j, r0, r1, z[j]}, 0.5 * s.dphi * (r1 * r1 - r0 * r0));
+            }
+            j = k + 1;
+        }
+
+        double total = 0.0;
+        for (double a : areas_) total += a;
+        if (total <= 0.0) return;
+
+        double width = s.sides > 0 ? s.dphi / s.sides : 0.0;
+        for (int n = 0; n < count; ++n) {
+            const Patch& p = patches_[pick(areas_, total)];
+            double phi = uniform() * s.dphi;
+            double rho = 0.0, pz = p.z;
+            if (p.type == Patch::Ring) {
+                rho = std::sqrt(p.r0 * p.r0 + uniform() * (p.r1 * p.r1 - p.r0 * p.r0));
+            } else {
+                size_t i = p.section;
+                const std::vector<double>& radius = p.type == Patch::Inner ? s.rmin : s.rmax;
+                double t, r;
+                // Rejection on the radius keeps the density uniform on cones
+                double rMax = std::max(radius[i], radius[i + 1]);
+                do {
+                    t = uniform();
+                    r = radius[i] + (radius[i + 1] - radius[i]) * t;
+                } while (p.type != Patch::PhiCut && uniform() * rMax > r);
+                pz = z[i] + (z[i + 1] - z[i]) * t;
+                if (p.type == Patch::PhiCut) {
+                    double r0 = s.rmin[i] + (s.rmin[i + 1] - s.rmin[i]) * t;
+                    double r1 = s.rmax[i] + (s.rmax[i + 1] - s.rmax[i]) * t;
+                    rho = uniform(r0, r1);
+                    phi = uniform() < 0.5 ? 0.0 : s.dphi;
+                } else {
+                    rho = r;
+                }
+            }
+            if (s.sides > 0) {
+                // Radii are distances to the sides: move onto the polygon
+                double side = std::min(std::floor(phi / width), double(s.sides - 1));
+                rho /= std::cos(phi - (side + 0.5) * width);
+            }
+            phi += s.sphi;
+            out.push_back({rho * std::cos(phi), rho * std::sin(phi), pz});
+        }
+    }
+
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<double> dist_{0.0, 1.0};
+    std::vector<double> areas_;
+    std::vector<Patch> patches_;
+};
+
+// ===== Scene snapshot =====
+
+struct Volume {
+    VolumeNode* node = nullptr;
+    int copy = 0;  // array copy of the node
+    int parent = -1;
+    Frame frame;
+    Solid solid;
+    double lo[3] = {}, hi[3] = {};  // world bounds
+    bool valid() const { return solid.kind != Solid::Kind::None; }
+    V3 center() const { return frame.t; }
+};
+
+void worldBounds(Volume& v) {
+    // Arvo: transform the local box extents through the rotation
+    for (int i = 0; i < 3; ++i) {
+        double t = i == 0 ? v.frame.t.x : (i == 1 ? v.frame.t.y : v.frame.t.z);
+        v.lo[i] = v.hi[i] = t;
+        for (int j = 0; j < 3; ++j) {
+            double a = v.frame.r[i][j] * v.solid.lo[j], b = v.frame.r[i][j] * v.solid.hi[j];
+            v.lo[i] += std::min(a, b);
+            v.hi[i] += std::max(a, b);
+        }
+    }
+}
+
+V3 boundsOverlapCenter(const Volume& a, const Volume& b) {
+    double c[3];
+    for (int i = 0; i < 3; ++i) c[i] = 0.5 * (std::max(a.lo[i], b.lo[i]) + std::min(a.hi[i], b.hi[i]));
+    return {c[0], c[1], c[2]};
+}
+
+struct Hit {
+    double depth = -1.0;
+    V3 point{0, 0, 0};
+};
+
+// ===== Analytic narrow phase =====
+
+// Penetration depth of two boxes: the smallest overlap over the 15 SAT axes
+double boxBoxDepth(const Volume& a, const Volume& b) {
+    V3 axesA[3] = {a.frame.axis(0), a.frame.axis(1), a.frame.axis(2)};
+    V3 axesB[3] = {b.frame.axis(0), b.frame.axis(1), b.frame.axis(2)};
+    V3 t = b.center() - a.center();
+    double best = std::numeric_limits<double>::max();
+    auto test = [&](V3 axis) {
+        double len = norm(axis);
+        if (len < 1e-9) return;  // parallel edges: covered by the face axes
+        axis = axis * (1.0 / len);
+        double ra = 0.0, rb = 0.0;
+        for (int i = 0; i < 3; ++i) {
+            ra += a.solid.a[i] * std::abs(dot(axesA[i], axis));
+            rb += b.solid.a[i] * std::abs(dot(axesB[i], axis));
+        }
+        best = std::min(best, ra + rb - std::abs(dot(t, axis)));
+    };
+    for (int i = 0; i < 3; ++i) test(axesA[i]);
+    for (int i = 0; i < 3; ++i) test(axesB[i]);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) test(cross(axesA[i], axesB[j]));
+    }
+    return best;
+}
+
+// Two cylinders with parallel axes: coaxial shells or off-axis solid cylinders
+bool parallelCylinders(const Volume& a, const Volume& b, double& along, double& perp) {
+    V3 axis = a.frame.axis(2);
+    if (std::abs(dot(axis, b.frame.axis(2))) < 1.0 - 1e-12) return false;
+    V3 delta = b.center() - a.center();
+    along = dot(delta, axis);
+    perp = norm(delta - axis * along);
+    return true;
+}
+
+bool analyticSiblings(const Volume& a, const Volume& b, Hit& hit) {
+    const Solid& sa = a.solid;
+    const Solid& sb = b.solid;
+    if (sa.kind == Solid::Kind::Box && sb.kind == Solid::Kind::Box) {
+        hit.depth = boxBoxDepth(a, b);
+        hit.point = boundsOverlapCenter(a, b);
+        return true;
+    }
+    if (sa.isSolidSphere() && sb.isSolidSphere()) {
+        V3 delta = b.center() - a.center();
+        double d = norm(delta);
+        hit.depth = sa.a[1] + sb.a[1] - d;
+        hit.point = d > 0.0 ? a.center() + delta * (sa.a[1] / d) : a.center();
+        return true;
+    }
+    if ((sa.kind == Solid::Kind::Box && sb.isSolidSphere()) || (sb.kind == Solid::Kind::Box && sa.isSolidSphere())) {
+        const Volume& box = sa.kind == Solid::Kind::Box ? a : b;
+        const Volume& sphere = sa.kind == Solid::Kind::Box ? b : a;
+        const double* h = box.solid.a;
+        V3 c = box.frame.toLocal(sphere.center());
+        V3 q{std::clamp(c.x, -h[0], h[0]), std::clamp(c.y, -h[1], h[1]), std::clamp(c.z, -h[2], h[2])};
+        double inside = insideDepth(box.solid, c);
+        hit.depth = sphere.solid.a[1] + (inside > 0.0 ? inside : -norm(c - q));
+        hit.point = box.frame.toWorld(q);
+        return true;
+    }
+    double along, perp;
+    if (sa.isCylinder() && sb.isCylinder() && parallelCylinders(a, b, along, perp)) {
+        double radial;
+        if (perp < 1e-9) {
+            radial = std::min(sa.rmax[0], sb.rmax[0]) - std::max(sa.rmin[0], sb.rmin[0]);
+        } else if (sa.rmin[0] <= 0.0 && sb.rmin[0] <= 0.0) {
+            radial = sa.rmax[0] + sb.rmax[0] - perp;
+        } else {
+            return false;
+        }
+        double axial = sa.z[1] + sb.z[1] - std::abs(along);
+        hit.depth = std::min(radial, axial);
+        hit.point = boundsOverlapCenter(a, b);
+        return true;
+    }
+    return false;
+}
+
+bool analyticExtrusion(const Volume& d, const Volume& m, Hit& hit) {
+    const Solid& sd = d.solid;
+    const Solid& sm = m.solid;
+    if (sm.kind == Solid::Kind::Box && sd.hasHull()) {
+        // Extent of the daughter along each mother axis, from the support
+        // function of its hull (a convex mother contains a solid iff it contains its hull)
+        for (int i = 0; i < 3; ++i) {
+            V3 e = m.frame.axis(i);
+            double c = dot(d.center() - m.center(), e);
+            double up = c + support(sd, d.frame.dirToLocal(e)) - sm.a[i];
+            double down = -c + support(sd, d.frame.dirToLocal(e * -1.0)) - sm.a[i];
+            double depth = std::max(up, down);
+            if (depth > hit.depth) {
+                V3 local = m.frame.toLocal(d.center());
+                double* coord = i == 0 ? &local.x : (i == 1 ? &local.y : &local.z);
+                *coord = up >= down ? sm.a[i] : -sm.a[i];
+                hit.depth = depth;
+                hit.point = m.frame.toWorld(local);
+            }
+        }
+        return true;
+    }
+    if (sd.isPolyhedral() && sm.isConvex()) {
+        // A polyhedron is inside a convex solid iff all its corners are
+        V3 corners[8];
+        vertices(sd, corners);
+        for (const V3& corner : corners) {
+            V3 world = d.frame.toWorld(corner);
+            double depth = -insideDepth(sm, m.frame.toLocal(world));
+            if (depth > hit.depth) {
+                hit.depth = depth;
+                hit.point = world;
+            }
+        }
+        return true;
+    }
+    double along, perp;
+    if (sm.isCylinder() && sm.rmin[0] <= 0.0 && (sd.isCylinder() || sd.isSolidSphere())) {
+        double radius = sd.isCylinder() ? sd.rmax[0] : sd.a[1];
+        double half = sd.isCylinder() ? sd.z[1] : sd.a[1];
+        if (sd.isSolidSphere()) {
+            V3 axis = m.frame.axis(2);
+            V3 delta = d.center() - m.center();
+            along = dot(delta, axis);
+            perp = norm(delta - axis * along);
+        } else if (!parallelCylinders(m, d, along, perp)) {
+            return false;
+        }
+        hit.depth = std::max(perp + radius - sm.rmax[0], std::abs(along) + half - sm.z[1]);
+        hit.point = d.center();
+        return true;
+    }
+    if (sm.isSolidSphere() && sd.isSolidSphere()) {
+        hit.depth = norm(d.center() - m.center()) + sd.a[1] - sm.a[1];
+        hit.point = d.center();
+        return true;
+    }
+    return false;
+}
+
+// ===== Sampling narrow phase =====
+
+/**
+ * Surface points of 'from' evaluated in 'against': the deepest one inside it
+ * (siblings) or outside it (extrusion). Points are seeded by the volume id,
+ * so the result does not depend on the thread or on the order of the checks.
+ */
+void sampledDepth(const Volume& from, const Volume& against, bool outside, int samples,
+                  std::vector<V3>& points, Hit& hit) {
+    SurfaceSampler sampler((from.node->getId() * 0x9E3779B97F4A7C15ull + 1) ^ uint64_t(from.copy));
+    sampler.sample(from.solid, samples, points);
+    const Solid& s = against.solid;
+    for (const V3& p : points) {
+        V3 world = from.frame.toWorld(p);
+        V3 local = against.frame.toLocal(world);
+        double depth;
+        if (outside) {
+            depth = -insideDepth(s, local);
+        } else {
+            // Cheap reject against the local bounds before the exact test
+            if (local.x < s.lo[0] || local.x > s.hi[0] || local.y < s.lo[1] || local.y > s.hi[1]
+                || local.z < s.lo[2] || local.z > s.hi[2]) {
+                continue;
+            }
+            depth = insideDepth(s, local);
+        }
+        if (depth > hit.depth) {
+            hit.depth = depth;
+            hit.point = world;
+        }
+    }
+}
+
+struct Task {
+    int volume;
+    int other;  // sibling, or the mother
+    bool extrusion;
+};
+
+QVector3D toQt(const V3& v) { return QVector3D(float(v.x), float(v.y), float(v.z)); }
+
+} // namespace
+
+OverlapChecker::OverlapChecker(const OverlapOptions& options)
+    : options_(options)
+{
+}
+
+std::vector<OverlapReport> OverlapChecker::check(const SceneGraph& sceneGraph, const ProgressCallback& progress) {
+    return check(sceneGraph.getRoot(), progress);
+}
+
+std::vector<OverlapReport> OverlapChecker::check(const VolumeNode* root, const ProgressCallback& progress) {
+    auto start = std::chrono::steady_clock::now();
+    stats_ = Stats();
+    cancelled_ = false;
+    std::vector<OverlapReport> reports;
+    if (!root) return reports;
+
+    // Snapshot: rigid world frames and solids, parents before children. Every
+    // copy of an array is placed in its mother; the daughters of an array are
+    // checked in copy 0 only, the other copies repeat the same layout.
+    std::vector<Volume> volumes;
+    std::vector<int> stack;  // copy 0 of the current ancestors
+    traversal::preOrder(root, [&](const VolumeNode* node, size_t depth) {
+        const int parent = depth > 0 ? stack[depth - 1] : -1;
+        const ArrayPattern& pattern = node->getArrayPattern();
+        const int copies = parent >= 0 && pattern.isArray() ? pattern.copies() : 1;
+        const Solid solid = makeSolid(node->getShape());
+        if (stack.size() <= depth) stack.resize(depth + 1);
+        stack[depth] = int(volumes.size());
+        for (int copy = 0; copy < copies; ++copy) {
+            Volume v;
+            v.node = const_cast<VolumeNode*>(node);
+            v.copy = copy;
+            v.parent = parent;
+            Frame local = localFrame(pattern.copyTransform(node->getTransform(), copy));
+            v.frame = parent >= 0 ? compose(volumes[parent].frame, local) : local;
+            v.solid = solid;
+            if (v.valid()) {
+                worldBounds(v);
+                ++stats_.volumes;
+            } else {
+                ++stats_.skipped;
+            }
+            volumes.push_back(std::move(v));
+        }
+    });
+
+    // Broad phase: sweep-and-prune over the world boxes of each mother's daughters
+    const double tol = options_.tolerance;
+    std::vector<Task> tasks;
+    std::vector<std::vector<int>> daughters(volumes.size());
+    for (int i = 1; i < int(volumes.size()); ++i) {
+        if (volumes[i].valid()) daughters[volumes[i].parent].push_back(i);
+    }
+    for (int m = 0; m < int(volumes.size()); ++m) {
+        std::vector<int>& list = daughters[m];
+        if (options_.checkMothers && volumes[m].valid()) {
+            for (int d : list) tasks.push_back({d, m, true});
+            stats_.motherChecks += list.size();
+        }
+        if (list.size() < 2) continue;
+
+        // Sweep along the axis with the largest spread of box centres
+        double lo[3] = {1e300, 1e300, 1e300}, hi[3] = {-1e300, -1e300, -1e300};
+        for (int d : list) {
+            for (int k = 0; k < 3; ++k) {
+                double c = 0.5 * (volumes[d].lo[k] + volumes[d].hi[k]);
+                lo[k] = std::min(lo[k], c);
+                hi[k] = std::max(hi[k], c);
+            }
+        }
+        int axis = 0;
+        for (int k = 1; k < 3; ++k) {
+            if (hi[k] - lo[k] > hi[axis] - lo[axis]) axis = k;
+        }
+        std::sort(list.begin(), list.end(), [&](int a, int b) { return volumes[a].lo[axis] < volumes[b].lo[axis]; });
+        for (size_t i = 0; i < list.size(); ++i) {
+            const Volume& a = volumes[list[i]];
+            for (size_t j = i + 1; j < list.size(); ++j) {
+                const Volume& b = volumes[list[j]];
+                if (b.lo[axis] >= a.hi[axis] - tol) break;
+                bool overlap = true;
+                for (int k = 0; k < 3 && overlap; ++k) {
+                    overlap = b.lo[k] < a.hi[k] - tol && a.lo[k] < b.hi[k] - tol;
+                }
+                if (overlap) {
+                    tasks.push_back({list[i], list[j], false});
+                    ++stats_.siblingPairs;
+                }
+            }
+        }
+    }
+
+    // Narrow phase: the workers pull chunks of tasks; the calling thread works
+    // too and reports progress between its chunks
+    unsigned threads = options_.threads ? options_.threads : std::thread::hardware_concurrency();
+    constexpr size_t Chunk = 64;
+    threads = std::max(1u, std::min<unsigned>(threads, unsigned((tasks.size() + Chunk - 1) / Chunk)));
+    stats_.threads = threads;
+
+    std::atomic<size_t> next{0}, done{0};
+    std::atomic<size_t> analytic{0}, sampled{0};
+    std::atomic<bool> cancel{false};
+    std::mutex reportsMutex;
+    const int samples = std::max(1, options_.samplesPerVolume);
+
+    auto worker = [&](bool reportProgress) {
+        std::vector<OverlapReport> local;
+        std::vector<V3> points;
+        size_t localAnalytic = 0, localSampled = 0;
+        auto lastProgress = std::chrono::steady_clock::now();
+        while (!cancel.load(std::memory_order_relaxed)) {
+            size_t first = next.fetch_add(Chunk);
+            if (first >= tasks.size()) break;
+            size_t last = std::min(first + Chunk, tasks.size());
+            for (size_t t = first; t < last; ++t) {
+                const Task& task = tasks[t];
+                const Volume& a = volumes[task.volume];
+                const Volume& b = volumes[task.other];
+                Hit hit;
+                bool exact = task.extrusion ? analyticExtrusion(a, b, hit) : analyticSiblings(a, b, hit);
+                if (exact) {
+                    ++localAnalytic;
+                } else {
+                    ++localSampled;
+                    hit = Hit();
+                    sampledDepth(a, b, task.extrusion, samples, points, hit);
+                    if (!task.extrusion) sampledDepth(b, a, false, samples, points, hit);
+                }
+                if (hit.depth > tol) {
+                    OverlapReport report;
+                    report.kind = task.extrusion ? OverlapReport::Kind::Extrusion : OverlapReport::Kind::Siblings;
+                    report.volume = a.node;
+                    report.other = b.node;
+                    report.copy = a.copy;
+                    report.otherCopy = b.copy;
+                    report.depth = hit.depth;
+                    report.point = toQt(hit.point);
+                    report.exact = exact;
+                    local.push_back(report);
+                }
+            }
+            size_t finished = done.fetch_add(last - first) + (last - first);
+            if (reportProgress && progress) {
+                auto now = std::chrono::steady_clock::now();
+                if (now - lastProgress > std::chrono::milliseconds(50)) {
+                    lastProgress = now;
+                    if (!progress(finished, tasks.size())) cancel = true;
+                }
+            }
+        }
+        analytic += localAnalytic;
+        sampled += localSampled;
+        std::lock_guard<std::mutex> lock(reportsMutex);
+        reports.insert(reports.end(), local.begin(), local.end());
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; ++i) pool.emplace_back(worker, false);
+    worker(true);
+    for (auto& thread : pool) thread.join();
+
+    cancelled_ = cancel;
+    if (progress && !cancelled_) progress(tasks.size(), tasks.size());
+
+    std::sort(reports.begin(), reports.end(), [](const OverlapReport& a, const OverlapReport& b) {
+        if (a.depth != b.depth) return a.depth > b.depth;
+        if (a.volume != b.volume) return a.volume->getId() < b.volume->getId();
+        return a.copy < b.copy;
+    });
+    stats_.analyticTests = analytic;
+    stats_.sampledTests = sampled;
+    stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return reports;
+}
+
+} // namespace geantcad
@@ -5,25 +5,47 @@
 #include "OutputConfig.hh"
 #include "ParticleGunConfig.hh"
 #include <algorithm>
+#include <utility>
 
 namespace geantcad {
 
 SceneGraph::SceneGraph() {
     // Create root node
-    root_ = std::make_unique<VolumeNode>("World");
+    auto root = std::make_unique<VolumeNode>("World");
     auto worldShape = makeBox(1000.0, 1000.0, 1000.0);
-    root_->setShape(std::move(worldShape));
-    root_->setMaterial(Material::makeVacuum());
+    root->setShape(std::move(worldShape));
+    root->setMaterial(Material::makeVacuum());
+    setRoot(std::move(root));
 }
 
 SceneGraph::~SceneGraph() {
+    // Listeners may already be gone: don't report the teardown
+    onSelectionChanged = nullptr;
+    onNodeAdded = nullptr;
+    onNodeRemoved = nullptr;
+    onNodeChanged = nullptr;
+    onGraphChanged = nullptr;
+    
     // Root will delete all children
+    setRoot(nullptr);
+}
+
+void SceneGraph::setRoot(std::unique_ptr<VolumeNode> root) {
+    // Drop the indexes wholesale before the old tree unregisters node by node
+    idIndex_.clear();
+    nameIndex_.clear();
+    root_.reset();
+    markStructureChanged();
+    
+    root_ = std::move(root);
+    if (root_) {
+        root_->attachToScene(this);
+    }
 }
 
 VolumeNode* SceneGraph::createVolume(const std::string& name) {
     auto* node = new VolumeNode(name);
-    root_->addChild(node);
-    notifyNodeAdded(node);
+    root_->addChild(node); // reports onNodeAdded
     notifyGraphChanged();
     return node;
 }
@@ -31,13 +53,14 @@ VolumeNode* SceneGraph::createVolume(const std::string& name) {
 void SceneGraph::removeVolume(VolumeNode* node) {
     if (!node || node == root_.get()) return;
     
-    if (selected_ == node) {
+    if (selected_ && (selected_ == node || selected_->isDescendantOf(node))) {
         setSelected(nullptr);
     }
+    multiSelection_.erase(std::remove_if(multiSelection_.begin(), multiSelection_.end(),
+        [node](VolumeNode* n) { return n == node || n->isDescendantOf(node); }),
+        multiSelection_.end());
     
-    notifyNodeRemoved(node);
-    
-    // Remove from parent (which will delete it)
+    // Remove from parent (which will delete it); detaching reports onNodeRemoved
     VolumeNode* parent = node->getParent();
     if (parent) {
         parent->removeChild(node);
@@ -46,24 +69,254 @@ void SceneGraph::removeVolume(VolumeNode* node) {
     }
 }
 
-VolumeNode* SceneGraph::findVolumeById(uint64_t id) {
-    VolumeNode* result = nullptr;
-    traverse([&](VolumeNode* node) {
-        if (node->getId() == id) {
-            result = node;
+namespace {
+    size_t depthOf(const VolumeNode* node) {
+        size_t depth = 0;
+        while ((node = node->getParent())) ++depth;
+        return depth;
+    }
+    
+    // Whether 'a' comes before 'b' in pre-order: both are lifted to the
+    // children of their common ancestor, whose order decides. O(depth) plus a
+    // scan of those siblings up to the first of the two.
+    bool precedesInPreOrder(const VolumeNode* a, const VolumeNode* b) {
+        size_t depthA = depthOf(a);
+        size_t depthB = depthOf(b);
+        for (; depthA > depthB; --depthA) {
+            a = a->getParent();
+            if (a == b) return false;  // b is an ancestor of a
         }
-    });
-    return result;
+        for (; depthB > depthA; --depthB) {
+            b = b->getParent();
+            if (b == a) return true;
+        }
+        while (a->getParent() != b->getParent()) {
+            a = a->getParent();
+            b = b->getParent();
+        }
+        const VolumeNode* parent = a->getParent();
+        if (!parent) return false;
+        for (const VolumeNode* child : parent->getChildren()) {
+            if (child == a) return true;
+            if (child == b) return false;
+        }
+        return false;
+    }
+    
+    bool sameTransform(const Transform& a, const Transform& b) {
+        return a.getTranslation() == b.getTranslation()
+            && a.getRotation() == b.getRotation()
+            && a.getScale() == b.getScale();
+    }
+    
+    // Copy the fields of 'source' through the setters, only where they differ
+    // (unchanged volumes get no notification and keep their shared shapes)
+    void restoreFields(VolumeNode& node, const VolumeNode& source) {
+        if (node.getName() != source.getName()) {
+            node.setName(source.getName());
+        }
+        const Shape* shape = node.getShape();
+        const Shape* sourceShape = source.getShape();
+        bool sameShape = shape == sourceShape
+            || (shape && sourceShape && shape->getName() == sourceShape->getName()
+                && shape->sameGeometry(*sourceShape));
+        if (!sameShape) {
+            node.setShape(source.getSharedShape());
+        }
+        const Material* material = node.getMaterial().get();
+        const Material* sourceMaterial = source.getMaterial().get();
+        bool sameMaterial = material == sourceMaterial
+            || (material && sourceMaterial && material->sameContent(*sourceMaterial));
+        if (!sameMaterial) {
+            node.setMaterial(source.getMaterial());
+        }
+        if (!sameTransform(std::as_const(node).getTransform(), source.getTransform())) {
+            node.setTransform(source.getTransform());
+        }
+        if (!(node.getArrayPattern() == source.getArrayPattern())) {
+            node.setArrayPattern(source.getArrayPattern());
+        }
+        node.setVisible(source.isVisible());
+        node.getSDConfig() = source.getSDConfig();
+        node.getOpticalConfig() = source.getOpticalConfig();
+    }
+}
+
+void SceneGraph::restoreHierarchy(const VolumeNode& target) {
+    if (!root_) return;
+    beginBatch();
+    
+    std::unordered_set<uint64_t> targetIds;
+    traversal::preOrder(&target, [&](const VolumeNode* node) { targetIds.insert(node->getId()); });
+    
+    // Volumes missing from the target go first, top-most ones with their subtree
+    std::vector<VolumeNode*> stale;
+    std::vector<VolumeNode*> pending(root_->children_.begin(), root_->children_.end());
+    while (!pending.empty()) {
+        VolumeNode* node = pending.back();
+        pending.pop_back();
+        if (!targetIds.count(node->getId())) {
+            stale.push_back(node);
+        } else {
+            pending.insert(pending.end(), node->children_.begin(), node->children_.end());
+        }
+    }
+    for (VolumeNode* node : stale) {
+        removeVolume(node);
+    }
+    
+    // Then parents before children: create, move and update each volume. A
+    // volume moved here is never an ancestor of its new parent (all of those
+    // are already placed).
+    restoreFields(*root_, target);
+    std::vector<std::pair<const VolumeNode*, VolumeNode*>> stack{{&target, root_.get()}};
+    std::vector<std::pair<VolumeNode*, std::vector<VolumeNode*>>> orders;
+    while (!stack.empty()) {
+        auto [source, parent] = stack.back();
+        stack.pop_back();
+        
+        std::vector<VolumeNode*> order;
+        order.reserve(source->children_.size());
+        for (const VolumeNode* sourceChild : source->children_) {
+            VolumeNode* node = findVolumeById(sourceChild->getId());
+            if (!node) {
+                node = new VolumeNode(sourceChild->getName());
+                node->id_ = sourceChild->getId();
+                if (node->id_ >= VolumeNode::nextId_) {
+                    VolumeNode::nextId_ = node->id_ + 1;
+                }
+                restoreFields(*node, *sourceChild);
+                parent->addChild(node);
+            } else {
+                if (node->parent_ != parent) {
+                    if (node->parent_) node->parent_->removeChild(node);
+                    parent->addChild(node);
+                }
+                restoreFields(*node, *sourceChild);
+            }
+            order.push_back(node);
+        }
+        for (size_t i = order.size(); i-- > 0;) {
+            stack.emplace_back(source->children_[i], order[i]);
+        }
+        orders.emplace_back(parent, std::move(order));
+    }
+    
+    // Sibling order, once every volume is under its final parent
+    for (auto& [parent, order] : orders) {
+        if (parent->children_ != order) {
+            parent->children_ = std::move(order);
+            markStructureChanged();
+        }
+    }
+    
+    notifyGraphChanged();
+    endBatch();
+}
+
+VolumeNode* SceneGraph::findVolumeById(uint64_t id) {
+    auto it = idIndex_.find(id);
+    return it != idIndex_.end() ? it->second : nullptr;
 }
 
 VolumeNode* SceneGraph::findVolumeByName(const std::string& name) {
-    VolumeNode* result = nullptr;
-    traverse([&](VolumeNode* node) {
-        if (node->getName() == name && !result) {
-            result = node;
+    auto it = nameIndex_.find(name);
+    if (it == nameIndex_.end() || it->second.empty()) return nullptr;
+    
+    // Several volumes may share the name: keep the first in pre-order
+    VolumeNode* first = it->second.front();
+    for (size_t i = 1; i < it->second.size(); ++i) {
+        if (precedesInPreOrder(it->second[i], first)) {
+            first = it->second[i];
         }
-    });
-    return result;
+    }
+    return first;
+}
+
+const std::vector<VolumeNode*>& SceneGraph::findVolumesByName(const std::string& name) const {
+    static const std::vector<VolumeNode*> empty;
+    auto it = nameIndex_.find(name);
+    return it != nameIndex_.end() ? it->second : empty;
+}
+
+const SpatialIndex& SceneGraph::getSpatialIndex() {
+    if (!spatialBuilt_ || spatialVersion_ != structureVersion_) {
+        spatialIndex_.build(root_.get());
+        spatialVersion_ = structureVersion_;
+        spatialBuilt_ = true;
+        spatialDirty_.clear();
+        return spatialIndex_;
+    }
+    if (spatialDirty_.empty()) return spatialIndex_;
+    
+    updateWorldTransforms();
+    bool rebuild = false;
+    auto update = [&](VolumeNode* node) {
+        if (node != root_.get() && !spatialIndex_.updateNode(node)) {
+            rebuild = true;
+        }
+    };
+    for (const auto& [node, changes] : spatialDirty_) {
+        if (changes & (static_cast<uint32_t>(NodeChange::Transform) | static_cast<uint32_t>(NodeChange::Array))) {
+            traversal::preOrder(node, update);  // world boxes (or copies) of the whole subtree moved
+        } else {
+            update(node);
+        }
+    }
+    spatialDirty_.clear();
+    
+    if (rebuild) {
+        spatialIndex_.build(root_.get());
+    } else {
+        spatialIndex_.refit();
+    }
+    return spatialIndex_;
+}
+
+void SceneGraph::indexNode(VolumeNode* node) {
+    markStructureChanged();
+    idIndex_[node->getId()] = node;
+    addName(node);
+    notifyNodeAdded(node);
+}
+
+void SceneGraph::unindexNode(VolumeNode* node) {
+    markStructureChanged();
+    notifyNodeRemoved(node);
+    spatialDirty_.erase(node);
+    auto idIt = idIndex_.find(node->getId());
+    if (idIt != idIndex_.end() && idIt->second == node) {
+        idIndex_.erase(idIt);
+    }
+    
+    removeName(node, node->getName());
+}
+
+void SceneGraph::reindexName(VolumeNode* node, const std::string& oldName) {
+    removeName(node, oldName);
+    addName(node);
+}
+
+void SceneGraph::addName(VolumeNode* node) {
+    auto& nodes = nameIndex_[node->getName()];
+    node->nameSlot_ = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(node);
+}
+
+void SceneGraph::removeName(VolumeNode* node, const std::string& name) {
+    auto nameIt = nameIndex_.find(name);
+    if (nameIt == nameIndex_.end()) return;
+    auto& nodes = nameIt->second;
+    const uint32_t slot = node->nameSlot_;
+    if (slot >= nodes.size() || nodes[slot] != node) return;
+    
+    // Swap and pop: the last node takes the freed slot
+    nodes[slot] = nodes.back();
+    nodes[slot]->nameSlot_ = slot;
+    nodes.pop_back();
+    if (nodes.empty()) {
+        nameIndex_.erase(nameIt);
+    }
 }
 
 void SceneGraph::setSelected(VolumeNode* node) {
@@ -130,35 +383,21 @@ void SceneGraph::clearMultiSelection() {
 }
 
 void SceneGraph::traverse(std::function<void(VolumeNode*)> visitor) {
-    if (!root_) return;
-    
-    std::function<void(VolumeNode*)> visit = [&](VolumeNode* node) {
-        visitor(node);
-        for (auto* child : node->getChildren()) {
-            visit(child);
-        }
-    };
-    
-    visit(root_.get());
+    forEach([&](VolumeNode* node) { visitor(node); });
 }
 
 void SceneGraph::traverseConst(std::function<void(const VolumeNode*)> visitor) const {
-    if (!root_) return;
-    
-    std::function<void(const VolumeNode*)> visit = [&](const VolumeNode* node) {
-        visitor(node);
-        for (auto* child : node->getChildren()) {
-            visit(child);
-        }
-    };
-    
-    visit(root_.get());
+    forEach([&](const VolumeNode* node) { visitor(node); });
 }
 
 nlohmann::json SceneGraph::toJson() const {
     nlohmann::json j;
     if (root_) {
-        j["root"] = root_->toJson();
+        // Table of distinct materials in first-use order; volumes store the id
+        MaterialRegistry table;
+        forEach([&table](const VolumeNode* node) { table.intern(node->getMaterial()); });
+        j["materials"] = table.toJson();
+        j["root"] = root_->toJson(&table);
     }
     if (selected_) {
         j["selectedId"] = selected_->getId();
@@ -171,26 +410,80 @@ nlohmann::json SceneGraph::toJson() const {
 
 void SceneGraph::fromJson(const nlohmann::json& j) {
     if (j.contains("root")) {
-        root_ = VolumeNode::fromJson(j["root"]);
-        
-        if (j.contains("selectedId")) {
-            uint64_t selectedId = j["selectedId"];
-            selected_ = findVolumeById(selectedId);
+        MaterialRegistry table;
+        if (j.contains("materials")) {
+            table = MaterialRegistry::fromJson(j["materials"]);
         }
-        
-        if (j.contains("physics")) {
-            physicsConfig_.fromJson(j["physics"]);
-        }
-        
-        if (j.contains("output")) {
-            outputConfig_.fromJson(j["output"]);
+        adoptLoadedScene(VolumeNode::fromJson(j["root"], &table), j);
+    }
+}
+
+size_t SceneGraph::internMaterials() {
+    materials_.clear();
+    forEach([this](VolumeNode* node) {
+        if (node->material_) {
+            node->material_ = materials_.intern(node->material_);
         }
-        if (j.contains("particleGun")) {
-            particleGunConfig_.fromJson(j["particleGun"]);
+    });
+    return materials_.size();
+}
+
+std::vector<VolumeNode*> SceneGraph::getLinkedInstances(const VolumeNode* node) {
+    std::vector<VolumeNode*> instances;
+    if (!node || !node->shape_) return instances;
+    forEach([&](VolumeNode* other) {
+        if (other->shape_ == node->shape_) instances.push_back(other);
+    });
+    return instances;
+}
+
+size_t SceneGraph::internShapes() {
+    std::unordered_map<size_t, std::vector<std::shared_ptr<const Shape>>> byGeometry;
+    size_t distinct = 0;
+    forEach([&](VolumeNode* node) {
+        if (!node->shape_) return;
+        auto& candidates = byGeometry[node->shape_->geometryHash()];
+        for (const auto& shape : candidates) {
+            if (shape == node->shape_) return;
+            if (shape->sameGeometry(*node->shape_) && shape->getName() == node->shape_->getName()) {
+                node->shape_ = shape;
+                return;
+            }
         }
-        
-        notifyGraphChanged();
+        candidates.push_back(node->shape_);
+        ++distinct;
+    });
+    markStructureChanged();
+    return distinct;
+}
+
+void SceneGraph::adoptLoadedScene(std::unique_ptr<VolumeNode> root, const nlohmann::json& j) {
+    selected_ = nullptr;
+    multiSelection_.clear();
+    setRoot(std::move(root));
+    // Files written before the material table (or edited by hand) embed one
+    // copy per volume: share them again
+    internMaterials();
+    // Shapes are stored per volume: identical ones become linked instances
+    internShapes();
+    
+    if (j.contains("selectedId")) {
+        uint64_t selectedId = j["selectedId"];
+        selected_ = findVolumeById(selectedId);
     }
+    
+    if (j.contains("physics")) {
+        physicsConfig_.fromJson(j["physics"]);
+    }
+    
+    if (j.contains("output")) {
+        outputConfig_.fromJson(j["output"]);
+    }
+    if (j.contains("particleGun")) {
+        particleGunConfig_.fromJson(j["particleGun"]);
+    }
+    
+    notifyGraphChanged();
 }
 
 void SceneGraph::notifySelectionChanged() {
@@ -200,22 +493,93 @@ void SceneGraph::notifySelectionChanged() {
 }
 
 void SceneGraph::notifyNodeAdded(VolumeNode* node) {
+    ++revision_;
+    if (batchDepth_ > 0) {
+        batchAdded_.push_back(node);
+        batchAddedSet_.insert(node);
+        return;
+    }
     if (onNodeAdded) {
         onNodeAdded(node);
     }
 }
 
 void SceneGraph::notifyNodeRemoved(VolumeNode* node) {
+    ++revision_;
+    if (batchDepth_ > 0) {
+        batchChanges_.erase(node);
+        // Never reported as added: listeners don't know it
+        if (batchAddedSet_.erase(node)) return;
+    }
     if (onNodeRemoved) {
         onNodeRemoved(node);
     }
 }
 
+void SceneGraph::notifyNodeChanged(VolumeNode* node, NodeChange change) {
+    ++revision_;
+    if (spatialBuilt_ && (change == NodeChange::Transform || change == NodeChange::Shape || change == NodeChange::Array)) {
+        spatialDirty_[node] |= static_cast<uint32_t>(change);
+    }
+    if (batchDepth_ > 0) {
+        // Nodes added in the batch are reported with their final state
+        if (batchAddedSet_.count(node)) return;
+        uint32_t& mask = batchChanges_[node];
+        if (mask == 0) batchChangedOrder_.push_back(node);
+        mask |= static_cast<uint32_t>(change);
+        return;
+    }
+    if (onNodeChanged) {
+        onNodeChanged(node, change);
+    }
+}
+
 void SceneGraph::notifyGraphChanged() {
+    if (batchDepth_ > 0) {
+        batchGraphChanged_ = true;
+        return;
+    }
     if (onGraphChanged) {
         onGraphChanged();
     }
 }
 
+void SceneGraph::endBatch() {
+    if (batchDepth_ == 0 || --batchDepth_ > 0) return;
+    
+    std::vector<VolumeNode*> added;
+    added.swap(batchAdded_);
+    std::vector<VolumeNode*> changedOrder;
+    changedOrder.swap(batchChangedOrder_);
+    std::unordered_map<VolumeNode*, uint32_t> changes;
+    changes.swap(batchChanges_);
+    std::unordered_set<VolumeNode*> live;
+    live.swap(batchAddedSet_);
+    const bool graphChanged = batchGraphChanged_;
+    batchGraphChanged_ = false;
+    
+    for (VolumeNode* node : added) {
+        // erase: a pointer reused by a later allocation is reported once
+        if (live.erase(node) && onNodeAdded) {
+            onNodeAdded(node);
+        }
+    }
+    for (VolumeNode* node : changedOrder) {
+        auto it = changes.find(node);
+        // Removed in the meantime (and possibly re-added: order entry is stale)
+        if (it == changes.end() || it->second == 0) continue;
+        const uint32_t mask = it->second;
+        it->second = 0;
+        for (uint32_t bit = 1; bit <= static_cast<uint32_t>(NodeChange::Array); bit <<= 1) {
+            if ((mask & bit) && onNodeChanged) {
+                onNodeChanged(node, static_cast<NodeChange>(bit));
+            }
+        }
+    }
+    if (graphChanged && onGraphChanged) {
+        onGraphChanged();
+    }
+}
+
 } // namespace geantcad
 
@@ -21,7 +21,9 @@ bool saveSceneToFile(SceneGraph* sceneGraph, const std::string& filePath) {
         
         // If extension is .geantcad, treat as directory name
         fs::path projectDir;
-        if (path.extension() == ".geantcad") {
+        if (path.extension() == ".gcadb") {
+            return saveSceneToBinary(sceneGraph, filePath);
+        } else if (path.extension() == ".geantcad") {
             projectDir = path;
         } else if (path.extension() == ".json") {
             // Legacy: single JSON file
@@ -100,15 +102,14 @@ bool saveSceneToFile(SceneGraph* sceneGraph, const std::string& filePath) {
             file << particleGunJson.dump(2);
         }
         
-        // Extract and save custom materials to materials.json
+        // Extract and save custom materials to materials.json, once per distinct material
         nlohmann::json materialsJson = nlohmann::json::array();
-        sceneGraph->traverseConst([&](const VolumeNode* node) {
-            if (node && node->getMaterial()) {
-                auto mat = node->getMaterial();
-                // Only save custom materials (non-NIST)
-                if (mat->getNistName().empty()) {
-                    materialsJson.push_back(mat->toJson());
-                }
+        MaterialRegistry materials;
+        sceneGraph->forEach([&](const VolumeNode* node) {
+            auto mat = node->getMaterial();
+            // Only save custom materials (non-NIST)
+            if (mat && mat->getNistName().empty() && materials.indexOf(mat.get()) == MaterialRegistry::npos) {
+                materialsJson.push_back(materials.intern(mat)->toJson());
             }
         });
         {
@@ -128,6 +129,10 @@ bool saveSceneToFile(SceneGraph* sceneGraph, const std::string& filePath) {
 }
 
 bool loadSceneFromFile(SceneGraph* sceneGraph, const std::string& filePath) {
+    return loadSceneFromFile(sceneGraph, filePath, nullptr);
+}
+
+bool loadSceneFromFile(SceneGraph* sceneGraph, const std::string& filePath, const LoadProgressCallback& progress) {
     if (!sceneGraph) return false;
     
     try {
@@ -157,11 +162,8 @@ bool loadSceneFromFile(SceneGraph* sceneGraph, const std::string& filePath) {
                 std::cerr << "scene.json not found in project directory" << std::endl;
                 return false;
             }
-            {
-                std::ifstream file(sceneFile);
-                nlohmann::json sceneJson;
-                file >> sceneJson;
-                sceneGraph->fromJson(sceneJson);
+            if (!loadSceneFromJson(sceneGraph, sceneFile.string(), progress)) {
+                return false;
             }
             
             // Load physics.json if exists
@@ -203,21 +205,11 @@ bool loadSceneFromFile(SceneGraph* sceneGraph, const std::string& filePath) {
             }
             
             return true;
+        } else if (isBinarySceneFile(filePath)) {
+            return loadSceneFromBinary(sceneGraph, filePath);
         } else {
             // Legacy: single JSON file
-            std::ifstream file(filePath);
-            if (!file.is_open()) {
-                std::cerr << "Failed to open file for reading: " << filePath << std::endl;
-                return false;
-            }
-            
-            nlohmann::json j;
-            file >> j;
-            file.close();
-            
-            sceneGraph->fromJson(j);
-            
-            return true;
+            return loadSceneFromJson(sceneGraph, filePath, progress);
         }
     } catch (const std::exception& e) {
         std::cerr << "Error loading scene: " << e.what() << std::endl;
@@ -1,8 +1,104 @@
 #include "Shape.hh"
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
 
 namespace geantcad {
 
+namespace {
+    // Field views used for hashing/comparison (keep in sync with the structs)
+    auto fields(const BoxParams& p) { return std::tie(p.x, p.y, p.z); }
+    auto fields(const TubeParams& p) { return std::tie(p.rmin, p.rmax, p.dz, p.sphi, p.dphi); }
+    auto fields(const SphereParams& p) { return std::tie(p.rmin, p.rmax, p.sphi, p.dphi, p.stheta, p.dtheta); }
+    auto fields(const ConeParams& p) { return std::tie(p.rmin1, p.rmax1, p.rmin2, p.rmax2, p.dz, p.sphi, p.dphi); }
+    auto fields(const TrdParams& p) { return std::tie(p.dx1, p.dx2, p.dy1, p.dy2, p.dz); }
+    auto fields(const PolyconeParams& p) { return std::tie(p.sphi, p.dphi, p.zPlanes, p.rmin, p.rmax); }
+    auto fields(const PolyhedraParams& p) { return std::tie(p.numSides, p.sphi, p.dphi, p.zPlanes, p.rmin, p.rmax); }
+    auto fields(const BooleanParams& p) {
+        return std::tie(p.operation, p.solidA_name, p.solidB_name,
+                        p.relPosX, p.relPosY, p.relPosZ, p.relRotX, p.relRotY, p.relRotZ);
+    }
+
+    void hashCombine(size_t& seed, size_t value) {
+        seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    }
+
+    template<typename T>
+    void hashValue(size_t& seed, const T& value) {
+        if constexpr (std::is_enum_v<T>) {
+            hashCombine(seed, std::hash<std::underlying_type_t<T>>()(static_cast<std::underlying_type_t<T>>(value)));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            // -0.0 and 0.0 describe the same geometry
+            hashCombine(seed, std::hash<T>()(value == T(0) ? T(0) : value));
+        } else {
+            hashCombine(seed, std::hash<T>()(value));
+        }
+    }
+
+    template<typename T>
+    void hashValue(size_t& seed, const std::vector<T>& values) {
+        hashCombine(seed, values.size());
+        for (const auto& v : values) {
+            hashValue(seed, v);
+        }
+    }
+}
+
+size_t Shape::geometryHash() const {
+    size_t seed = 0;
+    hashValue(seed, type_);
+    hashCombine(seed, params_.index());
+    std::visit([&seed](const auto& p) {
+        std::apply([&seed](const auto&... field) { (hashValue(seed, field), ...); }, fields(p));
+    }, params_);
+    return seed;
+}
+
+bool Shape::sameGeometry(const Shape& other) const {
+    if (type_ != other.type_ || params_.index() != other.params_.index()) return false;
+    return std::visit([&other](const auto& p) {
+        using T = std::decay_t<decltype(p)>;
+        return fields(p) == fields(std::get<T>(other.params_));
+    }, params_);
+}
+
+bool Shape::localBounds(double min[3], double max[3]) const {
+    auto set = [&](double x, double y, double zMin, double zMax) {
+        min[0] = -x; max[0] = x;
+        min[1] = -y; max[1] = y;
+        min[2] = zMin; max[2] = zMax;
+        return true;
+    };
+    auto planes = [&](const std::vector<double>& zPlanes, const std::vector<double>& rmax, double scale) {
+        if (zPlanes.empty() || rmax.empty()) return false;
+        double r = *std::max_element(rmax.begin(), rmax.end()) * scale;
+        auto [zMin, zMax] = std::minmax_element(zPlanes.begin(), zPlanes.end());
+        return set(r, r, *zMin, *zMax);
+    };
+    
+    if (auto* p = std::get_if<BoxParams>(&params_)) return set(p->x, p->y, -p->z, p->z);
+    if (auto* p = std::get_if<TubeParams>(&params_)) return set(p->rmax, p->rmax, -p->dz, p->dz);
+    if (auto* p = std::get_if<SphereParams>(&params_)) return set(p->rmax, p->rmax, -p->rmax, p->rmax);
+    if (auto* p = std::get_if<ConeParams>(&params_)) {
+        double r = std::max(p->rmax1, p->rmax2);
+        return set(r, r, -p->dz, p->dz);
+    }
+    if (auto* p = std::get_if<TrdParams>(&params_)) {
+        return set(std::max(p->dx1, p->dx2), std::max(p->dy1, p->dy2), -p->dz, p->dz);
+    }
+    if (auto* p = std::get_if<PolyconeParams>(&params_)) return planes(p->zPlanes, p->rmax, 1.0);
+    if (auto* p = std::get_if<PolyhedraParams>(&params_)) {
+        // rmax is the distance to the sides (as in G4Polyhedra): corners lie further out
+        const double pi = 3.14159265358979323846;
+        double corner = p->numSides >= 3 ? 1.0 / std::cos(pi / p->numSides) : 1.0;
+        return planes(p->zPlanes, p->rmax, corner);
+    }
+    return false;
+}
+
 Shape::Shape(ShapeType type, const std::string& name, ShapeParams params)
     : type_(type)
     , name_(name)
@@ -0,0 +1,464 @@
+#include "SpatialIndex.hh"
+#include "VolumeNode.hh"
+#include "SceneTraversal.hh"
+#include "ArrayPattern.hh"
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+namespace geantcad {
+
+// ===== Aabb =====
+
+void Aabb::expand(const QVector3D& p) {
+    min = QVector3D(std::min(min.x(), p.x()), std::min(min.y(), p.y()), std::min(min.z(), p.z()));
+    max = QVector3D(std::max(max.x(), p.x()), std::max(max.y(), p.y()), std::max(max.z(), p.z()));
+}
+
+void Aabb::expand(const Aabb& other) {
+    min = QVector3D(std::min(min.x(), other.min.x()), std::min(min.y(), other.min.y()), std::min(min.z(), other.min.z()));
+    max = QVector3D(std::max(max.x(), other.max.x()), std::max(max.y(), other.max.y()), std::max(max.z(), other.max.z()));
+}
+
+bool Aabb::intersects(const Aabb& other) const {
+    return min.x() <= other.max.x() && max.x() >= other.min.x()
+        && min.y() <= other.max.y() && max.y() >= other.min.y()
+        && min.z() <= other.max.z() && max.z() >= other.min.z();
+}
+
+bool Aabb::contains(const QVector3D& p) const {
+    return p.x() >= min.x() && p.x() <= max.x()
+        && p.y() >= min.y() && p.y() <= max.y()
+        && p.z() >= min.z() && p.z() <= max.z();
+}
+
+float Aabb::distanceSquared(const QVector3D& p) const {
+    float d2 = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        float d = std::max({min[i] - p[i], 0.0f, p[i] - max[i]});
+        d2 += d * d;
+    }
+    return d2;
+}
+
+float Aabb::rayEntry(const QVector3D& origin, const QVector3D& invDir, float maxT) const {
+    if (!isValid()) return -1.0f;
+    float tNear = 0.0f;
+    float tFar = maxT;
+    for (int i = 0; i < 3; ++i) {
+        if (std::isinf(invDir[i])) {
+            // Parallel to the slab: inside it or never
+            if (origin[i] < min[i] || origin[i] > max[i]) return -1.0f;
+            continue;
+        }
+        float t0 = (min[i] - origin[i]) * invDir[i];
+        float t1 = (max[i] - origin[i]) * invDir[i];
+        if (t0 > t1) std::swap(t0, t1);
+        tNear = std::max(tNear, t0);
+        tFar = std::min(tFar, t1);
+        if (tNear > tFar) return -1.0f;
+    }
+    return tNear;
+}
+
+Aabb Aabb::transformed(const double localMin[3], const double localMax[3], const QMatrix4x4& matrix) {
+    // Transform the center, project the half extents on the world axes
+    float lo[3], hi[3];
+    for (int i = 0; i < 3; ++i) {
+        double center = matrix(i, 3);
+        double extent = 0.0;
+        for (int j = 0; j < 3; ++j) {
+            double c = 0.5 * (localMin[j] + localMax[j]);
+            double e = 0.5 * (localMax[j] - localMin[j]);
+            center += matrix(i, j) * c;
+            extent += std::abs(matrix(i, j)) * e;
+        }
+        lo[i] = static_cast<float>(center - extent);
+        hi[i] = static_cast<float>(center + extent);
+    }
+    return Aabb(QVector3D(lo[0], lo[1], lo[2]), QVector3D(hi[0], hi[1], hi[2]));
+}
+
+// ===== SpatialIndex =====
+
+void SpatialIndex::clear() {
+    items_.clear();
+    nodes_.clear();
+    itemIndex_.clear();
+    copyItems_.clear();
+    dirtyLeaves_.clear();
+}
+
+void SpatialIndex::worldBounds(const VolumeNode* node, bool inArray, std::vector<Aabb>& boxes) {
+    boxes.clear();
+    double lo[3], hi[3];
+    if (!node->getShape() || !node->getShape()->localBounds(lo, hi)) return;
+    const QMatrix4x4& world = node->getWorldMatrix();
+    if (!inArray) {
+        boxes.push_back(Aabb::transformed(lo, hi, world));
+        return;
+    }
+    for (const QMatrix4x4& offset : arrayCopyOffsets(node)) {
+        boxes.push_back(Aabb::transformed(lo, hi, world * offset));
+    }
+}
+
+bool SpatialIndex::inArray(const VolumeNode* node) {
+    // Patterns of the node or of an ancestor (the root's own is not placed)
+    for (const VolumeNode* a = node; a && a->getParent(); a = a->getParent()) {
+        if (a->getArrayPattern().isArray()) return true;
+    }
+    return false;
+}
+
+void SpatialIndex::build(VolumeNode* root) {
+    clear();
+    if (!root) return;
+
+    root->updateWorldTransforms();
+    std::vector<char> arrayed;  // per depth: the node or an ancestor is an array
+    traversal::preOrder(root, [&](VolumeNode* node, size_t depth) {
+        if (arrayed.size() <= depth) arrayed.resize(depth + 1);
+        if (node == root) {
+            arrayed[depth] = false;
+            return;
+        }
+        arrayed[depth] = arrayed[depth - 1] || node->getArrayPattern().isArray();
+        worldBounds(node, arrayed[depth], boxScratch_);
+        for (size_t copy = 0; copy < boxScratch_.size(); ++copy) {
+            items_.push_back(Item{node, boxScratch_[copy], InvalidIndex, static_cast<Index>(copy)});
+        }
+        if (boxScratch_.size() > 1) {
+            copyItems_[node].resize(boxScratch_.size() - 1);
+        }
+    });
+    if (items_.empty()) return;
+
+    nodes_.reserve(2 * (items_.size() / MaxLeafSize + 1));
+    buildRange(0, static_cast<Index>(items_.size()), InvalidIndex);
+
+    itemIndex_.reserve(items_.size());
+    for (Index i = 0; i < items_.size(); ++i) {
+        if (items_[i].copy == 0) {
+            itemIndex_[items_[i].node] = i;
+        } else {
+            copyItems_[items_[i].node][items_[i].copy - 1] = i;
+        }
+    }
+}
+
+SpatialIndex::Index SpatialIndex::buildRange(Index first, Index last, Index parent) {
+    const Index index = static_cast<Index>(nodes_.size());
+    nodes_.push_back(Node{Aabb(), parent, InvalidIndex, first, 0});
+
+    Aabb bounds, centroids;
+    for (Index i = first; i < last; ++i) {
+        bounds.expand(items_[i].bounds);
+        centroids.expand(items_[i].bounds.center());
+    }
+    nodes_[index].bounds = bounds;
+
+    const Index count = last - first;
+    if (count <= MaxLeafSize) {
+        nodes_[index].count = count;
+        for (Index i = first; i < last; ++i) {
+            items_[i].leaf = index;
+        }
+        return index;
+    }
+
+    // Median split on the axis where the centroids spread the most: the halves
+    // always have equal size, so the depth stays log2(n) even for coincident boxes
+    QVector3D spread = centroids.max - centroids.min;
+    int axis = 0;
+    if (spread.y() > spread[axis]) axis = 1;
+    if (spread.z() > spread[axis]) axis = 2;
+    const Index mid = first + count / 2;
+    std::nth_element(items_.begin() + first, items_.begin() + mid, items_.begin() + last,
+        [axis](const Item& a, const Item& b) {
+            return a.bounds.min[axis] + a.bounds.max[axis] < b.bounds.min[axis] + b.bounds.max[axis];
+        });
+
+    buildRange(first, mid, index);  // left child = index + 1
+    const Index right = buildRange(mid, last, index);
+    nodes_[index].right = right;
+    return index;
+}
+
+Aabb SpatialIndex::bounds(const VolumeNode* node) const {
+    auto it = itemIndex_.find(node);
+    return it != itemIndex_.end() ? items_[it->second].bounds : Aabb();
+}
+
+bool SpatialIndex::updateNode(const VolumeNode* node) {
+    worldBounds(node, inArray(node), boxScratch_);
+
+    auto it = itemIndex_.find(node);
+    if (it == itemIndex_.end()) {
+        return boxScratch_.empty();
+    }
+    auto copies = copyItems_.find(node);
+    const size_t indexed = 1 + (copies != copyItems_.end() ? copies->second.size() : 0);
+    if (!boxScratch_.empty() && boxScratch_.size() != indexed) {
+        return false;
+    }
+    // A node whose bounds became unknown keeps empty boxes (never hit)
+    for (size_t copy = 0; copy < indexed; ++copy) {
+        Item& item = items_[copy == 0 ? it->second : copies->second[copy - 1]];
+        Aabb box = boxScratch_.empty() ? Aabb() : boxScratch_[copy];
+        if (item.bounds != box) {
+            item.bounds = box;
+            dirtyLeaves_.push_back(item.leaf);
+        }
+    }
+    return true;
+}
+
+void SpatialIndex::refit() {
+    if (dirtyLeaves_.empty()) return;
+
+    auto leafBounds = [this](const Node& leaf) {
+        Aabb box;
+        for (Index i = leaf.first; i < leaf.first + leaf.count; ++i) {
+            box.expand(items_[i].bounds);
+        }
+        return box;
+    };
+
+    if (dirtyLeaves_.size() * 8 > nodes_.size()) {
+        // Most of the tree moved: one bottom-up pass (children follow their parent)
+        for (size_t n = nodes_.size(); n-- > 0;) {
+            Node& node = nodes_[n];
+            if (node.isLeaf()) {
+                node.bounds = leafBounds(node);
+            } else {
+                node.bounds = nodes_[n + 1].bounds;
+                node.bounds.expand(nodes_[node.right].bounds);
+            }
+        }
+    } else {
+        // Walk up from each touched leaf until a box stops changing
+        for (Index leaf : dirtyLeaves_) {
+            Aabb box = leafBounds(nodes_[leaf]);
+            if (box == nodes_[leaf].bounds) continue;
+            nodes_[leaf].bounds = box;
+
+            for (Index n = nodes_[leaf].parent; n != InvalidIndex; n = nodes_[n].parent) {
+                Aabb merged = nodes_[n + 1].bounds;
+                merged.expand(nodes_[nodes_[n].right].bounds);
+                if (merged == nodes_[n].bounds) break;
+                nodes_[n].bounds = merged;
+            }
+        }
+    }
+    dirtyLeaves_.clear();
+}
+
+void SpatialIndex::queryBox(const Aabb& box, std::vector<VolumeNode*>& out) const {
+    if (nodes_.empty()) return;
+    const size_t firstHit = out.size();
+
+    Index stack[MaxDepth];
+    size_t size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const Node& node = nodes_[stack[--size]];
+        if (!node.bounds.intersects(box)) continue;
+        if (node.isLeaf()) {
+            for (Index i = node.first; i < node.first + node.count; ++i) {
+                if (items_[i].bounds.intersects(box)) {
+                    out.push_back(items_[i].node);
+                }
+            }
+        } else {
+            const Index n = static_cast<Index>(&node - nodes_.data());
+            stack[size++] = node.right;
+            stack[size++] = n + 1;
+        }
+    }
+
+    // Several copies of an array may match
+    if (!copyItems_.empty()) {
+        std::sort(out.begin() + firstHit, out.end());
+        out.erase(std::unique(out.begin() + firstHit, out.end()), out.end());
+    }
+}
+
+namespace {
+    QVector3D inverseDirection(const QVector3D& dir) {
+        // 1/0 = inf marks an axis-parallel ray (handled by Aabb::rayEntry)
+        auto inv = [](float v) {
+            return v != 0.0f ? 1.0f / v : std::numeric_limits<float>::infinity();
+        };
+        return QVector3D(inv(dir.x()), inv(dir.y()), inv(dir.z()));
+    }
+}
+
+void SpatialIndex::queryRay(const QVector3D& origin, const QVector3D& direction, float maxDistance,
+                            std::vector<RayHit>& hits) const {
+    if (nodes_.empty() || direction.length() == 0.0f) return;
+
+    const QVector3D invDir = inverseDirection(direction.normalized());
+    const size_t firstHit = hits.size();
+
+    Index stack[MaxDepth];
+    size_t size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const Node& node = nodes_[stack[--size]];
+        if (node.bounds.rayEntry(origin, invDir, maxDistance) < 0.0f) continue;
+        if (node.isLeaf()) {
+            for (Index i = node.first; i < node.first + node.count; ++i) {
+                float t = items_[i].bounds.rayEntry(origin, invDir, maxDistance);
+                if (t >= 0.0f) {
+                    hits.push_back(RayHit{items_[i].node, t});
+                }
+            }
+        } else {
+            const Index n = static_cast<Index>(&node - nodes_.data());
+            stack[size++] = node.right;
+            stack[size++] = n + 1;
+        }
+    }
+
+    std::sort(hits.begin() + firstHit, hits.end(),
+              [](const RayHit& a, const RayHit& b) { return a.distance < b.distance; });
+
+    // Keep the nearest copy of each array
+    if (!copyItems_.empty()) {
+        std::unordered_set<const VolumeNode*> seen;
+        auto repeated = [&seen](const RayHit& hit) { return !seen.insert(hit.node).second; };
+        hits.erase(std::remove_if(hits.begin() + firstHit, hits.end(), repeated), hits.end());
+    }
+}
+
+bool SpatialIndex::raycast(const QVector3D& origin, const QVector3D& direction, float maxDistance,
+                           RayHit& hit, const Filter& accept) const {
+    if (nodes_.empty() || direction.length() == 0.0f) return false;
+
+    const QVector3D invDir = inverseDirection(direction.normalized());
+    hit = RayHit{nullptr, maxDistance};
+
+    // Stack entries carry the entry distance so farther subtrees are pruned
+    struct Entry { Index node; float t; };
+    Entry stack[MaxDepth];
+    size_t size = 0;
+    float t = nodes_[0].bounds.rayEntry(origin, invDir, maxDistance);
+    if (t < 0.0f) return false;
+    stack[size++] = Entry{0, t};
+
+    while (size > 0) {
+        Entry entry = stack[--size];
+        if (entry.t > hit.distance) continue;
+        const Node& node = nodes_[entry.node];
+        if (node.isLeaf()) {
+            for (Index i = node.first; i < node.first + node.count; ++i) {
+                float ti = items_[i].bounds.rayEntry(origin, invDir, hit.distance);
+                if (ti >= 0.0f && (!hit.node || ti < hit.distance) && (!accept || accept(items_[i].node))) {
+                    hit = RayHit{items_[i].node, ti};
+                }
+            }
+            continue;
+        }
+        // Push the farther child first so the nearer one is visited next
+        float tl = nodes_[entry.node + 1].bounds.rayEntry(origin, invDir, hit.distance);
+        float tr = nodes_[node.right].bounds.rayEntry(origin, invDir, hit.distance);
+        Entry left{entry.node + 1, tl};
+        Entry right{node.right, tr};
+        if (tl >= 0.0f && tr >= 0.0f && tl < tr) std::swap(left, right);
+        if (left.t >= 0.0f) stack[size++] = left;
+        if (right.t >= 0.0f) stack[size++] = right;
+    }
+    return hit.node != nullptr;
+}
+
+VolumeNode* SpatialIndex::nearest(const QVector3D& point, float* distance, const Filter& accept) const {
+    std::vector<Neighbor> result;
+    kNearest(point, 1, result, accept);
+    if (result.empty()) return nullptr;
+    if (distance) *distance = result.front().distance;
+    return result.front().node;
+}
+
+void SpatialIndex::kNearest(const QVector3D& point, size_t k, std::vector<Neighbor>& out,
+                            const Filter& accept) const {
+    out.clear();
+    if (nodes_.empty() || k == 0) return;
+
+    // Max-heap of the best k squared distances found so far
+    auto farther = [](const Neighbor& a, const Neighbor& b) { return a.distance < b.distance; };
+    std::vector<Neighbor> best;
+    auto bound = [&]() {
+        return best.size() < k ? std::numeric_limits<float>::max() : best.front().distance;
+    };
+
+    struct Entry { Index node; float d2; };
+    Entry stack[MaxDepth];
+    size_t size = 0;
+    stack[size++] = Entry{0, nodes_[0].bounds.distanceSquared(point)};
+
+    while (size > 0) {
+        Entry entry = stack[--size];
+        if (entry.d2 > bound()) continue;
+        const Node& node = nodes_[entry.node];
+        if (node.isLeaf()) {
+            for (Index i = node.first; i < node.first + node.count; ++i) {
+                if (!items_[i].bounds.isValid()) continue;
+                float d2 = items_[i].bounds.distanceSquared(point);
+                if (d2 >= bound()) continue;
+                if (accept && !accept(items_[i].node)) continue;
+                if (!copyItems_.empty()) {
+                    // Another copy of the same array already kept: keep the nearer one
+                    auto same = std::find_if(best.begin(), best.end(),
+                        [&](const Neighbor& n) { return n.node == items_[i].node; });
+                    if (same != best.end()) {
+                        if (d2 < same->distance) {
+                            same->distance = d2;
+                            std::make_heap(best.begin(), best.end(), farther);
+                        }
+                        continue;
+                    }
+                }
+                best.push_back(Neighbor{items_[i].node, d2});
+                std::push_heap(best.begin(), best.end(), farther);
+                if (best.size() > k) {
+                    std::pop_heap(best.begin(), best.end(), farther);
+                    best.pop_back();
+                }
+            }
+            continue;
+        }
+        // Nearer child on top of the stack
+        Entry left{entry.node + 1, nodes_[entry.node + 1].bounds.distanceSquared(point)};
+        Entry right{node.right, nodes_[node.right].bounds.distanceSquared(point)};
+        if (left.d2 < right.d2) std::swap(left, right);
+        stack[size++] = left;
+        stack[size++] = right;
+    }
+
+    std::sort_heap(best.begin(), best.end(), farther);
+    for (Neighbor& n : best) {
+        n.distance = std::sqrt(n.distance);
+    }
+    out.swap(best);
+}
+
+size_t SpatialIndex::depth() const {
+    if (nodes_.empty()) return 0;
+    size_t maxDepth = 0;
+    struct Entry { Index node; size_t depth; };
+    std::vector<Entry> stack{{0, 1}};
+    while (!stack.empty()) {
+        Entry entry = stack.back();
+        stack.pop_back();
+        maxDepth = std::max(maxDepth, entry.depth);
+        const Node& node = nodes_[entry.node];
+        if (!node.isLeaf()) {
+            stack.push_back({entry.node + 1, entry.depth + 1});
+            stack.push_back({node.right, entry.depth + 1});
+        }
+    }
+    return maxDepth;
+}
+
+} // namespace geantcad
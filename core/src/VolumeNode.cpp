@@ -1,10 +1,92 @@
 #include "VolumeNode.hh"
+#include "SceneGraph.hh"
+#include "SceneTraversal.hh"
+#include "MaterialRegistry.hh"
 #include <algorithm>
+#include <stdexcept>
 
 namespace geantcad {
 
 uint64_t VolumeNode::nextId_ = 1;
 
+nlohmann::json SensitiveDetectorConfig::toJson() const {
+    nlohmann::json j;
+    j["enabled"] = enabled;
+    j["type"] = type;
+    j["collectionName"] = collectionName;
+    j["copyNumber"] = copyNumber;
+    j["usesScoringMesh"] = usesScoringMesh;
+    j["meshSizeX"] = meshSizeX;
+    j["meshSizeY"] = meshSizeY;
+    j["meshSizeZ"] = meshSizeZ;
+    j["nBinsX"] = nBinsX;
+    j["nBinsY"] = nBinsY;
+    j["nBinsZ"] = nBinsZ;
+    
+    nlohmann::json scorersJson = nlohmann::json::array();
+    for (const auto& scorer : scorers) {
+        scorersJson.push_back({
+            {"name", scorer.name},
+            {"type", scorer.type},
+            {"particle_filter", scorer.particle_filter},
+            {"min_energy", scorer.min_energy},
+            {"max_energy", scorer.max_energy}
+        });
+    }
+    j["scorers"] = scorersJson;
+    return j;
+}
+
+SensitiveDetectorConfig SensitiveDetectorConfig::fromJson(const nlohmann::json& sd) {
+    SensitiveDetectorConfig config;
+    config.enabled = sd.value("enabled", false);
+    config.type = sd.value("type", "calorimeter");
+    config.collectionName = sd.value("collectionName", "");
+    config.copyNumber = sd.value("copyNumber", 0);
+    config.usesScoringMesh = sd.value("usesScoringMesh", false);
+    config.meshSizeX = sd.value("meshSizeX", 0.0);
+    config.meshSizeY = sd.value("meshSizeY", 0.0);
+    config.meshSizeZ = sd.value("meshSizeZ", 0.0);
+    config.nBinsX = sd.value("nBinsX", 10);
+    config.nBinsY = sd.value("nBinsY", 10);
+    config.nBinsZ = sd.value("nBinsZ", 10);
+    
+    if (sd.contains("scorers")) {
+        for (const auto& scorerJson : sd["scorers"]) {
+            ScorerConfig scorer;
+            scorer.name = scorerJson.value("name", "");
+            scorer.type = scorerJson.value("type", "energy_deposit");
+            scorer.particle_filter = scorerJson.value("particle_filter", "");
+            scorer.min_energy = scorerJson.value("min_energy", 0.0);
+            scorer.max_energy = scorerJson.value("max_energy", 0.0);
+            config.scorers.push_back(scorer);
+        }
+    }
+    return config;
+}
+
+nlohmann::json OpticalSurfaceConfig::toJson() const {
+    return {
+        {"enabled", enabled},
+        {"model", model},
+        {"finish", finish},
+        {"reflectivity", reflectivity},
+        {"sigmaAlpha", sigmaAlpha},
+        {"preset", preset}
+    };
+}
+
+OpticalSurfaceConfig OpticalSurfaceConfig::fromJson(const nlohmann::json& opt) {
+    OpticalSurfaceConfig config;
+    config.enabled = opt.value("enabled", false);
+    config.model = opt.value("model", "unified");
+    config.finish = opt.value("finish", "polished");
+    config.reflectivity = opt.value("reflectivity", 0.95);
+    config.sigmaAlpha = opt.value("sigmaAlpha", 0.0);
+    config.preset = opt.value("preset", "");
+    return config;
+}
+
 VolumeNode::VolumeNode(const std::string& name)
     : id_(nextId_++)
     , name_(name)
@@ -18,11 +100,62 @@ VolumeNode::~VolumeNode() {
         parent_->removeChild(this);
     }
     
-    // Remove children
-    while (!children_.empty()) {
-        auto* child = children_.back();
-        removeChild(child);
-        delete child;
+    // Root nodes have no parent to detach them from the indexes
+    if (sceneGraph_) {
+        detachFromScene();
+    }
+    
+    // Delete descendants iteratively (deep hierarchies would overflow the stack
+    // through nested destructors): each node is emptied before being deleted
+    std::vector<VolumeNode*> pending;
+    pending.swap(children_);
+    while (!pending.empty()) {
+        VolumeNode* node = pending.back();
+        pending.pop_back();
+        pending.insert(pending.end(), node->children_.begin(), node->children_.end());
+        node->children_.clear();
+        node->parent_ = nullptr;
+        delete node;
+    }
+}
+
+void VolumeNode::setName(const std::string& name) {
+    if (name_ == name) return;
+    
+    std::string oldName = name_;
+    name_ = name;
+    if (sceneGraph_) {
+        sceneGraph_->reindexName(this, oldName);
+        sceneGraph_->notifyNodeChanged(this, NodeChange::Name);
+    }
+}
+
+void VolumeNode::attachToScene(SceneGraph* sceneGraph) {
+    if (!sceneGraph) return;
+    
+    std::vector<VolumeNode*> stack{this};
+    while (!stack.empty()) {
+        VolumeNode* node = stack.back();
+        stack.pop_back();
+        if (node->sceneGraph_ == sceneGraph) continue;
+        if (node->sceneGraph_) {
+            node->sceneGraph_->unindexNode(node);
+        }
+        node->sceneGraph_ = sceneGraph;
+        sceneGraph->indexNode(node);
+        stack.insert(stack.end(), node->children_.begin(), node->children_.end());
+    }
+}
+
+void VolumeNode::detachFromScene() {
+    std::vector<VolumeNode*> stack{this};
+    while (!stack.empty()) {
+        VolumeNode* node = stack.back();
+        stack.pop_back();
+        if (!node->sceneGraph_) continue;
+        node->sceneGraph_->unindexNode(node);
+        node->sceneGraph_ = nullptr;
+        stack.insert(stack.end(), node->children_.begin(), node->children_.end());
     }
 }
 
@@ -52,6 +185,19 @@ void VolumeNode::addChild(VolumeNode* child) {
     if (child->parent_ != this) {
         child->parent_ = this;
     }
+    child->markWorldDirty();
+    
+    if (sceneGraph_) {
+        child->attachToScene(sceneGraph_);
+    }
+}
+
+void VolumeNode::insertChild(size_t index, VolumeNode* child) {
+    addChild(child);
+    auto it = std::find(children_.begin(), children_.end(), child);
+    if (it != children_.end() && size_t(it - children_.begin()) > index) {
+        std::rotate(children_.begin() + index, it, it + 1);
+    }
 }
 
 void VolumeNode::removeChild(VolumeNode* child) {
@@ -62,6 +208,10 @@ void VolumeNode::removeChild(VolumeNode* child) {
         children_.erase(it);
         if (child->parent_ == this) {
             child->parent_ = nullptr;
+            child->markWorldDirty();
+        }
+        if (child->sceneGraph_) {
+            child->detachFromScene();
         }
     }
 }
@@ -75,21 +225,111 @@ bool VolumeNode::isDescendantOf(const VolumeNode* ancestor) const {
     return false;
 }
 
-void VolumeNode::setShape(std::unique_ptr<Shape> shape) {
+Shape* VolumeNode::editShape() {
+    if (!shape_) return nullptr;
+    if (shape_.use_count() > 1) {
+        // Copy-on-write: the other holders keep the unmodified shape
+        shape_ = std::make_shared<Shape>(*shape_);
+        if (sceneGraph_) sceneGraph_->markStructureChanged();
+    }
+    // Every Shape is created non-const; only the handle is const
+    return const_cast<Shape*>(shape_.get());
+}
+
+void VolumeNode::setShape(std::shared_ptr<const Shape> shape) {
     shape_ = std::move(shape);
+    if (sceneGraph_) {
+        sceneGraph_->markStructureChanged();
+        sceneGraph_->notifyNodeChanged(this, NodeChange::Shape);
+    }
 }
 
-Transform VolumeNode::getWorldTransform() const {
-    Transform world = transform_;
-    const VolumeNode* current = parent_;
-    while (current) {
-        world = current->transform_.combine(world);
-        current = current->parent_;
+void VolumeNode::setArrayPattern(const ArrayPattern& pattern) {
+    arrayPattern_ = pattern;
+    if (sceneGraph_) {
+        sceneGraph_->markStructureChanged();
+        sceneGraph_->notifyNodeChanged(this, NodeChange::Array);
+    }
+}
+
+void VolumeNode::setMaterial(std::shared_ptr<Material> material) {
+    material_ = std::move(material);
+    notifyChanged(NodeChange::Material);
+}
+
+void VolumeNode::setVisible(bool visible) {
+    if (visible_ == visible) return;
+    visible_ = visible;
+    notifyChanged(NodeChange::Visibility);
+}
+
+void VolumeNode::notifyChanged(NodeChange change) {
+    if (sceneGraph_) {
+        sceneGraph_->notifyNodeChanged(this, change);
     }
-    return world;
 }
 
-nlohmann::json VolumeNode::toJson() const {
+void VolumeNode::setTransform(const Transform& transform) {
+    transform_ = transform;
+    transformChanged();
+}
+
+void VolumeNode::transformChanged() {
+    markWorldDirty();
+    notifyChanged(NodeChange::Transform);
+}
+
+void VolumeNode::markWorldDirty() {
+    // A dirty node already has a dirty subtree, so the walk stops there
+    if (worldDirty_) return;
+    
+    std::vector<VolumeNode*> stack{this};
+    while (!stack.empty()) {
+        VolumeNode* node = stack.back();
+        stack.pop_back();
+        if (node->worldDirty_) continue;
+        node->worldDirty_ = true;
+        stack.insert(stack.end(), node->children_.begin(), node->children_.end());
+    }
+}
+
+void VolumeNode::computeWorldTransform() const {
+    worldTransform_ = parent_ ? parent_->worldTransform_.combine(transform_) : transform_;
+    worldMatrix_ = worldTransform_.getMatrix();
+    worldDirty_ = false;
+}
+
+const Transform& VolumeNode::getWorldTransform() const {
+    if (worldDirty_) {
+        // Clean nodes only have clean ancestors: recompute the dirty part of
+        // the path top-down, starting below the first clean ancestor
+        std::vector<const VolumeNode*> path;
+        for (const VolumeNode* n = this; n && n->worldDirty_; n = n->parent_) {
+            path.push_back(n);
+        }
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            (*it)->computeWorldTransform();
+        }
+    }
+    return worldTransform_;
+}
+
+const QMatrix4x4& VolumeNode::getWorldMatrix() const {
+    getWorldTransform();
+    return worldMatrix_;
+}
+
+void VolumeNode::updateWorldTransforms() const {
+    getWorldTransform();
+    // Pre-order: parents are always clean before their children are visited
+    traversal::preOrder(this, [](const VolumeNode* node) {
+        if (node->worldDirty_) {
+            node->computeWorldTransform();
+        }
+    });
+}
+
+nlohmann::json VolumeNode::toJson(const MaterialRegistry* materials) const {
     nlohmann::json j;
     j["id"] = id_;
     j["name"] = name_;
@@ -100,121 +340,88 @@ nlohmann::json VolumeNode::toJson() const {
     }
     
     if (material_) {
-        j["material"] = material_->toJson();
-    }
-    
-    nlohmann::json sdJson;
-    sdJson["enabled"] = sdConfig_.enabled;
-    sdJson["type"] = sdConfig_.type;
-    sdJson["collectionName"] = sdConfig_.collectionName;
-    sdJson["copyNumber"] = sdConfig_.copyNumber;
-    sdJson["usesScoringMesh"] = sdConfig_.usesScoringMesh;
-    sdJson["meshSizeX"] = sdConfig_.meshSizeX;
-    sdJson["meshSizeY"] = sdConfig_.meshSizeY;
-    sdJson["meshSizeZ"] = sdConfig_.meshSizeZ;
-    sdJson["nBinsX"] = sdConfig_.nBinsX;
-    sdJson["nBinsY"] = sdConfig_.nBinsY;
-    sdJson["nBinsZ"] = sdConfig_.nBinsZ;
-    
-    nlohmann::json scorersJson = nlohmann::json::array();
-    for (const auto& scorer : sdConfig_.scorers) {
-        scorersJson.push_back({
-            {"name", scorer.name},
-            {"type", scorer.type},
-            {"particle_filter", scorer.particle_filter},
-            {"min_energy", scorer.min_energy},
-            {"max_energy", scorer.max_energy}
-        });
+        size_t materialId = materials ? materials->indexOf(material_.get()) : MaterialRegistry::npos;
+        if (materialId != MaterialRegistry::npos) {
+            j["materialId"] = materialId;
+        } else {
+            j["material"] = material_->toJson();
+        }
     }
-    sdJson["scorers"] = scorersJson;
-    j["sdConfig"] = sdJson;
     
-    j["opticalConfig"] = {
-        {"enabled", opticalConfig_.enabled},
-        {"model", opticalConfig_.model},
-        {"finish", opticalConfig_.finish},
-        {"reflectivity", opticalConfig_.reflectivity},
-        {"sigmaAlpha", opticalConfig_.sigmaAlpha},
-        {"preset", opticalConfig_.preset}
-    };
+    j["sdConfig"] = sdConfig_.toJson();
+    j["opticalConfig"] = opticalConfig_.toJson();
     
     j["visible"] = visible_;
     
+    if (arrayPattern_.type != ArrayPattern::Type::None) {
+        j["array"] = arrayPattern_.toJson();
+    }
+    
     // Children
     nlohmann::json childrenJson = nlohmann::json::array();
     for (auto* child : children_) {
-        childrenJson.push_back(child->toJson());
+        childrenJson.push_back(child->toJson(materials));
     }
     j["children"] = childrenJson;
     
     return j;
 }
 
-std::unique_ptr<VolumeNode> VolumeNode::fromJson(const nlohmann::json& j) {
+std::unique_ptr<VolumeNode> VolumeNode::fromJson(const nlohmann::json& j, const MaterialRegistry* materials) {
     auto node = std::make_unique<VolumeNode>(j["name"]);
-    node->id_ = j.value("id", node->id_); // Preserve ID if provided
+    node->readJsonFields(j, materials);
+    
+    // Children (recursive)
+    if (j.contains("children")) {
+        for (const auto& childJson : j["children"]) {
+            auto child = fromJson(childJson, materials);
+            node->addChild(child.release());
+        }
+    }
+    
+    return node;
+}
+
+void VolumeNode::readJsonFields(const nlohmann::json& j, const MaterialRegistry* materials) {
+    if (j.contains("name")) {
+        name_ = j["name"].get<std::string>();
+    }
+    id_ = j.value("id", id_); // Preserve ID if provided
+    // Keep freshly created nodes from reusing a loaded ID
+    if (id_ >= nextId_) {
+        nextId_ = id_ + 1;
+    }
     
     if (j.contains("transform")) {
-        node->transform_ = Transform::fromJson(j["transform"]);
+        transform_ = Transform::fromJson(j["transform"]);
     }
     
     if (j.contains("shape")) {
-        node->shape_ = Shape::fromJson(j["shape"]);
+        shape_ = Shape::fromJson(j["shape"]);
     }
     
-    if (j.contains("material")) {
-        node->material_ = Material::fromJson(j["material"]);
+    if (j.contains("materialId")) {
+        if (!materials) {
+            throw std::runtime_error("Volume references a material table that is missing");
+        }
+        material_ = materials->at(j["materialId"].get<size_t>());
+    } else if (j.contains("material")) {
+        material_ = Material::fromJson(j["material"]);
     }
     
     if (j.contains("sdConfig")) {
-        auto sd = j["sdConfig"];
-        node->sdConfig_.enabled = sd.value("enabled", false);
-        node->sdConfig_.type = sd.value("type", "calorimeter");
-        node->sdConfig_.collectionName = sd.value("collectionName", "");
-        node->sdConfig_.copyNumber = sd.value("copyNumber", 0);
-        node->sdConfig_.usesScoringMesh = sd.value("usesScoringMesh", false);
-        node->sdConfig_.meshSizeX = sd.value("meshSizeX", 0.0);
-        node->sdConfig_.meshSizeY = sd.value("meshSizeY", 0.0);
-        node->sdConfig_.meshSizeZ = sd.value("meshSizeZ", 0.0);
-        node->sdConfig_.nBinsX = sd.value("nBinsX", 10);
-        node->sdConfig_.nBinsY = sd.value("nBinsY", 10);
-        node->sdConfig_.nBinsZ = sd.value("nBinsZ", 10);
-        
-        if (sd.contains("scorers")) {
-            node->sdConfig_.scorers.clear();
-            for (const auto& scorerJson : sd["scorers"]) {
-                ScorerConfig scorer;
-                scorer.name = scorerJson.value("name", "");
-                scorer.type = scorerJson.value("type", "energy_deposit");
-                scorer.particle_filter = scorerJson.value("particle_filter", "");
-                scorer.min_energy = scorerJson.value("min_energy", 0.0);
-                scorer.max_energy = scorerJson.value("max_energy", 0.0);
-                node->sdConfig_.scorers.push_back(scorer);
-            }
-        }
+        sdConfig_ = SensitiveDetectorConfig::fromJson(j["sdConfig"]);
     }
     
     if (j.contains("opticalConfig")) {
-        auto opt = j["opticalConfig"];
-        node->opticalConfig_.enabled = opt.value("enabled", false);
-        node->opticalConfig_.model = opt.value("model", "unified");
-        node->opticalConfig_.finish = opt.value("finish", "polished");
-        node->opticalConfig_.reflectivity = opt.value("reflectivity", 0.95);
-        node->opticalConfig_.sigmaAlpha = opt.value("sigmaAlpha", 0.0);
-        node->opticalConfig_.preset = opt.value("preset", "");
+        opticalConfig_ = OpticalSurfaceConfig::fromJson(j["opticalConfig"]);
     }
     
-    node->visible_ = j.value("visible", true);
+    visible_ = j.value("visible", true);
     
-    // Children (recursive)
-    if (j.contains("children")) {
-        for (const auto& childJson : j["children"]) {
-            auto child = fromJson(childJson);
-            node->addChild(child.release());
-        }
+    if (j.contains("array")) {
+        arrayPattern_ = ArrayPattern::fromJson(j["array"]);
     }
-    
-    return node;
 }
 
 } // namespace geantcad
@@ -21,10 +21,14 @@
 #include "../../core/include/PhysicsConfig.hh"
 #include "../../core/include/OutputConfig.hh"
 #include "../../core/include/ParticleGunConfig.hh"
+#include "../../core/include/OverlapChecker.hh"
 
 // Generator includes
 #include "../../generator/include/GDMLExporter.hh"
+#include "../../generator/include/GDMLImporter.hh"
 #include "../../generator/include/Geant4ProjectGenerator.hh"
+#include "../../generator/include/MeshCache.hh"
+#include "../../generator/include/TemplateEngine.hh"
 
 namespace py = pybind11;
 using namespace geantcad;
@@ -178,6 +182,25 @@ PYBIND11_MODULE(geantcad_python, m) {
         .def_readwrite("sigmaAlpha", &OpticalSurfaceConfig::sigmaAlpha)
         .def_readwrite("preset", &OpticalSurfaceConfig::preset);
     
+    // ArrayPattern
+    py::class_<ArrayPattern> arrayPattern(m, "ArrayPattern");
+    py::enum_<ArrayPattern::Type>(arrayPattern, "Type")
+        .value("None", ArrayPattern::Type::None)
+        .value("Linear", ArrayPattern::Type::Linear)
+        .value("Grid", ArrayPattern::Type::Grid)
+        .value("Ring", ArrayPattern::Type::Ring);
+    arrayPattern
+        .def(py::init<>())
+        .def_readwrite("type", &ArrayPattern::type)
+        .def_property("count",
+            [](const ArrayPattern& p) { return std::vector<int>(p.count, p.count + 3); },
+            [](ArrayPattern& p, const std::vector<int>& v) { for (size_t i = 0; i < 3 && i < v.size(); ++i) p.count[i] = v[i]; })
+        .def_property("step",
+            [](const ArrayPattern& p) { return std::vector<double>(p.step, p.step + 3); },
+            [](ArrayPattern& p, const std::vector<double>& v) { for (size_t i = 0; i < 3 && i < v.size(); ++i) p.step[i] = v[i]; })
+        .def_readwrite("dphi", &ArrayPattern::dphi)
+        .def("copies", &ArrayPattern::copies);
+    
     // Transform wrapper (simplified - using tuples for vectors)
     py::class_<Transform>(m, "Transform")
         .def(py::init<>())
@@ -209,18 +232,22 @@ PYBIND11_MODULE(geantcad_python, m) {
         .def("setParent", &VolumeNode::setParent)
         .def("addChild", &VolumeNode::addChild)
         .def("removeChild", &VolumeNode::removeChild)
-        .def("getShape", (Shape*(VolumeNode::*)())&VolumeNode::getShape, py::return_value_policy::reference_internal)
-        .def("setShape", [](VolumeNode& v, Shape* shape) {
-            // Create unique_ptr from raw pointer (takes ownership)
-            if (shape) {
-                v.setShape(std::unique_ptr<Shape>(shape));
-            }
-        }, py::arg("shape"), py::keep_alive<0, 2>()) // Keep shape alive until VolumeNode is destroyed
-        .def("getTransform", (Transform&(VolumeNode::*)())&VolumeNode::getTransform, py::return_value_policy::reference_internal)
+        .def("getShape", [](const VolumeNode& v) { return std::const_pointer_cast<Shape>(v.getSharedShape()); })
+        .def("editShape", &VolumeNode::editShape, py::return_value_policy::reference_internal)
+        .def("setShape", [](VolumeNode& v, std::shared_ptr<Shape> shape) {
+            // Shared with Python: the same Shape can be given to several volumes
+            v.setShape(std::move(shape));
+        }, py::arg("shape"))
+        .def("getTransform", [](const VolumeNode& v) { return v.getTransform(); })  // a copy: write back with setTransform
+        .def("setTransform", &VolumeNode::setTransform)
+        .def("getWorldTransform", &VolumeNode::getWorldTransform)
+        .def("updateWorldTransforms", &VolumeNode::updateWorldTransforms)
         .def("getMaterial", &VolumeNode::getMaterial)
         .def("setMaterial", &VolumeNode::setMaterial)
         .def("getSDConfig", (SensitiveDetectorConfig&(VolumeNode::*)())&VolumeNode::getSDConfig, py::return_value_policy::reference_internal)
-        .def("getOpticalConfig", (OpticalSurfaceConfig&(VolumeNode::*)())&VolumeNode::getOpticalConfig, py::return_value_policy::reference_internal);
+        .def("getOpticalConfig", (OpticalSurfaceConfig&(VolumeNode::*)())&VolumeNode::getOpticalConfig, py::return_value_policy::reference_internal)
+        .def("getArrayPattern", &VolumeNode::getArrayPattern)
+        .def("setArrayPattern", &VolumeNode::setArrayPattern);
     
     // SceneGraph class
     py::class_<SceneGraph>(m, "SceneGraph")
@@ -230,6 +257,10 @@ PYBIND11_MODULE(geantcad_python, m) {
         .def("removeVolume", &SceneGraph::removeVolume)
         .def("findVolumeById", &SceneGraph::findVolumeById, py::return_value_policy::reference_internal)
         .def("findVolumeByName", &SceneGraph::findVolumeByName, py::return_value_policy::reference_internal)
+        .def("findVolumesByName", &SceneGraph::findVolumesByName, py::return_value_policy::reference_internal)
+        .def("getVolumeCount", &SceneGraph::getVolumeCount)
+        .def("internMaterials", &SceneGraph::internMaterials)
+        .def("updateWorldTransforms", &SceneGraph::updateWorldTransforms)
         .def("getSelected", &SceneGraph::getSelected, py::return_value_policy::reference_internal)
         .def("setSelected", &SceneGraph::setSelected)
         .def("clearSelection", &SceneGraph::clearSelection)
@@ -237,10 +268,84 @@ PYBIND11_MODULE(geantcad_python, m) {
         .def("getOutputConfig", (OutputConfig&(SceneGraph::*)())&SceneGraph::getOutputConfig, py::return_value_policy::reference_internal)
         .def("getParticleGunConfig", (ParticleGunConfig&(SceneGraph::*)())&SceneGraph::getParticleGunConfig, py::return_value_policy::reference_internal);
     
+    // Overlap checker
+    py::class_<OverlapOptions>(m, "OverlapOptions")
+        .def(py::init<>())
+        .def_readwrite("samplesPerVolume", &OverlapOptions::samplesPerVolume)
+        .def_readwrite("tolerance", &OverlapOptions::tolerance)
+        .def_readwrite("checkMothers", &OverlapOptions::checkMothers)
+        .def_readwrite("threads", &OverlapOptions::threads);
+    
+    py::class_<OverlapReport> overlapReport(m, "OverlapReport");
+    py::enum_<OverlapReport::Kind>(overlapReport, "Kind")
+        .value("Siblings", OverlapReport::Kind::Siblings)
+        .value("Extrusion", OverlapReport::Kind::Extrusion);
+    overlapReport
+        .def_readonly("kind", &OverlapReport::kind)
+        .def_property_readonly("volume", [](const OverlapReport& r) { return r.volume; }, py::return_value_policy::reference)
+        .def_property_readonly("other", [](const OverlapReport& r) { return r.other; }, py::return_value_policy::reference)
+        .def_readonly("copy", &OverlapReport::copy)
+        .def_readonly("otherCopy", &OverlapReport::otherCopy)
+        .def_readonly("depth", &OverlapReport::depth)
+        .def_property_readonly("point", [](const OverlapReport& r) {
+            return Vector3D(r.point.x(), r.point.y(), r.point.z());
+        })
+        .def_readonly("exact", &OverlapReport::exact);
+    
+    py::class_<OverlapChecker>(m, "OverlapChecker")
+        .def(py::init<const OverlapOptions&>(), py::arg("options") = OverlapOptions())
+        .def("setOptions", &OverlapChecker::setOptions)
+        .def("getOptions", &OverlapChecker::getOptions)
+        .def("check", [](OverlapChecker& checker, const SceneGraph& scene) {
+            py::gil_scoped_release release;
+            return checker.check(scene);
+        }, "Overlapping siblings and daughters protruding from their mother, deepest first")
+        .def("getStats", [](const OverlapChecker& checker) {
+            const auto& stats = checker.getStats();
+            py::dict d;
+            d["volumes"] = stats.volumes;
+            d["skipped"] = stats.skipped;
+            d["siblingPairs"] = stats.siblingPairs;
+            d["motherChecks"] = stats.motherChecks;
+            d["analyticTests"] = stats.analyticTests;
+            d["sampledTests"] = stats.sampledTests;
+            d["threads"] = stats.threads;
+            d["seconds"] = stats.seconds;
+            return d;
+        });
+    
     // GDMLExporter class
     py::class_<GDMLExporter>(m, "GDMLExporter")
         .def(py::init<>())
-        .def("exportToFile", &GDMLExporter::exportToFile, "Export SceneGraph to GDML file");
+        .def("exportToFile", &GDMLExporter::exportToFile, "Export SceneGraph to GDML file")
+        .def("getLastStats", [](const GDMLExporter& exporter) {
+            const auto& stats = exporter.getLastStats();
+            py::dict d;
+            d["volumes"] = stats.volumes;
+            d["solids"] = stats.solids;
+            d["logicalVolumes"] = stats.logicalVolumes;
+            d["placements"] = stats.placements;
+            return d;
+        });
+    
+    // GDMLImporter class
+    py::class_<GDMLImporter>(m, "GDMLImporter")
+        .def(py::init<>())
+        .def("importFromFile", &GDMLImporter::importFromFile, "Replace the scene geometry with a GDML file")
+        .def("setThreads", &GDMLImporter::setThreads, "Parser threads (0 = all cores)")
+        .def("getLastError", &GDMLImporter::getLastError)
+        .def("getLastStats", [](const GDMLImporter& importer) {
+            const auto& stats = importer.getLastStats();
+            py::dict d;
+            d["volumes"] = stats.volumes;
+            d["solids"] = stats.solids;
+            d["materials"] = stats.materials;
+            d["logicalVolumes"] = stats.logicalVolumes;
+            d["placements"] = stats.placements;
+            d["skipped"] = stats.skipped;
+            d["threads"] = stats.threads;
+            return d;
+        });
     
     // Geant4ProjectGenerator class
     py::class_<Geant4ProjectGenerator>(m, "Geant4ProjectGenerator")
@@ -248,8 +353,40 @@ PYBIND11_MODULE(geantcad_python, m) {
         .def("setTemplateDir", &Geant4ProjectGenerator::setTemplateDir)
         .def("generateProject", &Geant4ProjectGenerator::generateProject, "Generate Geant4 project");
     
+    // Template engine (used by the project generator)
+    py::class_<CompiledTemplate, std::shared_ptr<CompiledTemplate>>(m, "CompiledTemplate")
+        .def(py::init<std::string>())
+        .def("render", &CompiledTemplate::render, "Render with a dict of variables")
+        .def("getPlaceholderCount", &CompiledTemplate::getPlaceholderCount);
+    
+    py::class_<TemplateEngine>(m, "TemplateEngine")
+        .def(py::init<>())
+        .def("render", &TemplateEngine::render, "Render {{variable}} placeholders of a template string")
+        .def("renderWithPreservation", &TemplateEngine::renderWithPreservation,
+             "Render keeping the user code regions of an existing file")
+        .def("extractUserCode", &TemplateEngine::extractUserCode)
+        .def_static("loadTemplate", [](const std::string& path) {
+            return std::const_pointer_cast<CompiledTemplate>(TemplateEngine::loadTemplate(path));
+        }, "Compiled template file, cached by path (None if missing or empty)")
+        .def_static("clearTemplateCache", &TemplateEngine::clearTemplateCache);
+    
+    // Tessellation cache (shared by viewport and mesh export)
+    m.def("meshCacheStats", []() {
+        auto stats = MeshCache::instance().getStats();
+        py::dict d;
+        d["hits"] = stats.hits;
+        d["misses"] = stats.misses;
+        d["evictions"] = stats.evictions;
+        d["entries"] = stats.entries;
+        return d;
+    }, "Hit/miss counters of the tessellation cache");
+    m.def("clearMeshCache", []() { MeshCache::instance().clear(); }, "Drop all cached tessellations");
+    
     // Serialization functions
     m.def("saveSceneToFile", &saveSceneToFile, "Save SceneGraph to JSON file");
-    m.def("loadSceneFromFile", &loadSceneFromFile, "Load SceneGraph from JSON file");
+    m.def("loadSceneFromFile", (bool(*)(SceneGraph*, const std::string&))&loadSceneFromFile, "Load SceneGraph from JSON file");
+    m.def("saveSceneToBinary", &saveSceneToBinary, "Save SceneGraph to a binary .gcadb file");
+    m.def("loadSceneFromBinary", &loadSceneFromBinary, "Load SceneGraph from a binary .gcadb file");
+    m.def("convertSceneFile", &convertSceneFile, "Convert a scene between JSON and binary formats");
 }
 
@@ -5,16 +5,28 @@
 
 namespace geantcad {
 
+/**
+ * Conteggi dell'ultimo export: volumi della scena contro solidi e volumi
+ * logici scritti (i volumi identici condividono solido e volume logico).
+ */
+struct GDMLExportStats {
+    size_t volumes = 0;         // scene volumes, world included
+    size_t solids = 0;
+    size_t logicalVolumes = 0;  // world included
+    size_t placements = 0;      // physvols, replicavols and paramvols
+};
+
 class GDMLExporter {
 public:
     GDMLExporter();
     ~GDMLExporter();
-    
+
     bool exportToFile(SceneGraph* sceneGraph, const std::string& filePath);
-    
+
+    const GDMLExportStats& getLastStats() const { return stats_; }
+
 private:
-    // Implementation
+    GDMLExportStats stats_;
 };
 
 } // namespace geantcad
-
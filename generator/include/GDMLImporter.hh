@@ -0,0 +1,55 @@
+#pragma once
+
+#include "../../core/include/SceneGraph.hh"
+#include <memory>
+#include <string>
+
+namespace geantcad {
+
+/**
+ * Conteggi dell'ultimo import: elementi GDML letti e volumi creati nella scena
+ * (ogni physvol di un volume logico diventa un VolumeNode).
+ */
+struct GDMLImportStats {
+    size_t volumes = 0;         // scene volumes created, world included
+    size_t solids = 0;
+    size_t materials = 0;
+    size_t logicalVolumes = 0;
+    size_t placements = 0;      // physvols, replicavols and paramvols
+    size_t skipped = 0;         // unsupported elements (solids, divisions, border surfaces...)
+    unsigned threads = 0;       // parser threads used
+};
+
+/**
+ * Importa un file GDML nella scena: solidi, materiali, struttura e physvol
+ * vengono mappati su Shape/Material/VolumeNode. Le sezioni del file sono
+ * analizzate in parallelo; la gerarchia viene costruita staccata dalla scena
+ * e installata in un colpo solo (nessuna notifica per singolo inserimento).
+ */
+class GDMLImporter {
+public:
+    GDMLImporter();
+    ~GDMLImporter();
+
+    // Replace the scene with the geometry of a GDML file. The simulation
+    // settings of the scene are kept.
+    bool importFromFile(SceneGraph* sceneGraph, const std::string& filePath);
+
+    // Parser threads (0 = std::thread::hardware_concurrency)
+    void setThreads(unsigned threads) { threads_ = threads; }
+
+    const GDMLImportStats& getLastStats() const { return stats_; }
+    const std::string& getLastError() const { return lastError_; }
+
+private:
+    struct Document;
+
+    bool parse(const char* data, size_t size, Document& document);
+    std::unique_ptr<VolumeNode> buildHierarchy(Document& document);
+
+    GDMLImportStats stats_;
+    std::string lastError_;
+    unsigned threads_ = 0;
+};
+
+} // namespace geantcad
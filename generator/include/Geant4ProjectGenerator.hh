@@ -22,7 +22,6 @@ private:
     TemplateEngine templateEngine_;
     
     // Helper methods
-    std::string readTemplateFile(const std::string& templatePath);
     bool writeGeneratedFile(const std::string& filePath, const std::string& content, bool preserveRegions = false);
     std::string readExistingFile(const std::string& filePath);
     bool createDirectoryStructure(const std::string& outputDir);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "../../core/include/Shape.hh"
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifndef GEANTCAD_NO_VTK
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#endif
+
+namespace geantcad {
+
+/**
+ * MeshCache: cache condivisa (thread-safe) delle tessellazioni delle shape.
+ * La chiave e' (ShapeType, parametri, risoluzione): volumi con la stessa geometria
+ * riusano un unico vtkPolyData, che va trattato come read-only.
+ */
+class MeshCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+    };
+
+    // Process-wide cache shared by the viewport and the exporters
+    static MeshCache& instance();
+
+    // Resolution asking for the box on the shape's local bounds instead of
+    // its tessellation (impostor of volumes too small on screen)
+    static constexpr int BoundsResolution = 0;
+
+#ifndef GEANTCAD_NO_VTK
+    /**
+     * Tessellation of the shape in local coordinates (Z is the axis of
+     * tubes/cones, as in Geant4). Returns nullptr for unsupported shapes.
+     */
+    vtkSmartPointer<vtkPolyData> get(const Shape& shape, int resolution);
+
+    // Uncached tessellation
+    static vtkSmartPointer<vtkPolyData> tessellate(const Shape& shape, int resolution);
+#endif
+
+    Stats getStats() const;
+    void resetStats();
+    void clear();
+
+    // When more entries than this are stored, meshes no longer used outside
+    // the cache are dropped
+    void setCapacity(size_t capacity);
+
+private:
+    MeshCache() = default;
+
+    struct Entry {
+        Shape key;
+        int resolution;
+#ifndef GEANTCAD_NO_VTK
+        vtkSmartPointer<vtkPolyData> mesh;
+#endif
+    };
+
+    void pruneUnused();
+
+    mutable std::mutex mutex_;
+    std::unordered_map<size_t, std::vector<Entry>> buckets_;
+    size_t entryCount_ = 0;
+    size_t capacity_ = 4096;
+    Stats stats_;
+};
+
+} // namespace geantcad
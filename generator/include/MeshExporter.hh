@@ -5,9 +5,20 @@
 
 namespace geantcad {
 
+/**
+ * Counts of the last mesh export
+ */
+struct MeshExportStats {
+    size_t volumes = 0;      // exported placements (array copies included)
+    size_t meshes = 0;       // distinct tessellations
+    size_t triangles = 0;
+    unsigned threads = 0;    // worker threads used
+};
+
 /**
  * MeshExporter exports the scene graph to mesh formats (STL, OBJ)
- * Uses VTK for mesh generation and export
+ * Uses VTK for tessellation; the volumes are transformed in parallel and the
+ * triangles streamed to the file in batches (no merged vtkPolyData)
  */
 class MeshExporter {
 public:
@@ -29,7 +40,7 @@ public:
     bool exportToFile(SceneGraph* sceneGraph, const std::string& filePath, Format format);
     
     /**
-     * Export scene to STL format
+     * Export scene to binary STL format
      */
     bool exportToSTL(SceneGraph* sceneGraph, const std::string& filePath);
     
@@ -38,13 +49,23 @@ public:
      */
     bool exportToOBJ(SceneGraph* sceneGraph, const std::string& filePath);
     
+    /**
+     * Worker threads (0 = std::thread::hardware_concurrency)
+     */
+    void setThreads(unsigned threads) { threads_ = threads; }
+    
     /**
      * Get the last error message
      */
     const std::string& getLastError() const { return lastError_; }
+    const MeshExportStats& getLastStats() const { return stats_; }
     
 private:
+    bool exportMesh(SceneGraph* sceneGraph, const std::string& filePath, Format format);
+    
     std::string lastError_;
+    MeshExportStats stats_;
+    unsigned threads_ = 0;
 };
 
 } // namespace geantcad
@@ -2,16 +2,53 @@
 
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
 
 namespace geantcad {
 
+/**
+ * Template compilato: il testo e' analizzato una sola volta in segmenti
+ * letterali e segnaposto {{nome}}; il rendering e' un'unica passata in un
+ * buffer gia' dimensionato.
+ */
+class CompiledTemplate {
+public:
+    CompiledTemplate() = default;
+    explicit CompiledTemplate(std::string templateStr);
+
+    // Placeholders without a matching variable are left as written. Values
+    // are inserted verbatim (not re-expanded).
+    std::string render(const std::map<std::string, std::string>& variables) const;
+
+    const std::string& getSource() const { return source_; }
+    size_t getPlaceholderCount() const { return placeholderCount_; }
+
+private:
+    struct Segment {
+        size_t offset;     // into source_; a placeholder spans the whole "{{name}}"
+        size_t length;
+        std::string name;  // empty for literal text
+    };
+
+    std::string source_;
+    std::vector<Segment> segments_;
+    size_t placeholderCount_ = 0;
+};
+
 class TemplateEngine {
 public:
     TemplateEngine();
     ~TemplateEngine();
-    
+
     std::string render(const std::string& templateStr, const std::map<std::string, std::string>& variables);
-    
+
+    // Template file compiled on first use and cached by path (shared by all
+    // engines, recompiled when the file changes). nullptr if the file is
+    // missing or empty.
+    static std::shared_ptr<const CompiledTemplate> loadTemplate(const std::string& templatePath);
+    static void clearTemplateCache();
+
     // Render template and preserve user code regions from existing file
     // Returns rendered template with preserved regions inserted
     std::string renderWithPreservation(
@@ -19,14 +56,13 @@ public:
         const std::map<std::string, std::string>& variables,
         const std::string& existingContent
     );
-    
+
     // Extract user code from a region tag
     // Returns empty string if region not found
     std::string extractUserCode(const std::string& content, const std::string& tag);
-    
+
 private:
     // Implementation
 };
 
 } // namespace geantcad
-
@@ -3,9 +3,15 @@
 #include "../../core/include/Shape.hh"
 #include "../../core/include/Material.hh"
 #include "../../core/include/Transform.hh"
+#include "../../core/include/MaterialRegistry.hh"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
 #include <fstream>
-#include <sstream>
-#include <iomanip>
+#include <functional>
+#include <unordered_map>
+#include <vector>
 
 namespace geantcad {
 
@@ -38,17 +44,86 @@ namespace {
         return mm / 10.0;
     }
     
-    // Format double for XML
-    std::string formatDouble(double value, int precision = 6) {
-        std::ostringstream oss;
-        oss << std::fixed << std::setprecision(precision) << value;
-        std::string str = oss.str();
-        // Remove trailing zeros
-        str.erase(str.find_last_not_of('0') + 1, std::string::npos);
-        str.erase(str.find_last_not_of('.') + 1, std::string::npos);
-        return str;
+    // Number for XML: fixed notation, trailing zeros removed. Formatted by
+    // GDMLWriter straight into its buffer
+    struct FormattedDouble {
+        double value;
+        int precision;
+    };
+    
+    FormattedDouble formatDouble(double value, int precision = 6) {
+        return {value, precision};
     }
     
+    /**
+     * Sink bufferizzato dell'export: il testo si accumula in un blocco da 1 MB
+     * scritto sul file quando e' pieno, senza sentry e locale di std::ostream
+     * per ogni pezzo. I numeri sono formattati con std::to_chars (nessuna
+     * allocazione) con lo stesso risultato di std::fixed + setprecision.
+     */
+    class GDMLWriter {
+    public:
+        explicit GDMLWriter(std::ostream& out, size_t capacity = 1 << 20)
+            : out_(out), buffer_(capacity) {}
+        ~GDMLWriter() { flush(); }
+        
+        GDMLWriter& operator<<(const char* text) { return write(text, std::strlen(text)); }
+        GDMLWriter& operator<<(const std::string& text) { return write(text.data(), text.size()); }
+        GDMLWriter& operator<<(char c) { return write(&c, 1); }
+        GDMLWriter& operator<<(int value) { return integer(value); }
+        GDMLWriter& operator<<(size_t value) { return integer(value); }
+        
+        GDMLWriter& operator<<(const FormattedDouble& number) {
+            // Fixed notation of any double fits (DBL_MAX has 309 digits)
+            char* first = reserve(MaxNumberChars);
+            auto result = std::to_chars(first, first + MaxNumberChars, number.value,
+                                        std::chars_format::fixed, number.precision);
+            char* last = result.ptr;
+            if (result.ec == std::errc() && number.precision > 0 && std::find(first, last, '.') != last) {
+                while (last[-1] == '0') --last;
+                if (last[-1] == '.') --last;
+            }
+            used_ = size_t(last - buffer_.data());
+            return *this;
+        }
+        
+        void flush() {
+            if (used_ > 0) out_.write(buffer_.data(), std::streamsize(used_));
+            used_ = 0;
+        }
+        
+    private:
+        static constexpr size_t MaxNumberChars = 352;
+        
+        template <typename T>
+        GDMLWriter& integer(T value) {
+            char* first = reserve(24);
+            used_ = size_t(std::to_chars(first, first + 24, value).ptr - buffer_.data());
+            return *this;
+        }
+        
+        GDMLWriter& write(const char* data, size_t size) {
+            if (size > buffer_.size()) {
+                flush();
+                out_.write(data, std::streamsize(size));
+                return *this;
+            }
+            std::memcpy(reserve(size), data, size);
+            used_ += size;
+            return *this;
+        }
+        
+        // Free space for at least `size` chars at the end of the buffer
+        char* reserve(size_t size) {
+            if (buffer_.size() - used_ < size) flush();
+            return buffer_.data() + used_;
+        }
+        
+        std::ostream& out_;
+        std::vector<char> buffer_;
+        size_t used_ = 0;
+    };
+    
     // Check if rotation is non-identity (has significant rotation)
     bool hasRotation(const Transform& transform) {
         auto rot = transform.getRotation();
@@ -61,7 +136,7 @@ namespace {
     }
     
     // Write transform to GDML (position + rotation)
-    void writeTransform(std::ostream& os, const Transform& transform, const std::string& name) {
+    void writeTransform(GDMLWriter& os, const Transform& transform, const std::string& name) {
         auto pos = transform.getTranslation();
         std::string posName = sanitizeName(name) + "_pos";
         
@@ -86,8 +161,12 @@ namespace {
         }
     }
     
+    // Solid name used for a boolean operand (operands are referenced by volume name)
+    using OperandRef = std::function<std::string(const std::string&)>;
+
     // Write shape to GDML
-    void writeShape(std::ostream& os, const Shape* shape, const std::string& name) {
+    void writeShape(GDMLWriter& os, const Shape* shape, const std::string& name,
+                    const OperandRef& operandRef = nullptr) {
         if (!shape) return;
         
         std::string shapeName = sanitizeName(name) + "_shape";
@@ -217,8 +296,8 @@ namespace {
                         case BooleanOperation::Intersection: opTag = "intersection"; break;
                     }
                     
-                    std::string solidA_ref = sanitizeName(params->solidA_name) + "_shape";
-                    std::string solidB_ref = sanitizeName(params->solidB_name) + "_shape";
+                    std::string solidA_ref = operandRef ? operandRef(params->solidA_name) : sanitizeName(params->solidA_name) + "_shape";
+                    std::string solidB_ref = operandRef ? operandRef(params->solidB_name) : sanitizeName(params->solidB_name) + "_shape";
                     std::string posName = shapeName + "_relpos";
                     std::string rotName = shapeName + "_relrot";
                     
@@ -270,7 +349,7 @@ namespace {
     }
     
     // Write optical surface definition
-    void writeOpticalSurface(std::ostream& os, const OpticalSurfaceConfig& config, const std::string& name) {
+    void writeOpticalSurface(GDMLWriter& os, const OpticalSurfaceConfig& config, const std::string& name) {
         std::string surfName = sanitizeName(name) + "_optical_surface";
         
         os << "  <opticalsurface name=\"" << surfName << "\" ";
@@ -284,78 +363,315 @@ namespace {
         os << "/>\n";
     }
     
-    // Recursive volume export
-    void exportVolume(std::ostream& os, VolumeNode* node, int indent = 1) {
-        if (!node) return;
-        
-        std::string indentStr(indent * 2, ' ');
-        std::string volName = sanitizeName(node->getName());
-        
-        // Write shape
-        if (node->getShape()) {
-            writeShape(os, node->getShape(), volName);
+    /**
+     * Logical volumes deduplicated by structure. Volumes with the same solid
+     * (by geometry), material and daughters (same logical volumes at the same
+     * placements) are written as one <volume> placed several times. Volumes
+     * with a sensitive detector or an optical surface keep their own logical
+     * volume, because the generated code looks them up by name.
+     */
+    class LogicalVolumeTable {
+    public:
+        static constexpr size_t None = static_cast<size_t>(-1);
+
+        LogicalVolumeTable(VolumeNode* root, size_t volumeCount) {
+            logicalOf_.reserve(volumeCount);
+            byName_.reserve(volumeCount);
+            solidOf_.reserve(volumeCount);
+            solidsByGeometry_.reserve(volumeCount);
+            volumesByKey_.reserve(volumeCount);
+            // Post-order: daughters get their logical volume before the mother
+            traversal::postOrder(static_cast<const VolumeNode*>(root), [&](const VolumeNode* node) {
+                byName_.emplace(node->getName(), node);
+                Key key;
+                key.solid = solidOf(node);
+                key.material = node->getMaterial() ? materials_.indexOf(materials_.intern(node->getMaterial()).get()) : None;
+                if (node == root || node->getSDConfig().enabled || node->getOpticalConfig().enabled) {
+                    key.unique = node;
+                }
+                for (const VolumeNode* child : node->getChildren()) {
+                    key.daughters.push_back(logicalOf_.at(child));
+                    const Transform& t = child->getTransform();
+                    const QVector3D& pos = t.getTranslation();
+                    const QQuaternion& rot = t.getRotation();
+                    key.placements.insert(key.placements.end(),
+                        {pos.x(), pos.y(), pos.z(), rot.scalar(), rot.x(), rot.y(), rot.z()});
+                    const ArrayPattern& pattern = child->getArrayPattern();
+                    if (pattern.isArray()) {
+                        key.placements.insert(key.placements.end(),
+                            {float(pattern.type), float(pattern.count[0]), float(pattern.count[1]), float(pattern.count[2]),
+                             float(pattern.step[0]), float(pattern.step[1]), float(pattern.step[2]), float(pattern.dphi)});
+                    }
+                }
+                logicalOf_.emplace(node, logicalFor(std::move(key), node));
+            });
         }
-        
-        // Write volume
-        os << indentStr << "<volume name=\"" << volName << "\">\n";
-        
-        // Material reference
-        std::string matRef = getMaterialRef(node->getMaterial().get());
-        os << indentStr << "  <materialref ref=\"" << matRef << "\"/>\n";
-        
-        // Solid reference
-        std::string shapeName = sanitizeName(node->getName()) + "_shape";
-        os << indentStr << "  <solidref ref=\"" << shapeName << "\"/>\n";
-        
-        // Write children (physvols)
-        for (auto* child : node->getChildren()) {
-            std::string childName = sanitizeName(child->getName());
-            std::string posName = childName + "_pos";
-            std::string rotName = childName + "_rot";
-            
-            // Write position (and rotation if present)
-            writeTransform(os, child->getTransform(), childName);
-            
-            os << indentStr << "  <physvol>\n";
-            os << indentStr << "    <volumeref ref=\"" << childName << "\"/>\n";
-            os << indentStr << "    <positionref ref=\"" << posName << "\"/>\n";
-            
-            // Add rotation reference if rotation exists
-            if (hasRotation(child->getTransform())) {
-                os << indentStr << "    <rotationref ref=\"" << rotName << "\"/>\n";
+
+        // One entry per logical volume, daughters before mothers
+        const std::vector<const VolumeNode*>& volumes() const { return volumes_; }
+        // First volume using each solid
+        const std::vector<const VolumeNode*>& solids() const { return solids_; }
+
+        bool ownsVolume(const VolumeNode* node) const { return volumes_[logicalOf_.at(node)] == node; }
+        size_t logicalId(const VolumeNode* node) const { return logicalOf_.at(node); }
+
+        std::string volumeRef(const VolumeNode* node) const {
+            return sanitizeName(volumes_[logicalOf_.at(node)]->getName());
+        }
+        std::string solidRef(const VolumeNode* node) const {
+            size_t solid = solidOf_.count(node->getShape()) ? solidOf_.at(node->getShape()) : None;
+            return sanitizeName(solid != None ? solids_[solid]->getName() : node->getName()) + "_shape";
+        }
+        std::string operandRef(const std::string& volumeName) const {
+            auto it = byName_.find(volumeName);
+            return it != byName_.end() ? solidRef(it->second) : sanitizeName(volumeName) + "_shape";
+        }
+
+    private:
+        struct Key {
+            size_t solid = None;
+            size_t material = None;
+            const VolumeNode* unique = nullptr;
+            std::vector<size_t> daughters;
+            std::vector<float> placements;
+
+            bool operator==(const Key& o) const {
+                return solid == o.solid && material == o.material && unique == o.unique
+                    && daughters == o.daughters && placements == o.placements;
             }
-            
-            os << indentStr << "  </physvol>\n";
+            size_t hash() const {
+                size_t h = std::hash<size_t>()(solid) ^ (std::hash<size_t>()(material) << 1)
+                    ^ std::hash<const void*>()(unique);
+                for (size_t d : daughters) h = h * 1000003u ^ d;
+                for (float p : placements) h = h * 1000003u ^ std::hash<float>()(p);
+                return h;
+            }
+        };
+
+        size_t solidOf(const VolumeNode* node) {
+            const Shape* shape = node->getShape();
+            if (!shape) return None;
+            auto known = solidOf_.find(shape);
+            if (known != solidOf_.end()) return known->second;
+
+            // Shapes that are not shared objects can still have the same geometry
+            auto& bucket = solidsByGeometry_[shape->geometryHash()];
+            size_t id = None;
+            for (size_t candidate : bucket) {
+                if (solids_[candidate]->getShape()->sameGeometry(*shape)) { id = candidate; break; }
+            }
+            if (id == None) {
+                id = solids_.size();
+                solids_.push_back(node);
+                bucket.push_back(id);
+            }
+            solidOf_.emplace(shape, id);
+            return id;
         }
-        
-        os << indentStr << "</volume>\n";
-        
-        // Recursively export children
-        for (auto* child : node->getChildren()) {
-            exportVolume(os, child, indent + 1);
+
+        size_t logicalFor(Key key, const VolumeNode* node) {
+            auto& bucket = volumesByKey_[key.hash()];
+            for (size_t candidate : bucket) {
+                if (keys_[candidate] == key) return candidate;
+            }
+            size_t id = volumes_.size();
+            volumes_.push_back(node);
+            keys_.push_back(std::move(key));
+            bucket.push_back(id);
+            return id;
         }
+
+        MaterialRegistry materials_;
+        std::vector<const VolumeNode*> solids_;
+        std::unordered_map<const Shape*, size_t> solidOf_;
+        std::unordered_map<size_t, std::vector<size_t>> solidsByGeometry_;
+        std::vector<const VolumeNode*> volumes_;
+        std::vector<Key> keys_;
+        std::unordered_map<size_t, std::vector<size_t>> volumesByKey_;
+        std::unordered_map<const VolumeNode*, size_t> logicalOf_;
+        std::unordered_map<std::string, const VolumeNode*> byName_;
+    };
+
+    bool nearlyEqual(double a, double b) {
+        return std::abs(a - b) <= 1e-4 * std::max(1.0, std::abs(a));
     }
-    
-    // Export optical surfaces (called after volumes)
-    void exportOpticalSurfaces(std::ostream& os, VolumeNode* node) {
-        if (!node) return;
-        
-        const auto& opticalConfig = node->getOpticalConfig();
-        if (opticalConfig.enabled) {
-            std::string volName = sanitizeName(node->getName());
-            std::string surfName = volName + "_optical_surface";
-            
-            // Write optical surface definition (in <define> section)
-            writeOpticalSurface(os, opticalConfig, volName);
-            
-            // Write skin surface (in <setup> section, will be handled separately)
-            // For now, we'll add it to a list to write later
+
+    // How an arrayed daughter is written
+    enum class ArrayPlacement {
+        Single,    // not an array
+        Replica,   // <replicavol>: slices filling the mother
+        Paramvol,  // <paramvol>: one parameterised volume
+        Expanded   // one <physvol> per copy (solid without GDML parameterisation)
+    };
+
+    // A linear array of box slices along one mother axis, alone in a box
+    // mother that it fills exactly, is a G4PVReplica. Returns the axis or -1.
+    int replicaAxis(const VolumeNode* mother, const VolumeNode* child) {
+        const ArrayPattern& pattern = child->getArrayPattern();
+        if (pattern.type != ArrayPattern::Type::Linear || mother->getChildren().size() != 1) return -1;
+        const Shape* motherShape = mother->getShape();
+        const Shape* childShape = child->getShape();
+        const BoxParams* motherBox = motherShape ? motherShape->getParamsAs<BoxParams>() : nullptr;
+        const BoxParams* cellBox = childShape ? childShape->getParamsAs<BoxParams>() : nullptr;
+        if (!motherBox || !cellBox || hasRotation(child->getTransform())) return -1;
+
+        int axis = -1;
+        for (int i = 0; i < 3; ++i) {
+            if (pattern.step[i] == 0.0) continue;
+            if (axis >= 0) return -1;
+            axis = i;
         }
-        
-        // Recursively process children
-        for (auto* child : node->getChildren()) {
-            exportOpticalSurfaces(os, child);
+        if (axis < 0 || pattern.step[axis] <= 0.0) return -1;
+
+        const double motherHalf[3] = {motherBox->x, motherBox->y, motherBox->z};
+        const double cellHalf[3] = {cellBox->x, cellBox->y, cellBox->z};
+        const QVector3D& pos = child->getTransform().getTranslation();
+        const int n = pattern.copies();
+        const double width = pattern.step[axis];
+        for (int i = 0; i < 3; ++i) {
+            bool ok = (i == axis)
+                ? nearlyEqual(cellHalf[i], width / 2) && nearlyEqual(motherHalf[i], n * width / 2)
+                    && nearlyEqual(pos[i], -(n - 1) * width / 2)
+                : nearlyEqual(cellHalf[i], motherHalf[i]) && std::abs(pos[i]) < 1e-4;
+            if (!ok) return -1;
+        }
+        return axis;
+    }
+
+    ArrayPlacement arrayPlacement(const VolumeNode* mother, const VolumeNode* child) {
+        if (!child->getArrayPattern().isArray()) return ArrayPlacement::Single;
+        // Replicas and parameterised volumes number their copies from 0 and
+        // must be the only daughter of their mother (Geant4 GeomMgt0002)
+        const SensitiveDetectorConfig& sd = child->getSDConfig();
+        if ((sd.enabled && sd.copyNumber != 0) || mother->getChildren().size() != 1) return ArrayPlacement::Expanded;
+        if (replicaAxis(mother, child) >= 0) return ArrayPlacement::Replica;
+        switch (child->getShape() ? child->getShape()->getType() : ShapeType::BooleanSolid) {
+            case ShapeType::Box:
+            case ShapeType::Tube:
+            case ShapeType::Cone:
+            case ShapeType::Sphere:
+            case ShapeType::Trd:
+                return ArrayPlacement::Paramvol;
+            default:
+                return ArrayPlacement::Expanded;
+        }
+    }
+
+    // Name of the position/rotation defines of one placement
+    std::string placementName(const VolumeNode* child, int copy) {
+        std::string name = sanitizeName(child->getName());
+        return copy == 0 ? name : name + "_" + std::to_string(copy);
+    }
+
+    // Defines used by the placements of a daughter (expanded arrays: one per copy)
+    void writePlacementDefines(GDMLWriter& os, const VolumeNode* mother, const VolumeNode* child) {
+        ArrayPlacement placement = arrayPlacement(mother, child);
+        if (placement == ArrayPlacement::Replica || placement == ArrayPlacement::Paramvol) return;
+        const ArrayPattern& pattern = child->getArrayPattern();
+        int copies = placement == ArrayPlacement::Expanded ? pattern.copies() : 1;
+        for (int copy = 0; copy < copies; ++copy) {
+            writeTransform(os, pattern.copyTransform(child->getTransform(), copy), placementName(child, copy));
+        }
+    }
+
+    // Solid dimensions of one <paramvol> copy (every copy has the cell's solid)
+    void writeParamDimensions(GDMLWriter& os, const Shape* shape) {
+        if (auto* p = shape->getParamsAs<BoxParams>()) {
+            os << "          <box_dimensions x=\"" << formatDouble(mmToCm(p->x * 2.0)) << "\" y=\"" << formatDouble(mmToCm(p->y * 2.0))
+               << "\" z=\"" << formatDouble(mmToCm(p->z * 2.0)) << "\" lunit=\"cm\"/>\n";
+        } else if (auto* p = shape->getParamsAs<TubeParams>()) {
+            os << "          <tube_dimensions InR=\"" << formatDouble(mmToCm(p->rmin)) << "\" OutR=\"" << formatDouble(mmToCm(p->rmax))
+               << "\" hz=\"" << formatDouble(mmToCm(p->dz * 2.0)) << "\" StartPhi=\"" << formatDouble(p->sphi)
+               << "\" DeltaPhi=\"" << formatDouble(p->dphi) << "\" aunit=\"deg\" lunit=\"cm\"/>\n";
+        } else if (auto* p = shape->getParamsAs<ConeParams>()) {
+            os << "          <cone_dimensions rmin1=\"" << formatDouble(mmToCm(p->rmin1)) << "\" rmax1=\"" << formatDouble(mmToCm(p->rmax1))
+               << "\" rmin2=\"" << formatDouble(mmToCm(p->rmin2)) << "\" rmax2=\"" << formatDouble(mmToCm(p->rmax2))
+               << "\" z=\"" << formatDouble(mmToCm(p->dz * 2.0)) << "\" startphi=\"" << formatDouble(p->sphi)
+               << "\" deltaphi=\"" << formatDouble(p->dphi) << "\" aunit=\"deg\" lunit=\"cm\"/>\n";
+        } else if (auto* p = shape->getParamsAs<SphereParams>()) {
+            os << "          <sphere_dimensions rmin=\"" << formatDouble(mmToCm(p->rmin)) << "\" rmax=\"" << formatDouble(mmToCm(p->rmax))
+               << "\" startphi=\"" << formatDouble(p->sphi) << "\" deltaphi=\"" << formatDouble(p->dphi)
+               << "\" starttheta=\"" << formatDouble(p->stheta) << "\" deltatheta=\"" << formatDouble(p->dtheta)
+               << "\" aunit=\"deg\" lunit=\"cm\"/>\n";
+        } else if (auto* p = shape->getParamsAs<TrdParams>()) {
+            os << "          <trd_dimensions x1=\"" << formatDouble(mmToCm(p->dx1 * 2.0)) << "\" x2=\"" << formatDouble(mmToCm(p->dx2 * 2.0))
+               << "\" y1=\"" << formatDouble(mmToCm(p->dy1 * 2.0)) << "\" y2=\"" << formatDouble(mmToCm(p->dy2 * 2.0))
+               << "\" z=\"" << formatDouble(mmToCm(p->dz * 2.0)) << "\" lunit=\"cm\"/>\n";
+        }
+    }
+
+    void writeReplica(GDMLWriter& os, const VolumeNode* mother, const VolumeNode* child, const LogicalVolumeTable& table) {
+        static const char* const axisNames[3] = {"x", "y", "z"};
+        int axis = replicaAxis(mother, child);
+        const ArrayPattern& pattern = child->getArrayPattern();
+        os << "    <replicavol number=\"" << pattern.copies() << "\">\n";
+        os << "      <volumeref ref=\"" << table.volumeRef(child) << "\"/>\n";
+        os << "      <replicate_along_axis>\n";
+        os << "        <direction " << axisNames[axis] << "=\"1\"/>\n";
+        os << "        <width value=\"" << formatDouble(mmToCm(pattern.step[axis])) << "\" unit=\"cm\"/>\n";
+        os << "        <offset value=\"0\" unit=\"cm\"/>\n";
+        os << "      </replicate_along_axis>\n";
+        os << "    </replicavol>\n";
+    }
+
+    void writeParamvol(GDMLWriter& os, const VolumeNode* child, const LogicalVolumeTable& table) {
+        const ArrayPattern& pattern = child->getArrayPattern();
+        std::string name = sanitizeName(child->getName());
+        os << "    <paramvol ncopies=\"" << pattern.copies() << "\">\n";
+        os << "      <volumeref ref=\"" << table.volumeRef(child) << "\"/>\n";
+        os << "      <parameterised_position_size>\n";
+        for (int copy = 0; copy < pattern.copies(); ++copy) {
+            Transform t = pattern.copyTransform(child->getTransform(), copy);
+            const QVector3D& pos = t.getTranslation();
+            os << "        <parameters number=\"" << copy + 1 << "\">\n";
+            os << "          <position name=\"" << name << "_p" << copy << "_pos\" unit=\"cm\" x=\"" << formatDouble(mmToCm(pos.x()))
+               << "\" y=\"" << formatDouble(mmToCm(pos.y())) << "\" z=\"" << formatDouble(mmToCm(pos.z())) << "\"/>\n";
+            if (hasRotation(t)) {
+                QVector3D euler = t.getRotation().toEulerAngles();
+                os << "          <rotation name=\"" << name << "_p" << copy << "_rot\" unit=\"deg\" x=\"" << formatDouble(euler.x())
+                   << "\" y=\"" << formatDouble(euler.y()) << "\" z=\"" << formatDouble(euler.z()) << "\"/>\n";
+            }
+            writeParamDimensions(os, child->getShape());
+            os << "        </parameters>\n";
+        }
+        os << "      </parameterised_position_size>\n";
+        os << "    </paramvol>\n";
+    }
+
+    // Placements of a logical volume: one physvol per daughter (arrays as
+    // replica/paramvol when possible), copy numbers count the placements of
+    // each daughter logical volume within the mother
+    size_t writePhysvols(GDMLWriter& os, const VolumeNode* mother, const LogicalVolumeTable& table) {
+        std::unordered_map<size_t, int> copies;
+        size_t placements = 0;
+        for (const VolumeNode* child : mother->getChildren()) {
+            ArrayPlacement placement = arrayPlacement(mother, child);
+            if (placement == ArrayPlacement::Replica) {
+                writeReplica(os, mother, child, table);
+                ++placements;
+                continue;
+            }
+            if (placement == ArrayPlacement::Paramvol) {
+                writeParamvol(os, child, table);
+                ++placements;
+                continue;
+            }
+            int count = placement == ArrayPlacement::Expanded ? child->getArrayPattern().copies() : 1;
+            for (int copy = 0; copy < count; ++copy) {
+                std::string name = placementName(child, copy);
+                int copyNumber = child->getSDConfig().enabled ? child->getSDConfig().copyNumber + copy
+                                                              : copies[table.logicalId(child)]++;
+                os << "    <physvol name=\"" << name << "\" copynumber=\"" << copyNumber << "\">\n";
+                os << "      <volumeref ref=\"" << table.volumeRef(child) << "\"/>\n";
+                os << "      <positionref ref=\"" << name << "_pos\"/>\n";
+                if (hasRotation(child->getArrayPattern().copyTransform(child->getTransform(), copy))) {
+                    os << "      <rotationref ref=\"" << name << "_rot\"/>\n";
+                }
+                os << "    </physvol>\n";
+                ++placements;
+            }
         }
+        return placements;
     }
 }
 
@@ -367,119 +683,80 @@ bool GDMLExporter::exportToFile(SceneGraph* sceneGraph, const std::string& fileP
         if (!file.is_open()) {
             return false;
         }
+        GDMLWriter out(file);
+        stats_ = GDMLExportStats();
+        VolumeNode* root = sceneGraph->getRoot();
         
         // Write GDML header
-        file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
-        file << "<gdml xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
-             << "xsi:noNamespaceSchemaLocation=\"http://service-spi.web.cern.ch/service-spi/app/releases/GDML/schema/gdml.xsd\">\n";
-        
-        file << "<define>\n";
-        file << "  <position name=\"world_pos\" unit=\"cm\" x=\"0\" y=\"0\" z=\"0\"/>\n";
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        out << "<gdml xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+            << "xsi:noNamespaceSchemaLocation=\"http://service-spi.web.cern.ch/service-spi/app/releases/GDML/schema/gdml.xsd\">\n";
         
-        // Export optical surface definitions
-        VolumeNode* root = sceneGraph->getRoot();
-        if (root) {
-            std::function<void(VolumeNode*)> writeOpticalSurfaces = [&](VolumeNode* node) {
-                const auto& opticalConfig = node->getOpticalConfig();
-                if (opticalConfig.enabled) {
-                    writeOpticalSurface(file, opticalConfig, sanitizeName(node->getName()));
-                }
-                for (auto* child : node->getChildren()) {
-                    writeOpticalSurfaces(child);
-                }
-            };
-            writeOpticalSurfaces(root);
+        if (!root) {
+            out << "</gdml>\n";
+            return true;
         }
+        LogicalVolumeTable table(root, sceneGraph->getVolumeCount());
+        std::vector<const VolumeNode*> opticalVolumes;
+        traversal::preOrder(static_cast<const VolumeNode*>(root), [&](const VolumeNode* node) {
+            if (node->getOpticalConfig().enabled) opticalVolumes.push_back(node);
+        });
         
-        file << "<solids>\n";
-        // Shapes will be written by exportVolume
-        file << "</solids>\n";
-        
-        file << "<structure>\n";
-        
-        // Export volumes (starting from root's children, not root itself)
-        // Reuse root variable from above
-        root = sceneGraph->getRoot();
-        if (root) {
-            // Write shapes first
-            file << "<solids>\n";
-            std::function<void(VolumeNode*)> writeShapes = [&](VolumeNode* node) {
-                if (node->getShape()) {
-                    writeShape(file, node->getShape(), sanitizeName(node->getName()));
-                }
-                for (auto* child : node->getChildren()) {
-                    writeShapes(child);
-                }
-            };
-            writeShapes(root);
-            file << "</solids>\n";
-            
-            // Write positions
-            file << "<define>\n";
-            std::function<void(VolumeNode*)> writePositions = [&](VolumeNode* node) {
-                for (auto* child : node->getChildren()) {
-                    writeTransform(file, child->getTransform(), sanitizeName(child->getName()));
-                    writePositions(child);
-                }
-            };
-            writePositions(root);
-            file << "</define>\n";
-            
-            // Write volumes
-            for (auto* child : root->getChildren()) {
-                exportVolume(file, child, 1);
+        // Positions and rotations of the placements that are written: the
+        // daughters of each logical volume
+        out << "<define>\n";
+        out << "  <position name=\"world_pos\" unit=\"cm\" x=\"0\" y=\"0\" z=\"0\"/>\n";
+        for (const VolumeNode* volume : table.volumes()) {
+            for (const VolumeNode* child : volume->getChildren()) {
+                writePlacementDefines(out, volume, child);
             }
-            
-            // World volume
-            file << "  <volume name=\"world\">\n";
-            file << "    <materialref ref=\"G4_Galactic\"/>\n";
-            file << "    <solidref ref=\"world_shape\"/>\n";
-            for (auto* child : root->getChildren()) {
-                std::string childName = sanitizeName(child->getName());
-                file << "    <physvol>\n";
-                file << "      <volumeref ref=\"" << childName << "\"/>\n";
-                file << "      <positionref ref=\"" << childName << "_pos\"/>\n";
-                
-                // Add rotation reference if rotation exists
-                if (hasRotation(child->getTransform())) {
-                    file << "      <rotationref ref=\"" << childName << "_rot\"/>\n";
-                }
-                
-                file << "    </physvol>\n";
-            }
-            file << "  </volume>\n";
         }
+        out << "</define>\n";
         
-        file << "</structure>\n";
+        // Solids (one per geometry) and optical surfaces
+        out << "<solids>\n";
+        auto operandRef = [&](const std::string& name) { return table.operandRef(name); };
+        for (const VolumeNode* node : table.solids()) {
+            writeShape(out, node->getShape(), sanitizeName(node->getName()), operandRef);
+        }
+        for (const VolumeNode* node : opticalVolumes) {
+            writeOpticalSurface(out, node->getOpticalConfig(), sanitizeName(node->getName()));
+        }
+        out << "</solids>\n";
         
-        // Write setup section with skin surfaces
-        file << "<setup name=\"Default\" version=\"1.0\">\n";
-        file << "  <world ref=\"world\"/>\n";
+        // Logical volumes, daughters first; the world is the last one
+        out << "<structure>\n";
+        for (const VolumeNode* volume : table.volumes()) {
+            bool isWorld = volume == root;
+            out << "  <volume name=\"" << (isWorld ? "world" : sanitizeName(volume->getName())) << "\">\n";
+            out << "    <materialref ref=\"" << (isWorld ? "G4_Galactic" : getMaterialRef(volume->getMaterial().get())) << "\"/>\n";
+            out << "    <solidref ref=\"" << table.solidRef(volume) << "\"/>\n";
+            stats_.placements += writePhysvols(out, volume, table);
+            out << "  </volume>\n";
+        }
         
-        // Export skin surfaces for volumes with optical surfaces
-        if (root) {
-            std::function<void(VolumeNode*)> writeSkinSurfaces = [&](VolumeNode* node) {
-                const auto& opticalConfig = node->getOpticalConfig();
-                if (opticalConfig.enabled) {
-                    std::string volName = sanitizeName(node->getName());
-                    std::string surfName = volName + "_optical_surface";
-                    file << "  <skinsurface name=\"" << volName << "_skin\" surface=\"" 
-                         << surfName << "\">\n";
-                    file << "    <volumeref ref=\"" << volName << "\"/>\n";
-                    file << "  </skinsurface>\n";
-                }
-                for (auto* child : node->getChildren()) {
-                    writeSkinSurfaces(child);
-                }
-            };
-            writeSkinSurfaces(root);
+        // Skin surfaces for volumes with optical surfaces (always own logical volume)
+        for (const VolumeNode* node : opticalVolumes) {
+            std::string volName = sanitizeName(node->getName());
+            out << "  <skinsurface name=\"" << volName << "_skin\" surfaceproperty=\""
+                << volName << "_optical_surface\">\n";
+            out << "    <volumeref ref=\"" << volName << "\"/>\n";
+            out << "  </skinsurface>\n";
         }
+        out << "</structure>\n";
+        
+        out << "<setup name=\"Default\" version=\"1.0\">\n";
+        out << "  <world ref=\"world\"/>\n";
+        out << "</setup>\n";
+        out << "</gdml>\n";
         
-        file << "</setup>\n";
-        file << "</gdml>\n";
+        stats_.volumes = sceneGraph->getVolumeCount();
+        stats_.solids = table.solids().size();
+        stats_.logicalVolumes = table.volumes().size();
         
+        out.flush();
         file.close();
-        return true;
+        return file.good();
     } catch (...) {
         return false;
     }
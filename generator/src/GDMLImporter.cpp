@@ -0,0 +1,1602 @@
+#include "GDMLImporter.hh"
+#include "../../core/include/SceneGraph.hh"
+#include "../../core/include/Shape.hh"
+#include "../../core/include/Material.hh"
+#include "../../core/include/Transform.hh"
+#include <QFile>
+#include <QString>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace geantcad {
+
+namespace {
+    constexpr double Pi = 3.14159265358979323846;
+    constexpr double RadToDeg = 180.0 / Pi;
+
+    // ===== XML =====
+
+    bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    // Past a comment, processing instruction, CDATA or DOCTYPE starting at p
+    // ("<!" or "<?"), nullptr if unterminated
+    const char* skipMarkup(const char* p, const char* end) {
+        auto after = [&](const char* from, const char* terminator) -> const char* {
+            size_t n = std::strlen(terminator);
+            std::string_view rest(from, size_t(end - from));
+            size_t at = rest.find(std::string_view(terminator, n));
+            return at == std::string_view::npos ? nullptr : from + at + n;
+        };
+        std::string_view head(p, size_t(std::min<ptrdiff_t>(end - p, 9)));
+        if (head.substr(0, 4) == "<!--") return after(p + 4, "-->");
+        if (head.substr(0, 9) == "<![CDATA[") return after(p + 9, "]]>");
+        if (head.substr(0, 2) == "<?") return after(p + 2, "?>");
+        // <!DOCTYPE ...> with an optional [internal subset]
+        for (const char* q = p + 2; q < end; ++q) {
+            if (*q == '[') return after(q, "]>");
+            if (*q == '>') return q + 1;
+        }
+        return nullptr;
+    }
+
+    // The '>' closing the tag whose name starts at p (quoted values may hold '>')
+    const char* tagEnd(const char* p, const char* end) {
+        for (; p < end; ++p) {
+            if (*p == '"' || *p == '\'') {
+                p = static_cast<const char*>(std::memchr(p + 1, *p, size_t(end - p - 1)));
+                if (!p) return nullptr;
+            } else if (*p == '>') {
+                return p;
+            }
+        }
+        return nullptr;
+    }
+
+    // Next start tag from p, skipping text and markup. Stops on an end tag
+    // ("</") too; nullptr at the end of the input.
+    const char* nextTag(const char* p, const char* end) {
+        for (;;) {
+            p = static_cast<const char*>(std::memchr(p, '<', size_t(end - p)));
+            if (!p || p + 1 >= end) return nullptr;
+            if (p[1] != '!' && p[1] != '?') return p;
+            p = skipMarkup(p, end);
+            if (!p) return nullptr;
+        }
+    }
+
+    std::string_view tagName(const char* p, const char* end) {
+        const char* name = p + 1;
+        const char* q = name;
+        while (q < end && !isSpace(*q) && *q != '/' && *q != '>') ++q;
+        return std::string_view(name, size_t(q - name));
+    }
+
+    // End of the element starting at p ('<'), nullptr if malformed. Only tags
+    // are looked at, so this is the cheap pass that splits the sections.
+    const char* skipElement(const char* p, const char* end) {
+        int depth = 0;
+        for (;;) {
+            const char* close = tagEnd(p + 1, end);
+            if (!close) return nullptr;
+            p = close + 1;
+            if (close[-1] != '/') ++depth;
+            if (depth == 0) return p;
+            for (;;) {
+                p = nextTag(p, end);
+                if (!p) return nullptr;
+                if (p[1] != '/') break;
+                close = static_cast<const char*>(std::memchr(p, '>', size_t(end - p)));
+                if (!close) return nullptr;
+                p = close + 1;
+                if (--depth == 0) return p;
+            }
+        }
+    }
+
+    // Entity references in names and values (rare: decoded on demand)
+    std::string decodeText(std::string_view text) {
+        if (text.find('&') == std::string_view::npos) return std::string(text);
+        static const std::pair<std::string_view, char> entities[] = {
+            {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+        std::string result;
+        result.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i) {
+            bool replaced = false;
+            if (text[i] == '&') {
+                for (const auto& entity : entities) {
+                    if (text.substr(i, entity.first.size()) == entity.first) {
+                        result += entity.second;
+                        i += entity.first.size() - 1;
+                        replaced = true;
+                        break;
+                    }
+                }
+            }
+            if (!replaced) result += text[i];
+        }
+        return result;
+    }
+
+    struct XmlAttribute {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    struct XmlNode {
+        std::string_view tag;
+        uint32_t firstAttribute = 0;
+        uint32_t attributeCount = 0;
+        int32_t firstChild = -1;
+        int32_t nextSibling = -1;
+    };
+
+    /**
+     * Albero di un singolo elemento di sezione (un solido, un volume...). Tag e
+     * attributi puntano nel file mappato; ogni worker riusa lo stesso albero
+     * elemento dopo elemento.
+     */
+    class XmlTree {
+    public:
+        // Parse the element starting at 'begin' ('<'); node 0 is its root
+        bool parse(const char* begin, const char* end) {
+            nodes_.clear();
+            attributes_.clear();
+            int32_t root = -1;
+            return parseElement(begin, end, 0, root) != nullptr;
+        }
+
+        const XmlNode& node(int32_t i) const { return nodes_[size_t(i)]; }
+        std::string_view tag(int32_t i) const { return nodes_[size_t(i)].tag; }
+
+        std::string_view attribute(int32_t i, std::string_view name) const {
+            const XmlNode& n = nodes_[size_t(i)];
+            for (uint32_t a = n.firstAttribute; a < n.firstAttribute + n.attributeCount; ++a) {
+                if (attributes_[a].name == name) return attributes_[a].value;
+            }
+            return {};
+        }
+        bool hasAttribute(int32_t i, std::string_view name) const {
+            const XmlNode& n = nodes_[size_t(i)];
+            for (uint32_t a = n.firstAttribute; a < n.firstAttribute + n.attributeCount; ++a) {
+                if (attributes_[a].name == name) return true;
+            }
+            return false;
+        }
+
+        // First child with the given tag, -1 if none
+        int32_t child(int32_t i, std::string_view tag) const {
+            for (int32_t c = nodes_[size_t(i)].firstChild; c >= 0; c = nodes_[size_t(c)].nextSibling) {
+                if (nodes_[size_t(c)].tag == tag) return c;
+            }
+            return -1;
+        }
+
+        template<class F> void forEachChild(int32_t i, F&& visitor) const {
+            for (int32_t c = nodes_[size_t(i)].firstChild; c >= 0; c = nodes_[size_t(c)].nextSibling) {
+                visitor(c);
+            }
+        }
+
+    private:
+        static constexpr int MaxDepth = 64;
+
+        const char* parseElement(const char* p, const char* end, int depth, int32_t& index) {
+            std::string_view name = tagName(p, end);
+            if (name.empty()) return nullptr;
+            index = int32_t(nodes_.size());
+            nodes_.push_back({name, uint32_t(attributes_.size()), 0, -1, -1});
+            p = name.data() + name.size();
+
+            // Attributes
+            for (;;) {
+                while (p < end && isSpace(*p)) ++p;
+                if (p >= end) return nullptr;
+                if (*p == '/') return (p + 1 < end && p[1] == '>') ? p + 2 : nullptr;
+                if (*p == '>') { ++p; break; }
+                const char* attributeName = p;
+                while (p < end && *p != '=' && !isSpace(*p)) ++p;
+                std::string_view attribute(attributeName, size_t(p - attributeName));
+                while (p < end && isSpace(*p)) ++p;
+                if (p >= end || *p != '=') return nullptr;
+                ++p;
+                while (p < end && isSpace(*p)) ++p;
+                if (p >= end || (*p != '"' && *p != '\'')) return nullptr;
+                const char quote = *p++;
+                const char* valueEnd = static_cast<const char*>(std::memchr(p, quote, size_t(end - p)));
+                if (!valueEnd) return nullptr;
+                attributes_.push_back({attribute, std::string_view(p, size_t(valueEnd - p))});
+                nodes_[size_t(index)].attributeCount++;
+                p = valueEnd + 1;
+            }
+
+            // Children (text content is not used by GDML elements we read)
+            int32_t last = -1;
+            for (;;) {
+                p = nextTag(p, end);
+                if (!p) return nullptr;
+                if (p[1] == '/') {
+                    const char* close = static_cast<const char*>(std::memchr(p, '>', size_t(end - p)));
+                    return close ? close + 1 : nullptr;
+                }
+                if (depth >= MaxDepth) return nullptr;
+                int32_t child = -1;
+                p = parseElement(p, end, depth + 1, child);
+                if (!p) return nullptr;
+                if (last < 0) {
+                    nodes_[size_t(index)].firstChild = child;
+                } else {
+                    nodes_[size_t(last)].nextSibling = child;
+                }
+                last = child;
+            }
+        }
+
+        std::vector<XmlNode> nodes_;
+        std::vector<XmlAttribute> attributes_;
+    };
+
+    // ===== Expressions =====
+
+    // Units of GDML attributes in the internal system (mm, rad)
+    bool builtinValue(std::string_view name, double& value) {
+        static const std::pair<std::string_view, double> table[] = {
+            {"mm", 1.0}, {"millimeter", 1.0}, {"cm", 10.0}, {"centimeter", 10.0},
+            {"m", 1000.0}, {"meter", 1000.0}, {"km", 1.0e6}, {"kilometer", 1.0e6},
+            {"um", 1.0e-3}, {"micrometer", 1.0e-3}, {"nm", 1.0e-6}, {"nanometer", 1.0e-6},
+            {"rad", 1.0}, {"radian", 1.0}, {"mrad", 1.0e-3}, {"milliradian", 1.0e-3},
+            {"deg", Pi / 180.0}, {"degree", Pi / 180.0},
+            {"pi", Pi}, {"twopi", 2.0 * Pi}, {"halfpi", Pi / 2.0}};
+        for (const auto& entry : table) {
+            if (entry.first == name) {
+                value = entry.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Valutatore delle espressioni GDML ("2*cm", "pi/4", "width/2+gap"):
+     * numeri, costanti della sezione define, unita' e funzioni matematiche.
+     * I valori puramente numerici (il caso comune) non passano dal parser.
+     */
+    class Evaluator {
+    public:
+        explicit Evaluator(const std::unordered_map<std::string, double>& constants) : constants_(constants) {}
+
+        bool evaluate(std::string_view text, double& value) const {
+            while (!text.empty() && isSpace(text.front())) text.remove_prefix(1);
+            while (!text.empty() && isSpace(text.back())) text.remove_suffix(1);
+            if (text.empty()) return false;
+            const char* first = text.data();
+            const char* last = first + text.size();
+            if (*first == '+') ++first;
+            auto result = std::from_chars(first, last, value);
+            if (result.ec == std::errc() && result.ptr == last) return true;
+
+            Cursor c{text.data(), text.data() + text.size()};
+            if (!sum(c, value)) return false;
+            skipSpace(c);
+            return c.p == c.end;
+        }
+
+    private:
+        struct Cursor {
+            const char* p;
+            const char* end;
+        };
+
+        static void skipSpace(Cursor& c) {
+            while (c.p < c.end && isSpace(*c.p)) ++c.p;
+        }
+        static bool accept(Cursor& c, char ch) {
+            skipSpace(c);
+            if (c.p < c.end && *c.p == ch) { ++c.p; return true; }
+            return false;
+        }
+
+        bool sum(Cursor& c, double& value) const {
+            if (!product(c, value)) return false;
+            for (;;) {
+                double rhs;
+                if (accept(c, '+')) {
+                    if (!product(c, rhs)) return false;
+                    value += rhs;
+                } else if (accept(c, '-')) {
+                    if (!product(c, rhs)) return false;
+                    value -= rhs;
+                } else {
+                    return true;
+                }
+            }
+        }
+
+        bool product(Cursor& c, double& value) const {
+            if (!unary(c, value)) return false;
+            for (;;) {
+                double rhs;
+                if (accept(c, '*')) {
+                    if (!unary(c, rhs)) return false;
+                    value *= rhs;
+                } else if (accept(c, '/')) {
+                    if (!unary(c, rhs)) return false;
+                    value /= rhs;
+                } else {
+                    return true;
+                }
+            }
+        }
+
+        bool unary(Cursor& c, double& value) const {
+            if (accept(c, '-')) {
+                if (!unary(c, value)) return false;
+                value = -value;
+                return true;
+            }
+            if (accept(c, '+')) return unary(c, value);
+            if (!primary(c, value)) return false;
+            if (accept(c, '^')) {
+                double exponent;
+                if (!unary(c, exponent)) return false;
+                value = std::pow(value, exponent);
+            }
+            return true;
+        }
+
+        bool primary(Cursor& c, double& value) const {
+            skipSpace(c);
+            if (c.p >= c.end) return false;
+            if (*c.p == '(') {
+                ++c.p;
+                return sum(c, value) && accept(c, ')');
+            }
+            if (std::isdigit(static_cast<unsigned char>(*c.p)) || *c.p == '.') {
+                auto result = std::from_chars(c.p, c.end, value);
+                if (result.ec != std::errc()) return false;
+                c.p = result.ptr;
+                return true;
+            }
+            const char* name = c.p;
+            while (c.p < c.end && (std::isalnum(static_cast<unsigned char>(*c.p)) || *c.p == '_')) ++c.p;
+            std::string_view identifier(name, size_t(c.p - name));
+            if (identifier.empty()) return false;
+
+            if (accept(c, '(')) {
+                double args[2] = {0.0, 0.0};
+                int count = 0;
+                if (!accept(c, ')')) {
+                    do {
+                        if (count == 2 || !sum(c, args[count++])) return false;
+                    } while (accept(c, ','));
+                    if (!accept(c, ')')) return false;
+                }
+                return function(identifier, args, count, value);
+            }
+            auto it = constants_.find(std::string(identifier));
+            if (it != constants_.end()) {
+                value = it->second;
+                return true;
+            }
+            return builtinValue(identifier, value);
+        }
+
+        static bool function(std::string_view name, const double* a, int count, double& value) {
+            if (count == 1) {
+                if (name == "sin") value = std::sin(a[0]);
+                else if (name == "cos") value = std::cos(a[0]);
+                else if (name == "tan") value = std::tan(a[0]);
+                else if (name == "asin") value = std::asin(a[0]);
+                else if (name == "acos") value = std::acos(a[0]);
+                else if (name == "atan") value = std::atan(a[0]);
+                else if (name == "sqrt") value = std::sqrt(a[0]);
+                else if (name == "exp") value = std::exp(a[0]);
+                else if (name == "log") value = std::log(a[0]);
+                else if (name == "log10") value = std::log10(a[0]);
+                else if (name == "abs" || name == "fabs") value = std::abs(a[0]);
+                else return false;
+                return true;
+            }
+            if (count == 2) {
+                if (name == "pow") value = std::pow(a[0], a[1]);
+                else if (name == "atan2") value = std::atan2(a[0], a[1]);
+                else if (name == "min") value = std::min(a[0], a[1]);
+                else if (name == "max") value = std::max(a[0], a[1]);
+                else return false;
+                return true;
+            }
+            return false;
+        }
+
+        const std::unordered_map<std::string, double>& constants_;
+    };
+
+    // Density units of <D> (g/cm3 internally)
+    bool densityUnit(std::string_view unit, double& factor) {
+        static const std::pair<std::string_view, double> table[] = {
+            {"g/cm3", 1.0}, {"g/cm^3", 1.0}, {"mg/cm3", 1.0e-3}, {"kg/m3", 1.0e-3}, {"kg/m^3", 1.0e-3},
+            {"g/mm3", 1.0e3}, {"g/m3", 1.0e-6}};
+        for (const auto& entry : table) {
+            if (entry.first == unit) {
+                factor = entry.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Geant4 writes names with the address of the object ("World0x1f2e3d");
+    // the suffix is dropped from the names shown in the scene
+    std::string displayName(const std::string& name) {
+        size_t at = name.rfind("0x");
+        if (at == std::string::npos || at == 0 || at + 2 == name.size()) return name;
+        for (size_t i = at + 2; i < name.size(); ++i) {
+            if (!std::isxdigit(static_cast<unsigned char>(name[i]))) return name;
+        }
+        return name.substr(0, at);
+    }
+
+    QQuaternion gdmlRotation(const double* angles) {
+        // Geant4 builds R = Rz * Ry * Rx from the GDML angles and places the
+        // daughter with the inverse
+        return QQuaternion::fromAxisAndAngle(1.0f, 0.0f, 0.0f, float(-angles[0] * RadToDeg))
+             * QQuaternion::fromAxisAndAngle(0.0f, 1.0f, 0.0f, float(-angles[1] * RadToDeg))
+             * QQuaternion::fromAxisAndAngle(0.0f, 0.0f, 1.0f, float(-angles[2] * RadToDeg));
+    }
+
+    bool nearlyEqual(double a, double b) {
+        return std::abs(a - b) <= 1e-4 * std::max(1.0, std::abs(a));
+    }
+
+    bool sameTranslation(const Transform& a, const Transform& b) {
+        const QVector3D& p = a.getTranslation();
+        const QVector3D& q = b.getTranslation();
+        return nearlyEqual(p.x(), q.x()) && nearlyEqual(p.y(), q.y()) && nearlyEqual(p.z(), q.z());
+    }
+
+    // Linear or grid (x fastest, as the exporter writes them) array pattern
+    // reproducing the given copy placements, copy 0 being the volume itself
+    bool detectArray(const std::vector<Transform>& copies, ArrayPattern& pattern) {
+        const int n = int(copies.size());
+        if (n < 2) return false;
+        const QVector3D origin = copies[0].getTranslation();
+        auto offset = [&](int i) { return copies[size_t(i)].getTranslation() - origin; };
+
+        // Copies along the first step
+        const QVector3D stepX = offset(1);
+        int nx = 1;
+        while (nx < n && sameTranslation(copies[size_t(nx)], Transform(origin + stepX * float(nx)))) ++nx;
+
+        ArrayPattern candidate;
+        if (nx == n) {
+            candidate.type = ArrayPattern::Type::Linear;
+            candidate.count[0] = n;
+            for (int i = 0; i < 3; ++i) candidate.step[i] = stepX[i];
+        } else {
+            const QVector3D stepY = offset(nx);
+            int ny = 1;
+            while (ny * nx < n && sameTranslation(copies[size_t(ny * nx)], Transform(origin + stepY * float(ny)))) ++ny;
+            if (n % (nx * ny) != 0) return false;
+            const int nz = n / (nx * ny);
+            candidate.type = ArrayPattern::Type::Grid;
+            candidate.count[0] = nx;
+            candidate.count[1] = ny;
+            candidate.count[2] = nz;
+            candidate.step[0] = stepX.x();
+            candidate.step[1] = stepY.y();
+            candidate.step[2] = nz > 1 ? offset(nx * ny).z() : 0.0;
+        }
+        for (int i = 1; i < n; ++i) {
+            if (!sameTranslation(copies[size_t(i)], candidate.copyTransform(copies[0], i))) return false;
+        }
+        pattern = candidate;
+        return true;
+    }
+
+    // ===== Records (one per section element, filled by the workers) =====
+
+    // Position/rotation/scale of a placement, inline or by reference to <define>
+    struct Frame {
+        double position[3] = {0.0, 0.0, 0.0};  // mm
+        double rotation[3] = {0.0, 0.0, 0.0};  // rad
+        double scale[3] = {1.0, 1.0, 1.0};
+        std::string positionRef;
+        std::string rotationRef;
+        std::string scaleRef;
+    };
+
+    struct DefineRecord {
+        enum class Kind { None, Position, Rotation, Scale, Unsupported };
+        Kind kind = Kind::None;
+        std::string name;
+        double value[3] = {0.0, 0.0, 0.0};  // mm, rad or factors
+    };
+
+    struct MaterialRecord {
+        enum class Kind { None, Isotope, Element, Material, Unsupported };
+        Kind kind = Kind::None;
+        std::string name;
+        std::string formula;
+        double Z = 0.0;
+        bool hasZ = false;
+        double A = 0.0;            // g/mole
+        double density = 0.0;      // g/cm3
+        bool hasDensity = false;
+        std::string state;
+        std::vector<std::pair<std::string, double>> fractions;   // ref, mass fraction
+        std::vector<std::pair<std::string, int>> composites;     // ref, atoms
+    };
+
+    struct SolidRecord {
+        enum class Kind { None, Solid, Boolean, OpticalSurface, Define, Unsupported };
+        Kind kind = Kind::None;
+        std::string name;
+        std::string tag;
+        DefineRecord define;  // position/rotation written among the solids
+        std::shared_ptr<const Shape> shape;
+        // Boolean solids: operands by solid name, relative placement of the second
+        BooleanOperation operation = BooleanOperation::Union;
+        std::string first;
+        std::string second;
+        Frame frame;
+        // Optical surfaces
+        OpticalSurfaceConfig optical;
+    };
+
+    struct ParamCopy {
+        Frame frame;
+        std::shared_ptr<const Shape> shape;  // null: the solid of the volume
+    };
+
+    struct PlacementRecord {
+        enum class Kind { Physvol, Replica, Paramvol };
+        Kind kind = Kind::Physvol;
+        std::string name;
+        std::string volume;
+        int copyNumber = 0;
+        bool hasCopyNumber = false;
+        Frame frame;
+        // Replica: along x/y/z (0-2) or phi (3)
+        int number = 0;
+        int axis = -1;
+        double width = 0.0;   // mm or rad
+        double offset = 0.0;
+        // Paramvol
+        std::vector<ParamCopy> copies;
+    };
+
+    struct StructureRecord {
+        enum class Kind { None, Volume, Assembly, SkinSurface, Unsupported };
+        Kind kind = Kind::None;
+        std::string name;
+        std::string material;
+        std::string solid;
+        std::string sensitiveDetector;   // <auxiliary auxtype="SensDet">
+        std::vector<PlacementRecord> placements;
+        // Skin surfaces: surface property and logical volume
+        std::string surface;
+        std::string volume;
+        int skipped = 0;                 // unsupported placements (divisions, external files)
+    };
+
+    /**
+     * Conversione di un elemento di sezione nel record corrispondente. Una
+     * istanza per worker: l'albero XML e' riusato, il valutatore e' condiviso
+     * (le costanti sono gia' state lette).
+     */
+    class ElementReader {
+    public:
+        explicit ElementReader(const Evaluator& evaluator) : eval_(evaluator) {}
+
+        const std::string& error() const { return error_; }
+        XmlTree& tree() { return tree_; }
+
+        bool readDefine(DefineRecord& record) {
+            std::string_view tag = tree_.tag(0);
+            record.name = decodeText(tree_.attribute(0, "name"));
+            if (tag == "position" || tag == "rotation") {
+                record.kind = tag == "position" ? DefineRecord::Kind::Position : DefineRecord::Kind::Rotation;
+                double unit = 1.0;
+                if (!unitFactor(0, "unit", tag == "position" ? "mm" : "rad", unit)) return false;
+                return vector3(0, unit, 0.0, record.value);
+            }
+            if (tag == "scale") {
+                record.kind = DefineRecord::Kind::Scale;
+                return vector3(0, 1.0, 1.0, record.value);
+            }
+            if (tag == "constant" || tag == "variable" || tag == "quantity") {
+                record.kind = DefineRecord::Kind::None;  // read before the workers start
+                return true;
+            }
+            record.kind = DefineRecord::Kind::Unsupported;
+            return true;
+        }
+
+        bool readMaterial(MaterialRecord& record) {
+            std::string_view tag = tree_.tag(0);
+            record.name = decodeText(tree_.attribute(0, "name"));
+            if (tag == "isotope") record.kind = MaterialRecord::Kind::Isotope;
+            else if (tag == "element") record.kind = MaterialRecord::Kind::Element;
+            else if (tag == "material") record.kind = MaterialRecord::Kind::Material;
+            else {
+                record.kind = MaterialRecord::Kind::Unsupported;
+                return true;
+            }
+            record.formula = decodeText(tree_.attribute(0, "formula"));
+            record.state = std::string(tree_.attribute(0, "state"));
+            if (tree_.hasAttribute(0, "Z")) {
+                record.hasZ = true;
+                if (!number(0, "Z", 0.0, record.Z)) return false;
+            }
+            bool ok = true;
+            tree_.forEachChild(0, [&](int32_t c) {
+                std::string_view child = tree_.tag(c);
+                if (child == "atom") {
+                    double unit = 1.0;
+                    std::string_view unitName = tree_.attribute(c, "unit");
+                    if (unitName == "kg/mole") unit = 1000.0;
+                    ok = ok && number(c, "value", 0.0, record.A);
+                    record.A *= unit;
+                } else if (child == "D") {
+                    double factor = 1.0;
+                    std::string_view unitName = tree_.attribute(c, "unit");
+                    if (!unitName.empty() && !densityUnit(unitName, factor)) {
+                        ok = fail("unknown density unit " + std::string(unitName));
+                        return;
+                    }
+                    record.hasDensity = true;
+                    ok = ok && number(c, "value", 0.0, record.density);
+                    record.density *= factor;
+                } else if (child == "fraction") {
+                    double n = 0.0;
+                    ok = ok && number(c, "n", 0.0, n);
+                    record.fractions.emplace_back(decodeText(tree_.attribute(c, "ref")), n);
+                } else if (child == "composite") {
+                    double n = 0.0;
+                    ok = ok && number(c, "n", 0.0, n);
+                    record.composites.emplace_back(decodeText(tree_.attribute(c, "ref")), int(std::lround(n)));
+                }
+            });
+            return ok;
+        }
+
+        bool readSolid(SolidRecord& record) {
+            std::string_view tag = tree_.tag(0);
+            record.name = decodeText(tree_.attribute(0, "name"));
+            record.tag = std::string(tag);
+            if (tag == "position" || tag == "rotation" || tag == "scale") {
+                record.kind = SolidRecord::Kind::Define;
+                return readDefine(record.define);
+            }
+            if (tag == "opticalsurface") {
+                record.kind = SolidRecord::Kind::OpticalSurface;
+                OpticalSurfaceConfig& o = record.optical;
+                o.enabled = true;
+                if (tree_.hasAttribute(0, "model")) o.model = decodeText(tree_.attribute(0, "model"));
+                if (tree_.hasAttribute(0, "finish")) o.finish = decodeText(tree_.attribute(0, "finish"));
+                return number(0, "value", o.reflectivity, o.reflectivity)
+                    && number(0, "sigmaalpha", o.sigmaAlpha, o.sigmaAlpha);
+            }
+            if (tag == "union" || tag == "subtraction" || tag == "intersection") {
+                record.kind = SolidRecord::Kind::Boolean;
+                record.operation = tag == "union" ? BooleanOperation::Union
+                                 : tag == "subtraction" ? BooleanOperation::Subtraction
+                                                        : BooleanOperation::Intersection;
+                int32_t first = tree_.child(0, "first");
+                int32_t second = tree_.child(0, "second");
+                if (first < 0 || second < 0) return fail("boolean solid " + record.name + " without operands");
+                record.first = decodeText(tree_.attribute(first, "ref"));
+                record.second = decodeText(tree_.attribute(second, "ref"));
+                // The placement of the second solid is a child of the boolean
+                // (some writers nest it in <second>)
+                return readFrame(0, record.frame) && readFrame(second, record.frame);
+            }
+
+            double lunit = 1.0, aunit = 1.0;
+            if (!unitFactor(0, "lunit", "mm", lunit) || !unitFactor(0, "aunit", "rad", aunit)) return false;
+            auto length = [&](const char* name, double& value) {
+                if (!number(0, name, 0.0, value)) return false;
+                value *= lunit;
+                return true;
+            };
+            // Angles in degrees, like the shape parameters
+            auto angle = [&](const char* name, double fallbackDeg, double& value) {
+                if (!tree_.hasAttribute(0, name)) {
+                    value = fallbackDeg;
+                    return true;
+                }
+                if (!number(0, name, 0.0, value)) return false;
+                value *= aunit * RadToDeg;
+                return true;
+            };
+
+            record.kind = SolidRecord::Kind::Solid;
+            std::unique_ptr<Shape> shape;
+            if (tag == "box") {
+                double x, y, z;
+                if (!length("x", x) || !length("y", y) || !length("z", z)) return false;
+                shape = makeBox(x / 2.0, y / 2.0, z / 2.0);
+            } else if (tag == "tube") {
+                double rmin, rmax, z, sphi, dphi;
+                if (!length("rmin", rmin) || !length("rmax", rmax) || !length("z", z)
+                    || !angle("startphi", 0.0, sphi) || !angle("deltaphi", 360.0, dphi)) return false;
+                shape = makeTube(rmin, rmax, z / 2.0, sphi, dphi);
+            } else if (tag == "cone") {
+                double rmin1, rmax1, rmin2, rmax2, z, sphi, dphi;
+                if (!length("rmin1", rmin1) || !length("rmax1", rmax1) || !length("rmin2", rmin2)
+                    || !length("rmax2", rmax2) || !length("z", z)
+                    || !angle("startphi", 0.0, sphi) || !angle("deltaphi", 360.0, dphi)) return false;
+                shape = makeCone(rmin1, rmax1, rmin2, rmax2, z / 2.0, sphi, dphi);
+            } else if (tag == "sphere") {
+                double rmin, rmax, sphi, dphi, stheta, dtheta;
+                if (!length("rmin", rmin) || !length("rmax", rmax)
+                    || !angle("startphi", 0.0, sphi) || !angle("deltaphi", 360.0, dphi)
+                    || !angle("starttheta", 0.0, stheta) || !angle("deltatheta", 180.0, dtheta)) return false;
+                shape = makeSphere(rmin, rmax, sphi, dphi, stheta, dtheta);
+            } else if (tag == "orb") {
+                double r;
+                if (!length("r", r)) return false;
+                shape = makeSphere(0.0, r);
+            } else if (tag == "trd") {
+                double x1, x2, y1, y2, z;
+                if (!length("x1", x1) || !length("x2", x2) || !length("y1", y1)
+                    || !length("y2", y2) || !length("z", z)) return false;
+                shape = makeTrd(x1 / 2.0, x2 / 2.0, y1 / 2.0, y2 / 2.0, z / 2.0);
+            } else if (tag == "polycone" || tag == "polyhedra") {
+                double sphi, dphi, sides = 0.0;
+                if (!angle("startphi", 0.0, sphi) || !angle("deltaphi", 360.0, dphi)) return false;
+                if (tag == "polyhedra" && !number(0, "numsides", 0.0, sides)) return false;
+                std::vector<double> z, rmin, rmax;
+                bool ok = true;
+                tree_.forEachChild(0, [&](int32_t c) {
+                    if (!ok || tree_.tag(c) != "zplane") return;
+                    double values[3];
+                    ok = number(c, "z", 0.0, values[0]) && number(c, "rmin", 0.0, values[1])
+                        && number(c, "rmax", 0.0, values[2]);
+                    z.push_back(values[0] * lunit);
+                    rmin.push_back(values[1] * lunit);
+                    rmax.push_back(values[2] * lunit);
+                });
+                if (!ok) return false;
+                if (z.size() < 2) return fail(record.tag + " " + record.name + " needs at least two zplanes");
+                shape = tag == "polycone" ? makePolycone(sphi, dphi, z, rmin, rmax)
+                                                 : makePolyhedra(int(sides), sphi, dphi, z, rmin, rmax);
+            } else {
+                record.kind = SolidRecord::Kind::Unsupported;
+                return true;
+            }
+            shape->setName(displayName(record.name));
+            record.shape = std::move(shape);
+            return true;
+        }
+
+        bool readStructure(StructureRecord& record) {
+            std::string_view tag = tree_.tag(0);
+            record.name = decodeText(tree_.attribute(0, "name"));
+            if (tag == "skinsurface") {
+                record.kind = StructureRecord::Kind::SkinSurface;
+                record.surface = decodeText(tree_.attribute(0, "surfaceproperty"));
+                int32_t ref = tree_.child(0, "volumeref");
+                if (ref >= 0) record.volume = decodeText(tree_.attribute(ref, "ref"));
+                return true;
+            }
+            if (tag != "volume" && tag != "assembly") {
+                record.kind = StructureRecord::Kind::Unsupported;
+                return true;
+            }
+            record.kind = tag == "volume" ? StructureRecord::Kind::Volume : StructureRecord::Kind::Assembly;
+            bool ok = true;
+            tree_.forEachChild(0, [&](int32_t c) {
+                if (!ok) return;
+                std::string_view child = tree_.tag(c);
+                if (child == "materialref") {
+                    record.material = decodeText(tree_.attribute(c, "ref"));
+                } else if (child == "solidref") {
+                    record.solid = decodeText(tree_.attribute(c, "ref"));
+                } else if (child == "auxiliary") {
+                    if (tree_.attribute(c, "auxtype") == "SensDet") {
+                        record.sensitiveDetector = decodeText(tree_.attribute(c, "auxvalue"));
+                    }
+                } else if (child == "physvol") {
+                    ok = readPhysvol(c, record);
+                } else if (child == "replicavol") {
+                    ok = readReplica(c, record);
+                } else if (child == "paramvol") {
+                    ok = readParamvol(c, record);
+                } else if (child == "divisionvol" || child == "replica_vol") {
+                    record.skipped++;
+                }
+            });
+            return ok;
+        }
+
+    private:
+        bool fail(const std::string& message) {
+            error_ = message;
+            return false;
+        }
+
+        bool number(int32_t node, std::string_view name, double fallback, double& value) {
+            std::string_view text = tree_.attribute(node, name);
+            if (text.data() == nullptr) {
+                value = fallback;
+                return true;
+            }
+            if (!eval_.evaluate(text, value)) {
+                return fail("cannot evaluate " + std::string(name) + "=\"" + std::string(text) + "\" in <"
+                    + std::string(tree_.tag(node)) + ">");
+            }
+            return true;
+        }
+
+        bool unitFactor(int32_t node, std::string_view attribute, std::string_view fallback, double& factor) {
+            std::string_view unit = tree_.attribute(node, attribute);
+            if (unit.data() == nullptr || unit.empty()) unit = fallback;
+            if (builtinValue(unit, factor) || eval_.evaluate(unit, factor)) return true;
+            return fail("unknown unit \"" + std::string(unit) + "\"");
+        }
+
+        bool vector3(int32_t node, double unit, double fallback, double* value) {
+            static const char* const axes[3] = {"x", "y", "z"};
+            for (int i = 0; i < 3; ++i) {
+                if (!number(node, axes[i], fallback, value[i])) return false;
+                value[i] *= unit;
+            }
+            return true;
+        }
+
+        // Inline or referenced position/rotation/scale among the children of 'node'
+        bool readFrame(int32_t node, Frame& frame) {
+            bool ok = true;
+            tree_.forEachChild(node, [&](int32_t c) {
+                if (!ok) return;
+                std::string_view tag = tree_.tag(c);
+                double unit = 1.0;
+                if (tag == "position") {
+                    ok = unitFactor(c, "unit", "mm", unit) && vector3(c, unit, 0.0, frame.position);
+                } else if (tag == "rotation") {
+                    ok = unitFactor(c, "unit", "rad", unit) && vector3(c, unit, 0.0, frame.rotation);
+                } else if (tag == "scale") {
+                    ok = vector3(c, 1.0, 1.0, frame.scale);
+                } else if (tag == "positionref") {
+                    frame.positionRef = decodeText(tree_.attribute(c, "ref"));
+                } else if (tag == "rotationref") {
+                    frame.rotationRef = decodeText(tree_.attribute(c, "ref"));
+                } else if (tag == "scaleref") {
+                    frame.scaleRef = decodeText(tree_.attribute(c, "ref"));
+                }
+            });
+            return ok;
+        }
+
+        bool readPhysvol(int32_t node, StructureRecord& record) {
+            int32_t ref = tree_.child(node, "volumeref");
+            if (ref < 0) {
+                // <file name="..."/>: external geometry, not followed
+                record.skipped++;
+                return true;
+            }
+            PlacementRecord placement;
+            placement.name = decodeText(tree_.attribute(node, "name"));
+            placement.volume = decodeText(tree_.attribute(ref, "ref"));
+            if (tree_.hasAttribute(node, "copynumber")) {
+                double copy = 0.0;
+                if (!number(node, "copynumber", 0.0, copy)) return false;
+                placement.copyNumber = int(std::lround(copy));
+                placement.hasCopyNumber = true;
+            }
+            if (!readFrame(node, placement.frame)) return false;
+            record.placements.push_back(std::move(placement));
+            return true;
+        }
+
+        bool readReplica(int32_t node, StructureRecord& record) {
+            int32_t ref = tree_.child(node, "volumeref");
+            int32_t along = tree_.child(node, "replicate_along_axis");
+            if (ref < 0 || along < 0) return fail("incomplete replicavol in volume " + record.name);
+            PlacementRecord placement;
+            placement.kind = PlacementRecord::Kind::Replica;
+            placement.volume = decodeText(tree_.attribute(ref, "ref"));
+            double copies = 0.0;
+            if (!number(node, "number", 0.0, copies)) return false;
+            placement.number = int(std::lround(copies));
+
+            int32_t direction = tree_.child(along, "direction");
+            if (direction >= 0) {
+                static const char* const axes[4] = {"x", "y", "z", "phi"};
+                for (int i = 0; i < 4; ++i) {
+                    double v = 0.0;
+                    if (!number(direction, axes[i], 0.0, v)) return false;
+                    if (v != 0.0) placement.axis = i;
+                }
+            }
+            if (placement.axis < 0) {
+                // rho replicas have no equivalent array pattern
+                record.skipped++;
+                return true;
+            }
+            auto quantity = [&](const char* tag, double& value) {
+                int32_t c = tree_.child(along, tag);
+                if (c < 0) {
+                    value = 0.0;
+                    return true;
+                }
+                double unit = 1.0;
+                if (!number(c, "value", 0.0, value)
+                    || !unitFactor(c, "unit", placement.axis == 3 ? "rad" : "mm", unit)) return false;
+                value *= unit;
+                return true;
+            };
+            if (!quantity("width", placement.width) || !quantity("offset", placement.offset)) return false;
+            record.placements.push_back(std::move(placement));
+            return true;
+        }
+
+        bool readParamvol(int32_t node, StructureRecord& record) {
+            int32_t ref = tree_.child(node, "volumeref");
+            int32_t sets = tree_.child(node, "parameterised_position_size");
+            if (ref < 0 || sets < 0) return fail("incomplete paramvol in volume " + record.name);
+            PlacementRecord placement;
+            placement.kind = PlacementRecord::Kind::Paramvol;
+            placement.volume = decodeText(tree_.attribute(ref, "ref"));
+            bool ok = true;
+            tree_.forEachChild(sets, [&](int32_t c) {
+                if (!ok || tree_.tag(c) != "parameters") return;
+                ParamCopy copy;
+                ok = readFrame(c, copy.frame) && readDimensions(c, copy.shape);
+                placement.copies.push_back(std::move(copy));
+            });
+            if (!ok) return false;
+            placement.number = int(placement.copies.size());
+            record.placements.push_back(std::move(placement));
+            return true;
+        }
+
+        // Solid of one paramvol copy (*_dimensions), null if not given
+        bool readDimensions(int32_t parameters, std::shared_ptr<const Shape>& shape) {
+            bool ok = true;
+            tree_.forEachChild(parameters, [&](int32_t c) {
+                std::string_view tag = tree_.tag(c);
+                if (!ok || tag.size() < 11 || tag.substr(tag.size() - 11) != "_dimensions") return;
+                double lunit = 1.0, aunit = 1.0;
+                ok = unitFactor(c, "lunit", "mm", lunit) && unitFactor(c, "aunit", "rad", aunit);
+                auto get = [&](const char* name, double unit, double fallback) {
+                    double value = 0.0;
+                    ok = ok && number(c, name, fallback, value);
+                    return value * unit;
+                };
+                const double deg = aunit * RadToDeg;
+                if (tag == "box_dimensions") {
+                    shape = makeBox(get("x", lunit, 0) / 2, get("y", lunit, 0) / 2, get("z", lunit, 0) / 2);
+                } else if (tag == "tube_dimensions") {
+                    double rmin = get("InR", lunit, 0), rmax = get("OutR", lunit, 0), hz = get("hz", lunit, 0);
+                    shape = makeTube(rmin, rmax, hz / 2, get("StartPhi", deg, 0), get("DeltaPhi", deg, 2 * Pi / aunit));
+                } else if (tag == "cone_dimensions") {
+                    double rmin1 = get("rmin1", lunit, 0), rmax1 = get("rmax1", lunit, 0);
+                    double rmin2 = get("rmin2", lunit, 0), rmax2 = get("rmax2", lunit, 0), z = get("z", lunit, 0);
+                    shape = makeCone(rmin1, rmax1, rmin2, rmax2, z / 2, get("startphi", deg, 0), get("deltaphi", deg, 2 * Pi / aunit));
+                } else if (tag == "sphere_dimensions") {
+                    double rmin = get("rmin", lunit, 0), rmax = get("rmax", lunit, 0);
+                    double sphi = get("startphi", deg, 0), dphi = get("deltaphi", deg, 2 * Pi / aunit);
+                    shape = makeSphere(rmin, rmax, sphi, dphi, get("starttheta", deg, 0), get("deltatheta", deg, Pi / aunit));
+                } else if (tag == "trd_dimensions") {
+                    double x1 = get("x1", lunit, 0), x2 = get("x2", lunit, 0), y1 = get("y1", lunit, 0);
+                    double y2 = get("y2", lunit, 0), z = get("z", lunit, 0);
+                    shape = makeTrd(x1 / 2, x2 / 2, y1 / 2, y2 / 2, z / 2);
+                }
+            });
+            return ok;
+        }
+
+        const Evaluator& eval_;
+        XmlTree tree_;
+        std::string error_;
+    };
+
+}
+
+/**
+ * Contenuto del file: per ogni sezione gli elementi di primo livello
+ * (intervalli nel file mappato) e, dopo il parsing, i record corrispondenti.
+ */
+struct GDMLImporter::Document {
+    struct Item {
+        const char* begin;
+        const char* end;
+    };
+
+    std::vector<Item> defines;
+    std::vector<Item> materials;
+    std::vector<Item> solids;
+    std::vector<Item> structure;
+    std::vector<Item> setup;
+
+    std::unordered_map<std::string, double> constants;
+    std::vector<DefineRecord> defineRecords;
+    std::vector<MaterialRecord> materialRecords;
+    std::vector<SolidRecord> solidRecords;
+    std::vector<StructureRecord> structureRecords;
+    std::string world;
+};
+
+GDMLImporter::GDMLImporter() {
+}
+
+GDMLImporter::~GDMLImporter() {
+}
+
+bool GDMLImporter::importFromFile(SceneGraph* sceneGraph, const std::string& filePath) {
+    stats_ = GDMLImportStats();
+    lastError_.clear();
+    if (!sceneGraph) {
+        lastError_ = "no scene";
+        return false;
+    }
+
+    QFile file(QString::fromStdString(filePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        lastError_ = "cannot open " + filePath;
+        std::cerr << "GDML import: " << lastError_ << std::endl;
+        return false;
+    }
+    const qint64 size = file.size();
+    uchar* data = size > 0 ? file.map(0, size) : nullptr;
+    if (!data) {
+        lastError_ = size > 0 ? "cannot map " + filePath : filePath + " is empty";
+        std::cerr << "GDML import: " << lastError_ << std::endl;
+        return false;
+    }
+
+    std::unique_ptr<VolumeNode> root;
+    try {
+        Document document;
+        if (parse(reinterpret_cast<const char*>(data), size_t(size), document)) {
+            root = buildHierarchy(document);
+        }
+    } catch (const std::exception& e) {
+        lastError_ = e.what();
+    }
+    file.unmap(data);
+    if (!root) {
+        std::cerr << "GDML import of " << filePath << " failed: " << lastError_ << std::endl;
+        return false;
+    }
+
+    std::function<void(const VolumeNode*)> count = [&](const VolumeNode* node) {
+        stats_.volumes++;
+        for (const VolumeNode* child : node->getChildren()) count(child);
+    };
+    count(root.get());
+
+    // One graph notification for the whole hierarchy; the simulation
+    // settings of the scene are not in the file and stay as they are
+    sceneGraph->adoptLoadedScene(std::move(root), nlohmann::json::object());
+    return true;
+}
+
+bool GDMLImporter::parse(const char* data, size_t size, Document& doc) {
+    const char* end = data + size;
+
+    // Prolog, then <gdml>
+    const char* p = nextTag(data, end);
+    if (!p || tagName(p, end) != "gdml") {
+        lastError_ = "not a GDML document (no <gdml> root element)";
+        return false;
+    }
+    const char* rootClose = tagEnd(p + 1, end);
+    if (!rootClose) {
+        lastError_ = "malformed <gdml> tag";
+        return false;
+    }
+    p = rootClose + 1;
+
+    // Sections: split into their top-level elements with a tag-only pass
+    for (;;) {
+        p = nextTag(p, end);
+        if (!p) {
+            lastError_ = "unexpected end of file (missing </gdml>)";
+            return false;
+        }
+        if (p[1] == '/') break;
+        std::string_view section = tagName(p, end);
+        std::vector<Document::Item>* items = section == "define" ? &doc.defines
+                                           : section == "materials" ? &doc.materials
+                                           : section == "solids" ? &doc.solids
+                                           : section == "structure" ? &doc.structure
+                                           : section == "setup" ? &doc.setup : nullptr;
+        if (!items) {
+            const char* next = skipElement(p, end);
+            if (!next) {
+                lastError_ = "malformed <" + std::string(section) + "> section";
+                return false;
+            }
+            p = next;
+            continue;
+        }
+        const char* close = tagEnd(p + 1, end);
+        if (!close) {
+            lastError_ = "malformed <" + std::string(section) + "> tag";
+            return false;
+        }
+        p = close + 1;
+        if (close[-1] == '/') continue;
+        for (;;) {
+            p = nextTag(p, end);
+            if (!p) {
+                lastError_ = "unterminated <" + std::string(section) + "> section";
+                return false;
+            }
+            if (p[1] == '/') {
+                p = static_cast<const char*>(std::memchr(p, '>', size_t(end - p))) + 1;
+                break;
+            }
+            const char* next = skipElement(p, end);
+            if (!next) {
+                lastError_ = "malformed element <" + std::string(tagName(p, end)) + "> in <" + std::string(section) + ">";
+                return false;
+            }
+            if (section == "setup") {
+                if (doc.world.empty() && tagName(p, end) == "world") {
+                    XmlTree tree;
+                    if (tree.parse(p, next)) doc.world = decodeText(tree.attribute(0, "ref"));
+                }
+            } else {
+                items->push_back({p, next});
+            }
+            p = next;
+        }
+    }
+
+    // Constants first, in document order: any later attribute may use them
+    Evaluator evaluator(doc.constants);
+    {
+        XmlTree tree;
+        for (const Document::Item& item : doc.defines) {
+            std::string_view tag = tagName(item.begin, item.end);
+            if (tag != "constant" && tag != "variable" && tag != "quantity") continue;
+            if (!tree.parse(item.begin, item.end)) {
+                lastError_ = "malformed <" + std::string(tag) + ">";
+                return false;
+            }
+            double value = 0.0, unit = 1.0;
+            std::string_view unitName = tree.attribute(0, "unit");
+            if (!evaluator.evaluate(tree.attribute(0, "value"), value)
+                || (!unitName.empty() && !builtinValue(unitName, unit) && !evaluator.evaluate(unitName, unit))) {
+                lastError_ = "cannot evaluate " + std::string(tag) + " " + std::string(tree.attribute(0, "name"));
+                return false;
+            }
+            doc.constants[decodeText(tree.attribute(0, "name"))] = value * unit;
+        }
+    }
+
+    // Every other element is independent: convert them on a pool of workers
+    // pulling chunks from the four sections
+    doc.defineRecords.resize(doc.defines.size());
+    doc.materialRecords.resize(doc.materials.size());
+    doc.solidRecords.resize(doc.solids.size());
+    doc.structureRecords.resize(doc.structure.size());
+    const size_t offsets[5] = {
+        0,
+        doc.defines.size(),
+        doc.defines.size() + doc.materials.size(),
+        doc.defines.size() + doc.materials.size() + doc.solids.size(),
+        doc.defines.size() + doc.materials.size() + doc.solids.size() + doc.structure.size()};
+    const size_t total = offsets[4];
+
+    constexpr size_t Chunk = 256;
+    unsigned threads = threads_ ? threads_ : std::thread::hardware_concurrency();
+    threads = std::max(1u, std::min<unsigned>(threads, unsigned((total + Chunk - 1) / Chunk)));
+    stats_.threads = threads;
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::vector<std::string> errors(threads);
+    auto worker = [&](unsigned id) {
+        ElementReader reader(evaluator);
+        for (;;) {
+            size_t begin = next.fetch_add(Chunk);
+            if (begin >= total || failed.load(std::memory_order_relaxed)) return;
+            size_t last = std::min(total, begin + Chunk);
+            for (size_t i = begin; i < last; ++i) {
+                const Document::Item* item;
+                int section = 0;
+                while (i >= offsets[section + 1]) ++section;
+                size_t index = i - offsets[section];
+                switch (section) {
+                    case 0: item = &doc.defines[index]; break;
+                    case 1: item = &doc.materials[index]; break;
+                    case 2: item = &doc.solids[index]; break;
+                    default: item = &doc.structure[index]; break;
+                }
+                bool ok = reader.tree().parse(item->begin, item->end);
+                if (ok) {
+                    switch (section) {
+                        case 0: ok = reader.readDefine(doc.defineRecords[index]); break;
+                        case 1: ok = reader.readMaterial(doc.materialRecords[index]); break;
+                        case 2: ok = reader.readSolid(doc.solidRecords[index]); break;
+                        default: ok = reader.readStructure(doc.structureRecords[index]); break;
+                    }
+                }
+                if (!ok) {
+                    errors[id] = reader.error().empty()
+                        ? "malformed element <" + std::string(tagName(item->begin, item->end)) + ">"
+                        : reader.error();
+                    failed = true;
+                    return;
+                }
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; ++i) pool.emplace_back(worker, i);
+    worker(0);
+    for (auto& thread : pool) thread.join();
+
+    if (failed) {
+        for (const std::string& error : errors) {
+            if (!error.empty()) {
+                lastError_ = error;
+                break;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<VolumeNode> GDMLImporter::buildHierarchy(Document& doc) {
+    // ---- Lookup tables (names point into the records)
+    std::unordered_map<std::string_view, const DefineRecord*> defines;
+    defines.reserve(doc.defineRecords.size() + doc.solidRecords.size());
+    for (const DefineRecord& r : doc.defineRecords) {
+        if (r.kind == DefineRecord::Kind::Unsupported) stats_.skipped++;
+        if (r.kind != DefineRecord::Kind::None && r.kind != DefineRecord::Kind::Unsupported) defines[r.name] = &r;
+    }
+    std::unordered_map<std::string_view, const MaterialRecord*> materialRecords;
+    materialRecords.reserve(doc.materialRecords.size());
+    for (const MaterialRecord& r : doc.materialRecords) {
+        if (r.kind == MaterialRecord::Kind::Unsupported) stats_.skipped++;
+        else materialRecords[r.name] = &r;
+    }
+    std::unordered_map<std::string_view, const SolidRecord*> solids;
+    solids.reserve(doc.solidRecords.size());
+    for (const SolidRecord& r : doc.solidRecords) {
+        if (r.kind == SolidRecord::Kind::Define) {
+            defines[r.define.name] = &r.define;
+            continue;
+        }
+        if (r.kind == SolidRecord::Kind::Unsupported) {
+            std::cerr << "GDML import: unsupported solid <" << r.tag << "> " << r.name << std::endl;
+            stats_.skipped++;
+        }
+        solids[r.name] = &r;
+        if (r.kind == SolidRecord::Kind::Solid || r.kind == SolidRecord::Kind::Boolean) stats_.solids++;
+    }
+    std::unordered_map<std::string_view, const StructureRecord*> logicals;
+    logicals.reserve(doc.structureRecords.size());
+    std::unordered_map<std::string_view, const OpticalSurfaceConfig*> skins;
+    for (const StructureRecord& r : doc.structureRecords) {
+        stats_.skipped += size_t(r.skipped);
+        switch (r.kind) {
+            case StructureRecord::Kind::Volume:
+            case StructureRecord::Kind::Assembly:
+                logicals[r.name] = &r;
+                stats_.logicalVolumes++;
+                stats_.placements += r.placements.size();
+                break;
+            case StructureRecord::Kind::SkinSurface: {
+                auto surface = solids.find(r.surface);
+                if (surface != solids.end() && surface->second->kind == SolidRecord::Kind::OpticalSurface) {
+                    skins[r.volume] = &surface->second->optical;
+                }
+                break;
+            }
+            default:
+                stats_.skipped++;
+                break;
+        }
+    }
+
+    // ---- Materials (created once per name, shared by the volumes)
+    std::unordered_map<std::string_view, std::shared_ptr<Material>> materials;
+    std::function<std::shared_ptr<Material>(const std::string&, int)> material =
+        [&](const std::string& name, int depth) -> std::shared_ptr<Material> {
+        auto known = materials.find(name);
+        if (known != materials.end()) return known->second;
+        auto it = materialRecords.find(name);
+        std::shared_ptr<Material> result;
+        if (it == materialRecords.end() || it->second->kind != MaterialRecord::Kind::Material) {
+            if (name.compare(0, 3, "G4_") != 0) {
+                std::cerr << "GDML import: unknown material " << name << ", using G4_AIR" << std::endl;
+            }
+            result = name.compare(0, 3, "G4_") == 0 ? Material::makeNist(name) : Material::makeAir();
+        } else {
+            const MaterialRecord& r = *it->second;
+            result = std::make_shared<Material>(displayName(r.name));
+            result->setDensity(r.density);
+            if (r.state == "gas") result->setState(Material::State::Gas);
+            else if (r.state == "liquid") result->setState(Material::State::Liquid);
+            if (r.hasZ) {
+                result->setMaterialType(Material::Type::SingleElement);
+                result->setAtomicNumber(int(std::lround(r.Z)));
+                result->setAtomicMass(r.A);
+            } else if (!r.fractions.empty() || !r.composites.empty()) {
+                // Elements by atom count or mass fraction, other materials by
+                // mass fraction
+                bool mixture = false;
+                auto element = [&](const std::string& ref) {
+                    auto e = materialRecords.find(ref);
+                    Element result(ref, ref, 0, 0.0);
+                    if (e != materialRecords.end()) {
+                        const MaterialRecord& er = *e->second;
+                        result = Element(er.formula.empty() ? displayName(er.name) : er.formula,
+                                         displayName(er.name), int(std::lround(er.Z)), er.A);
+                        // Elements made of isotopes: Z of the first one
+                        if (!er.hasZ && !er.fractions.empty()) {
+                            auto iso = materialRecords.find(er.fractions.front().first);
+                            if (iso != materialRecords.end()) result.atomicNumber = int(std::lround(iso->second->Z));
+                        }
+                    }
+                    return result;
+                };
+                for (const auto& [ref, n] : r.composites) {
+                    MaterialComponent component;
+                    component.element = element(ref);
+                    component.nAtoms = n;
+                    result->addComponent(component);
+                }
+                for (const auto& [ref, fraction] : r.fractions) {
+                    MaterialComponent component;
+                    auto sub = materialRecords.find(ref);
+                    bool isMaterial = sub == materialRecords.end()
+                        ? ref.compare(0, 3, "G4_") == 0
+                        : sub->second->kind == MaterialRecord::Kind::Material;
+                    if (isMaterial && depth < 16) {
+                        component.type = MaterialComponent::Type::Material;
+                        component.material = material(ref, depth + 1);
+                        mixture = true;
+                    } else {
+                        component.element = element(ref);
+                    }
+                    component.fraction = fraction;
+                    result->addComponent(component);
+                }
+                result->setMaterialType(mixture ? Material::Type::Mixture : Material::Type::Compound);
+            }
+        }
+        materials.emplace(name, result);
+        return result;
+    };
+
+    // ---- Transforms
+    auto frameTransform = [&](const Frame& frame) {
+        const double* position = frame.position;
+        const double* rotation = frame.rotation;
+        const double* scale = frame.scale;
+        auto ref = [&](const std::string& name, DefineRecord::Kind kind, const double*& value) {
+            if (name.empty()) return;
+            auto it = defines.find(name);
+            if (it != defines.end() && it->second->kind == kind) {
+                value = it->second->value;
+            } else {
+                std::cerr << "GDML import: undefined reference " << name << std::endl;
+            }
+        };
+        ref(frame.positionRef, DefineRecord::Kind::Position, position);
+        ref(frame.rotationRef, DefineRecord::Kind::Rotation, rotation);
+        ref(frame.scaleRef, DefineRecord::Kind::Scale, scale);
+        return Transform(QVector3D(float(position[0]), float(position[1]), float(position[2])),
+                         gdmlRotation(rotation),
+                         QVector3D(float(scale[0]), float(scale[1]), float(scale[2])));
+    };
+
+    // ---- Hierarchy: every placement of a logical volume becomes a node;
+    // nodes are linked directly, the scene adopts the finished tree
+    std::unordered_map<std::string_view, std::shared_ptr<const Shape>> shapes;
+    std::vector<std::pair<VolumeNode*, const SolidRecord*>> booleans;
+    std::unordered_map<std::string_view, VolumeNode*> firstUser;  // solid name -> first volume
+    firstUser.reserve(doc.solidRecords.size());
+    auto attach = [](VolumeNode* parent, VolumeNode* child) {
+        child->parent_ = parent;
+        parent->children_.push_back(child);
+    };
+    auto setupVolume = [&](VolumeNode* node, const StructureRecord& logical) {
+        auto solid = solids.find(logical.solid);
+        if (solid != solids.end()) {
+            const SolidRecord& r = *solid->second;
+            firstUser.emplace(r.name, node);
+            if (r.kind == SolidRecord::Kind::Solid) node->shape_ = r.shape;
+            else if (r.kind == SolidRecord::Kind::Boolean) booleans.emplace_back(node, &r);
+        } else {
+            std::cerr << "GDML import: volume " << logical.name << " references unknown solid " << logical.solid << std::endl;
+        }
+        if (!logical.material.empty()) node->material_ = material(logical.material, 0);
+        if (!logical.sensitiveDetector.empty()) {
+            node->sdConfig_.enabled = true;
+            node->sdConfig_.collectionName = logical.sensitiveDetector;
+        }
+        auto skin = skins.find(logical.name);
+        if (skin != skins.end()) node->opticalConfig_ = *skin->second;
+    };
+
+    std::function<void(VolumeNode*, const StructureRecord&, const Transform*, int)> placeDaughters =
+        [&](VolumeNode* mother, const StructureRecord& logical, const Transform* assembly, int depth) {
+        if (depth > 256) {
+            std::cerr << "GDML import: hierarchy too deep (recursive volume " << logical.name << "?)" << std::endl;
+            return;
+        }
+        for (const PlacementRecord& placement : logical.placements) {
+            auto it = logicals.find(placement.volume);
+            if (it == logicals.end()) {
+                std::cerr << "GDML import: physvol references unknown volume " << placement.volume << std::endl;
+                stats_.skipped++;
+                continue;
+            }
+            const StructureRecord& daughter = *it->second;
+            Transform local = frameTransform(placement.frame);
+            if (assembly) local = assembly->combine(local);
+
+            // Assemblies are flattened: their daughters go to the mother
+            if (daughter.kind == StructureRecord::Kind::Assembly) {
+                placeDaughters(mother, daughter, &local, depth + 1);
+                continue;
+            }
+
+            auto makeNode = [&](const std::string& name, const Transform& transform, int copyNumber) {
+                auto* node = new VolumeNode(displayName(name.empty() ? daughter.name : name));
+                attach(mother, node);
+                node->transform_ = transform;
+                setupVolume(node, daughter);
+                if (node->sdConfig_.enabled) node->sdConfig_.copyNumber = copyNumber;
+                placeDaughters(node, daughter, nullptr, depth + 1);
+                return node;
+            };
+
+            switch (placement.kind) {
+                case PlacementRecord::Kind::Physvol:
+                    makeNode(placement.name, local, placement.copyNumber);
+                    break;
+
+                case PlacementRecord::Kind::Replica: {
+                    // Slices along x/y/z: a linear array centred in the mother;
+                    // phi: a ring of copies, each one width wide
+                    ArrayPattern pattern;
+                    pattern.count[0] = std::max(1, placement.number);
+                    Transform cell = local;
+                    if (placement.axis < 3) {
+                        pattern.type = ArrayPattern::Type::Linear;
+                        pattern.step[placement.axis] = placement.width;
+                        float start[3] = {0.0f, 0.0f, 0.0f};
+                        start[placement.axis] = float(-placement.width * (placement.number - 1) / 2.0 + placement.offset);
+                        cell.setTranslation(QVector3D(start[0], start[1], start[2]));
+                    } else {
+                        // Copy i turned by offset + width * (i - (n - 1) / 2), as G4PVReplica
+                        pattern.type = ArrayPattern::Type::Ring;
+                        pattern.dphi = placement.width * RadToDeg;
+                        cell.setRotation(QQuaternion::fromAxisAndAngle(0.0f, 0.0f, 1.0f,
+                            float((placement.offset - placement.width * (placement.number - 1) / 2.0) * RadToDeg)));
+                    }
+                    VolumeNode* node = makeNode(daughter.name, cell, 0);
+                    node->arrayPattern_ = pattern;
+                    break;
+                }
+
+                case PlacementRecord::Kind::Paramvol: {
+                    // Regular grids of identical, unrotated copies become an
+                    // array pattern, anything else one volume per copy
+                    std::vector<Transform> transforms;
+                    transforms.reserve(placement.copies.size());
+                    bool uniform = true;
+                    for (const ParamCopy& param : placement.copies) {
+                        Transform t = frameTransform(param.frame);
+                        transforms.push_back(assembly ? assembly->combine(t) : t);
+                        const double* r = param.frame.rotation;
+                        if (r[0] != 0.0 || r[1] != 0.0 || r[2] != 0.0 || !param.frame.rotationRef.empty()) uniform = false;
+                        const auto& firstShape = placement.copies.front().shape;
+                        if (bool(param.shape) != bool(firstShape)
+                            || (param.shape && !param.shape->sameGeometry(*firstShape))) uniform = false;
+                    }
+                    ArrayPattern pattern;
+                    if (uniform && detectArray(transforms, pattern)) {
+                        VolumeNode* node = makeNode(daughter.name, transforms.front(), 0);
+                        if (placement.copies.front().shape) node->shape_ = placement.copies.front().shape;
+                        node->arrayPattern_ = pattern;
+                        break;
+                    }
+                    for (size_t copy = 0; copy < placement.copies.size(); ++copy) {
+                        VolumeNode* node = makeNode(daughter.name + "_" + std::to_string(copy), transforms[copy], int(copy));
+                        if (placement.copies[copy].shape) node->shape_ = placement.copies[copy].shape;
+                    }
+                    break;
+                }
+            }
+        }
+    };
+
+    // ---- World
+    const StructureRecord* worldVolume = nullptr;
+    if (!doc.world.empty()) {
+        auto it = logicals.find(doc.world);
+        if (it != logicals.end()) worldVolume = it->second;
+    } else {
+        // No setup: the last volume is the world by convention
+        for (auto it = doc.structureRecords.rbegin(); it != doc.structureRecords.rend(); ++it) {
+            if (it->kind == StructureRecord::Kind::Volume) {
+                worldVolume = &*it;
+                break;
+            }
+        }
+    }
+    if (!worldVolume) {
+        lastError_ = doc.world.empty() ? "no world volume" : "world volume " + doc.world + " not found";
+        return nullptr;
+    }
+
+    auto root = std::make_unique<VolumeNode>("World");
+    setupVolume(root.get(), *worldVolume);
+    if (!root->shape_) root->shape_ = makeBox(1000.0, 1000.0, 1000.0);
+    if (!root->material_) root->material_ = Material::makeVacuum();
+    placeDaughters(root.get(), *worldVolume, nullptr, 0);
+
+    // ---- Boolean solids reference their operands by volume name: a volume
+    // already using the operand solid, or a hidden one made for it
+    std::unordered_map<std::string_view, std::shared_ptr<const Shape>> resolved;
+    std::function<std::shared_ptr<const Shape>(const SolidRecord&, int)> resolveBoolean;
+    auto operandVolume = [&](const std::string& solidName, int depth) -> std::string {
+        auto user = firstUser.find(solidName);
+        if (user != firstUser.end()) return user->second->getName();
+        auto it = solids.find(solidName);
+        auto* node = new VolumeNode(displayName(solidName));
+        node->visible_ = false;
+        node->material_ = root->material_;
+        attach(root.get(), node);
+        firstUser.emplace(solidName, node);
+        if (it != solids.end()) {
+            const SolidRecord& r = *it->second;
+            node->shape_ = r.kind == SolidRecord::Kind::Boolean ? resolveBoolean(r, depth + 1) : r.shape;
+        } else {
+            std::cerr << "GDML import: boolean operand " << solidName << " not found" << std::endl;
+        }
+        return node->getName();
+    };
+    resolveBoolean = [&](const SolidRecord& r, int depth) -> std::shared_ptr<const Shape> {
+        auto known = resolved.find(r.name);
+        if (known != resolved.end()) return known->second;
+        if (depth > 64) return nullptr;
+        std::string first = operandVolume(r.first, depth);
+        std::string second = operandVolume(r.second, depth);
+        Transform relative = frameTransform(r.frame);
+        const QVector3D& t = relative.getTranslation();
+        // Relative rotation as written in the file (degrees), like BooleanParams
+        const double* angles = r.frame.rotation;
+        if (!r.frame.rotationRef.empty()) {
+            auto it = defines.find(r.frame.rotationRef);
+            if (it != defines.end()) angles = it->second->value;
+        }
+        std::unique_ptr<Shape> made = makeBooleanSolid(r.operation, first, second, t.x(), t.y(), t.z(),
+            angles[0] * RadToDeg, angles[1] * RadToDeg, angles[2] * RadToDeg);
+        made->setName(displayName(r.name));
+        std::shared_ptr<const Shape> shape = std::move(made);
+        resolved.emplace(r.name, shape);
+        return shape;
+    };
+    for (auto& [node, record] : booleans) {
+        node->shape_ = resolveBoolean(*record, 0);
+    }
+
+    stats_.materials = materials.size();
+    return root;
+}
+
+} // namespace geantcad
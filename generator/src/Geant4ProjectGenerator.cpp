@@ -21,17 +21,6 @@ Geant4ProjectGenerator::Geant4ProjectGenerator()
 Geant4ProjectGenerator::~Geant4ProjectGenerator() {
 }
 
-std::string Geant4ProjectGenerator::readTemplateFile(const std::string& templatePath) {
-    std::ifstream file(templatePath);
-    if (!file.is_open()) {
-        return "";
-    }
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
-}
-
 std::string Geant4ProjectGenerator::readExistingFile(const std::string& filePath) {
     if (!fs::exists(filePath)) {
         return "";
@@ -100,7 +89,7 @@ std::string Geant4ProjectGenerator::generateSensitiveDetectorSetup(SceneGraph* s
     // Collect all volumes with SD enabled
     std::map<std::string, std::vector<std::pair<std::string, std::string>>> sdByType;
     
-    sceneGraph->traverseConst([&](const VolumeNode* node) {
+    sceneGraph->forEach([&](const VolumeNode* node) {
         if (node && node->getSDConfig().enabled) {
             const auto& sdConfig = node->getSDConfig();
             std::string type = sdConfig.type;
@@ -230,11 +219,11 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
     // Generate CMakeLists.txt
     {
         std::string templatePath = templateBase + "/CMakeLists.txt.template";
-        std::string templateContent = readTemplateFile(templatePath);
-        if (templateContent.empty()) {
+        auto compiled = TemplateEngine::loadTemplate(templatePath);
+        if (!compiled) {
             return false;
         }
-        std::string rendered = templateEngine_.render(templateContent, vars);
+        std::string rendered = compiled->render(vars);
         if (!writeGeneratedFile(outputDir + "/CMakeLists.txt", rendered, true)) {
             return false;
         }
@@ -242,7 +231,7 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
     
     // Generate Sensitive Detector files if needed
     std::set<std::string> sdTypes;
-    sceneGraph->traverseConst([&](const VolumeNode* node) {
+    sceneGraph->forEach([&](const VolumeNode* node) {
         if (node && node->getSDConfig().enabled) {
             sdTypes.insert(node->getSDConfig().type);
         }
@@ -258,9 +247,9 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
         };
         for (const auto& pair : files) {
             std::string templatePath = templateBase + "/" + pair.second;
-            std::string templateContent = readTemplateFile(templatePath);
-            if (!templateContent.empty()) {
-                std::string rendered = templateEngine_.render(templateContent, vars);
+            auto compiled = TemplateEngine::loadTemplate(templatePath);
+            if (compiled) {
+                std::string rendered = compiled->render(vars);
                 std::string filePath = outputDir + "/src/" + pair.first;
                 if (pair.first.find(".hh") != std::string::npos) {
                     filePath = outputDir + "/include/" + pair.first;
@@ -279,9 +268,9 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
         };
         for (const auto& pair : files) {
             std::string templatePath = templateBase + "/" + pair.second;
-            std::string templateContent = readTemplateFile(templatePath);
-            if (!templateContent.empty()) {
-                std::string rendered = templateEngine_.render(templateContent, vars);
+            auto compiled = TemplateEngine::loadTemplate(templatePath);
+            if (compiled) {
+                std::string rendered = compiled->render(vars);
                 std::string filePath = outputDir + "/src/" + pair.first;
                 if (pair.first.find(".hh") != std::string::npos) {
                     filePath = outputDir + "/include/" + pair.first;
@@ -300,9 +289,9 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
         };
         for (const auto& pair : files) {
             std::string templatePath = templateBase + "/" + pair.second;
-            std::string templateContent = readTemplateFile(templatePath);
-            if (!templateContent.empty()) {
-                std::string rendered = templateEngine_.render(templateContent, vars);
+            auto compiled = TemplateEngine::loadTemplate(templatePath);
+            if (compiled) {
+                std::string rendered = compiled->render(vars);
                 std::string filePath = outputDir + "/src/" + pair.first;
                 if (pair.first.find(".hh") != std::string::npos) {
                     filePath = outputDir + "/include/" + pair.first;
@@ -320,8 +309,8 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
         };
         for (const auto& pair : pgaFiles) {
             std::string templatePath = templateBase + "/" + pair.second;
-            std::string templateContent = readTemplateFile(templatePath);
-            if (!templateContent.empty()) {
+            auto compiled = TemplateEngine::loadTemplate(templatePath);
+            if (compiled) {
                 // Generate configuration code for PrimaryGeneratorAction
                 std::ostringstream pgaConfig;
                 const auto& pgConfig = sceneGraph->getParticleGunConfig();
@@ -352,7 +341,7 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
                 
                 vars["primary_generator_config"] = pgaConfig.str();
                 
-                std::string rendered = templateEngine_.render(templateContent, vars);
+                std::string rendered = compiled->render(vars);
                 std::string filePath = outputDir + "/src/" + pair.first;
                 if (pair.first.find(".hh") != std::string::npos) {
                     filePath = outputDir + "/include/" + pair.first;
@@ -379,11 +368,11 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
     
     for (const auto& pair : sourceFiles) {
         std::string templatePath = templateBase + "/" + pair.second;
-        std::string templateContent = readTemplateFile(templatePath);
-        if (templateContent.empty()) {
+        auto compiled = TemplateEngine::loadTemplate(templatePath);
+        if (!compiled) {
             continue; // Skip if template not found
         }
-        std::string rendered = templateEngine_.render(templateContent, vars);
+        std::string rendered = compiled->render(vars);
         std::string existingContent = readExistingFile(outputDir + "/src/" + pair.first);
         if (!existingContent.empty()) {
             rendered = templateEngine_.renderWithPreservation(rendered, vars, existingContent);
@@ -405,11 +394,11 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
     
     for (const auto& pair : headerFiles) {
         std::string templatePath = templateBase + "/" + pair.second;
-        std::string templateContent = readTemplateFile(templatePath);
-        if (templateContent.empty()) {
+        auto compiled = TemplateEngine::loadTemplate(templatePath);
+        if (!compiled) {
             continue;
         }
-        std::string rendered = templateEngine_.render(templateContent, vars);
+        std::string rendered = compiled->render(vars);
         std::string existingContent = readExistingFile(outputDir + "/include/" + pair.first);
         if (!existingContent.empty()) {
             rendered = templateEngine_.renderWithPreservation(rendered, vars, existingContent);
@@ -427,11 +416,11 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
     
     for (const auto& pair : macroFiles) {
         std::string templatePath = templateBase + "/" + pair.second;
-        std::string templateContent = readTemplateFile(templatePath);
-        if (templateContent.empty()) {
+        auto compiled = TemplateEngine::loadTemplate(templatePath);
+        if (!compiled) {
             continue;
         }
-        std::string rendered = templateEngine_.render(templateContent, vars);
+        std::string rendered = compiled->render(vars);
         std::string existingContent = readExistingFile(outputDir + "/macros/" + pair.first);
         if (!existingContent.empty()) {
             rendered = templateEngine_.renderWithPreservation(rendered, vars, existingContent);
@@ -444,9 +433,9 @@ bool Geant4ProjectGenerator::generateProject(SceneGraph* sceneGraph, const std::
     // Generate README
     {
         std::string templatePath = templateBase + "/README.md.template";
-        std::string templateContent = readTemplateFile(templatePath);
-        if (!templateContent.empty()) {
-            std::string rendered = templateEngine_.render(templateContent, vars);
+        auto compiled = TemplateEngine::loadTemplate(templatePath);
+        if (compiled) {
+            std::string rendered = compiled->render(vars);
             writeGeneratedFile(outputDir + "/README.md", rendered, false);
         }
     }
@@ -0,0 +1,209 @@
+#include "MeshCache.hh"
+
+#ifndef GEANTCAD_NO_VTK
+#include <vtkCubeSource.h>
+#include <vtkCylinderSource.h>
+#include <vtkSphereSource.h>
+#include <vtkConeSource.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+#endif
+
+namespace geantcad {
+
+MeshCache& MeshCache::instance() {
+    static MeshCache cache;
+    return cache;
+}
+
+#ifndef GEANTCAD_NO_VTK
+namespace {
+    size_t entryHash(const Shape& shape, int resolution) {
+        size_t seed = shape.geometryHash();
+        seed ^= std::hash<int>()(resolution) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        return seed;
+    }
+}
+
+vtkSmartPointer<vtkPolyData> MeshCache::get(const Shape& shape, int resolution) {
+    const size_t hash = entryHash(shape, resolution);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = buckets_.find(hash);
+        if (it != buckets_.end()) {
+            for (const auto& entry : it->second) {
+                if (entry.resolution == resolution && entry.key.sameGeometry(shape)) {
+                    ++stats_.hits;
+                    return entry.mesh;
+                }
+            }
+        }
+        ++stats_.misses;
+    }
+    
+    // Tessellate outside the lock so other threads are not serialized on VTK
+    auto mesh = tessellate(shape, resolution);
+    if (!mesh) return nullptr;
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& bucket = buckets_[hash];
+    for (const auto& entry : bucket) {
+        // Another thread got there first: keep a single shared copy
+        if (entry.resolution == resolution && entry.key.sameGeometry(shape)) {
+            return entry.mesh;
+        }
+    }
+    bucket.push_back({shape, resolution, mesh});
+    ++entryCount_;
+    if (entryCount_ > capacity_) {
+        pruneUnused();
+    }
+    return mesh;
+}
+
+vtkSmartPointer<vtkPolyData> MeshCache::tessellate(const Shape& shape, int resolution) {
+    vtkSmartPointer<vtkPolyData> polyData;
+    
+    if (resolution == BoundsResolution) {
+        double lo[3], hi[3];
+        if (!shape.localBounds(lo, hi)) return nullptr;
+        
+        auto source = vtkSmartPointer<vtkCubeSource>::New();
+        source->SetBounds(lo[0], hi[0], lo[1], hi[1], lo[2], hi[2]);
+        source->Update();
+        auto mesh = vtkSmartPointer<vtkPolyData>::New();
+        mesh->ShallowCopy(source->GetOutput());
+        return mesh;
+    }
+    
+    switch (shape.getType()) {
+        case ShapeType::Box: {
+            auto* params = shape.getParamsAs<BoxParams>();
+            if (!params) return nullptr;
+            
+            auto source = vtkSmartPointer<vtkCubeSource>::New();
+            source->SetXLength(params->x * 2.0);
+            source->SetYLength(params->y * 2.0);
+            source->SetZLength(params->z * 2.0);
+            source->Update();
+            polyData = source->GetOutput();
+            break;
+        }
+        case ShapeType::Tube: {
+            auto* params = shape.getParamsAs<TubeParams>();
+            if (!params) return nullptr;
+            
+            // VTK cylinder is oriented along Y, we want Z
+            auto source = vtkSmartPointer<vtkCylinderSource>::New();
+            source->SetRadius(params->rmax);
+            source->SetHeight(params->dz * 2.0);
+            source->SetResolution(resolution);
+            source->Update();
+            
+            // Rotate to align with Z axis
+            auto transform = vtkSmartPointer<vtkTransform>::New();
+            transform->RotateX(90);
+            
+            auto filter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+            filter->SetInputData(source->GetOutput());
+            filter->SetTransform(transform);
+            filter->Update();
+            polyData = filter->GetOutput();
+            break;
+        }
+        case ShapeType::Sphere: {
+            auto* params = shape.getParamsAs<SphereParams>();
+            if (!params) return nullptr;
+            
+            auto source = vtkSmartPointer<vtkSphereSource>::New();
+            source->SetRadius(params->rmax);
+            source->SetPhiResolution(resolution);
+            source->SetThetaResolution(resolution);
+            source->Update();
+            polyData = source->GetOutput();
+            break;
+        }
+        case ShapeType::Cone: {
+            auto* params = shape.getParamsAs<ConeParams>();
+            if (!params) return nullptr;
+            
+            auto source = vtkSmartPointer<vtkConeSource>::New();
+            source->SetRadius(params->rmax1);
+            source->SetHeight(params->dz * 2.0);
+            source->SetResolution(resolution);
+            source->Update();
+            polyData = source->GetOutput();
+            break;
+        }
+        case ShapeType::Trd: {
+            // Trapezoid - approximate with cube for now (would need custom mesh)
+            auto* params = shape.getParamsAs<TrdParams>();
+            if (!params) return nullptr;
+            
+            auto source = vtkSmartPointer<vtkCubeSource>::New();
+            source->SetXLength((params->dx1 + params->dx2));
+            source->SetYLength((params->dy1 + params->dy2));
+            source->SetZLength(params->dz * 2.0);
+            source->Update();
+            polyData = source->GetOutput();
+            break;
+        }
+        default:
+            return nullptr;
+    }
+    
+    // Detach from the (temporary) source pipeline: the mesh is shared read-only
+    auto mesh = vtkSmartPointer<vtkPolyData>::New();
+    mesh->ShallowCopy(polyData);
+    return mesh;
+}
+#endif
+
+MeshCache::Stats MeshCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.entries = entryCount_;
+    return stats;
+}
+
+void MeshCache::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = Stats();
+}
+
+void MeshCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buckets_.clear();
+    entryCount_ = 0;
+}
+
+void MeshCache::setCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    if (entryCount_ > capacity_) {
+        pruneUnused();
+    }
+}
+
+void MeshCache::pruneUnused() {
+#ifndef GEANTCAD_NO_VTK
+    // A mesh referenced only by the cache belongs to no live actor/export
+    for (auto it = buckets_.begin(); it != buckets_.end();) {
+        auto& bucket = it->second;
+        for (size_t i = 0; i < bucket.size();) {
+            if (bucket[i].mesh->GetReferenceCount() <= 1) {
+                bucket[i] = std::move(bucket.back());
+                bucket.pop_back();
+                --entryCount_;
+                ++stats_.evictions;
+            } else {
+                ++i;
+            }
+        }
+        it = bucket.empty() ? buckets_.erase(it) : std::next(it);
+    }
+#endif
+}
+
+} // namespace geantcad
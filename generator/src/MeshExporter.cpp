@@ -1,27 +1,28 @@
 #include "MeshExporter.hh"
+#include "MeshCache.hh"
 #include "../../core/include/Shape.hh"
 #include "../../core/include/VolumeNode.hh"
 #include "../../core/include/Transform.hh"
+#include "../../core/include/ArrayPattern.hh"
 
 #ifndef GEANTCAD_NO_VTK
 #include <vtkSmartPointer.h>
-#include <vtkAppendPolyData.h>
-#include <vtkSTLWriter.h>
-#include <vtkOBJWriter.h>
+#include <vtkNew.h>
 #include <vtkPolyData.h>
-#include <vtkTransformPolyDataFilter.h>
-#include <vtkTransform.h>
-#include <vtkMatrix4x4.h>
-
-// VTK sources for shapes
-#include <vtkCubeSource.h>
-#include <vtkCylinderSource.h>
-#include <vtkSphereSource.h>
-#include <vtkConeSource.h>
+#include <vtkCellArray.h>
+#include <vtkIdList.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
-#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace geantcad {
 
@@ -33,114 +34,171 @@ MeshExporter::~MeshExporter() {
 
 #ifndef GEANTCAD_NO_VTK
 namespace {
-    // Helper to create VTK source from Shape
-    vtkSmartPointer<vtkPolyData> createPolyDataFromShape(const Shape* shape) {
-        if (!shape) return nullptr;
-        
-        vtkSmartPointer<vtkPolyData> polyData;
-        
-        switch (shape->getType()) {
-            case ShapeType::Box: {
-                auto* params = shape->getParamsAs<BoxParams>();
-                if (!params) return nullptr;
-                
-                auto source = vtkSmartPointer<vtkCubeSource>::New();
-                source->SetXLength(params->x * 2.0);
-                source->SetYLength(params->y * 2.0);
-                source->SetZLength(params->z * 2.0);
-                source->Update();
-                polyData = source->GetOutput();
-                break;
-            }
-            case ShapeType::Tube: {
-                auto* params = shape->getParamsAs<TubeParams>();
-                if (!params) return nullptr;
-                
-                // VTK cylinder is oriented along Y, we want Z
-                auto source = vtkSmartPointer<vtkCylinderSource>::New();
-                source->SetRadius(params->rmax);
-                source->SetHeight(params->dz * 2.0);
-                source->SetResolution(36);
-                source->Update();
-                
-                // Rotate to align with Z axis
-                auto transform = vtkSmartPointer<vtkTransform>::New();
-                transform->RotateX(90);
-                
-                auto filter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-                filter->SetInputData(source->GetOutput());
-                filter->SetTransform(transform);
-                filter->Update();
-                polyData = filter->GetOutput();
-                break;
-            }
-            case ShapeType::Sphere: {
-                auto* params = shape->getParamsAs<SphereParams>();
-                if (!params) return nullptr;
-                
-                auto source = vtkSmartPointer<vtkSphereSource>::New();
-                source->SetRadius(params->rmax);
-                source->SetPhiResolution(32);
-                source->SetThetaResolution(32);
-                source->Update();
-                polyData = source->GetOutput();
-                break;
-            }
-            case ShapeType::Cone: {
-                auto* params = shape->getParamsAs<ConeParams>();
-                if (!params) return nullptr;
-                
-                auto source = vtkSmartPointer<vtkConeSource>::New();
-                source->SetRadius(params->rmax1);
-                source->SetHeight(params->dz * 2.0);
-                source->SetResolution(36);
-                source->Update();
-                polyData = source->GetOutput();
-                break;
+    // Angular resolution used for round shapes in exported meshes
+    constexpr int ExportResolution = 36;
+
+    // Triangles written per batch: bounds the memory of an export whatever
+    // the size of the scene (~50 MB of binary STL)
+    constexpr size_t BatchTriangles = size_t(1) << 20;
+
+    // Triangles of one tessellation, in the shape's local frame
+    struct TriangleMesh {
+        std::vector<float> points;       // x, y, z
+        std::vector<uint32_t> triangles; // 3 point indices each
+
+        size_t pointCount() const { return points.size() / 3; }
+        size_t triangleCount() const { return triangles.size() / 3; }
+    };
+
+    // One exported copy of a volume: its mesh and world matrix
+    struct Placement {
+        const VolumeNode* node;
+        int copy;              // index among the array copies of the node
+        uint32_t mesh;
+        QMatrix4x4 matrix;
+        bool mirrored;         // negative determinant: winding is flipped back
+    };
+
+    // Polygons (fans) and triangle strips of a tessellation as plain triangles.
+    // Reads the shared cached mesh: each distinct mesh is read by one thread.
+    TriangleMesh extractTriangles(vtkPolyData* polyData) {
+        TriangleMesh mesh;
+        const vtkIdType pointCount = polyData->GetNumberOfPoints();
+        mesh.points.resize(size_t(pointCount) * 3);
+        for (vtkIdType i = 0; i < pointCount; ++i) {
+            double p[3];
+            polyData->GetPoint(i, p);
+            mesh.points[size_t(i) * 3] = float(p[0]);
+            mesh.points[size_t(i) * 3 + 1] = float(p[1]);
+            mesh.points[size_t(i) * 3 + 2] = float(p[2]);
+        }
+
+        vtkNew<vtkIdList> ids;
+        if (vtkCellArray* polys = polyData->GetPolys()) {
+            polys->InitTraversal();
+            while (polys->GetNextCell(ids)) {
+                for (vtkIdType k = 2; k < ids->GetNumberOfIds(); ++k) {
+                    mesh.triangles.push_back(uint32_t(ids->GetId(0)));
+                    mesh.triangles.push_back(uint32_t(ids->GetId(k - 1)));
+                    mesh.triangles.push_back(uint32_t(ids->GetId(k)));
+                }
             }
-            case ShapeType::Trd: {
-                // Trapezoid - approximate with cube for now (would need custom mesh)
-                auto* params = shape->getParamsAs<TrdParams>();
-                if (!params) return nullptr;
-                
-                auto source = vtkSmartPointer<vtkCubeSource>::New();
-                source->SetXLength((params->dx1 + params->dx2));
-                source->SetYLength((params->dy1 + params->dy2));
-                source->SetZLength(params->dz * 2.0);
-                source->Update();
-                polyData = source->GetOutput();
-                break;
+        }
+        if (vtkCellArray* strips = polyData->GetStrips()) {
+            strips->InitTraversal();
+            while (strips->GetNextCell(ids)) {
+                for (vtkIdType k = 2; k < ids->GetNumberOfIds(); ++k) {
+                    // Every other triangle of a strip is wound the other way
+                    bool odd = (k % 2) != 0;
+                    mesh.triangles.push_back(uint32_t(ids->GetId(k - 2)));
+                    mesh.triangles.push_back(uint32_t(ids->GetId(odd ? k : k - 1)));
+                    mesh.triangles.push_back(uint32_t(ids->GetId(odd ? k - 1 : k)));
+                }
             }
-            default:
-                return nullptr;
         }
-        
-        return polyData;
+        return mesh;
     }
-    
-    // Transform polydata with the node's world transform
-    vtkSmartPointer<vtkPolyData> transformPolyData(vtkPolyData* input, const Transform& transform) {
-        if (!input) return nullptr;
-        
-        auto matrix = transform.getMatrix();
-        
-        auto vtkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-        const float* data = matrix.constData();
-        for (int i = 0; i < 4; ++i) {
-            for (int j = 0; j < 4; ++j) {
-                vtkMatrix->SetElement(i, j, data[i * 4 + j]);
+
+    // Run body(i) for i in [0, count) on the workers; the calling thread works too
+    template<class Body>
+    void parallelFor(size_t count, unsigned threads, size_t chunk, Body&& body) {
+        std::atomic<size_t> next{0};
+        auto worker = [&]() {
+            for (;;) {
+                size_t first = next.fetch_add(chunk);
+                if (first >= count) return;
+                size_t last = std::min(first + chunk, count);
+                for (size_t i = first; i < last; ++i) {
+                    body(i);
+                }
             }
+        };
+        threads = std::max(1u, std::min<unsigned>(threads, unsigned((count + chunk - 1) / chunk)));
+        std::vector<std::thread> pool;
+        pool.reserve(threads - 1);
+        for (unsigned i = 1; i < threads; ++i) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : pool) {
+            thread.join();
+        }
+    }
+
+    // Transformed vertices of one placement (winding of mirrored copies restored)
+    void placedTriangle(const TriangleMesh& mesh, const Placement& placement, size_t t, QVector3D v[3]) {
+        const uint32_t* tri = &mesh.triangles[t * 3];
+        for (int k = 0; k < 3; ++k) {
+            const float* p = &mesh.points[size_t(tri[k]) * 3];
+            v[k] = placement.matrix.map(QVector3D(p[0], p[1], p[2]));
+        }
+        if (placement.mirrored) {
+            std::swap(v[1], v[2]);
+        }
+    }
+
+    // Binary STL record of one triangle (50 bytes, little endian)
+    char* writeSTLTriangle(char* out, const QVector3D v[3]) {
+        QVector3D normal = QVector3D::crossProduct(v[1] - v[0], v[2] - v[0]).normalized();
+        float values[12] = {normal.x(), normal.y(), normal.z(),
+                            v[0].x(), v[0].y(), v[0].z(),
+                            v[1].x(), v[1].y(), v[1].z(),
+                            v[2].x(), v[2].y(), v[2].z()};
+        std::memcpy(out, values, sizeof(values));
+        out[48] = 0;
+        out[49] = 0;
+        return out + 50;
+    }
+
+    void appendFloat(std::string& out, float value) {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    void appendIndex(std::string& out, size_t value) {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    // OBJ text of one placement: an object with its vertices and faces.
+    // Vertex indices are global (1-based), firstVertex is the first one.
+    void writeOBJPlacement(std::string& out, const TriangleMesh& mesh, const Placement& placement, size_t firstVertex) {
+        out.reserve(out.size() + mesh.pointCount() * 36 + mesh.triangleCount() * 24 + 64);
+        out += "o ";
+        out += placement.node->getName();
+        if (placement.copy > 0) {
+            out += '_';
+            appendIndex(out, size_t(placement.copy));
+        }
+        out += '\n';
+        if (placement.node->getMaterial()) {
+            out += "usemtl ";
+            out += placement.node->getMaterial()->getName();
+            out += '\n';
+        }
+        for (size_t i = 0; i < mesh.pointCount(); ++i) {
+            const float* p = &mesh.points[i * 3];
+            QVector3D q = placement.matrix.map(QVector3D(p[0], p[1], p[2]));
+            out += "v ";
+            appendFloat(out, q.x());
+            out += ' ';
+            appendFloat(out, q.y());
+            out += ' ';
+            appendFloat(out, q.z());
+            out += '\n';
+        }
+        for (size_t t = 0; t < mesh.triangleCount(); ++t) {
+            const uint32_t* tri = &mesh.triangles[t * 3];
+            out += "f ";
+            appendIndex(out, firstVertex + tri[0]);
+            out += ' ';
+            appendIndex(out, firstVertex + (placement.mirrored ? tri[2] : tri[1]));
+            out += ' ';
+            appendIndex(out, firstVertex + (placement.mirrored ? tri[1] : tri[2]));
+            out += '\n';
         }
-        
-        auto vtkXform = vtkSmartPointer<vtkTransform>::New();
-        vtkXform->SetMatrix(vtkMatrix);
-        
-        auto filter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-        filter->SetInputData(input);
-        filter->SetTransform(vtkXform);
-        filter->Update();
-        
-        return filter->GetOutput();
     }
 }
 #endif
@@ -162,49 +220,7 @@ bool MeshExporter::exportToSTL(SceneGraph* sceneGraph, const std::string& filePa
     lastError_ = "VTK support required for STL export";
     return false;
 #else
-    if (!sceneGraph) {
-        lastError_ = "No scene graph provided";
-        return false;
-    }
-    
-    try {
-        auto appendFilter = vtkSmartPointer<vtkAppendPolyData>::New();
-        bool hasData = false;
-        
-        // Traverse scene graph and combine all meshes
-        sceneGraph->traverse([&](VolumeNode* node) {
-            if (!node || !node->getShape()) return;
-            if (node->getName() == "World") return;
-            if (!node->isVisible()) return;
-            
-            auto polyData = createPolyDataFromShape(node->getShape());
-            if (!polyData) return;
-            
-            // Apply world transform
-            auto transformed = transformPolyData(polyData, node->getWorldTransform());
-            if (transformed) {
-                appendFilter->AddInputData(transformed);
-                hasData = true;
-            }
-        });
-        
-        if (!hasData) {
-            lastError_ = "No exportable geometry found";
-            return false;
-        }
-        
-        appendFilter->Update();
-        
-        auto writer = vtkSmartPointer<vtkSTLWriter>::New();
-        writer->SetFileName(filePath.c_str());
-        writer->SetInputData(appendFilter->GetOutput());
-        writer->Write();
-        
-        return true;
-    } catch (const std::exception& e) {
-        lastError_ = std::string("Export failed: ") + e.what();
-        return false;
-    }
+    return exportMesh(sceneGraph, filePath, Format::STL);
 #endif
 }
 
@@ -213,44 +229,154 @@ bool MeshExporter::exportToOBJ(SceneGraph* sceneGraph, const std::string& filePa
     lastError_ = "VTK support required for OBJ export";
     return false;
 #else
+    return exportMesh(sceneGraph, filePath, Format::OBJ);
+#endif
+}
+
+bool MeshExporter::exportMesh(SceneGraph* sceneGraph, const std::string& filePath, Format format) {
+#ifdef GEANTCAD_NO_VTK
+    (void)sceneGraph;
+    (void)filePath;
+    (void)format;
+    lastError_ = "VTK support required for mesh export";
+    return false;
+#else
+    stats_ = MeshExportStats();
     if (!sceneGraph) {
         lastError_ = "No scene graph provided";
         return false;
     }
-    
+
     try {
-        auto appendFilter = vtkSmartPointer<vtkAppendPolyData>::New();
-        bool hasData = false;
-        
-        // Traverse scene graph and combine all meshes
-        sceneGraph->traverse([&](VolumeNode* node) {
+        unsigned threads = threads_ ? threads_ : std::thread::hardware_concurrency();
+        threads = std::max(1u, threads);
+
+        // Exported volumes; world matrices are computed up front so the
+        // workers only read them
+        std::vector<const VolumeNode*> nodes;
+        sceneGraph->updateWorldTransforms();
+        sceneGraph->forEach([&](VolumeNode* node) {
             if (!node || !node->getShape()) return;
             if (node->getName() == "World") return;
             if (!node->isVisible()) return;
-            
-            auto polyData = createPolyDataFromShape(node->getShape());
-            if (!polyData) return;
-            
-            // Apply world transform
-            auto transformed = transformPolyData(polyData, node->getWorldTransform());
-            if (transformed) {
-                appendFilter->AddInputData(transformed);
-                hasData = true;
-            }
+            nodes.push_back(node);
+        });
+
+        // Tessellations (MeshCache is thread-safe; shared shapes hit the cache)
+        std::vector<vtkSmartPointer<vtkPolyData>> polyData(nodes.size());
+        parallelFor(nodes.size(), threads, 16, [&](size_t i) {
+            polyData[i] = MeshCache::instance().get(*nodes[i]->getShape(), ExportResolution);
         });
-        
-        if (!hasData) {
+
+        // Distinct meshes and one placement per copy of each volume
+        std::unordered_map<vtkPolyData*, uint32_t> meshIndex;
+        std::vector<vtkPolyData*> distinct;
+        std::vector<Placement> placements;
+        placements.reserve(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (!polyData[i]) continue;
+            auto inserted = meshIndex.emplace(polyData[i].Get(), uint32_t(distinct.size()));
+            if (inserted.second) distinct.push_back(polyData[i].Get());
+            const QMatrix4x4& world = nodes[i]->getWorldMatrix();
+            int copy = 0;
+            for (const QMatrix4x4& offset : arrayCopyOffsets(nodes[i])) {
+                QMatrix4x4 matrix = world * offset;
+                placements.push_back({nodes[i], copy++, inserted.first->second, matrix, matrix.determinant() < 0.0});
+            }
+        }
+        if (placements.empty()) {
             lastError_ = "No exportable geometry found";
             return false;
         }
-        
-        appendFilter->Update();
-        
-        auto writer = vtkSmartPointer<vtkOBJWriter>::New();
-        writer->SetFileName(filePath.c_str());
-        writer->SetInputData(appendFilter->GetOutput());
-        writer->Write();
-        
+
+        std::vector<TriangleMesh> meshes(distinct.size());
+        parallelFor(distinct.size(), threads, 1, [&](size_t i) {
+            meshes[i] = extractTriangles(distinct[i]);
+        });
+
+        size_t totalTriangles = 0;
+        for (const Placement& placement : placements) {
+            totalTriangles += meshes[placement.mesh].triangleCount();
+        }
+        if (format == Format::STL && totalTriangles > UINT32_MAX) {
+            lastError_ = "Too many triangles for binary STL";
+            return false;
+        }
+
+        std::ofstream file(filePath, std::ios::binary);
+        if (!file.is_open()) {
+            lastError_ = "Cannot open file for writing: " + filePath;
+            return false;
+        }
+
+        if (format == Format::STL) {
+            char header[84] = {};
+            std::strncpy(header, "GeantCAD binary STL", 80);
+            const uint32_t count = uint32_t(totalTriangles);
+            std::memcpy(header + 80, &count, sizeof(count));
+            file.write(header, sizeof(header));
+        } else {
+            file << "# GeantCAD OBJ export\n";
+        }
+
+        // Batches of whole placements: each one is transformed and formatted
+        // in parallel into its slot, then the batch is written in order
+        std::vector<char> stlBuffer;
+        std::vector<std::string> objText;
+        size_t firstVertex = 1;
+        for (size_t begin = 0; begin < placements.size();) {
+            size_t end = begin;
+            size_t batchTriangles = 0;
+            while (end < placements.size() && (end == begin || batchTriangles < BatchTriangles)) {
+                batchTriangles += meshes[placements[end].mesh].triangleCount();
+                ++end;
+            }
+
+            if (format == Format::STL) {
+                std::vector<size_t> offsets(end - begin + 1, 0);
+                for (size_t i = begin; i < end; ++i) {
+                    offsets[i - begin + 1] = offsets[i - begin] + meshes[placements[i].mesh].triangleCount() * 50;
+                }
+                stlBuffer.resize(offsets.back());
+                parallelFor(end - begin, threads, 8, [&](size_t i) {
+                    const Placement& placement = placements[begin + i];
+                    const TriangleMesh& mesh = meshes[placement.mesh];
+                    char* out = stlBuffer.data() + offsets[i];
+                    QVector3D v[3];
+                    for (size_t t = 0; t < mesh.triangleCount(); ++t) {
+                        placedTriangle(mesh, placement, t, v);
+                        out = writeSTLTriangle(out, v);
+                    }
+                });
+                file.write(stlBuffer.data(), std::streamsize(stlBuffer.size()));
+            } else {
+                std::vector<size_t> vertexOffsets(end - begin);
+                for (size_t i = begin; i < end; ++i) {
+                    vertexOffsets[i - begin] = firstVertex;
+                    firstVertex += meshes[placements[i].mesh].pointCount();
+                }
+                objText.assign(end - begin, std::string());
+                parallelFor(end - begin, threads, 8, [&](size_t i) {
+                    const Placement& placement = placements[begin + i];
+                    writeOBJPlacement(objText[i], meshes[placement.mesh], placement, vertexOffsets[i]);
+                });
+                for (const std::string& text : objText) {
+                    file.write(text.data(), std::streamsize(text.size()));
+                }
+            }
+            begin = end;
+        }
+
+        file.close();
+        if (!file) {
+            lastError_ = "Error writing file: " + filePath;
+            return false;
+        }
+
+        stats_.volumes = placements.size();
+        stats_.meshes = meshes.size();
+        stats_.triangles = totalTriangles;
+        stats_.threads = threads;
         return true;
     } catch (const std::exception& e) {
         lastError_ = std::string("Export failed: ") + e.what();
@@ -260,4 +386,3 @@ bool MeshExporter::exportToOBJ(SceneGraph* sceneGraph, const std::string& filePa
 }
 
 } // namespace geantcad
-
@@ -1,9 +1,137 @@
 #include "TemplateEngine.hh"
-#include <regex>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
 #include <sstream>
+#include <string_view>
+#include <unordered_map>
 
 namespace geantcad {
 
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::string_view BeginMarker = "// ==== USER CODE BEGIN ";
+constexpr std::string_view EndMarker = "// ==== USER CODE END ";
+
+bool isTagChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Tag following a begin marker at 'pos' (word characters, may be empty)
+std::string_view tagAt(std::string_view text, size_t pos) {
+    const size_t start = pos + BeginMarker.size();
+    size_t end = start;
+    while (end < text.size() && isTagChar(text[end])) {
+        ++end;
+    }
+    return text.substr(start, end - start);
+}
+
+// User code of every region in 'content' by tag (first region of a tag wins),
+// found in one scan instead of one search per region
+std::unordered_map<std::string_view, std::string_view> collectUserCode(std::string_view content) {
+    std::unordered_map<std::string_view, std::string_view> regions;
+    std::string endMarker;
+    for (size_t pos = content.find(BeginMarker); pos != std::string_view::npos;
+         pos = content.find(BeginMarker, pos + BeginMarker.size())) {
+        const std::string_view tag = tagAt(content, pos);
+        if (tag.empty() || regions.count(tag)) continue;
+
+        std::string_view code;
+        const size_t beginLineEnd = content.find('\n', pos);
+        if (beginLineEnd != std::string_view::npos) {
+            endMarker.assign(EndMarker).append(tag);
+            const size_t endPos = content.find(endMarker, beginLineEnd + 1);
+            if (endPos != std::string_view::npos) {
+                code = content.substr(beginLineEnd + 1, endPos - beginLineEnd - 1);
+                if (!code.empty() && code.back() == '\n') {
+                    code.remove_suffix(1);
+                }
+            }
+        }
+        regions.emplace(tag, code);
+    }
+    return regions;
+}
+
+// Compiled template files by path
+struct CachedTemplate {
+    fs::file_time_type modified;
+    std::shared_ptr<const CompiledTemplate> compiled;
+};
+
+std::mutex templateCacheMutex;
+std::unordered_map<std::string, CachedTemplate> templateCache;
+
+} // namespace
+
+CompiledTemplate::CompiledTemplate(std::string templateStr)
+    : source_(std::move(templateStr))
+{
+    // Segments: literal runs and {{name}} placeholders (name without braces or
+    // line breaks); a "{{" that doesn't close stays literal
+    auto addLiteral = [this](size_t offset, size_t length) {
+        if (length == 0) return;
+        if (!segments_.empty() && segments_.back().name.empty()) {
+            segments_.back().length += length;
+        } else {
+            segments_.push_back({offset, length, std::string()});
+        }
+    };
+
+    size_t literalStart = 0;
+    size_t pos = source_.find("{{");
+    while (pos != std::string::npos) {
+        size_t nameEnd = pos + 2;
+        while (nameEnd < source_.size() && source_[nameEnd] != '{' && source_[nameEnd] != '}' && source_[nameEnd] != '\n') {
+            ++nameEnd;
+        }
+        const bool closed = nameEnd > pos + 2 && source_.compare(nameEnd, 2, "}}") == 0;
+        if (!closed) {
+            pos = source_.find("{{", pos + 1);
+            continue;
+        }
+        addLiteral(literalStart, pos - literalStart);
+        segments_.push_back({pos, nameEnd + 2 - pos, source_.substr(pos + 2, nameEnd - pos - 2)});
+        ++placeholderCount_;
+        literalStart = nameEnd + 2;
+        pos = source_.find("{{", literalStart);
+    }
+    addLiteral(literalStart, source_.size() - literalStart);
+}
+
+std::string CompiledTemplate::render(const std::map<std::string, std::string>& variables) const {
+    // Look the values up once, size the output, then copy
+    std::vector<const std::string*> values;
+    values.reserve(placeholderCount_);
+    size_t size = 0;
+    for (const Segment& segment : segments_) {
+        if (segment.name.empty()) {
+            size += segment.length;
+            continue;
+        }
+        auto it = variables.find(segment.name);
+        const std::string* value = it != variables.end() ? &it->second : nullptr;
+        values.push_back(value);
+        size += value ? value->size() : segment.length;
+    }
+
+    std::string result;
+    result.reserve(size);
+    size_t next = 0;
+    for (const Segment& segment : segments_) {
+        const std::string* value = segment.name.empty() ? nullptr : values[next++];
+        if (value) {
+            result.append(*value);
+        } else {
+            result.append(source_, segment.offset, segment.length);
+        }
+    }
+    return result;
+}
+
 TemplateEngine::TemplateEngine() {
 }
 
@@ -11,51 +139,53 @@ TemplateEngine::~TemplateEngine() {
 }
 
 std::string TemplateEngine::render(const std::string& templateStr, const std::map<std::string, std::string>& variables) {
-    std::string result = templateStr;
-    
     // Simple template replacement: {{variable}}
-    for (const auto& pair : variables) {
-        std::string pattern = "\\{\\{" + pair.first + "\\}\\}";
-        std::regex re(pattern);
-        result = std::regex_replace(result, re, pair.second);
-    }
-    
-    return result;
+    return CompiledTemplate(templateStr).render(variables);
 }
 
-std::string TemplateEngine::extractUserCode(const std::string& content, const std::string& tag) {
-    std::string beginMarker = "// ==== USER CODE BEGIN " + tag;
-    std::string endMarker = "// ==== USER CODE END " + tag;
-    
-    size_t beginPos = content.find(beginMarker);
-    if (beginPos == std::string::npos) {
-        return "";
+std::shared_ptr<const CompiledTemplate> TemplateEngine::loadTemplate(const std::string& templatePath) {
+    // One stat per call: the cached entry is valid while the file is unchanged
+    std::error_code ec;
+    const auto modified = fs::last_write_time(templatePath, ec);
+    if (ec) {
+        return nullptr;
     }
-    
-    // Find the end of the begin marker line
-    size_t beginLineEnd = content.find('\n', beginPos);
-    if (beginLineEnd == std::string::npos) {
-        return "";
+
+    {
+        std::lock_guard<std::mutex> lock(templateCacheMutex);
+        auto it = templateCache.find(templatePath);
+        if (it != templateCache.end() && it->second.modified == modified) {
+            return it->second.compiled;
+        }
     }
-    
-    // Start after the begin marker line
-    size_t codeStart = beginLineEnd + 1;
-    
-    // Find the end marker
-    size_t endPos = content.find(endMarker, codeStart);
-    if (endPos == std::string::npos) {
-        return "";
+
+    std::ifstream file(templatePath);
+    if (!file.is_open()) {
+        return nullptr;
     }
-    
-    // Extract the code between markers
-    std::string userCode = content.substr(codeStart, endPos - codeStart);
-    
-    // Remove trailing newline if present
-    if (!userCode.empty() && userCode.back() == '\n') {
-        userCode.pop_back();
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string content = buffer.str();
+    if (content.empty()) {
+        return nullptr;
     }
-    
-    return userCode;
+    auto compiled = std::make_shared<const CompiledTemplate>(std::move(content));
+
+    std::lock_guard<std::mutex> lock(templateCacheMutex);
+    templateCache[templatePath] = CachedTemplate{modified, compiled};
+    return compiled;
+}
+
+void TemplateEngine::clearTemplateCache() {
+    std::lock_guard<std::mutex> lock(templateCacheMutex);
+    templateCache.clear();
+}
+
+std::string TemplateEngine::extractUserCode(const std::string& content, const std::string& tag) {
+    // Exact tag: "Build" must not pick up the region of "BuildForMaster"
+    const auto regions = collectUserCode(content);
+    auto it = regions.find(tag);
+    return it != regions.end() ? std::string(it->second) : std::string();
 }
 
 std::string TemplateEngine::renderWithPreservation(
@@ -64,66 +194,61 @@ std::string TemplateEngine::renderWithPreservation(
     const std::string& existingContent)
 {
     // First render the template
-    std::string rendered = render(templateStr, variables);
-    
-    // Extract and preserve user code regions
-    std::regex regionRegex(R"(// ==== USER CODE BEGIN (\w+))");
-    std::sregex_iterator iter(rendered.begin(), rendered.end(), regionRegex);
-    std::sregex_iterator end;
-    
-    // Collect all regions first
+    const std::string rendered = render(templateStr, variables);
+
+    // User code of the existing file, then the regions of the rendered one
+    // whose generated code it replaces
+    const auto userCode = collectUserCode(existingContent);
+    if (userCode.empty()) {
+        return rendered;
+    }
+
     struct Region {
-        std::string tag;
-        size_t beginPos;
         size_t codeStart;
         size_t endPos;
-        std::string userCode;
+        std::string_view userCode;
     };
-    
+
     std::vector<Region> regions;
-    for (auto it = iter; it != end; ++it) {
-        std::smatch match = *it;
-        std::string tag = match[1].str();
-        size_t pos = match.position();
-        
+    size_t size = rendered.size();
+    size_t cursor = 0;
+    std::string endMarker;
+    const std::string_view text = rendered;
+    for (size_t pos = text.find(BeginMarker); pos != std::string_view::npos;
+         pos = text.find(BeginMarker, pos + BeginMarker.size())) {
+        const std::string_view tag = tagAt(text, pos);
+        if (tag.empty()) continue;
+
         // Find the corresponding end marker in rendered template
-        std::string endMarker = "// ==== USER CODE END " + tag;
-        size_t endPos = rendered.find(endMarker, pos);
-        
-        if (endPos != std::string::npos) {
-            // Find end of begin marker line
-            size_t beginLineEnd = rendered.find('\n', pos);
-            if (beginLineEnd != std::string::npos) {
-                size_t codeStart = beginLineEnd + 1;
-                
-                // Extract user code from existing file
-                std::string userCode = extractUserCode(existingContent, tag);
-                
-                Region region;
-                region.tag = tag;
-                region.beginPos = pos;
-                region.codeStart = codeStart;
-                region.endPos = endPos;
-                region.userCode = userCode;
-                regions.push_back(region);
-            }
-        }
+        endMarker.assign(EndMarker).append(tag);
+        const size_t endPos = text.find(endMarker, pos);
+        const size_t beginLineEnd = text.find('\n', pos);
+        if (endPos == std::string_view::npos || beginLineEnd == std::string_view::npos) continue;
+
+        const size_t codeStart = beginLineEnd + 1;
+        auto it = userCode.find(tag);
+        // Regions nested in one already replaced are gone with its code
+        if (it == userCode.end() || it->second.empty() || codeStart < cursor || endPos < codeStart) continue;
+
+        regions.push_back({codeStart, endPos, it->second});
+        size += it->second.size() + 1;
+        size -= endPos - codeStart;
+        cursor = endPos;
     }
-    
-    // Process regions in reverse order to preserve positions
-    std::string result = rendered;
-    for (auto it = regions.rbegin(); it != regions.rend(); ++it) {
-        const Region& region = *it;
-        if (!region.userCode.empty()) {
-            // Replace the generated code with preserved user code
-            std::string before = result.substr(0, region.codeStart);
-            std::string after = result.substr(region.endPos);
-            result = before + region.userCode + "\n" + after;
-        }
+
+    // Replace the generated code with preserved user code, in one pass
+    std::string result;
+    result.reserve(size);
+    cursor = 0;
+    for (const Region& region : regions) {
+        result.append(text.substr(cursor, region.codeStart - cursor));
+        result.append(region.userCode);
+        result.push_back('\n');
+        cursor = region.endPos;
     }
-    
+    result.append(text.substr(cursor));
+
     return result;
 }
 
 } // namespace geantcad
-
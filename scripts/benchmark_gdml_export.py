@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+#
+# GDML export throughput: time to write a large scene and MB/s of output.
+# Every volume gets its own position; the shapes are varied so most solids
+# are distinct.
+# Usage: PYTHONPATH=build python3 scripts/benchmark_gdml_export.py [volumes] [repeats]
+#
+
+import os
+import sys
+import tempfile
+import time
+
+import geantcad_python as gcad
+
+
+def build_scene(volumes):
+    scene = gcad.SceneGraph()
+    air = gcad.Material.makeAir()
+    lead = gcad.Material.makeLead()
+    groups = []
+    for g in range(100):
+        group = scene.createVolume("group_%d" % g)
+        group.setShape(gcad.makeBox(1000.0, 1000.0, 1000.0))
+        group.setMaterial(air)
+        groups.append(group)
+    shapes = [lambda s: gcad.makeBox(10.0 + s, 10.0, 10.0),
+              lambda s: gcad.makeTube(0.0, 5.0 + s, 20.0),
+              lambda s: gcad.makeSphere(0.0, 8.0 + s),
+              lambda s: gcad.makeCone(0.0, 4.0, 0.0, 8.0 + s, 10.0)]
+    for i in range(volumes):
+        node = scene.createVolume("crystal_%d" % i)
+        node.setShape(shapes[i % len(shapes)](0.001 * i))
+        node.setMaterial(lead)
+        node.setParent(groups[i % len(groups)])
+        t = gcad.Transform()
+        t.setTranslation(0.37 * (i % 997), 1.3 * (i % 89), -2.9 * (i % 13))
+        node.setTransform(t)
+    return scene
+
+
+def main():
+    volumes = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    repeats = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+
+    print("Building scene with %d volumes..." % volumes)
+    scene = build_scene(volumes)
+    exporter = gcad.GDMLExporter()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, "scene.gdml")
+        best = float("inf")
+        for _ in range(repeats):
+            start = time.perf_counter()
+            if not exporter.exportToFile(scene, path):
+                sys.exit("failed to export " + path)
+            best = min(best, time.perf_counter() - start)
+        size = os.path.getsize(path) / 1e6
+
+    stats = exporter.getLastStats()
+    print("%10s %12s %10s %12s %10s" % ("solids", "placements", "size [MB]", "export [ms]", "MB/s"))
+    print("%10d %12d %10.1f %12.1f %10.1f" % (stats["solids"], stats["placements"], size, best * 1e3, size / best))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+#
+# Volume lookups as the scene grows: findVolumeById / findVolumeByName should
+# cost the same at every size. A name shared by a few volumes ("pmt") is also
+# looked up right after an edit of the hierarchy. Also times removing many
+# volumes that share one name ("vol_copy", as left by repeated duplication).
+# Usage: PYTHONPATH=build python3 scripts/benchmark_lookup.py [lookups]
+#
+
+import random
+import sys
+import time
+
+import geantcad_python as gcad
+
+SIZES = (1000, 10000, 50000, 200000)
+
+
+def build_scene(volumes, copies):
+    scene = gcad.SceneGraph()
+    groups = []
+    for g in range(100):
+        group = scene.createVolume("group_%d" % g)
+        groups.append(group)
+    ids, names = [], []
+    for i in range(volumes):
+        node = scene.createVolume("crystal_%d" % i)
+        node.setParent(groups[i % len(groups)])
+        ids.append(node.getId())
+        names.append(node.getName())
+    for g in range(0, len(groups), 10):
+        scene.createVolume("pmt").setParent(groups[g])
+    # Spread over the groups, like duplicates of volumes placed in them
+    shared = []
+    for i in range(copies):
+        node = scene.createVolume("vol_copy")
+        node.setParent(groups[i % len(groups)])
+        shared.append(node)
+    return scene, ids, names, shared
+
+
+def per_lookup(lookup, keys):
+    start = time.perf_counter()
+    for key in keys:
+        if lookup(key) is None:
+            sys.exit("lookup failed for %r" % (key,))
+    return (time.perf_counter() - start) / len(keys)
+
+
+def after_edits(scene, edits, lookup):
+    # Each edit moves a volume to another group, then looks the name up
+    groups = [scene.findVolumeByName("group_%d" % g) for g in range(100)]
+    mover = scene.createVolume("mover")
+    start = time.perf_counter()
+    for i in range(edits):
+        mover.setParent(groups[i % len(groups)])
+        if lookup and scene.findVolumeByName("pmt") is None:
+            sys.exit("lookup failed for 'pmt'")
+    elapsed = time.perf_counter() - start
+    scene.removeVolume(mover)
+    return elapsed / edits
+
+
+def main():
+    lookups = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    rng = random.Random(1)
+
+    print("%-10s %14s %16s %24s %18s" % ("volumes", "by id [us]", "by name [us]", "shared after edit [us]",
+                                         "remove copies [ms]"))
+    for volumes in SIZES:
+        copies = volumes // 10
+        scene, ids, names, shared = build_scene(volumes, copies)
+        by_id = per_lookup(scene.findVolumeById, [rng.choice(ids) for _ in range(lookups)])
+        by_name = per_lookup(scene.findVolumeByName, [rng.choice(names) for _ in range(lookups)])
+        edits = max(1, lookups // 100)
+        shared_name = after_edits(scene, edits, True) - after_edits(scene, edits, False)
+
+        start = time.perf_counter()
+        for node in shared:
+            scene.removeVolume(node)
+        remove = time.perf_counter() - start
+        if scene.findVolumeByName("vol_copy") is not None:
+            sys.exit("vol_copy still indexed after removal")
+
+        print("%-10d %14.3f %16.3f %24.3f %18.1f" % (volumes, by_id * 1e6, by_name * 1e6, shared_name * 1e6,
+                                                     remove * 1e3))
+
+
+if __name__ == "__main__":
+    main()
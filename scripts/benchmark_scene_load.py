@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+#
+# Compare scene loading: JSON project (streaming loader) vs binary .gcadb
+# Reports load time, throughput and peak memory of each load.
+# Usage: PYTHONPATH=build python3 scripts/benchmark_scene_load.py [volumes] [repeats]
+#
+
+import os
+import resource
+import subprocess
+import sys
+import tempfile
+import time
+
+import geantcad_python as gcad
+
+
+def build_scene(volumes):
+    scene = gcad.SceneGraph()
+    air = gcad.Material.makeAir()
+    lead = gcad.Material.makeLead()
+    groups = []
+    for g in range(100):
+        group = scene.createVolume("group_%d" % g)
+        group.setShape(gcad.makeBox(1000.0, 1000.0, 1000.0))
+        group.setMaterial(air)
+        groups.append(group)
+    shapes = [lambda: gcad.makeBox(10.0, 10.0, 10.0),
+              lambda: gcad.makeTube(0.0, 5.0, 20.0),
+              lambda: gcad.makeSphere(0.0, 8.0),
+              lambda: gcad.makeCone(0.0, 4.0, 0.0, 8.0, 10.0)]
+    for i in range(volumes):
+        node = scene.createVolume("crystal_%d" % i)
+        node.setShape(shapes[i % len(shapes)]())
+        node.setMaterial(lead)
+        node.setParent(groups[i % len(groups)])
+    return scene
+
+
+def load_once(path):
+    # Runs in a child process, so ru_maxrss is the peak of this load alone
+    baseline = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    scene = gcad.SceneGraph()
+    start = time.perf_counter()
+    if not gcad.loadSceneFromFile(scene, path):
+        sys.exit("failed to load " + path)
+    elapsed = time.perf_counter() - start
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss - baseline
+    print("%f %d" % (elapsed, peak))
+
+
+def measure(path, repeats):
+    best, peak = float("inf"), 0
+    for _ in range(repeats):
+        out = subprocess.check_output([sys.executable, __file__, "--load", path])
+        seconds, kilobytes = out.split()
+        best = min(best, float(seconds))
+        peak = max(peak, int(kilobytes))
+    return best, peak
+
+
+def size_of(path):
+    if os.path.isdir(path):
+        return sum(os.path.getsize(os.path.join(path, f)) for f in os.listdir(path))
+    return os.path.getsize(path)
+
+
+def main():
+    volumes = int(sys.argv[1]) if len(sys.argv) > 1 else 200000
+    repeats = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+
+    print("Building scene with %d volumes..." % volumes)
+    scene = build_scene(volumes)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        json_path = os.path.join(tmp, "scene.geantcad")
+        binary_path = os.path.join(tmp, "scene.gcadb")
+        if not gcad.saveSceneToFile(scene, json_path) or not gcad.saveSceneToBinary(scene, binary_path):
+            sys.exit("failed to save the scene")
+
+        print("%-8s %10s %10s %10s %14s" % ("format", "size [MB]", "load [ms]", "MB/s", "peak mem [MB]"))
+        for name, path in (("json", json_path), ("binary", binary_path)):
+            seconds, peak = measure(path, repeats)
+            size = size_of(path) / 1e6
+            print("%-8s %10.1f %10.1f %10.1f %14.1f" % (name, size, seconds * 1e3, size / seconds, peak / 1024.0))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) == 3 and sys.argv[1] == "--load":
+        load_once(sys.argv[2])
+    else:
+        main()
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+#
+# Render every template in templates/geant4_project with generator-sized
+# variables: compiling on each call, from the compiled-template cache, and
+# with user code preservation against an edited copy of the output.
+# Usage: PYTHONPATH=build python3 scripts/benchmark_templates.py [repeats]
+#
+
+import os
+import sys
+import time
+
+import geantcad_python as gcad
+
+TEMPLATE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "templates", "geant4_project")
+
+
+def make_variables():
+    # Same keys as Geant4ProjectGenerator, generated sections of a large scene
+    physics = "".join("    RegisterPhysics(new G4EmStandardPhysics_option%d());\n" % (i % 4) for i in range(50))
+    detectors = "".join("    sdManager->AddNewDetector(new CalorimeterSD(\"crystal_%d\", \"crystal_%dHitsCollection\"));\n"
+                        % (i, i) for i in range(500))
+    return {
+        "project_name": "BenchmarkDetector",
+        "generation_date": "2026-01-01 00:00:00",
+        "physics_constructors": physics,
+        "particle_gun_commands": "/gun/particle e-\n/gun/energy 10 MeV\n",
+        "sensitive_detector_setup": detectors,
+        "output_config": "",
+        "event_action_output": "    // output\n" * 20,
+        "run_action_output": "    // output\n" * 20,
+        "primary_generator_config": "    pga->SetParticleType(\"e-\");\n" * 10,
+    }
+
+
+def with_user_code(rendered):
+    # Existing file: a line of user code added to every region
+    marker = "// ==== USER CODE END "
+    return rendered.replace(marker, "    userCode(); // kept across regeneration\n" + marker)
+
+
+def best_of(repeats, fn):
+    best = float("inf")
+    for _ in range(repeats):
+        start = time.perf_counter()
+        fn()
+        best = min(best, time.perf_counter() - start)
+    return best
+
+
+def main():
+    repeats = int(sys.argv[1]) if len(sys.argv) > 1 else 20
+    variables = make_variables()
+    engine = gcad.TemplateEngine()
+
+    paths = sorted(os.path.join(TEMPLATE_DIR, f) for f in os.listdir(TEMPLATE_DIR) if f.endswith(".template"))
+    sources = []
+    for path in paths:
+        with open(path) as f:
+            sources.append(f.read())
+    rendered = [engine.render(text, variables) for text in sources]
+    existing = [with_user_code(text) for text in rendered]
+    output_bytes = sum(len(text) for text in rendered)
+
+    gcad.TemplateEngine.clearTemplateCache()
+    start = time.perf_counter()
+    for path in paths:
+        gcad.TemplateEngine.loadTemplate(path)
+    cold = time.perf_counter() - start
+
+    modes = (
+        ("compile+render", lambda: [engine.render(text, variables) for text in sources]),
+        ("cached", lambda: [gcad.TemplateEngine.loadTemplate(path).render(variables) for path in paths]),
+        ("preservation", lambda: [engine.renderWithPreservation(text, variables, old)
+                                  for text, old in zip(rendered, existing)]),
+    )
+
+    print("%d templates, %.1f KB rendered, first load (read + compile) %.2f ms"
+          % (len(paths), output_bytes / 1e3, cold * 1e3))
+    print("%-16s %12s %10s" % ("mode", "all [ms]", "MB/s"))
+    for name, fn in modes:
+        seconds = best_of(repeats, fn)
+        print("%-16s %12.3f %10.1f" % (name, seconds * 1e3, output_bytes / 1e6 / seconds))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+#
+# Golden-file test for the GDML exporter: exports a fixed scene and compares
+# the output byte-for-byte with scripts/golden/export_reference.gdml.
+# The scene covers every primitive, shared solids, nesting, arrays (expanded
+# next to siblings, paramvol and replicavol when alone in their mother), a
+# sensitive detector, an optical surface and non-round numbers. No rotations:
+# they go through Euler conversion and would make the reference depend on
+# float rounding.
+# Usage: PYTHONPATH=build python3 scripts/check_gdml_golden.py [--update]
+#
+
+import difflib
+import os
+import sys
+import tempfile
+
+import geantcad_python as gcad
+
+REFERENCE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "golden", "export_reference.gdml")
+
+
+def place(node, x, y, z):
+    t = gcad.Transform()
+    t.setTranslation(x, y, z)
+    node.setTransform(t)
+
+
+def build_scene():
+    scene = gcad.SceneGraph()
+    air = gcad.Material.makeAir()
+    lead = gcad.Material.makeLead()
+    silicon = gcad.Material.makeSilicon()
+    water = gcad.Material.makeWater()
+
+    detector = scene.createVolume("detector")
+    detector.setShape(gcad.makeBox(400.0, 400.0, 400.0))
+    detector.setMaterial(air)
+
+    crystal = scene.createVolume("crystal")
+    crystal.setShape(gcad.makeBox(10.0, 10.0, 22.5))
+    crystal.setMaterial(lead)
+    crystal.setParent(detector)
+    place(crystal, -37.5, 12.25, 0.0)
+    grid = gcad.ArrayPattern()
+    grid.type = gcad.ArrayPattern.Type.Grid
+    grid.count = [3, 2, 1]
+    grid.step = [25.0, 25.0, 0.0]
+    crystal.setArrayPattern(grid)
+    sd = crystal.getSDConfig()
+    sd.enabled = True
+    sd.type = "calorimeter"
+    sd.collectionName = "CrystalHits"
+    sd.copyNumber = 100
+
+    # An array alone in its mother: <paramvol>
+    bundle = scene.createVolume("bundle")
+    bundle.setShape(gcad.makeBox(20.0, 5.0, 110.0))
+    bundle.setMaterial(air)
+    bundle.setParent(detector)
+    place(bundle, 0.0, 150.0, 0.0)
+
+    fiber = scene.createVolume("fiber")
+    fiber.setShape(gcad.makeTube(0.0, 1.5, 100.0))
+    fiber.setMaterial(silicon)
+    fiber.setParent(bundle)
+    place(fiber, -4.95, 0.0, -0.1)
+    row = gcad.ArrayPattern()
+    row.type = gcad.ArrayPattern.Type.Linear
+    row.count = [4, 1, 1]
+    row.step = [3.3, 0.0, 0.0]
+    fiber.setArrayPattern(row)
+
+    # Same geometry and material: one solid and one logical volume
+    for i, x in enumerate((-150.0, 150.0)):
+        pmt = scene.createVolume("pmt_%d" % i)
+        pmt.setShape(gcad.makeTube(5.0, 12.7, 30.0, 0.0, 270.0))
+        pmt.setMaterial(lead)
+        pmt.setParent(detector)
+        place(pmt, x, -150.0, 0.0)
+
+    # Box slices filling a box mother: <replicavol>
+    calo = scene.createVolume("calo")
+    calo.setShape(gcad.makeBox(30.0, 10.0, 10.0))
+    calo.setMaterial(air)
+    place(calo, 0.0, 0.0, -700.0)
+    slab = scene.createVolume("slab")
+    slab.setShape(gcad.makeBox(5.0, 10.0, 10.0))
+    slab.setMaterial(lead)
+    slab.setParent(calo)
+    place(slab, -25.0, 0.0, 0.0)
+    slices = gcad.ArrayPattern()
+    slices.type = gcad.ArrayPattern.Type.Linear
+    slices.count = [6, 1, 1]
+    slices.step = [10.0, 0.0, 0.0]
+    slab.setArrayPattern(slices)
+
+    ball = scene.createVolume("ball")
+    ball.setShape(gcad.makeSphere(0.0, 30.0, 0.0, 360.0, 0.0, 90.0))
+    ball.setMaterial(water)
+    place(ball, 0.0, 0.0, 700.0)
+    optical = ball.getOpticalConfig()
+    optical.enabled = True
+    optical.finish = "ground"
+    optical.reflectivity = 0.875
+    optical.sigmaAlpha = 1.3
+
+    cone = scene.createVolume("cone")
+    cone.setShape(gcad.makeCone(0.0, 20.0, 2.5, 40.0, 50.0))
+    cone.setMaterial(gcad.Material.makeNist("G4_Cu"))
+    place(cone, -700.0, 0.0, 0.0)
+
+    wedge = scene.createVolume("wedge")
+    wedge.setShape(gcad.makeTrd(10.0, 20.0, 12.5, 17.75, 30.0))
+    wedge.setMaterial(gcad.Material.makeVacuum())
+    place(wedge, 700.0, -0.001, 1e-5)
+    return scene
+
+
+def main():
+    update = "--update" in sys.argv[1:]
+    exporter = gcad.GDMLExporter()
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, "golden.gdml")
+        if not exporter.exportToFile(build_scene(), path):
+            sys.exit("export failed")
+        with open(path, "rb") as f:
+            output = f.read()
+
+    if update:
+        os.makedirs(os.path.dirname(REFERENCE), exist_ok=True)
+        with open(REFERENCE, "wb") as f:
+            f.write(output)
+        print("updated " + REFERENCE)
+        return
+
+    with open(REFERENCE, "rb") as f:
+        reference = f.read()
+    if output == reference:
+        print("GDML export matches %s (%d bytes)" % (os.path.basename(REFERENCE), len(output)))
+        return
+    diff = difflib.unified_diff(reference.decode("utf-8", "replace").splitlines(),
+                                output.decode("utf-8", "replace").splitlines(),
+                                "reference", "export", lineterm="", n=1)
+    for line in list(diff)[:60]:
+        print(line)
+    sys.exit("GDML export differs from the reference")
+
+
+if __name__ == "__main__":
+    main()